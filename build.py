@@ -1,5 +1,7 @@
 from __future__ import annotations
 
+import sys
+
 from os.path import dirname, realpath, sep
 
 from hbuild import *
@@ -8,10 +10,44 @@ project_folder = dirname(realpath(__file__))
 assets_folder  = sep.join([project_folder, "assets"])
 
 
-softrast = add_executable("softrast", sources=[
+if sys.platform == "win32":
+    platform_sources = ["softrast_platform_win32.cpp"]
+else:
+    platform_sources = ["softrast_platform_linux.cpp"]
+
+
+softrast_headless = add_executable("softrast_headless", sources=[
     "softrast.cpp",
+    *platform_sources,
+    "softrast_headless.cpp",
 ])
 
-add_package("sofrast", targets=[
-    softrast,
+softrast_bench = add_executable("softrast_bench", sources=[
+    "softrast.cpp",
+    *platform_sources,
+    "softrast_bench.cpp",
+])
+
+softrast_batch = add_executable("softrast_batch", sources=[
+    "softrast.cpp",
+    *platform_sources,
+    "softrast_batch.cpp",
 ])
+
+softrast_test = add_executable("softrast_test", sources=[
+    "softrast.cpp",
+    *platform_sources,
+    "softrast_test.cpp",
+])
+
+targets = [softrast_headless, softrast_bench, softrast_batch, softrast_test]
+
+if sys.platform == "win32":
+    softrast = add_executable("softrast", sources=[
+        "softrast.cpp",
+        *platform_sources,
+        "softrast_win32.cpp",
+    ])
+    targets.append(softrast)
+
+add_package("sofrast", targets=targets)
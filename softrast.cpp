@@ -1,723 +1,607 @@
+#include "softrast.h"
 
-#include <cassert>
-#include <cmath>
-
-#include <algorithm>
-#include <array>
-#include <vector>
-#include <string>
-#include <string_view>
-#include <fstream>
-#include <sstream>
-#include <functional>
-#include <random>
-
-#if !defined(NOMINMAX)
-#define NOMINMAX
-#endif
+#include <cstring>
+#include <cstdio>
 
-#include <windows.h>
+#include <charconv>
+#include <filesystem>
 
-typedef signed char    S8;
-typedef signed short   S16;
-typedef signed int     S32;
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define SOFTRAST_X86 1
 
-typedef unsigned char  U8;
-typedef unsigned short U16;
-typedef unsigned int   U32;
+    #include <immintrin.h>
 
-#if defined(_WIN32)
-    typedef signed   long long S64;
-    typedef unsigned long long U64;
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
 #else
-    typedef signed   long S64;
-    typedef unsigned long U64;
+    #define SOFTRAST_X86 0
 #endif
 
-
-typedef char     C8;
-
-#if !defined(__cplusplus)
-    typedef S16  C16;
-
+// NOTE: GCC and Clang wants to know which ISA function is compiled for,
+// otherwise they refuse to inline intrinsics. MSVC just lets us use them.
+#if defined(_MSC_VER) && !defined(__clang__)
+    #define TARGET_SSE2
+    #define TARGET_SSE41
+    #define TARGET_AVX2
 #else
-    typedef wchar_t C16;
+    #define TARGET_SSE2  __attribute__((target("sse2")))
+    #define TARGET_SSE41 __attribute__((target("sse4.1")))
+    #define TARGET_AVX2  __attribute__((target("avx2")))
 #endif
 
-typedef S32    C32;
-
-typedef float  F32;
-typedef double F64;
-
-typedef U8  Byte;
-typedef U64 USZ;
-typedef S64 SSZ;
-
-#define MAX_U8  255
-#define MAX_U16 65535
-#define MAX_U32 4294967295
-#define MAX_U64 18446744073709551615
-
-
-#define global_var static
-#define persist_var static
-
-
-#define KEY_A 0x41
-#define KEY_D 0x44
-#define KEY_S 0x53
-#define KEY_W 0x57
-
-
-S64 perf_get_counter_frequency(void);
-S64 perf_get_counter(void);
+void
+Arena::init(USZ reserve_size)
+{
+    assert(this->base == nullptr);
 
-struct Clock {
-    S64 ticks_begin;
-    S64 ticks_end;
-    S64 frequency;
+    this->reserved = (reserve_size + ARENA_COMMIT_SIZE - 1) / ARENA_COMMIT_SIZE * ARENA_COMMIT_SIZE;
+    this->base = static_cast<U8 *>(platform_reserve(this->reserved));
+    assert(this->base && "Failed to reserve memory!");
 
-    Clock(void) : ticks_begin(perf_get_counter()), ticks_end(0), frequency(perf_get_counter_frequency()) {}
+    this->committed = 0;
+    this->used = 0;
+}
 
-    inline F64
-    tick(void) noexcept
-    {
-        this->ticks_end = perf_get_counter();
-        F64 elapsed = static_cast<double>(this->ticks_end - this->ticks_begin) / static_cast<double>(this->frequency);
-        this->ticks_begin = perf_get_counter();
-        return elapsed;
+void
+Arena::deinit(void)
+{
+    if (this->base != nullptr) {
+        platform_release(this->base, this->reserved);
     }
-};
 
-
-/*
- * Extracts width and height of Win32's `RECT` type.
- */
-constexpr void
-GetRectSize(_In_ const RECT *r,
-            _Out_ S32        *w,
-            _Out_ S32        *h) noexcept
-{
-    *w = r->right  - r->left;
-    *h = r->bottom - r->top;
+    this->base = nullptr;
+    this->reserved = 0;
+    this->committed = 0;
+    this->used = 0;
 }
 
-struct V2 {
-
-    F32 x = 0;
-    F32 y = 0;
-
-    constexpr V2(F32 x_ = 0, F32 y_ = 0) noexcept : x(x_), y(y_) {}
-
-    F32 dot(V2 other) const;
-    F32 magnitude(void) const;
-
-    V2 normal(void) const;
-
-    V2 perpendicular_ccw(void) const;
-    V2 perpendicular_cw(void) const;
-
-    constexpr V2
-    operator+ (V2 other) const noexcept
-    {
-        return { this->x + other.x, this->y + other.y };
-    }
-
-    constexpr V2
-    operator- (V2 other) const noexcept
-    {
-        return { this->x - other.x, this->y - other.y };
-    }
+void *
+Arena::push(USZ size, USZ alignment)
+{
+    assert(this->base != nullptr && std::has_single_bit(alignment));
 
-    constexpr V2
-    operator* (F32 value) const noexcept
-    {
-        return { this->x * value, this->y * value };
-    }
+    USZ begin = (this->used + alignment - 1) & ~(alignment - 1);
 
-    constexpr V2
-    operator/ (F32 value) const noexcept
-    {
-        return { this->x / value, this->y / value };
+    if (begin > this->reserved || size > this->reserved - begin) {
+        return nullptr;
     }
-};
 
-struct V3 {
+    USZ end = begin + size;
 
-    F32 x = 0;
-    F32 y = 0;
-    F32 z = 0;
+    if (end > this->committed) {
+        USZ committed = std::min((end + ARENA_COMMIT_SIZE - 1) / ARENA_COMMIT_SIZE * ARENA_COMMIT_SIZE, this->reserved);
 
-    constexpr V3
-    operator+ (V3 other) const noexcept
-    {
-        return { this->x + other.x, this->y + other.y, this->z + other.z };
-    }
+        if (!platform_commit(this->base + this->committed, committed - this->committed)) {
+            return nullptr;
+        }
 
-    constexpr V3
-    operator+ (V2 other) const noexcept
-    {
-        return { this->x + other.x, this->y + other.y, this->z };
+        this->committed = committed;
     }
 
-    constexpr V3
-    operator- (V3 other) const noexcept
-    {
-        return { this->x - other.x, this->y - other.y, this->z - other.z };
-    }
+    this->used = end;
 
-    constexpr V3
-    operator- (V2 other) const noexcept
-    {
-        return { this->x - other.x, this->y - other.y, this->z };
-    }
+    return this->base + begin;
+}
 
-    constexpr V3
-    operator* (F32 value) const noexcept
-    {
-        return { this->x * value, this->y * value, this->z * value };
-    }
+void
+Arena::trim(void)
+{
+    USZ keep = (this->used + ARENA_COMMIT_SIZE - 1) / ARENA_COMMIT_SIZE * ARENA_COMMIT_SIZE;
 
-    template<typename Ty> constexpr Ty
-    to() const noexcept
-    {
-        static_assert("Convertion not implemented!");
+    if (keep * 2 < this->committed) {
+        platform_decommit(this->base + keep, this->committed - keep);
+        this->committed = keep;
     }
+}
 
-    template<> constexpr V2
-    to() const noexcept
-    {
-        return { this->x, this->y };
+//
+// Fills `count` values starting at `p` with non-temporal stores, which are
+// going around the cache and don't read the lines they are writing first.
+//
+#if SOFTRAST_X86
+TARGET_SSE2 static void
+fill_u32_streaming(U32 *p, U32 value, USZ count)
+{
+    // NOTE: Streaming stores need 16 byte alignment, head and tail are
+    // written as usual.
+    while (count > 0 && (reinterpret_cast<std::uintptr_t>(p) & 15) != 0) {
+        *p++ = value;
+        --count;
     }
-};
-
-// Matrix 3x3
-struct M3x3 {
-    V3 r0{}, r1{}, r2{};
-};
 
+    __m128i v = _mm_set1_epi32(static_cast<S32>(value));
 
-/*
-    constexpr V3
-    transform(V3 ihat, V3 jhat, V3 khat, V3 p) const
-    {
-        // ihat - x axis, jhat - y axis, khat - z axis.
-        return ihat * p.x + jhat * p.y + khat * p.z;
+    for (; count >= 4; count -= 4, p += 4) {
+        _mm_stream_si128(reinterpret_cast<__m128i *>(p), v);
     }
-*/
-
 
-V3
-operator* (M3x3 m, V3 v)
+    std::fill_n(p, count, value);
+}
+#else
+static void
+fill_u32_streaming(U32 *p, U32 value, USZ count)
 {
-    V3 ret = m.r0 * v.x + m.r1 * v.y + m.r2 * v.z;
-    return ret;
+    std::fill_n(p, count, value);
 }
-
+#endif // SOFTRAST_X86
 
 //
-// source: https://danceswithcode.net/engineeringnotes/rotations_in_3d/rotations_in_3d_part1.html
+// Offset of pixel (x, y) in every buffer and sample plane, see "Framebuffer
+// layout".
 //
-
-
-M3x3
-get_rotation_mat3x3_roll(F32 roll)
+static inline USZ
+pixel_offset(const Basic_Renderer *r, S32 x, S32 y)
 {
-    // roll - u
-    // as eurler angle symbol
+    U32 ux = static_cast<U32>(x);
+    U32 uy = static_cast<U32>(y);
 
-    M3x3 ret{};
-
-    ret.r0 = { 1, 0, 0 };
-    ret.r1 = { 0, std::cos(roll), -std::sin(roll) };
-    ret.r2 = { 0, std::sin(roll), std::cos(roll) };
+    if (r->pixels_layout == PIXELS_LAYOUT_TILED) {
+        USZ block = static_cast<USZ>(uy / RASTER_BLOCK_SIZE) * (r->pixels_pitch / RASTER_BLOCK_SIZE) + ux / RASTER_BLOCK_SIZE;
+        return block * (RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE) + (uy % RASTER_BLOCK_SIZE) * RASTER_BLOCK_SIZE + ux % RASTER_BLOCK_SIZE;
+    }
 
-    return ret;
+    return static_cast<USZ>(uy) * r->pixels_pitch + ux;
 }
 
-
-M3x3
-get_rotation_mat3x3_pitch(F32 pitch)
+//
+// Distance between rows of one raster block, in pixels.
+//
+static inline U32
+block_row_pitch(const Basic_Renderer *r)
 {
-    // pitch - v
-    // as eurler angle symbol
-
-    M3x3 ret{};
-
-    ret.r0 = { std::cos(pitch), 0, std::sin(pitch) };
-    ret.r1 = { 0, 1, 0 };
-    ret.r2 = { -std::sin(pitch), 0, std::cos(pitch) };
-
-    return ret;
+    return r->pixels_layout == PIXELS_LAYOUT_TILED ? RASTER_BLOCK_SIZE : r->pixels_pitch;
 }
 
-
-M3x3
-get_rotation_mat3x3_yaw(F32 yaw)
+static inline USZ
+framebuffer_plane_size(const Basic_Renderer *r)
 {
-    // yaw - w
-    // as eurler angle symbol
-
-    M3x3 ret{};
-
-    ret.r0 = { std::cos(yaw), -std::sin(yaw), 0 };
-    ret.r1 = { std::sin(yaw), std::cos(yaw), 0 };
-    ret.r2 = { 0, 0, 1 };
-
-    return ret;
+    U32 rows = (r->pixels_height + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE;
+    return static_cast<USZ>(r->pixels_pitch) * rows;
 }
 
+//
+// Fills tile with clear values, if it's still pending.
+//
+// NOTE: Only worker which owns the tile touches it's flag, so there is no need
+// for atomics.
+//
+static void
+clear_tile(Basic_Renderer *r, S32 tile_index)
+{
+    U8 *pending = &r->tiles_clear_pending[tile_index];
 
-struct Transform {
-
-    F32 roll = 0, pitch = 0, yaw = 0;
+    if (!*pending) {
+        return;
+    }
 
-    // void
-    // basis_vectors(V3 *ihat, V3 *jhat, V3 *khat) const
-    // {
-    //     if (ihat) {
-    //         *ihat = { std::cos(this->pitch), 0, std::sin(this->pitch) };
-    //     }
+    *pending = 0;
 
-    //     if (jhat) {
-    //         *jhat = { 0, 1, 0 };
-    //     }
+    S32 tile_x = tile_index % r->tile_bins.tiles_x;
+    S32 tile_y = tile_index / r->tile_bins.tiles_x;
 
-    //     if (khat) {
-    //         *khat = { -std::sin(this->pitch), 0, std::cos(this->pitch) };
-    //     }
-    // }
+    S32 x_begin = tile_x * TILE_SIZE;
+    S32 y_begin = tile_y * TILE_SIZE;
+    S32 x_end = std::min<S32>(x_begin + TILE_SIZE, r->pixels_width);
+    S32 y_end = std::min<S32>(y_begin + TILE_SIZE, r->pixels_height);
 
-    inline V3
-    to_world(V3 p) const noexcept
-    {
-        V3 result = p;
+    U32 *pixels = static_cast<U32 *>(r->pixels_buffer);
+    U32 *depths = reinterpret_cast<U32 *>(r->depth_buffer);
+    U32 *samples = reinterpret_cast<U32 *>(r->samples_buffer);
+    U32 depth_value = std::bit_cast<U32>(DEPTH_CLEAR_VALUE);
+    USZ planes_stride = framebuffer_plane_size(r);
 
-        result = get_rotation_mat3x3_roll(this->roll) * result;
-        result = get_rotation_mat3x3_pitch(this->pitch) * result;
-        result = get_rotation_mat3x3_yaw(this->yaw) * result;
+    // NOTE: Tiled buffers are filled by whole blocks, so every row of blocks
+    // of the tile is one run.
+    S32 y_step = 1;
+    S32 count = x_end - x_begin;
 
-        return result;
+    if (r->pixels_layout == PIXELS_LAYOUT_TILED) {
+        y_step = RASTER_BLOCK_SIZE;
+        count = (count + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE;
     }
 
-    // constexpr V3
-    // transform(V3 ihat, V3 jhat, V3 khat, V3 p) const
-    // {
-    //     // ihat - x axis, jhat - y axis, khat - z axis.
-    //     return ihat * p.x + jhat * p.y + khat * p.z;
-    // }
-
-};
+    for (S32 y = y_begin; y < y_end; y += y_step) {
+        USZ offset = pixel_offset(r, x_begin, y);
 
+        fill_u32_streaming(pixels + offset, CLEAR_PIXEL, count);
 
-struct V3S32 {
-    S32 x = 0, y = 0, z = 0;
+        for (U32 sample = 0; sample < r->samples_count; ++sample) {
+            fill_u32_streaming(depths + sample * planes_stride + offset, depth_value, count);
 
-    constexpr V3S32
-    operator- (S32 value) const noexcept
-    {
-        return { this->x - value, this->y - value, this->z - value };
+            if (samples != nullptr) {
+                fill_u32_streaming(samples + sample * planes_stride + offset, CLEAR_PIXEL, count);
+            }
+        }
     }
-};
-
-
-struct R32 {
-    S32 x = 0, y = 0, w = 0, h = 0;
-};
-
-
-
-bool point_inside_triangle(V2 p, V2 a, V2 b, V2 c);
 
-std::pair<std::vector<V3>, std::vector<S32>> load_obj(std::string_view file_name);
+    // NOTE: Streaming stores are weakly ordered, raster of the tile has to
+    // see them.
+    #if SOFTRAST_X86
+    _mm_sfence();
+    #endif
 
-struct Rect {
-    U16 X;
-    U16 Y;
-    U16 Width;
-    U16 Height;
-
-    constexpr Rect(U16 x = 0, U16 y = 0, U16 width = 0, U16 height = 0) noexcept
-        : X(x), Y(y), Width(width), Height(height)
-    { }
-
-    constexpr bool
-    IsInside(U16 x, U16 y) const noexcept
-    {
-        return x >= X && x <= X + Width && y >= Y && y <= Y + Height;
-    }
+    Hi_Z_Buffer *hi_z = &r->hi_z;
 
+    S32 block_x_begin = x_begin / RASTER_BLOCK_SIZE;
+    S32 block_y_begin = y_begin / RASTER_BLOCK_SIZE;
+    S32 block_x_end = std::min(block_x_begin + TILE_SIZE / RASTER_BLOCK_SIZE, hi_z->blocks_x);
+    S32 block_y_end = std::min(block_y_begin + TILE_SIZE / RASTER_BLOCK_SIZE, hi_z->blocks_y);
 
-    // TODO(ilya.a): Fix bug when `r` is bigger than `this`.
-    constexpr bool
-    IsOverlapping(const Rect &r) const noexcept
-    {
-        return IsInside(r.X + 0      , r.Y + 0)
-            || IsInside(r.X + r.Width, r.Y + r.Height)
-            || IsInside(r.X + r.Width, r.Y + 0)
-            || IsInside(r.X + 0      , r.Y + r.Height);
+    for (S32 block_y = block_y_begin; block_y < block_y_end; ++block_y) {
+        F32 *row = hi_z->blocks.data() + get_offset(hi_z->blocks_x, block_y, 0);
+        std::fill(row + block_x_begin, row + block_x_end, DEPTH_CLEAR_VALUE);
     }
-};
 
-
-constexpr S32
-get_offset(S32 width, S32 y, S32 x) noexcept
-{
-    return width * y + x;
+    hi_z->tiles[tile_index] = DEPTH_CLEAR_VALUE;
 }
 
-struct Color4 {
-    U8 B;
-    U8 G;
-    U8 R;
-    U8 A;
-
-    constexpr Color4(U8 r = 0, U8 g = 0, U8 b = 0, U8 a = 0) noexcept
-        : R(r), G(g), B(b), A(a)
-    { }
-
-    constexpr Color4
-    operator+(const Color4 &other) const noexcept
-    {
-        return Color4(R+other.R,
-                      G+other.G,
-                      B+other.B,
-                      A+other.A);
+//
+// Fills pending tiles under the rectangle, before something is drawn there.
+//
+static void
+clear_tiles_under(Basic_Renderer *r, S32 x_begin, S32 y_begin, S32 x_end, S32 y_end)
+{
+    for (S32 tile_y = y_begin / TILE_SIZE; tile_y <= (y_end - 1) / TILE_SIZE; ++tile_y) {
+        for (S32 tile_x = x_begin / TILE_SIZE; tile_x <= (x_end - 1) / TILE_SIZE; ++tile_x) {
+            clear_tile(r, get_offset(r->tile_bins.tiles_x, tile_y, tile_x));
+        }
     }
-};
-
-
-static_assert(sizeof(Color4) == sizeof(U32));
-
-global_var constexpr Color4 COLOR_WHITE = Color4(MAX_U8, MAX_U8, MAX_U8, MAX_U8);
-global_var constexpr Color4 COLOR_RED   = Color4(MAX_U8, 0, 0, 0);
-global_var constexpr Color4 COLOR_GREEN = Color4(0, MAX_U8, 0, 0);
-global_var constexpr Color4 COLOR_BLUE  = Color4(0, 0, MAX_U8, 0);
-global_var constexpr Color4 COLOR_BLACK = Color4(0, 0, 0, 0);
-
-global_var constexpr Color4 COLOR_YELLOW = COLOR_GREEN + COLOR_RED;
+}
 
-global_var bool shouldStop = false;
+//
+// Averages `count` bytes of `samples_count` sample planes, which are
+// `plane_size` pixels apart, into `pixels`.
+//
+#if SOFTRAST_X86
+TARGET_SSE2 static void
+resolve_samples_row(U8 *pixels, const U8 *samples, USZ plane_size, U32 samples_count, S32 count)
+{
+    USZ plane_bytes = plane_size * sizeof(Color4);
+    U32 shift = std::countr_zero(samples_count);
+    S32 i = 0;
 
-bool get_window_dim(HWND window, S32 *x, S32 *y, S32 *w, S32 *h);
-R32 calculate_bounding_box(V2 window_size, V2 triangle[3]);
-V2 world_to_screen(V3 v, Transform transform, V2 screen_size);
+    // NOTE: Sum of 8 samples still fits into 16 bits.
+    __m128i zero = _mm_setzero_si128();
+    __m128i rounding = _mm_set1_epi16(static_cast<S16>(samples_count / 2));
+    __m128i shift_count = _mm_cvtsi32_si128(static_cast<S32>(shift));
 
-struct Basic_Renderer {
-    Color4 clear_color;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = rounding, hi = rounding;
 
-    U8 bytes_per_pixel = 4;
-    U64 x_offset = 0;
-    U64 y_offset = 0;
+        for (U32 sample = 0; sample < samples_count; ++sample) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + sample * plane_bytes + i));
 
-    void *pixels_buffer = nullptr;
-    U32 pixels_width = 0;
-    U32 pixels_height = 0;
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
 
-    BITMAPINFO info{};
+        lo = _mm_srl_epi16(lo, shift_count);
+        hi = _mm_srl_epi16(hi, shift_count);
 
-    void blit(HDC dc, S32 x_offset, S32 y_offset, S32 width, S32 height);
-    void resize(S32 w, S32 h);
-};
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i), _mm_packus_epi16(lo, hi));
+    }
 
-static Basic_Renderer global_renderer{};
+    for (; i < count; ++i) {
+        U32 sum = samples_count / 2;
 
-LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wParam, LPARAM lParam);
+        for (U32 sample = 0; sample < samples_count; ++sample) {
+            sum += samples[sample * plane_bytes + i];
+        }
 
-int WINAPI
-WinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prevInstance, _In_ LPSTR commandLine, _In_ int showMode)
+        pixels[i] = static_cast<U8>(sum >> shift);
+    }
+}
+#else
+static void
+resolve_samples_row(U8 *pixels, const U8 *samples, USZ plane_size, U32 samples_count, S32 count)
 {
-    assert(AllocConsole());
-    freopen("CONOUT$", "w+", stdout); // redirect stdout to console
-    freopen("CONOUT$", "w+", stderr); // redirect stderr to console
-    freopen("CONIN$", "r+", stdin);   // redirect stdin to console
-
-    persist_var LPCSTR CLASS_NAME = "Software Rasterizer";
-    persist_var LPCSTR WINDOW_TITLE = "Software Rasterizer";
-
-    WNDCLASS windowClass{};
-    windowClass.style = CS_OWNDC | CS_VREDRAW | CS_HREDRAW;
-    windowClass.lpfnWndProc = win32_window_proc;
-    windowClass.hInstance = instance;
-    windowClass.lpszClassName = CLASS_NAME;
-
-    assert(RegisterClassA(&windowClass));
+    USZ plane_bytes = plane_size * sizeof(Color4);
+    U32 shift = std::countr_zero(samples_count);
 
-    HWND window = CreateWindowExA(
-        0,
-        windowClass.lpszClassName,
-        WINDOW_TITLE,
-        WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-        CW_USEDEFAULT,  // int x
-        CW_USEDEFAULT,  // int y
-        600,  // int width
-        600 + 23,  // int height
-        nullptr,        // windowParent
-        nullptr,        // menu
-        instance,
-        nullptr);
-    assert(window);
+    for (S32 i = 0; i < count; ++i) {
+        U32 sum = samples_count / 2;
 
-    ShowWindow(window, showMode);
-
-    global_renderer.clear_color = COLOR_WHITE;
-
-    auto [ vertexes, indexes ] = load_obj(R"(P:\softrast\assets\cube.obj)");
+        for (U32 sample = 0; sample < samples_count; ++sample) {
+            sum += samples[sample * plane_bytes + i];
+        }
 
-    using result_type = decltype(std::default_random_engine())::result_type;
-    auto engine = std::default_random_engine();
-    std::uniform_int_distribution<result_type> dist(0, MAX_U8);
+        pixels[i] = static_cast<U8>(sum >> shift);
+    }
+}
+#endif // SOFTRAST_X86
 
-    auto get_random_color = [](decltype(dist) *dist, decltype(engine) *engine) -> Color4 {
-        return {
-            static_cast<U8>((*dist)(*engine)),
-            static_cast<U8>((*dist)(*engine)),
-            static_cast<U8>((*dist)(*engine)),
-            MAX_U8
-        };
-    };
+//
+// Averages samples of every pixel of the tile into `pixels_buffer`.
+//
+static void
+resolve_samples_tile(Basic_Renderer *r, S32 tile_index)
+{
+    if (r->samples_count == 1) {
+        return;
+    }
 
-    Clock clock{};
-    F32 rotation = 1.0f;
-    F32 rotation_speed = 0.8f;
+    S32 x_begin = (tile_index % r->tile_bins.tiles_x) * TILE_SIZE;
+    S32 y_begin = (tile_index / r->tile_bins.tiles_x) * TILE_SIZE;
+    S32 x_end = std::min<S32>(x_begin + TILE_SIZE, r->pixels_width);
+    S32 y_end = std::min<S32>(y_begin + TILE_SIZE, r->pixels_height);
 
-    std::vector<Color4> colors(indexes.size());
+    // NOTE: Same runs as in `clear_tile`.
+    S32 y_step = 1;
+    S32 count = x_end - x_begin;
 
-    /// XXX
-    for (USZ i = 0; i < indexes.size(); i += 3) {
-        Color4 color = get_random_color(&dist, &engine);
-        colors[i] = color;
-        colors[i + 1] = color;
-        colors[i + 2] = color;
+    if (r->pixels_layout == PIXELS_LAYOUT_TILED) {
+        y_step = RASTER_BLOCK_SIZE;
+        count = (count + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE;
     }
 
+    for (S32 y = y_begin; y < y_end; y += y_step) {
+        USZ offset = pixel_offset(r, x_begin, y);
 
-    while (!shouldStop) {
-
-        F32 dt = static_cast<F32>(clock.tick());
+        resolve_samples_row(reinterpret_cast<U8 *>(static_cast<Color4 *>(r->pixels_buffer) + offset),
+                            reinterpret_cast<const U8 *>(r->samples_buffer + offset),
+                            framebuffer_plane_size(r), r->samples_count, count * static_cast<S32>(sizeof(Color4)));
+    }
+}
 
-        MSG message = {};
-        while (PeekMessage(&message, nullptr, 0, 0, PM_REMOVE)) {
-            if (message.message == WM_QUIT) {
-                // NOTE(ilya.a): Make sure that we will quit the mainloop.
-                shouldStop = true;
-            }
+//
+// Makes `memory` hold one buffer of `size` bytes, see "Framebuffer memory".
+//
+static void *
+fit_framebuffer_memory(Arena *memory, USZ size, USZ reserve_size)
+{
+    // NOTE: Address space is given back only when window got bigger than
+    // anything before.
+    if (size > memory->reserved) {
+        memory->deinit();
+    }
 
-            TranslateMessage(&message);
-            DispatchMessageA(&message);
-        }
+    if (memory->base == nullptr) {
+        memory->init(std::max(size, reserve_size));
+    }
 
-        rotation += rotation_speed * dt;
+    memory->reset();
+    void *buffer = memory->push(size, FRAMEBUFFER_PITCH_ALIGNMENT);
+    assert(buffer != nullptr && "Failed to commit framebuffer memory!");
+    memory->trim();
 
-        S32 window_x = 0, window_y = 0, window_w = 0, window_h = 0;
-        assert(get_window_dim(window, &window_x, &window_y, &window_w, &window_h));
+    return buffer;
+}
 
-        V2 window_size { static_cast<F32>(window_w), static_cast<F32>(window_h) };
+void
+Basic_Renderer::release(void)
+{
+    this->pixels_memory.deinit();
+    this->depth_memory.deinit();
+    this->samples_memory.deinit();
+
+    this->present_memory.deinit();
+
+    this->pixels_buffer = nullptr;
+    this->depth_buffer = nullptr;
+    this->samples_buffer = nullptr;
+    this->present_buffer = nullptr;
+
+    this->persistent_arena.deinit();
+    this->frame_arena.deinit();
+    this->triangles.deinit();
+
+    this->hi_z = {};
+    this->tile_bins = {};
+    this->tiles_clear_pending = {};
+    this->tiles_dirty = {};
+    this->screen_vertexes = {};
+    this->vertex_varyings = nullptr;
+    this->draw_bounds = {};
+    this->previous_draws_valid = false;
+}
 
-        // printf(" window.w = %f  window.h = %f\n", window_size.x, window_size.y);
+void
+Basic_Renderer::resize(S32 w, S32 h)
+{
+    assert(this->samples_count == 1 || this->samples_count == 4 || this->samples_count == 8);
 
-        Basic_Renderer *r = &global_renderer;
+    if (this->persistent_arena.base == nullptr) {
+        this->persistent_arena.init(PERSISTENT_ARENA_RESERVE_SIZE);
+        this->frame_arena.init(FRAME_ARENA_RESERVE_SIZE);
+        this->triangles.init(TRIANGLES_RESERVE_COUNT);
+    }
 
-        // Setting screen to be gray!
-        memset(r->pixels_buffer, 69, r->pixels_width * r->pixels_height *  r->bytes_per_pixel);
+    // NOTE: Whatever is in frame arena was pushed for old size.
+    this->persistent_arena.reset();
+    this->frame_arena.reset();
+    this->triangles.clear();
+    this->tile_bins.offsets = nullptr;
+    this->tile_bins.indexes = nullptr;
 
-        for (USZ i = 0; i < indexes.size(); i += 3) {
-            V3 vertexes_[3]{vertexes[indexes[i]], vertexes[indexes[i + 1]], vertexes[indexes[i + 2]]};
+    // NOTE: Rounded up to whole 8 pixel spans too.
+    constexpr U32 PITCH_STEP = std::max<U32>(FRAMEBUFFER_PITCH_ALIGNMENT / sizeof(Color4), RASTER_BLOCK_SIZE);
+    constexpr U32 PAGE_PIXELS = 4096 / sizeof(Color4);
 
-            V2 triangle[3]{};
-            Transform transform{rotation, rotation * 0.1f, rotation * 0.3f};
+    U32 pitch = (static_cast<U32>(w) + PITCH_STEP - 1) / PITCH_STEP * PITCH_STEP;
 
-            triangle[0] = world_to_screen(vertexes_[0], transform, window_size);
-            triangle[1] = world_to_screen(vertexes_[1], transform, window_size);
-            triangle[2] = world_to_screen(vertexes_[2], transform, window_size);
+    if (pitch % PAGE_PIXELS == 0) {
+        pitch += PITCH_STEP;
+    }
 
-            R32 bb = calculate_bounding_box(window_size, triangle);
+    this->pixels_width = w;
+    this->pixels_height = h;
+    this->pixels_pitch = pitch;
 
-            for (S32 y = bb.y; y < bb.h; ++y) {
-                for (S32 x = bb.x; x < bb.w; ++x) {
-                    Color4 *pixel = static_cast<Color4 *>(r->pixels_buffer) + get_offset(r->pixels_height, x, y);
+    USZ planes_stride = framebuffer_plane_size(this);
+    USZ reserve_plane_size = static_cast<USZ>(FRAMEBUFFER_RESERVE_WIDTH + PITCH_STEP * 2) * FRAMEBUFFER_RESERVE_HEIGHT;
 
-                    V2 p{static_cast<F32>(x), static_cast<F32>(y)};
+    this->pixels_buffer = fit_framebuffer_memory(&this->pixels_memory, planes_stride * this->bytes_per_pixel, reserve_plane_size * this->bytes_per_pixel);
+    this->depth_buffer = static_cast<F32 *>(fit_framebuffer_memory(&this->depth_memory, planes_stride * this->samples_count * sizeof(F32),
+                                                                   reserve_plane_size * this->samples_count * sizeof(F32)));
 
-                    if (point_inside_triangle(p, triangle[0], triangle[1], triangle[2])) {
-                        *pixel = colors[i];
-                    }
-                }
-            }
+    if (this->samples_count > 1) {
+        this->samples_buffer = static_cast<Color4 *>(fit_framebuffer_memory(&this->samples_memory, planes_stride * this->samples_count * sizeof(Color4),
+                                                                           reserve_plane_size * this->samples_count * sizeof(Color4)));
+    } else {
+        this->samples_memory.deinit();
+        this->samples_buffer = nullptr;
+    }
 
+    if (this->pixels_layout == PIXELS_LAYOUT_TILED) {
+        this->present_buffer = static_cast<Color4 *>(fit_framebuffer_memory(&this->present_memory, planes_stride * sizeof(Color4),
+                                                                           reserve_plane_size * sizeof(Color4)));
+    } else {
+        this->present_memory.deinit();
+        this->present_buffer = nullptr;
+    }
 
-        }
+    this->tile_bins.tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+    this->tile_bins.tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
 
-        #if 0
-        USZ pitch = global_renderer.pixels_width * global_renderer.bytes_per_pixel /* sizeof(Color4) */;
-        U8 *row = static_cast<U8 *>(global_renderer.pixels_buffer);
+    U32 tiles_count = this->tile_bins.tiles_count();
 
-        for (U32 y = 0; y < global_renderer.pixels_height; ++y) {
-            Color4 *pixel = reinterpret_cast<Color4 *>(row);
+    this->hi_z.blocks_x = (w + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+    this->hi_z.blocks_y = (h + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+    this->hi_z.blocks = this->persistent_arena.push_span<F32>(this->hi_z.blocks_x * this->hi_z.blocks_y);
+    this->hi_z.tiles = this->persistent_arena.push_span<F32>(tiles_count);
 
-            for (U32 x = 0; x < global_renderer.pixels_width; ++x) {
-                //*pixel = COLOR_BLACK;
+    this->clear_depth();
 
-                V2 p{static_cast<F32>(x), static_cast<F32>(y)};
+    // NOTE: New pixels are whatever allocator gave us, so they are pending
+    // clear until the first frame.
+    this->tiles_clear_pending = this->persistent_arena.push_span<U8>(tiles_count);
+    std::fill(this->tiles_clear_pending.begin(), this->tiles_clear_pending.end(), 1);
 
+    this->tiles_dirty = this->persistent_arena.push_span<U8>(tiles_count);
 
-                if constexpr (0) {
-                    V2 a{ window_size.x * 0.2f, window_size.y * 0.2f };
-                    V2 b{ window_size.x * 0.6f, window_size.y * 0.4f };
-                    V2 c{ window_size.x * 0.4f, window_size.y * 0.5f };
+    // NOTE: All of it is less than a byte per pixel, only commit could fail.
+    assert(this->hi_z.blocks.data() && this->hi_z.tiles.data() && this->tiles_clear_pending.data() && this->tiles_dirty.data() &&
+           "Failed to commit persistent arena!");
 
-                    if (point_inside_triangle(p, a, b, c)) {
-                        *pixel = COLOR_WHITE;
-                    }
-                }
+    std::fill(this->tiles_dirty.begin(), this->tiles_dirty.end(), 1);
 
-                if constexpr (0) {
-                    pixel->R = MAX_U8 * p.x / window_size.x;
-                    pixel->G = MAX_U8 * p.y / window_size.y;
-                }
+    this->present_rects.reserve(tiles_count);
 
-                ++pixel;
-            }
+    this->previous_draws_valid = false;
+}
 
-            row += pitch;
-        }
-        #endif // #if 0
+void
+Basic_Renderer::clear(void)
+{
+    Clock clock{};
 
-        HDC dc = GetDC(window);
-        global_renderer.blit(dc, window_x, window_y, window_w, window_h);
-        ReleaseDC(window, dc);
+    // NOTE: Setting screen to be gray! Tile by tile, see `Clear_Mode`.
+    std::fill(this->tiles_clear_pending.begin(), this->tiles_clear_pending.end(), 1);
 
+    if (this->clear_mode == CLEAR_MODE_EAGER) {
+        this->resolve_clear();
     }
 
-    return 0;
+    this->stats.clear += clock.tick();
 }
 
-
-LRESULT CALLBACK
-win32_window_proc(HWND window, UINT message, WPARAM wParam, LPARAM lParam)
+void
+Basic_Renderer::resolve_clear(void)
 {
-    LRESULT result = 0;
-
-    switch (message) {
-        case WM_ACTIVATEAPP: {
-            OutputDebugString("WM_ACTIVATEAPP\n");
-        } break;
-        case WM_SIZE: {
-            OutputDebugString("WM_SIZE\n");
-            S32 width = LOWORD(lParam);
-            S32 height = HIWORD(lParam);
-
-            global_renderer.resize(width, height);
-        } break;
-        case WM_PAINT: {
-            OutputDebugString("WM_PAINT\n");
-
-            PAINTSTRUCT ps{};
-            HDC dc = BeginPaint(window, &ps);
-            assert(dc && dc != INVALID_HANDLE_VALUE);
-
-            S32 x = ps.rcPaint.left;
-            S32 y = ps.rcPaint.top;
-            S32 width = 0, height = 0;
-            GetRectSize(&ps.rcPaint, &width, &height);
-            global_renderer.blit(dc, x, y, width, height);
+    for (S32 i = 0; i < static_cast<S32>(this->tiles_clear_pending.size()); ++i) {
+        clear_tile(this, i);
+    }
+}
 
-            EndPaint(window, &ps);
+void
+Basic_Renderer::resolve_samples(void)
+{
+    for (S32 i = 0; i < static_cast<S32>(this->tile_bins.tiles_count()); ++i) {
+        resolve_samples_tile(this, i);
+    }
+}
 
-        } break;
-        case WM_CLOSE: {
-            // TODO(ilya.a): Ask for closing?
-            OutputDebugString("WM_CLOSE\n");
-            shouldStop = true;
-        } break;
-        case WM_DESTROY: {
-            // TODO(ilya.a): Casey says that we maybe should recreate
-            // window later?
-            OutputDebugString("WM_DESTROY\n");
-            // PostQuitMessage(0);
-        } break;
+//
+// Copies pixels `[kx_begin, kx_end)` of 8 pixel span.
+//
+#if SOFTRAST_X86
+TARGET_SSE2 static inline void
+copy_span(Color4 *dest, const Color4 *source, S32 kx_begin, S32 kx_end)
+{
+    if (kx_begin == 0 && kx_end == RASTER_BLOCK_SIZE) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 4));
 
-        default: {
-            // Leave other events to default Window's handler.
-            result = DefWindowProc(window, message, wParam, lParam);
-        } break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 4), hi);
+        return;
     }
 
-    return result;
+    std::copy(source + kx_begin, source + kx_end, dest + kx_begin);
 }
-
-void
-Basic_Renderer::blit(HDC dc, S32 x_offset, S32 y_offset, S32 width, S32 height)
+#else
+static inline void
+copy_span(Color4 *dest, const Color4 *source, S32 kx_begin, S32 kx_end)
 {
-    StretchDIBits(dc,
-        this->x_offset, this->y_offset, this->pixels_width, this->pixels_height,
-        x_offset, y_offset, width, height,
-        this->pixels_buffer, &this->info,
-        DIB_RGB_COLORS, SRCCOPY
-    );
+    std::copy(source + kx_begin, source + kx_end, dest + kx_begin);
 }
+#endif // SOFTRAST_X86
 
 void
-Basic_Renderer::resize(S32 w, S32 h)
+Basic_Renderer::read_pixels(Color4 *dest, U32 dest_pitch, R32 rect) const
 {
-    if (this->pixels_buffer != nullptr && VirtualFree(this->pixels_buffer, 0, MEM_RELEASE) == 0) {
-        //                                                                    ^^^^^^^^^^^
-        // NOTE(ilya.a): Might be more reasonable to use MEM_DECOMMIT instead for
-        // MEM_RELEASE. Because in that case it's will be keep buffer around, until
-        // we use it again.
-        // P.S. Also will be good to try protect buffer after deallocating or other
-        // stuff.
-        //
-        // TODO(ilya.a):
-        //     - [ ] Checkout how it works.
-        //     - [ ] Handle allocation error.
-        assert(false && "Failed to deallocate!");
+    const Color4 *pixels = static_cast<const Color4 *>(this->pixels_buffer);
+
+    if (this->pixels_layout == PIXELS_LAYOUT_LINEAR) {
+        for (S32 y = 0; y < rect.h; ++y) {
+            std::copy_n(pixels + get_offset(this->pixels_pitch, rect.y + y, rect.x), rect.w, dest + get_offset(dest_pitch, y, 0));
+        }
+
+        return;
     }
-    this->pixels_width = w;
-    this->pixels_height = h;
 
-    this->info.bmiHeader.biSize          = sizeof(this->info.bmiHeader);
-    this->info.bmiHeader.biWidth         = w;
-    this->info.bmiHeader.biHeight        = h;
-    this->info.bmiHeader.biPlanes        = 1;
-    this->info.bmiHeader.biBitCount      = 32;      // NOTE: Align to WORD
-    this->info.bmiHeader.biCompression   = BI_RGB;
-    this->info.bmiHeader.biSizeImage     = 0;
-    this->info.bmiHeader.biXPelsPerMeter = 0;
-    this->info.bmiHeader.biYPelsPerMeter = 0;
-    this->info.bmiHeader.biClrUsed       = 0;
-    this->info.bmiHeader.biClrImportant  = 0;
+    // NOTE: Block by block, so every block is read once from start to end,
+    // and it's rows are scattered into 8 rows of `dest`.
+    S32 x_end = rect.x + rect.w;
+    S32 y_end = rect.y + rect.h;
+    S32 block_x_begin = rect.x & ~(RASTER_BLOCK_SIZE - 1);
+    S32 block_y_begin = rect.y & ~(RASTER_BLOCK_SIZE - 1);
+
+    for (S32 block_y = block_y_begin; block_y < y_end; block_y += RASTER_BLOCK_SIZE) {
+        S32 ky_begin = std::max(rect.y - block_y, 0);
+        S32 ky_end = std::min(y_end - block_y, RASTER_BLOCK_SIZE);
 
-    USZ bufferSize = w * h * this->bytes_per_pixel;
-    this->pixels_buffer = VirtualAlloc(nullptr, bufferSize, MEM_COMMIT, PAGE_READWRITE);
-    assert(this->pixels_buffer && "Failed to allocate memory!");
+        for (S32 block_x = block_x_begin; block_x < x_end; block_x += RASTER_BLOCK_SIZE) {
+            S32 kx_begin = std::max(rect.x - block_x, 0);
+            S32 kx_end = std::min(x_end - block_x, RASTER_BLOCK_SIZE);
+
+            const Color4 *block = pixels + pixel_offset(this, block_x, block_y);
+
+            for (S32 ky = ky_begin; ky < ky_end; ++ky) {
+                Color4 *row = dest + get_offset(dest_pitch, block_y + ky - rect.y, block_x - rect.x);
+                copy_span(row, block + ky * RASTER_BLOCK_SIZE, kx_begin, kx_end);
+            }
+        }
+    }
 }
 
-bool
-get_window_dim(HWND window, S32 *x, S32 *y, S32 *w, S32 *h)
+const Color4 *
+Basic_Renderer::present(std::span<const R32> rects)
 {
-    RECT window_rect{};
-    if (!GetClientRect(window, &window_rect)) {
-        return false;
+    if (this->pixels_layout == PIXELS_LAYOUT_LINEAR) {
+        return static_cast<const Color4 *>(this->pixels_buffer);
     }
 
-    if (x) {
-        *x = window_rect.left;
-    }
+    Clock clock{};
 
-    if (y) {
-        *y = window_rect.top;
+    for (const R32 &rect : rects) {
+        this->read_pixels(this->present_buffer + get_offset(this->pixels_pitch, rect.y, rect.x), this->pixels_pitch, rect);
     }
 
-    if (w) {
-        *w = window_rect.right - window_rect.left;
-    }
+    this->stats.present += clock.tick();
 
-    if (h) {
-        *h = window_rect.bottom - window_rect.top;
-    }
+    return this->present_buffer;
+}
 
-    return true;
+void
+Basic_Renderer::clear_depth(void)
+{
+    std::fill_n(this->depth_buffer, framebuffer_plane_size(this) * this->samples_count, DEPTH_CLEAR_VALUE);
+    std::fill(this->hi_z.blocks.begin(), this->hi_z.blocks.end(), DEPTH_CLEAR_VALUE);
+    std::fill(this->hi_z.tiles.begin(), this->hi_z.tiles.end(), DEPTH_CLEAR_VALUE);
 }
 
 F32
@@ -773,107 +657,6613 @@ point_inside_triangle(V2 p, V2 a, V2 b, V2 c)
     return true;
 }
 
-std::pair<std::vector<V3>, std::vector<S32>>
-load_obj(std::string_view file_name)
+V3
+world_to_screen(V3 v, Transform transform, V2 screen_size)
 {
+    V3 v_world = transform.to_world(v);
 
-    std::ifstream file(file_name.data());
-
-    std::vector<V3> vertexes{};
-    std::vector<S32> indexes{};
+    F32 pixels_per_unit = screen_size.y / WORLD_UNITS_IN_SCREEN_HEIGHT;
 
-    std::string line{};
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
+    V2 offset = v_world.to<V2>() * pixels_per_unit;
+    V2 screen = (screen_size / 2) + offset;
 
-        if (line.starts_with("v ")) {
+    // NOTE: Camera looks down the -Z, so smaller depth is closer.
+    return { screen.x, screen.y, -v_world.z };
+}
 
-            C8 v = 0;
-            F32 x = 0, y = 0, z = 0;
+R32
+calculate_bounding_box(V2 window_size, V2 triangle[3])
+{
+    R32 result{};
 
-            iss >> v >> x >> y >> z;
+    V2 a = triangle[0], b = triangle[1], c = triangle[2];
 
-            vertexes.emplace_back(x, y, z);
-        }
+    F32 min_x = std::min(std::min(a.x, b.x), c.x);
+    F32 min_y = std::min(std::min(a.y, b.y), c.y);
+    F32 max_x = std::max(std::max(a.x, b.x), c.x);
+    F32 max_y = std::max(std::max(a.y, b.y), c.y);
 
-        if (line.starts_with("f ")) {
+    result.x = std::clamp(static_cast<S32>(min_x), 0, static_cast<S32>(window_size.x) - 1);
+    result.y = std::clamp(static_cast<S32>(min_y), 0, static_cast<S32>(window_size.y) - 1);
 
-            C8 prefix = 0, sep = 0;
-            iss >> prefix;
+    // NOTE: Max corner is exclusive, so it's clamped to the size, not to the
+    // last pixel, otherwise last row and column are never drawn.
+    result.w = std::clamp(static_cast<S32>(std::ceil(max_x)), 0, static_cast<S32>(window_size.x));
+    result.h = std::clamp(static_cast<S32>(std::ceil(max_y)), 0, static_cast<S32>(window_size.y));
 
-            S32 count = 0;
-            while (!iss.eof()) {
-                S32 index = 0, stub = 0;
-                iss >> index >> sep >> stub >> sep >> stub;
+    return result;
+}
 
-                if (count >= 3) {
-                    S32 a = indexes[indexes.size() - 3];
-                    S32 b = indexes[indexes.size() - 1];
+static void
+thread_pool_work(Thread_Pool *pool, U32 worker_index)
+{
+    auto pack = [](U32 begin, U32 end) -> U64 {
+        return (static_cast<U64>(end) << 32) | begin;
+    };
+
+    for (;;) {
+        bool found = false;
+        U32 index = 0;
+
+        // NOTE: First drain own range from the front, then go around and
+        // steal from the back of others.
+        for (U32 i = 0; i < pool->workers_count && !found; ++i) {
+            U32 victim = (worker_index + i) % pool->workers_count;
+            std::atomic<U64> *packed = &pool->ranges[victim].packed;
+
+            U64 range = packed->load(std::memory_order_relaxed);
+            for (;;) {
+                U32 begin = static_cast<U32>(range);
+                U32 end = static_cast<U32>(range >> 32);
+
+                if (begin >= end) {
+                    break;
+                }
 
-                    indexes.push_back(a);
-                    indexes.push_back(b);
+                U64 next = victim == worker_index ? pack(begin + 1, end) : pack(begin, end - 1);
+                if (packed->compare_exchange_weak(range, next, std::memory_order_acq_rel)) {
+                    index = victim == worker_index ? begin : end - 1;
+                    found = true;
+                    break;
                 }
+            }
+        }
+
+        if (!found) {
+            return;
+        }
 
-                indexes.push_back(index - 1); // In .obj index values starts from 1.
+        pool->proc(pool->data, index, worker_index);
+    }
+}
 
-                ++count;
+static void
+thread_pool_worker_main(Thread_Pool *pool, U32 worker_index)
+{
+    U64 seen_generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock lock(pool->mutex);
+            pool->wake_cv.wait(lock, [&] {
+                return pool->should_stop || pool->generation != seen_generation;
+            });
+
+            if (pool->should_stop) {
+                return;
+            }
+
+            seen_generation = pool->generation;
+        }
+
+        thread_pool_work(pool, worker_index);
+
+        {
+            std::lock_guard lock(pool->mutex);
+            if (--pool->busy_workers == 0) {
+                pool->done_cv.notify_one();
             }
         }
     }
+}
 
+void
+Thread_Pool::init(U32 workers_count)
+{
+    assert(workers_count > 0);
 
+    this->workers_count = workers_count;
+    this->ranges = std::make_unique<Work_Range[]>(workers_count);
 
-    return {vertexes, indexes};
+    for (U32 i = 1; i < workers_count; ++i) {
+        this->threads.emplace_back(thread_pool_worker_main, this, i);
+    }
 }
 
-V2
-world_to_screen(V3 v, Transform transform, V2 screen_size)
+void
+Thread_Pool::deinit(void)
 {
-    V3 v_world = transform.to_world(v);
+    {
+        std::lock_guard lock(this->mutex);
+        this->should_stop = true;
+    }
+    this->wake_cv.notify_all();
 
-    F32 world_units_in_screen_height = 5;
-    F32 pixels_per_unit = screen_size.y / world_units_in_screen_height;
+    for (std::thread &thread : this->threads) {
+        thread.join();
+    }
 
-    V2 offset = v_world.to<V2>() * pixels_per_unit;
-    return (screen_size / 2) + offset;
+    this->threads.clear();
+    this->workers_count = 0;
+}
+
+void
+Thread_Pool::parallel_for(U32 count, Parallel_For_Proc proc, void *data)
+{
+    // NOTE: Splitting in contiguous chunks, so neighbouring indices (tiles)
+    // mostly stay on the same worker.
+    for (U32 i = 0; i < this->workers_count; ++i) {
+        U64 begin = static_cast<U64>(count) * i / this->workers_count;
+        U64 end = static_cast<U64>(count) * (i + 1) / this->workers_count;
+        this->ranges[i].packed.store((end << 32) | begin, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard lock(this->mutex);
+        this->proc = proc;
+        this->data = data;
+        this->busy_workers = this->workers_count - 1;
+        ++this->generation;
+    }
+    this->wake_cv.notify_all();
 
+    thread_pool_work(this, 0);
+
+    std::unique_lock lock(this->mutex);
+    this->done_cv.wait(lock, [this] { return this->busy_workers == 0; });
 }
 
-R32
-calculate_bounding_box(V2 window_size, V2 triangle[3])
+//
+// Textures.
+//
+
+const char *TEXTURE_FILTER_NAMES[TEXTURE_FILTER_COUNT] = {
+    "nearest",
+    "bilinear",
+    "trilinear",
+};
+
+//
+// Spreads `bits` wide coordinate into every other bit, starting from `shift`.
+// Bits for which other coordinate doesn't have a pair are going on top of the
+// interleaved ones, so non square levels are packed tight too.
+//
+static U32
+texture_morton_spread(U32 value, U32 bits, U32 other_bits, U32 shift)
 {
-    R32 result{};
+    U32 shared_bits = std::min(bits, other_bits);
+    U32 result = 0;
 
-    V2 a = triangle[0], b = triangle[1], c = triangle[2];
+    for (U32 i = 0; i < shared_bits; ++i) {
+        result |= ((value >> i) & 1) << (2 * i + shift);
+    }
 
-    F32 min_x = std::min(std::min(a.x, b.x), c.x);
-    F32 min_y = std::min(std::min(a.y, b.y), c.y);
-    F32 max_x = std::max(std::max(a.x, b.x), c.x);
-    F32 max_y = std::max(std::max(a.y, b.y), c.y);
+    return result | ((value >> shared_bits) << (2 * shared_bits));
+}
 
-    result.x = std::clamp(static_cast<S32>(min_x), 0, static_cast<S32>(window_size.x) - 1);
-    result.y = std::clamp(static_cast<S32>(min_y), 0, static_cast<S32>(window_size.y) - 1);
+//
+// `pixels` are row major, `width` and `height` are powers of two.
+//
+static Texture_Level
+make_texture_level(const Color4 *pixels, S32 width, S32 height)
+{
+    Texture_Level level{};
+    level.width = width;
+    level.height = height;
 
-    result.w = std::clamp(static_cast<S32>(std::ceil(max_x)), 0, static_cast<S32>(window_size.x) - 1);
-    result.h = std::clamp(static_cast<S32>(std::ceil(max_y)), 0, static_cast<S32>(window_size.y) - 1);
+    U32 width_bits = static_cast<U32>(std::countr_zero(static_cast<U32>(width)));
+    U32 height_bits = static_cast<U32>(std::countr_zero(static_cast<U32>(height)));
 
-    return result;
+    level.morton_x.resize(width);
+    level.morton_y.resize(height);
+
+    for (S32 x = 0; x < width; ++x) {
+        level.morton_x[x] = texture_morton_spread(static_cast<U32>(x), width_bits, height_bits, 0);
+    }
+
+    for (S32 y = 0; y < height; ++y) {
+        level.morton_y[y] = texture_morton_spread(static_cast<U32>(y), height_bits, width_bits, 1);
+    }
+
+    level.texels.resize(static_cast<USZ>(width) * height);
+
+    for (S32 y = 0; y < height; ++y) {
+        for (S32 x = 0; x < width; ++x) {
+            level.texels[level.morton_x[x] | level.morton_y[y]] = pixels[get_offset(width, y, x)];
+        }
+    }
+
+    return level;
+}
+
+Texture
+make_texture(const Color4 *pixels, S32 width, S32 height)
+{
+    Texture texture{};
+
+    if (width <= 0 || height <= 0) {
+        return texture;
+    }
+
+    S32 level_width = static_cast<S32>(std::bit_ceil(static_cast<U32>(width)));
+    S32 level_height = static_cast<S32>(std::bit_ceil(static_cast<U32>(height)));
+
+    // NOTE: Resampling with nearest texels, it's only for odd sized images,
+    // most of the textures are already powers of two.
+    std::vector<Color4> linear(static_cast<USZ>(level_width) * level_height);
+
+    for (S32 y = 0; y < level_height; ++y) {
+        S32 source_y = static_cast<S32>(static_cast<S64>(y) * height / level_height);
+
+        for (S32 x = 0; x < level_width; ++x) {
+            S32 source_x = static_cast<S32>(static_cast<S64>(x) * width / level_width);
+            linear[get_offset(level_width, y, x)] = pixels[get_offset(width, source_y, source_x)];
+        }
+    }
+
+    for (;;) {
+        texture.levels.push_back(make_texture_level(linear.data(), level_width, level_height));
+
+        if (level_width == 1 && level_height == 1) {
+            break;
+        }
+
+        // NOTE: Box filter. Once one of the sides is down to 1, same texels
+        // are just averaged twice.
+        S32 next_width = std::max(level_width / 2, 1);
+        S32 next_height = std::max(level_height / 2, 1);
+        std::vector<Color4> next(static_cast<USZ>(next_width) * next_height);
+
+        for (S32 y = 0; y < next_height; ++y) {
+            S32 y0 = std::min(y * 2, level_height - 1);
+            S32 y1 = std::min(y * 2 + 1, level_height - 1);
+
+            for (S32 x = 0; x < next_width; ++x) {
+                S32 x0 = std::min(x * 2, level_width - 1);
+                S32 x1 = std::min(x * 2 + 1, level_width - 1);
+
+                Color4 a = linear[get_offset(level_width, y0, x0)];
+                Color4 b = linear[get_offset(level_width, y0, x1)];
+                Color4 c = linear[get_offset(level_width, y1, x0)];
+                Color4 d = linear[get_offset(level_width, y1, x1)];
+
+                next[get_offset(next_width, y, x)] = Color4(
+                    static_cast<U8>((a.R + b.R + c.R + d.R + 2) / 4),
+                    static_cast<U8>((a.G + b.G + c.G + d.G + 2) / 4),
+                    static_cast<U8>((a.B + b.B + c.B + d.B + 2) / 4),
+                    static_cast<U8>((a.A + b.A + c.A + d.A + 2) / 4));
+            }
+        }
+
+        linear = std::move(next);
+        level_width = next_width;
+        level_height = next_height;
+    }
+
+    return texture;
+}
+
+Texture
+make_checker_texture(S32 size, S32 cells, Color4 a, Color4 b)
+{
+    assert(size > 0 && cells > 0);
+
+    std::vector<Color4> pixels(static_cast<USZ>(size) * size);
+    S32 cell_size = std::max(size / cells, 1);
+
+    for (S32 y = 0; y < size; ++y) {
+        for (S32 x = 0; x < size; ++x) {
+            pixels[get_offset(size, y, x)] = ((x / cell_size + y / cell_size) & 1) ? b : a;
+        }
+    }
+
+    return make_texture(pixels.data(), size, size);
+}
+
+static const U8 *
+ppm_skip_spaces(const U8 *p, const U8 *end)
+{
+    while (p < end) {
+        if (*p == '#') {
+            while (p < end && *p != '\n') {
+                ++p;
+            }
+        } else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            ++p;
+        } else {
+            break;
+        }
+    }
+
+    return p;
+}
+
+static const U8 *
+ppm_parse_number(const U8 *p, const U8 *end, S32 *value)
+{
+    p = ppm_skip_spaces(p, end);
+
+    auto result = std::from_chars(reinterpret_cast<const C8 *>(p), reinterpret_cast<const C8 *>(end), *value);
+    return result.ec == std::errc() ? reinterpret_cast<const U8 *>(result.ptr) : nullptr;
+}
+
+static Texture
+load_texture_ppm(const U8 *file, USZ file_size)
+{
+    const U8 *end = file + file_size;
+    const U8 *p = file + 2;  // NOTE: Skipping "P6".
+
+    S32 width = 0, height = 0, max_value = 0;
+
+    if (!(p = ppm_parse_number(p, end, &width))
+        || !(p = ppm_parse_number(p, end, &height))
+        || !(p = ppm_parse_number(p, end, &max_value))) {
+        return {};
+    }
+
+    // NOTE: Exactly one whitespace character between header and texels.
+    ++p;
+
+    if (width <= 0 || height <= 0 || max_value <= 0 || max_value > MAX_U8
+        || end - p < static_cast<SSZ>(width) * height * 3) {
+        return {};
+    }
+
+    std::vector<Color4> pixels(static_cast<USZ>(width) * height);
+
+    for (S32 y = 0; y < height; ++y) {
+        // NOTE: Rows in `.ppm` are going top to bottom.
+        Color4 *row = pixels.data() + get_offset(width, height - 1 - y, 0);
+
+        for (S32 x = 0; x < width; ++x, p += 3) {
+            row[x] = Color4(
+                static_cast<U8>(p[0] * MAX_U8 / max_value),
+                static_cast<U8>(p[1] * MAX_U8 / max_value),
+                static_cast<U8>(p[2] * MAX_U8 / max_value),
+                MAX_U8);
+        }
+    }
+
+    return make_texture(pixels.data(), width, height);
+}
+
+#define TGA_HEADER_SIZE 18
+
+#define TGA_IMAGE_TYPE_TRUE_COLOR     2
+#define TGA_IMAGE_TYPE_TRUE_COLOR_RLE 10
+
+#define TGA_DESCRIPTOR_TOP_TO_BOTTOM (1 << 5)
+
+static Texture
+load_texture_tga(const U8 *file, USZ file_size)
+{
+    if (file_size < TGA_HEADER_SIZE) {
+        return {};
+    }
+
+    U8 id_length = file[0];
+    U8 color_map_type = file[1];
+    U8 image_type = file[2];
+    S32 width = file[12] | (file[13] << 8);
+    S32 height = file[14] | (file[15] << 8);
+    U8 bits_per_pixel = file[16];
+    U8 descriptor = file[17];
+
+    if (color_map_type != 0
+        || (image_type != TGA_IMAGE_TYPE_TRUE_COLOR && image_type != TGA_IMAGE_TYPE_TRUE_COLOR_RLE)
+        || (bits_per_pixel != 24 && bits_per_pixel != 32)
+        || width == 0 || height == 0) {
+        return {};
+    }
+
+    const U8 *end = file + file_size;
+    const U8 *p = file + TGA_HEADER_SIZE + id_length;
+
+    S32 bytes_per_pixel = bits_per_pixel / 8;
+    USZ pixels_count = static_cast<USZ>(width) * height;
+
+    std::vector<Color4> pixels(pixels_count);
+
+    // NOTE: Texels are BGR(A), same as `Color4`.
+    auto read_pixel = [&](const U8 *texel) {
+        return Color4(texel[2], texel[1], texel[0], bytes_per_pixel == 4 ? texel[3] : MAX_U8);
+    };
+
+    for (USZ i = 0; i < pixels_count;) {
+        bool run = false;
+        USZ count = 1;
+
+        if (image_type == TGA_IMAGE_TYPE_TRUE_COLOR_RLE) {
+            if (p >= end) {
+                return {};
+            }
+
+            run = (*p & 0x80) != 0;
+            count = (*p & 0x7F) + 1;
+            ++p;
+        }
+
+        count = std::min(count, pixels_count - i);
+
+        if (end - p < static_cast<SSZ>(run ? 1 : count) * bytes_per_pixel) {
+            return {};
+        }
+
+        for (USZ k = 0; k < count; ++k) {
+            pixels[i++] = read_pixel(p);
+
+            if (!run) {
+                p += bytes_per_pixel;
+            }
+        }
+
+        if (run) {
+            p += bytes_per_pixel;
+        }
+    }
+
+    // NOTE: Bottom to top is the default, which is already what textures want.
+    if (descriptor & TGA_DESCRIPTOR_TOP_TO_BOTTOM) {
+        for (S32 y = 0; y < height / 2; ++y) {
+            std::swap_ranges(pixels.begin() + get_offset(width, y, 0),
+                             pixels.begin() + get_offset(width, y + 1, 0),
+                             pixels.begin() + get_offset(width, height - 1 - y, 0));
+        }
+    }
+
+    return make_texture(pixels.data(), width, height);
+}
+
+Texture
+load_texture(std::string_view file_name)
+{
+    USZ file_size = 0;
+    const U8 *file = static_cast<const U8 *>(platform_map_file(std::string(file_name).c_str(), &file_size));
+    if (file == nullptr) {
+        return {};
+    }
+
+    // NOTE: `.tga` doesn't have any magic, so anything which is not `.ppm` is tried as one.
+    Texture texture = file_size >= 2 && file[0] == 'P' && file[1] == '6'
+                    ? load_texture_ppm(file, file_size)
+                    : load_texture_tga(file, file_size);
+
+    platform_unmap_file(const_cast<U8 *>(file), file_size);
+
+    return texture;
+}
+
+//
+// Mip levels and filter picked once per triangle.
+//
+struct Texture_Sampler {
+    const Texture_Level *levels[2]{};
+    U32 level_weight = 0;  // NOTE: Weight of `levels[1]`, out of 256.
+    Texture_Filter filter = TEXTURE_FILTER_NEAREST;
+};
+
+static Texture_Sampler
+make_texture_sampler(const Texture *texture, Texture_Filter filter, F32 lod)
+{
+    Texture_Sampler sampler{};
+    sampler.filter = filter;
+
+    S32 last_level = static_cast<S32>(texture->levels.size()) - 1;
+    F32 clamped_lod = std::clamp(lod, 0.0f, static_cast<F32>(last_level));
+
+    if (filter == TEXTURE_FILTER_TRILINEAR) {
+        S32 level = static_cast<S32>(clamped_lod);
+
+        sampler.levels[0] = &texture->levels[level];
+        sampler.levels[1] = &texture->levels[std::min(level + 1, last_level)];
+        sampler.level_weight = static_cast<U32>((clamped_lod - static_cast<F32>(level)) * 256);
+    } else {
+        S32 level = static_cast<S32>(clamped_lod + 0.5f);
+
+        sampler.levels[0] = &texture->levels[level];
+        sampler.levels[1] = sampler.levels[0];
+    }
+
+    return sampler;
 }
 
-S64
-perf_get_counter_frequency(void)
+static inline U32
+texture_fetch(const Texture_Level *level, S32 x, S32 y)
 {
-    LARGE_INTEGER perf_frequency_result;
-    QueryPerformanceFrequency(&perf_frequency_result);
-    S64 perf_frequency = perf_frequency_result.QuadPart;
-    return perf_frequency;
+    U32 index = level->morton_x[x & (level->width - 1)] | level->morton_y[y & (level->height - 1)];
+    return std::bit_cast<U32>(level->texels[index]);
 }
 
-S64
-perf_get_counter(void)
+//
+// Lerps all four channels at once, two at the time in 16 bit lanes.
+// `weight` is of `b`, out of 256.
+//
+static inline U32
+texture_lerp(U32 a, U32 b, U32 weight)
+{
+    U32 rb = ((((a & 0x00FF00FF) * (256 - weight)) + ((b & 0x00FF00FF) * weight)) >> 8) & 0x00FF00FF;
+    U32 ag = ((((a >> 8) & 0x00FF00FF) * (256 - weight)) + (((b >> 8) & 0x00FF00FF) * weight)) & 0xFF00FF00;
+    return rb | ag;
+}
+
+static inline U32
+texture_sample_nearest(const Texture_Level *level, V2 uv)
+{
+    F32 x = (uv.x - std::floor(uv.x)) * static_cast<F32>(level->width);
+    F32 y = (uv.y - std::floor(uv.y)) * static_cast<F32>(level->height);
+
+    return texture_fetch(level, static_cast<S32>(x), static_cast<S32>(y));
+}
+
+static inline U32
+texture_sample_bilinear(const Texture_Level *level, V2 uv)
+{
+    // NOTE: Texel centers are at half coordinates.
+    F32 x = (uv.x - std::floor(uv.x)) * static_cast<F32>(level->width) - 0.5f;
+    F32 y = (uv.y - std::floor(uv.y)) * static_cast<F32>(level->height) - 0.5f;
+
+    F32 x_floor = std::floor(x);
+    F32 y_floor = std::floor(y);
+
+    S32 x0 = static_cast<S32>(x_floor);
+    S32 y0 = static_cast<S32>(y_floor);
+
+    U32 weight_x = static_cast<U32>((x - x_floor) * 256);
+    U32 weight_y = static_cast<U32>((y - y_floor) * 256);
+
+    U32 bottom = texture_lerp(texture_fetch(level, x0, y0), texture_fetch(level, x0 + 1, y0), weight_x);
+    U32 top = texture_lerp(texture_fetch(level, x0, y0 + 1), texture_fetch(level, x0 + 1, y0 + 1), weight_x);
+
+    return texture_lerp(bottom, top, weight_y);
+}
+
+static inline U32
+texture_sampler_sample(const Texture_Sampler *sampler, V2 uv)
+{
+    U32 texel = 0;
+
+    switch (sampler->filter) {
+        case TEXTURE_FILTER_NEAREST: {
+            texel = texture_sample_nearest(sampler->levels[0], uv);
+        } break;
+        case TEXTURE_FILTER_BILINEAR: {
+            texel = texture_sample_bilinear(sampler->levels[0], uv);
+        } break;
+        default: {
+            texel = texture_sample_bilinear(sampler->levels[0], uv);
+
+            if (sampler->level_weight != 0) {
+                texel = texture_lerp(texel, texture_sample_bilinear(sampler->levels[1], uv), sampler->level_weight);
+            }
+        } break;
+    }
+
+    return texel;
+}
+
+Color4
+sample_texture(const Texture *texture, Texture_Filter filter, F32 lod, V2 uv)
+{
+    if (texture->levels.empty()) {
+        return COLOR_BLACK;
+    }
+
+    Texture_Sampler sampler = make_texture_sampler(texture, filter, lod);
+    return std::bit_cast<Color4>(texture_sampler_sample(&sampler, uv));
+}
+
+static bool
+raster_triangle_setup_fixed(Raster_Triangle *t)
+{
+    S32 x[3]{}, y[3]{};
+
+    for (S32 i = 0; i < 3; ++i) {
+        V2 v = t->vertexes[i];
+
+        if (!(std::abs(v.x) < FIXED_GUARD_BAND && std::abs(v.y) < FIXED_GUARD_BAND)) {
+            return false;
+        }
+
+        x[i] = snap_to_fixed(v.x);
+        y[i] = snap_to_fixed(v.y);
+    }
+
+    for (S32 i = 0; i < 3; ++i) {
+        S32 j = (i + 1) % 3;
+        S64 dx = static_cast<S64>(x[j]) - x[i];
+        S64 dy = static_cast<S64>(y[j]) - y[i];
+
+        Edge_Function_Fixed *e = &t->fixed_edges[i];
+        e->a = dy;
+        e->b = -dx;
+        e->origin_x = x[i];
+        e->origin_y = y[i];
+        e->bias = ((dy == 0 && dx > 0) || dy < 0) ? 1 : 0;
+    }
+
+    // NOTE: Rest of the setup is done in floats on snapped positions, which
+    // are exactly representable.
+    for (S32 i = 0; i < 3; ++i) {
+        t->vertexes[i] = V2(static_cast<F32>(x[i]) / SUBPIXEL_ONE, static_cast<F32>(y[i]) / SUBPIXEL_ONE);
+    }
+
+    return true;
+}
+
+bool
+raster_triangle_setup(Raster_Triangle *t, Raster_Mode mode, V2 screen_size)
 {
-    LARGE_INTEGER perf_counter_result;
-    QueryPerformanceCounter(&perf_counter_result);
-    S64 perf_counter = perf_counter_result.QuadPart;
-    return perf_counter;
+    // NOTE: Triangles which are too far outside of the screen are falling back
+    // to float edges.
+    t->fixed = mode == RASTER_MODE_FIXED && raster_triangle_setup_fixed(t);
+    t->bb = calculate_bounding_box(screen_size, t->vertexes);
+
+    for (S32 i = 0; i < 3; ++i) {
+        V2 v0 = t->vertexes[i];
+        V2 v1 = t->vertexes[(i + 1) % 3];
+        V2 d = v1 - v0;
+
+        Edge_Function *e = &t->edges[i];
+        e->a = d.y;
+        e->b = -d.x;
+        e->origin = v0;
+
+        // NOTE: Inside is on the right side of edge on screen (Y goes down),
+        // so top edge goes exactly right and left edge goes up.
+        e->top_left = (d.y == 0 && d.x > 0) || d.y < 0;
+    }
+
+    // NOTE: Same winding as `point_inside_triangle` accepts. Degenerate
+    // triangles and ones which flipped while snapping are skipped.
+    bool front_facing = false;
+
+    if (t->fixed) {
+        const Edge_Function_Fixed *e = &t->fixed_edges[0];
+        S64 cx = static_cast<S64>(t->fixed_edges[2].origin_x) - e->origin_x;
+        S64 cy = static_cast<S64>(t->fixed_edges[2].origin_y) - e->origin_y;
+
+        front_facing = e->a * cx + e->b * cy < 0;
+    } else {
+        V2 c = t->vertexes[2] - t->edges[0].origin;
+        F32 area = t->edges[0].a * c.x + t->edges[0].b * c.y;
+
+        front_facing = area < 0;
+    }
+
+    if (!(front_facing && t->bb.x < t->bb.w && t->bb.y < t->bb.h)) {
+        return false;
+    }
+
+    V2 d1 = t->vertexes[1] - t->vertexes[0];
+    V2 d2 = t->vertexes[2] - t->vertexes[0];
+    F32 dz1 = t->depths[1] - t->depths[0];
+    F32 dz2 = t->depths[2] - t->depths[0];
+    F32 det = d1.x * d2.y - d2.x * d1.y;
+
+    // NOTE: Sliver triangle could still round to zero area here.
+    if (det != 0) {
+        t->dz_dx = (dz1 * d2.y - dz2 * d1.y) / det;
+        t->dz_dy = (dz2 * d1.x - dz1 * d2.x) / det;
+    }
+
+    t->z_min = std::min(std::min(t->depths[0], t->depths[1]), t->depths[2]);
+    t->z_max = std::max(std::max(t->depths[0], t->depths[1]), t->depths[2]);
+
+    if (det != 0) {
+        for (U32 i = 0; i < t->varyings_count; ++i) {
+            F32 dv1 = t->varyings[1][i] - t->varyings[0][i];
+            F32 dv2 = t->varyings[2][i] - t->varyings[0][i];
+
+            t->dv_dx[i] = (dv1 * d2.y - dv2 * d1.y) / det;
+            t->dv_dy[i] = (dv2 * d1.x - dv1 * d2.x) / det;
+        }
+    }
+
+    if (t->texture != nullptr) {
+        // NOTE: Mip level is picked by the longer of the pixel's
+        // footprints on the base level.
+        const Texture_Level *base = &t->texture->levels[0];
+        F32 width = static_cast<F32>(base->width);
+        F32 height = static_cast<F32>(base->height);
+
+        F32 rho_x = std::hypot(t->dv_dx[0] * width, t->dv_dx[1] * height);
+        F32 rho_y = std::hypot(t->dv_dy[0] * width, t->dv_dy[1] * height);
+        F32 rho = std::max(rho_x, rho_y);
+
+        t->texture_lod = rho > 0 ? std::log2(rho) : 0;
+    }
+
+    return true;
+}
+
+//
+// Clipping and culling.
+//
+
+global_var constexpr U32 CLIP_CODE_NEAR = 1 << 0;
+
+global_var constexpr U32 CLIP_CODE_SCREEN_LEFT   = 1 << 1;
+global_var constexpr U32 CLIP_CODE_SCREEN_RIGHT  = 1 << 2;
+global_var constexpr U32 CLIP_CODE_SCREEN_TOP    = 1 << 3;
+global_var constexpr U32 CLIP_CODE_SCREEN_BOTTOM = 1 << 4;
+
+global_var constexpr U32 CLIP_CODE_GUARD_LEFT   = 1 << 5;
+global_var constexpr U32 CLIP_CODE_GUARD_RIGHT  = 1 << 6;
+global_var constexpr U32 CLIP_CODE_GUARD_TOP    = 1 << 7;
+global_var constexpr U32 CLIP_CODE_GUARD_BOTTOM = 1 << 8;
+
+// NOTE: Triangle with all vertexes outside of the same one of those is invisible.
+global_var constexpr U32 CLIP_CODE_REJECT_MASK = CLIP_CODE_NEAR | CLIP_CODE_SCREEN_LEFT | CLIP_CODE_SCREEN_RIGHT | CLIP_CODE_SCREEN_TOP | CLIP_CODE_SCREEN_BOTTOM;
+
+// NOTE: Triangle with any vertex outside of one of those has to be clipped.
+global_var constexpr U32 CLIP_CODE_CLIP_MASK = CLIP_CODE_NEAR | CLIP_CODE_GUARD_LEFT | CLIP_CODE_GUARD_RIGHT | CLIP_CODE_GUARD_TOP | CLIP_CODE_GUARD_BOTTOM;
+
+struct Clip_Vertex {
+    F32 x = 0, y = 0, z = 0;
+    F32 varyings[RASTER_MAX_VARYINGS]{};
+};
+
+//
+// Signed distance to the clip plane, vertex is inside if it's not negative.
+//
+struct Clip_Plane {
+    F32 x = 0, y = 0, z = 0, w = 0;
+
+    constexpr F32
+    distance(Clip_Vertex v) const noexcept
+    {
+        return this->x * v.x + this->y * v.y + this->z * v.z + this->w;
+    }
+};
+
+#define CLIP_PLANES_COUNT 5
+#define CLIP_MAX_VERTEXES (3 + CLIP_PLANES_COUNT)
+
+static U32
+clip_code(Clip_Vertex v, V2 screen_size, F32 near_depth)
+{
+    U32 code = 0;
+
+    code |= v.z < near_depth ? CLIP_CODE_NEAR : 0;
+
+    code |= v.x < 0             ? CLIP_CODE_SCREEN_LEFT   : 0;
+    code |= v.x > screen_size.x ? CLIP_CODE_SCREEN_RIGHT  : 0;
+    code |= v.y < 0             ? CLIP_CODE_SCREEN_TOP    : 0;
+    code |= v.y > screen_size.y ? CLIP_CODE_SCREEN_BOTTOM : 0;
+
+    code |= v.x < -CLIP_GUARD_BAND                 ? CLIP_CODE_GUARD_LEFT   : 0;
+    code |= v.x > screen_size.x + CLIP_GUARD_BAND  ? CLIP_CODE_GUARD_RIGHT  : 0;
+    code |= v.y < -CLIP_GUARD_BAND                 ? CLIP_CODE_GUARD_TOP    : 0;
+    code |= v.y > screen_size.y + CLIP_GUARD_BAND  ? CLIP_CODE_GUARD_BOTTOM : 0;
+
+    return code;
+}
+
+//
+// Sutherland-Hodgman against single plane. Returns number of vertexes written
+// into `out`.
+//
+static S32
+clip_polygon(const Clip_Vertex *in, S32 count, Clip_Plane plane, Clip_Vertex *out)
+{
+    S32 out_count = 0;
+
+    for (S32 i = 0; i < count; ++i) {
+        Clip_Vertex a = in[i];
+        Clip_Vertex b = in[(i + 1) % count];
+
+        F32 da = plane.distance(a);
+        F32 db = plane.distance(b);
+
+        if (da >= 0) {
+            out[out_count++] = a;
+        }
+
+        if ((da >= 0) != (db >= 0)) {
+            // NOTE: Always interpolating from inside vertex to the outside
+            // one, so edge shared by two triangles is cut at the exact same
+            // point for both of them and no cracks are showing up.
+            Clip_Vertex inside = da >= 0 ? a : b;
+            Clip_Vertex outside = da >= 0 ? b : a;
+            F32 d_inside = da >= 0 ? da : db;
+            F32 d_outside = da >= 0 ? db : da;
+
+            F32 t = d_inside / (d_inside - d_outside);
+
+            Clip_Vertex *v = &out[out_count++];
+            v->x = inside.x + (outside.x - inside.x) * t;
+            v->y = inside.y + (outside.y - inside.y) * t;
+            v->z = inside.z + (outside.z - inside.z) * t;
+
+            for (S32 k = 0; k < RASTER_MAX_VARYINGS; ++k) {
+                v->varyings[k] = inside.varyings[k] + (outside.varyings[k] - inside.varyings[k]) * t;
+            }
+        }
+    }
+
+    return out_count;
+}
+
+static void
+clip_triangle_push(Basic_Renderer *r, const Raster_Triangle *t, Clip_Vertex a, Clip_Vertex b, Clip_Vertex c, V2 screen_size)
+{
+    Raster_Triangle result{};
+    result.color = t->color;
+    result.texture = t->texture;
+    result.material = t->material;
+    result.varyings_count = t->varyings_count;
+
+    Clip_Vertex vertexes[3] = {a, b, c};
+
+    for (S32 k = 0; k < 3; ++k) {
+        result.vertexes[k] = { vertexes[k].x, vertexes[k].y };
+        result.depths[k] = vertexes[k].z;
+        std::copy(vertexes[k].varyings, vertexes[k].varyings + RASTER_MAX_VARYINGS, result.varyings[k]);
+    }
+
+    if (raster_triangle_setup(&result, r->raster_mode, screen_size)) {
+        // NOTE: Samples are up to half of the pixel away from it's center,
+        // so pixels right after the max corner could be covered too.
+        if (r->samples_count > 1) {
+            result.bb.w = std::min(result.bb.w + 1, static_cast<S32>(r->pixels_width));
+            result.bb.h = std::min(result.bb.h + 1, static_cast<S32>(r->pixels_height));
+        }
+
+        if (!r->triangles.push_back(result)) {
+            r->out_of_memory = true;
+        }
+    }
+}
+
+void
+clip_triangle(Basic_Renderer *r, const Raster_Triangle *t)
+{
+    V2 screen_size { static_cast<F32>(r->pixels_width), static_cast<F32>(r->pixels_height) };
+
+    Clip_Vertex vertexes[3]{};
+    U32 codes[3]{};
+
+    for (S32 k = 0; k < 3; ++k) {
+        vertexes[k].x = t->vertexes[k].x;
+        vertexes[k].y = t->vertexes[k].y;
+        vertexes[k].z = t->depths[k];
+        std::copy(t->varyings[k], t->varyings[k] + RASTER_MAX_VARYINGS, vertexes[k].varyings);
+        codes[k] = clip_code(vertexes[k], screen_size, r->near_depth);
+    }
+
+    if (codes[0] & codes[1] & codes[2] & CLIP_CODE_REJECT_MASK) {
+        ++r->stats.triangles_culled;
+        return;
+    }
+
+    // NOTE: Y goes down on the screen, so positive cross product is
+    // clockwise. In fixed point mode winding is taken from snapped vertexes,
+    // same ones rasterizer will see, because tiny triangles could flip while
+    // snapping.
+    bool clockwise = false;
+    bool degenerate = false;
+
+    if (r->raster_mode == RASTER_MODE_FIXED && !((codes[0] | codes[1] | codes[2]) & CLIP_CODE_CLIP_MASK)) {
+        S64 x[3]{}, y[3]{};
+
+        for (S32 k = 0; k < 3; ++k) {
+            x[k] = snap_to_fixed(vertexes[k].x);
+            y[k] = snap_to_fixed(vertexes[k].y);
+        }
+
+        S64 cross = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        clockwise = cross > 0;
+        degenerate = cross == 0;
+    } else {
+        V2 d1 = t->vertexes[1] - t->vertexes[0];
+        V2 d2 = t->vertexes[2] - t->vertexes[0];
+        F32 cross = d1.x * d2.y - d1.y * d2.x;
+
+        clockwise = cross > 0;
+        degenerate = cross == 0;
+    }
+
+    const Draw_Material *material = t->material;
+    bool front_facing = clockwise == (material->front_face == FRONT_FACE_CW);
+
+    if (degenerate
+        || (material->cull_mode == CULL_MODE_BACK && !front_facing)
+        || (material->cull_mode == CULL_MODE_FRONT && front_facing)) {
+        ++r->stats.triangles_culled;
+        return;
+    }
+
+    // NOTE: Rasterizer only takes clockwise triangles.
+    if (!clockwise) {
+        std::swap(vertexes[1], vertexes[2]);
+        std::swap(codes[1], codes[2]);
+    }
+
+    if (((codes[0] | codes[1] | codes[2]) & CLIP_CODE_CLIP_MASK) == 0) {
+        clip_triangle_push(r, t, vertexes[0], vertexes[1], vertexes[2], screen_size);
+        return;
+    }
+
+    ++r->stats.triangles_clipped;
+
+    Clip_Plane planes[CLIP_PLANES_COUNT] = {
+        { 0,  0, 1, -r->near_depth },
+        { 1,  0, 0, CLIP_GUARD_BAND },
+        {-1,  0, 0, screen_size.x + CLIP_GUARD_BAND },
+        { 0,  1, 0, CLIP_GUARD_BAND },
+        { 0, -1, 0, screen_size.y + CLIP_GUARD_BAND },
+    };
+
+    U32 plane_codes[CLIP_PLANES_COUNT] = {
+        CLIP_CODE_NEAR,
+        CLIP_CODE_GUARD_LEFT,
+        CLIP_CODE_GUARD_RIGHT,
+        CLIP_CODE_GUARD_TOP,
+        CLIP_CODE_GUARD_BOTTOM,
+    };
+
+    Clip_Vertex buffers[2][CLIP_MAX_VERTEXES]{};
+    Clip_Vertex *polygon = buffers[0];
+    S32 count = 3;
+
+    std::copy(vertexes, vertexes + 3, polygon);
+
+    U32 any_code = codes[0] | codes[1] | codes[2];
+
+    for (S32 i = 0; i < CLIP_PLANES_COUNT && count >= 3; ++i) {
+        // NOTE: Planes which no vertex is crossing are not cutting anything.
+        if (!(any_code & plane_codes[i])) {
+            continue;
+        }
+
+        Clip_Vertex *out = polygon == buffers[0] ? buffers[1] : buffers[0];
+        count = clip_polygon(polygon, count, planes[i], out);
+        polygon = out;
+    }
+
+    // NOTE: Clipped polygon is convex, so it's fanned out from the first
+    // vertex.
+    for (S32 i = 1; i + 1 < count; ++i) {
+        clip_triangle_push(r, t, polygon[0], polygon[i], polygon[i + 1], screen_size);
+    }
+}
+
+//
+// Trivial accept and reject of raster blocks.
+//
+// Inside of a block edge value is `(block + step_y[ky]) + step_x[kx]`, and
+// every step of it is monotonic in `kx` and `ky` (rounding is monotonic too),
+// so smallest and largest values of the whole block are exactly the ones at
+// it's corners. Checking those corners gives same answer as checking every
+// pixel. Same goes for depth, which is stepped the same way.
+//
+
+enum Block_Coverage : U8 {
+    BLOCK_COVERAGE_NONE,
+    BLOCK_COVERAGE_PARTIAL,
+    BLOCK_COVERAGE_FULL,
+};
+
+struct Block_Corners {
+    S32 min_kx[3]{}, min_ky[3]{};
+    S32 max_kx[3]{}, max_ky[3]{};
+
+    S32 z_near_kx = 0, z_near_ky = 0;
+};
+
+struct Raster_Block_Setup {
+    Raster_Span_Setup span{};
+
+    F32 step_y[3][RASTER_BLOCK_SIZE]{};
+    F32 step_z_y[RASTER_BLOCK_SIZE]{};
+
+    S64 fixed_step_y[3][RASTER_BLOCK_SIZE]{};
+    S64 fixed_min_offset[3]{};  // NOTE: Offsets of smallest and largest edge values in the block from it's origin.
+    S64 fixed_max_offset[3]{};
+
+    Block_Corners corners{};
+
+    F32 step_v_x[RASTER_MAX_VARYINGS][RASTER_BLOCK_SIZE]{};
+    F32 step_v_y[RASTER_MAX_VARYINGS][RASTER_BLOCK_SIZE]{};
+
+    Texture_Sampler sampler{};  // NOTE: Textured triangles only.
+
+    // NOTE: Multisampling only. Differences of edge and depth values at
+    // every sample from the ones at the pixel center.
+    U32 samples_count = 1;
+    F32 sample_e[MSAA_MAX_SAMPLES][3]{};
+    S64 sample_fixed_e[MSAA_MAX_SAMPLES][3]{};
+    F32 sample_z[MSAA_MAX_SAMPLES]{};
+
+    Raster_Span_Proc span_proc = nullptr;
+    Raster_Span_Fixed_Proc span_fixed_proc = nullptr;
+    Raster_Fill_Proc fill_proc = nullptr;
+    Raster_Samples_Proc samples_proc = nullptr;
+};
+
+static inline Block_Coverage
+classify_block(const Raster_Block_Setup *s, const F32 block[3])
+{
+    const Block_Corners *c = &s->corners;
+    bool full = true;
+
+    for (S32 i = 0; i < 3; ++i) {
+        F32 min_value = (block[i] + s->step_y[i][c->min_ky[i]]) + s->span.step_x[i][c->min_kx[i]];
+        F32 max_value = (block[i] + s->step_y[i][c->max_ky[i]]) + s->span.step_x[i][c->max_kx[i]];
+
+        if (!edge_inside(min_value, s->span.top_left[i])) {
+            return BLOCK_COVERAGE_NONE;
+        }
+
+        full = full && edge_inside(max_value, s->span.top_left[i]);
+    }
+
+    return full ? BLOCK_COVERAGE_FULL : BLOCK_COVERAGE_PARTIAL;
+}
+
+static inline Block_Coverage
+classify_block_fixed(const Raster_Block_Setup *s, const S64 block[3])
+{
+    bool full = true;
+
+    for (S32 i = 0; i < 3; ++i) {
+        if (block[i] + s->fixed_min_offset[i] >= 0) {
+            return BLOCK_COVERAGE_NONE;
+        }
+
+        full = full && block[i] + s->fixed_max_offset[i] < 0;
+    }
+
+    return full ? BLOCK_COVERAGE_FULL : BLOCK_COVERAGE_PARTIAL;
+}
+
+//
+// NOTE: Written so it's picking same values as `_mm_max_ps` and `_mm_min_ps`
+// do, including signed zeroes. Otherwise depth buffers of scalar and SIMD
+// kernels will differ.
+//
+static inline F32
+clamp_depth(F32 z, F32 z_min, F32 z_max)
+{
+    z = z > z_min ? z : z_min;
+    return z < z_max ? z : z_max;
+}
+
+static F32
+hi_z_block_far(const Basic_Renderer *r, S32 block_x, S32 block_y)
+{
+    S32 kx_end = std::min(RASTER_BLOCK_SIZE, static_cast<S32>(r->pixels_width) - block_x);
+    S32 ky_end = std::min(RASTER_BLOCK_SIZE, static_cast<S32>(r->pixels_height) - block_y);
+    USZ offset = pixel_offset(r, block_x, block_y);
+    U32 pitch = block_row_pitch(r);
+
+    USZ planes_stride = framebuffer_plane_size(r);
+
+    // NOTE: Every lane keeps it's own max, so whole rows are vectorized. With
+    // multisampling blocks are mostly partially covered, so if plane still has
+    // cleared depth, the rest of planes are not read.
+    F32 lanes_far[RASTER_BLOCK_SIZE];
+    std::fill_n(lanes_far, RASTER_BLOCK_SIZE, -DEPTH_CLEAR_VALUE);
+
+    F32 far = -DEPTH_CLEAR_VALUE;
+
+    for (U32 sample = 0; sample < r->samples_count && far != DEPTH_CLEAR_VALUE; ++sample) {
+        for (S32 ky = 0; ky < ky_end; ++ky) {
+            const F32 *depths = r->depth_buffer + sample * planes_stride + offset + ky * pitch;
+
+            if (kx_end == RASTER_BLOCK_SIZE) {
+                for (S32 kx = 0; kx < RASTER_BLOCK_SIZE; ++kx) {
+                    lanes_far[kx] = std::max(lanes_far[kx], depths[kx]);
+                }
+            } else {
+                for (S32 kx = 0; kx < kx_end; ++kx) {
+                    lanes_far[kx] = std::max(lanes_far[kx], depths[kx]);
+                }
+            }
+        }
+
+        far = lanes_far[0];
+
+        for (S32 kx = 1; kx < RASTER_BLOCK_SIZE; ++kx) {
+            far = std::max(far, lanes_far[kx]);
+        }
+    }
+
+    return far;
+}
+
+static F32
+hi_z_tile_far(const Basic_Renderer *r, S32 tile_x, S32 tile_y)
+{
+    const Hi_Z_Buffer *hz = &r->hi_z;
+    constexpr S32 BLOCKS_PER_TILE = TILE_SIZE / RASTER_BLOCK_SIZE;
+
+    S32 bx_begin = tile_x * BLOCKS_PER_TILE;
+    S32 by_begin = tile_y * BLOCKS_PER_TILE;
+    S32 bx_end = std::min(bx_begin + BLOCKS_PER_TILE, hz->blocks_x);
+    S32 by_end = std::min(by_begin + BLOCKS_PER_TILE, hz->blocks_y);
+
+    F32 far = -DEPTH_CLEAR_VALUE;
+
+    for (S32 by = by_begin; by < by_end; ++by) {
+        for (S32 bx = bx_begin; bx < bx_end; ++bx) {
+            far = std::max(far, hz->blocks[get_offset(hz->blocks_x, by, bx)]);
+        }
+    }
+
+    return far;
+}
+
+//
+// Overwrites flat color of `written` lanes of the span with texels. Depth test
+// is already done by span kernel.
+//
+static void
+raster_texture_span(Color4 *pixels, const Raster_Block_Setup *s, const F32 *row, U32 written)
+{
+    while (written != 0) {
+        S32 kx = std::countr_zero(written);
+        written &= written - 1;
+
+        V2 uv{row[0] + s->step_v_x[0][kx], row[1] + s->step_v_x[1][kx]};
+        pixels[kx] = std::bit_cast<Color4>(texture_sampler_sample(&s->sampler, uv));
+    }
+}
+
+//
+// Same as `raster_texture_span`, but with the shader's pixel stage, which is
+// inlined right here.
+//
+template<typename Shader>
+static inline void
+raster_shade_span(Color4 *pixels, const Raster_Block_Setup *s, const Shader *shader, const F32 *row, U32 written)
+{
+    constexpr U32 VARYINGS_COUNT = Shader::VARYINGS_COUNT;
+    static_assert(VARYINGS_COUNT <= RASTER_MAX_VARYINGS);
+
+    while (written != 0) {
+        S32 kx = std::countr_zero(written);
+        written &= written - 1;
+
+        F32 varyings[VARYINGS_COUNT];
+
+        for (U32 i = 0; i < VARYINGS_COUNT; ++i) {
+            varyings[i] = row[i] + s->step_v_x[i][kx];
+        }
+
+        pixels[kx] = shader->fragment(varyings);
+    }
+}
+
+//
+// Pixel stage of `render_mesh`: flat color, which span kernels are already
+// writing, or texture.
+//
+struct Raster_Flat_Shader {
+    static constexpr U32 VARYINGS_COUNT = 0;
+
+    Color4
+    fragment([[maybe_unused]] const F32 *varyings) const
+    {
+        return {};
+    }
+};
+
+//
+// Runs span kernels over rows of the block with edge values `block` (or
+// `fixed_block`) and depth `z_block` at it's origin. `pixels` and `depths` are
+// pointing at the origin of the block. Writes lanes which were written in every
+// row into `rows_written`, returns true if any was.
+//
+static inline bool
+raster_block_rows(const Raster_Triangle *t, const Raster_Block_Setup *s, Block_Coverage coverage, const F32 block[3], const S64 fixed_block[3], F32 z_block,
+                  Color4 *pixels, F32 *depths, S32 pitch, S32 ky_begin, S32 ky_end, S32 kx_begin, S32 kx_end, bool whole_span, U32 rows_written[RASTER_BLOCK_SIZE])
+{
+    bool written = false;
+
+    for (S32 ky = ky_begin; ky < ky_end; ++ky) {
+        Color4 *row_pixels = pixels + ky * pitch;
+        F32 *row_depths = depths + ky * pitch;
+
+        F32 z = z_block + s->step_z_y[ky];
+        U32 written_lanes = 0;
+
+        if (coverage == BLOCK_COVERAGE_FULL) {
+            written_lanes = s->fill_proc(row_pixels, row_depths, &s->span, z, kx_begin, kx_end, whole_span);
+        } else if (t->fixed) {
+            S32 fe[3]{};
+
+            for (S32 i = 0; i < 3; ++i) {
+                // NOTE: Edges which are covering whole block are not
+                // fitting into 32 bits, but they are not needed to be
+                // tested anyway. Keeping them far enough below zero.
+                if (fixed_block[i] + s->fixed_max_offset[i] < 0) {
+                    fe[i] = std::numeric_limits<S32>::min() / 2;
+                } else {
+                    fe[i] = static_cast<S32>(fixed_block[i] + s->fixed_step_y[i][ky]);
+                }
+            }
+
+            written_lanes = s->span_fixed_proc(row_pixels, row_depths, &s->span, fe[0], fe[1], fe[2], z, kx_begin, kx_end, whole_span);
+        } else {
+            F32 e0 = block[0] + s->step_y[0][ky];
+            F32 e1 = block[1] + s->step_y[1][ky];
+            F32 e2 = block[2] + s->step_y[2][ky];
+
+            written_lanes = s->span_proc(row_pixels, row_depths, &s->span, e0, e1, e2, z, kx_begin, kx_end, whole_span);
+        }
+
+        rows_written[ky] = written_lanes;
+        written |= written_lanes != 0;
+    }
+
+    return written;
+}
+
+//
+// Multisampled version of the block loop body of `raster_tile_blocks`. Samples
+// which can't be covered or can't pass depth test in this block are dropped up
+// front, then every row goes through `Raster_Samples_Proc` once, which is all
+// for flat triangles. Otherwise pixel stage runs once for the pixels which any
+// sample passed, and it's color is written into those samples only. Returns
+// true if any sample was written.
+//
+template<typename Shader>
+static bool
+raster_block_samples(Basic_Renderer *r, const Raster_Triangle *t, const Raster_Block_Setup *s, const Shader *shader, S32 block_x, S32 block_y,
+                     const F32 block[3], const S64 fixed_block[3], F32 z_block, F32 block_far,
+                     S32 ky_begin, S32 ky_end, S32 kx_begin, S32 kx_end, bool whole_span)
+{
+    const Block_Corners *c = &s->corners;
+
+    USZ planes_stride = framebuffer_plane_size(r);
+    USZ offset = pixel_offset(r, block_x, block_y);
+    S32 pitch = static_cast<S32>(block_row_pitch(r));
+
+    F32 block_samples[MSAA_MAX_SAMPLES][3]{};
+    S64 fixed_block_samples[MSAA_MAX_SAMPLES][3]{};
+    F32 z_samples[MSAA_MAX_SAMPLES]{};
+
+    Raster_Samples_Row row{};
+    row.fixed = t->fixed;
+    row.flat = Shader::VARYINGS_COUNT == 0 && t->texture == nullptr;
+
+    for (U32 sample = 0; sample < s->samples_count; ++sample) {
+        z_samples[sample] = z_block + s->sample_z[sample];
+        F32 z_near = clamp_depth((z_samples[sample] + s->step_z_y[c->z_near_ky]) + s->span.step_z[c->z_near_kx], t->z_min, t->z_max);
+
+        if (z_near >= block_far) {
+            continue;
+        }
+
+        for (S32 i = 0; i < 3; ++i) {
+            block_samples[sample][i] = block[i] + s->sample_e[sample][i];
+            fixed_block_samples[sample][i] = fixed_block[i] + s->sample_fixed_e[sample][i];
+        }
+
+        Block_Coverage coverage = t->fixed ? classify_block_fixed(s, fixed_block_samples[sample]) : classify_block(s, block_samples[sample]);
+
+        if (coverage != BLOCK_COVERAGE_NONE) {
+            row.samples |= 1U << sample;
+        }
+
+        if (coverage == BLOCK_COVERAGE_FULL) {
+            row.full |= 1U << sample;
+        }
+    }
+
+    if (row.samples == 0) {
+        return false;
+    }
+
+    U32 rows_samples[RASTER_BLOCK_SIZE][MSAA_MAX_SAMPLES];
+    U32 rows_any[RASTER_BLOCK_SIZE]{};
+    bool written = false;
+
+    for (S32 ky = ky_begin; ky < ky_end; ++ky) {
+        for (U32 samples = row.samples; samples != 0; samples &= samples - 1) {
+            U32 sample = std::countr_zero(samples);
+
+            row.z[sample] = z_samples[sample] + s->step_z_y[ky];
+
+            for (S32 i = 0; i < 3; ++i) {
+                if (!t->fixed) {
+                    row.e[sample][i] = block_samples[sample][i] + s->step_y[i][ky];
+                } else if (fixed_block_samples[sample][i] + s->fixed_max_offset[i] < 0) {
+                    // NOTE: Same as in `raster_block_rows`, edges covering whole
+                    // block are kept far enough below zero to fit into 32 bits.
+                    row.fixed_e[sample][i] = std::numeric_limits<S32>::min() / 2;
+                } else {
+                    row.fixed_e[sample][i] = static_cast<S32>(fixed_block_samples[sample][i] + s->fixed_step_y[i][ky]);
+                }
+            }
+        }
+
+        rows_any[ky] = s->samples_proc(r->samples_buffer + offset + ky * pitch, r->depth_buffer + offset + ky * pitch, planes_stride, &s->span, &row, kx_begin, kx_end, whole_span, rows_samples[ky]);
+        written |= rows_any[ky] != 0;
+    }
+
+    if (!written || row.flat) {
+        return written;
+    }
+
+    F32 v_block[RASTER_MAX_VARYINGS]{};
+
+    for (U32 i = 0; i < t->varyings_count; ++i) {
+        v_block[i] = t->varyings[0][i] + t->dv_dx[i] * (static_cast<F32>(block_x) - t->vertexes[0].x)
+                                       + t->dv_dy[i] * (static_cast<F32>(block_y) - t->vertexes[0].y);
+    }
+
+    for (S32 ky = ky_begin; ky < ky_end; ++ky) {
+        if (rows_any[ky] == 0) {
+            continue;
+        }
+
+        // NOTE: Shaded once at the pixel center, then copied into samples
+        // which passed.
+        Color4 shaded[RASTER_BLOCK_SIZE]{};
+        F32 v_row[RASTER_MAX_VARYINGS]{};
+
+        for (U32 i = 0; i < t->varyings_count; ++i) {
+            v_row[i] = v_block[i] + s->step_v_y[i][ky];
+        }
+
+        if constexpr (Shader::VARYINGS_COUNT != 0) {
+            raster_shade_span(shaded, s, shader, v_row, rows_any[ky]);
+        } else {
+            raster_texture_span(shaded, s, v_row, rows_any[ky]);
+        }
+
+        for (U32 samples = row.samples; samples != 0; samples &= samples - 1) {
+            U32 sample = std::countr_zero(samples);
+            U32 lanes = rows_samples[ky][sample];
+            U32 *pixels = reinterpret_cast<U32 *>(r->samples_buffer + sample * planes_stride + offset + ky * pitch);
+
+            if (lanes == 0) {
+                continue;
+            }
+
+            // NOTE: Whole span is selected branchless, which vectorizes.
+            if (whole_span) {
+                for (S32 kx = 0; kx < RASTER_BLOCK_SIZE; ++kx) {
+                    U32 keep = ((lanes >> kx) & 1) - 1;
+                    pixels[kx] = (pixels[kx] & keep) | (std::bit_cast<U32>(shaded[kx]) & ~keep);
+                }
+
+                continue;
+            }
+
+            for (; lanes != 0; lanes &= lanes - 1) {
+                S32 kx = std::countr_zero(lanes);
+                pixels[kx] = std::bit_cast<U32>(shaded[kx]);
+            }
+        }
+    }
+
+    return true;
+}
+
+//
+// Rasterizes part of the triangle, which is inside of single tile. Returns
+// true if any pixel was written.
+//
+template<typename Shader>
+static bool
+raster_tile_blocks(Basic_Renderer *r, const Raster_Triangle *t, const Raster_Block_Setup *s, const Shader *shader, S32 x_begin, S32 y_begin, S32 x_end, S32 y_end)
+{
+    const Edge_Function *e = t->edges;
+    const Block_Corners *c = &s->corners;
+    Hi_Z_Buffer *hz = &r->hi_z;
+
+    bool written_any = false;
+
+    S32 block_x_begin = x_begin & ~(RASTER_BLOCK_SIZE - 1);
+    S32 block_y_begin = y_begin & ~(RASTER_BLOCK_SIZE - 1);
+
+    for (S32 block_y = block_y_begin; block_y < y_end; block_y += RASTER_BLOCK_SIZE) {
+        S32 ky_begin = std::max(y_begin - block_y, 0);
+        S32 ky_end = std::min(y_end - block_y, RASTER_BLOCK_SIZE);
+
+        for (S32 block_x = block_x_begin; block_x < x_end; block_x += RASTER_BLOCK_SIZE) {
+            S32 kx_begin = std::max(x_begin - block_x, 0);
+            S32 kx_end = std::min(x_end - block_x, RASTER_BLOCK_SIZE);
+            // NOTE: Pitch is padded to whole spans (and tiled rows are whole
+            // blocks), so this always holds, lanes past the width are going
+            // into the padding.
+            bool whole_span = block_x + RASTER_BLOCK_SIZE <= static_cast<S32>(r->pixels_pitch);
+
+            F32 *block_far = &hz->blocks[get_offset(hz->blocks_x, block_y / RASTER_BLOCK_SIZE, block_x / RASTER_BLOCK_SIZE)];
+
+            F32 z_block = t->depths[0] + t->dz_dx * (static_cast<F32>(block_x) - t->vertexes[0].x)
+                                       + t->dz_dy * (static_cast<F32>(block_y) - t->vertexes[0].y);
+            // NOTE: With multisampling samples are nearer or farther than
+            // the pixel centers, so they are tested one by one.
+            if (s->samples_count == 1) {
+                F32 z_near = clamp_depth((z_block + s->step_z_y[c->z_near_ky]) + s->span.step_z[c->z_near_kx], t->z_min, t->z_max);
+
+                if (z_near >= *block_far) {
+                    continue;
+                }
+            }
+
+            F32 block[3]{};
+            S64 fixed_block[3]{};
+            Block_Coverage coverage = BLOCK_COVERAGE_NONE;
+
+            if (t->fixed) {
+                for (S32 i = 0; i < 3; ++i) {
+                    const Edge_Function_Fixed *fe = &t->fixed_edges[i];
+                    fixed_block[i] = fe->a * (static_cast<S64>(block_x) * SUBPIXEL_ONE - fe->origin_x)
+                                   + fe->b * (static_cast<S64>(block_y) * SUBPIXEL_ONE - fe->origin_y)
+                                   - fe->bias;
+                }
+
+                coverage = s->samples_count == 1 ? classify_block_fixed(s, fixed_block) : BLOCK_COVERAGE_PARTIAL;
+            } else {
+                for (S32 i = 0; i < 3; ++i) {
+                    block[i] = e[i].a * (static_cast<F32>(block_x) - e[i].origin.x)
+                             + e[i].b * (static_cast<F32>(block_y) - e[i].origin.y);
+                }
+
+                coverage = s->samples_count == 1 ? classify_block(s, block) : BLOCK_COVERAGE_PARTIAL;
+            }
+
+            if (s->samples_count > 1) {
+                if (raster_block_samples(r, t, s, shader, block_x, block_y, block, fixed_block, z_block, *block_far,
+                                         ky_begin, ky_end, kx_begin, kx_end, whole_span)) {
+                    *block_far = hi_z_block_far(r, block_x, block_y);
+                    written_any = true;
+                }
+
+                continue;
+            }
+
+            if (coverage == BLOCK_COVERAGE_NONE) {
+                continue;
+            }
+
+            F32 v_block[RASTER_MAX_VARYINGS]{};
+
+            for (U32 i = 0; i < t->varyings_count; ++i) {
+                v_block[i] = t->varyings[0][i] + t->dv_dx[i] * (static_cast<F32>(block_x) - t->vertexes[0].x)
+                                               + t->dv_dy[i] * (static_cast<F32>(block_y) - t->vertexes[0].y);
+            }
+
+            USZ offset = pixel_offset(r, block_x, block_y);
+            S32 pitch = static_cast<S32>(block_row_pitch(r));
+            U32 rows_written[RASTER_BLOCK_SIZE]{};
+
+            bool written = raster_block_rows(t, s, coverage, block, fixed_block, z_block,
+                                             static_cast<Color4 *>(r->pixels_buffer) + offset, r->depth_buffer + offset, pitch,
+                                             ky_begin, ky_end, kx_begin, kx_end, whole_span, rows_written);
+
+            if (written && t->varyings_count != 0) {
+                for (S32 ky = ky_begin; ky < ky_end; ++ky) {
+                    if (rows_written[ky] == 0) {
+                        continue;
+                    }
+
+                    Color4 *pixels = static_cast<Color4 *>(r->pixels_buffer) + offset + ky * pitch;
+                    F32 row[RASTER_MAX_VARYINGS]{};
+
+                    for (U32 i = 0; i < t->varyings_count; ++i) {
+                        row[i] = v_block[i] + s->step_v_y[i][ky];
+                    }
+
+                    if constexpr (Shader::VARYINGS_COUNT != 0) {
+                        raster_shade_span(pixels, s, shader, row, rows_written[ky]);
+                    } else if (t->texture != nullptr) {
+                        raster_texture_span(pixels, s, row, rows_written[ky]);
+                    }
+                }
+            }
+
+            if (written) {
+                *block_far = hi_z_block_far(r, block_x, block_y);
+                written_any = true;
+            }
+        }
+    }
+
+    return written_any;
+}
+
+// NOTE: Standard sample positions, in 1/16 of the pixel from it's center,
+// so they are exact in fixed point.
+global_var constexpr S32 MSAA_4X_OFFSETS[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+global_var constexpr S32 MSAA_8X_OFFSETS[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+
+template<typename Shader>
+static void
+raster_triangle_shaded(Basic_Renderer *r, const Raster_Triangle *t, R32 clip, const Shader *shader)
+{
+    // NOTE: `clip` is regular rectangle, while `t->bb` keeps max corner in `w`
+    // and `h`.
+    S32 x_begin = std::max(t->bb.x, clip.x);
+    S32 y_begin = std::max(t->bb.y, clip.y);
+    S32 x_end = std::min(t->bb.w, clip.x + clip.w);
+    S32 y_end = std::min(t->bb.h, clip.y + clip.h);
+
+    if (x_begin >= x_end || y_begin >= y_end) {
+        return;
+    }
+
+    clear_tiles_under(r, x_begin, y_begin, x_end, y_end);
+
+    const Edge_Function *e = t->edges;
+
+    Raster_Block_Setup s{};
+    s.span_proc = RASTER_SPAN_PROCS[r->isa];
+    s.span_fixed_proc = RASTER_SPAN_FIXED_PROCS[r->isa];
+    s.fill_proc = RASTER_FILL_PROCS[r->isa];
+    s.samples_proc = RASTER_SAMPLES_PROCS[r->isa];
+
+    if (t->fixed) {
+        for (S32 i = 0; i < 3; ++i) {
+            const Edge_Function_Fixed *fe = &t->fixed_edges[i];
+
+            for (S32 k = 0; k < RASTER_BLOCK_SIZE; ++k) {
+                s.span.fixed_step_x[i][k] = static_cast<S32>(fe->a * SUBPIXEL_ONE * k);
+                s.fixed_step_y[i][k] = fe->b * SUBPIXEL_ONE * k;
+            }
+
+            S64 last_x = fe->a * SUBPIXEL_ONE * (RASTER_BLOCK_SIZE - 1);
+            S64 last_y = fe->b * SUBPIXEL_ONE * (RASTER_BLOCK_SIZE - 1);
+
+            s.fixed_min_offset[i] = std::min<S64>(last_x, 0) + std::min<S64>(last_y, 0);
+            s.fixed_max_offset[i] = std::max<S64>(last_x, 0) + std::max<S64>(last_y, 0);
+        }
+    }
+
+    for (S32 i = 0; i < 3; ++i) {
+        s.span.top_left[i] = e[i].top_left ? MAX_U32 : 0;
+
+        for (S32 k = 0; k < RASTER_BLOCK_SIZE; ++k) {
+            s.span.step_x[i][k] = e[i].a * static_cast<F32>(k);
+            s.step_y[i][k] = e[i].b * static_cast<F32>(k);
+        }
+    }
+
+    for (S32 k = 0; k < RASTER_BLOCK_SIZE; ++k) {
+        s.span.step_z[k] = t->dz_dx * static_cast<F32>(k);
+        s.step_z_y[k] = t->dz_dy * static_cast<F32>(k);
+    }
+
+    s.span.z_min = t->z_min;
+    s.span.z_max = t->z_max;
+    s.span.color = t->color;
+
+    for (U32 i = 0; i < t->varyings_count; ++i) {
+        for (S32 k = 0; k < RASTER_BLOCK_SIZE; ++k) {
+            s.step_v_x[i][k] = t->dv_dx[i] * static_cast<F32>(k);
+            s.step_v_y[i][k] = t->dv_dy[i] * static_cast<F32>(k);
+        }
+    }
+
+    if (t->texture != nullptr) {
+        s.sampler = make_texture_sampler(t->texture, t->material->texture_filter, t->texture_lod);
+    }
+
+    constexpr S32 LAST = RASTER_BLOCK_SIZE - 1;
+
+    for (S32 i = 0; i < 3; ++i) {
+        s.corners.max_kx[i] = e[i].a > 0 ? LAST : 0;
+        s.corners.max_ky[i] = e[i].b > 0 ? LAST : 0;
+        s.corners.min_kx[i] = LAST - s.corners.max_kx[i];
+        s.corners.min_ky[i] = LAST - s.corners.max_ky[i];
+    }
+
+    s.corners.z_near_kx = t->dz_dx > 0 ? 0 : LAST;
+    s.corners.z_near_ky = t->dz_dy > 0 ? 0 : LAST;
+
+    s.samples_count = r->samples_count;
+
+    if (r->samples_count > 1) {
+        const S32 (*offsets)[2] = r->samples_count == 4 ? MSAA_4X_OFFSETS : MSAA_8X_OFFSETS;
+
+        for (U32 k = 0; k < r->samples_count; ++k) {
+            F32 x = static_cast<F32>(offsets[k][0]) / SUBPIXEL_ONE;
+            F32 y = static_cast<F32>(offsets[k][1]) / SUBPIXEL_ONE;
+
+            for (S32 i = 0; i < 3; ++i) {
+                s.sample_e[k][i] = e[i].a * x + e[i].b * y;
+
+                if (t->fixed) {
+                    s.sample_fixed_e[k][i] = t->fixed_edges[i].a * offsets[k][0] + t->fixed_edges[i].b * offsets[k][1];
+                }
+            }
+
+            s.sample_z[k] = t->dz_dx * x + t->dz_dy * y;
+        }
+    }
+
+    S32 tile_x_begin = x_begin / TILE_SIZE;
+    S32 tile_y_begin = y_begin / TILE_SIZE;
+    S32 tile_x_end = (x_end - 1) / TILE_SIZE;
+    S32 tile_y_end = (y_end - 1) / TILE_SIZE;
+
+    for (S32 tile_y = tile_y_begin; tile_y <= tile_y_end; ++tile_y) {
+        for (S32 tile_x = tile_x_begin; tile_x <= tile_x_end; ++tile_x) {
+            F32 *tile_far = &r->hi_z.tiles[get_offset(r->tile_bins.tiles_x, tile_y, tile_x)];
+
+            // NOTE: Whole triangle is behind everything in this tile.
+            if (t->z_min >= *tile_far) {
+                continue;
+            }
+
+            S32 tile_x_begin_px = std::max(x_begin, tile_x * TILE_SIZE);
+            S32 tile_y_begin_px = std::max(y_begin, tile_y * TILE_SIZE);
+            S32 tile_x_end_px = std::min(x_end, (tile_x + 1) * TILE_SIZE);
+            S32 tile_y_end_px = std::min(y_end, (tile_y + 1) * TILE_SIZE);
+
+            if (raster_tile_blocks(r, t, &s, shader, tile_x_begin_px, tile_y_begin_px, tile_x_end_px, tile_y_end_px)) {
+                *tile_far = hi_z_tile_far(r, tile_x, tile_y);
+            }
+        }
+    }
+}
+
+void
+raster_triangle(Basic_Renderer *r, const Raster_Triangle *t, R32 clip)
+{
+    Raster_Flat_Shader shader{};
+    raster_triangle_shaded(r, t, clip, &shader);
+}
+
+static U32
+raster_span_scalar(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 e0, F32 e1, F32 e2, F32 z, S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span)
+{
+    U32 written = 0;
+
+    for (S32 kx = kx_begin; kx < kx_end; ++kx) {
+        bool inside = edge_inside(e0 + setup->step_x[0][kx], setup->top_left[0])
+                    & edge_inside(e1 + setup->step_x[1][kx], setup->top_left[1])
+                    & edge_inside(e2 + setup->step_x[2][kx], setup->top_left[2]);
+
+        F32 pixel_z = clamp_depth(z + setup->step_z[kx], setup->z_min, setup->z_max);
+
+        if (inside && pixel_z < depths[kx]) {
+            depths[kx] = pixel_z;
+            pixels[kx] = setup->color;
+            written |= 1U << kx;
+        }
+    }
+
+    return written;
+}
+
+static U32
+raster_span_fixed_scalar(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, S32 e0, S32 e1, S32 e2, F32 z, S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span)
+{
+    U32 written = 0;
+
+    for (S32 kx = kx_begin; kx < kx_end; ++kx) {
+        bool inside = ((e0 + setup->fixed_step_x[0][kx]) & (e1 + setup->fixed_step_x[1][kx]) & (e2 + setup->fixed_step_x[2][kx])) < 0;
+
+        F32 pixel_z = clamp_depth(z + setup->step_z[kx], setup->z_min, setup->z_max);
+
+        if (inside && pixel_z < depths[kx]) {
+            depths[kx] = pixel_z;
+            pixels[kx] = setup->color;
+            written |= 1U << kx;
+        }
+    }
+
+    return written;
+}
+
+static U32
+raster_fill_scalar(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 z, S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span)
+{
+    U32 written = 0;
+
+    for (S32 kx = kx_begin; kx < kx_end; ++kx) {
+        F32 pixel_z = clamp_depth(z + setup->step_z[kx], setup->z_min, setup->z_max);
+
+        if (pixel_z < depths[kx]) {
+            depths[kx] = pixel_z;
+            pixels[kx] = setup->color;
+            written |= 1U << kx;
+        }
+    }
+
+    return written;
+}
+
+static U32
+raster_samples_scalar(Color4 *pixels, F32 *depths, USZ plane_stride, const Raster_Span_Setup *setup, const Raster_Samples_Row *row,
+                      S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span, U32 written[MSAA_MAX_SAMPLES])
+{
+    U32 written_any = 0;
+
+    for (U32 samples = row->samples; samples != 0; samples &= samples - 1) {
+        U32 sample = std::countr_zero(samples);
+        const F32 *e = row->e[sample];
+        const S32 *fe = row->fixed_e[sample];
+        bool full = row->full & (1U << sample);
+
+        Color4 *plane_pixels = pixels + sample * plane_stride;
+        F32 *plane_depths = depths + sample * plane_stride;
+
+        written[sample] = 0;
+
+        for (S32 kx = kx_begin; kx < kx_end; ++kx) {
+            bool inside = full;
+
+            if (!full && row->fixed) {
+                inside = ((fe[0] + setup->fixed_step_x[0][kx]) & (fe[1] + setup->fixed_step_x[1][kx]) & (fe[2] + setup->fixed_step_x[2][kx])) < 0;
+            } else if (!full) {
+                inside = edge_inside(e[0] + setup->step_x[0][kx], setup->top_left[0])
+                       & edge_inside(e[1] + setup->step_x[1][kx], setup->top_left[1])
+                       & edge_inside(e[2] + setup->step_x[2][kx], setup->top_left[2]);
+            }
+
+            F32 pixel_z = clamp_depth(row->z[sample] + setup->step_z[kx], setup->z_min, setup->z_max);
+
+            if (inside && pixel_z < plane_depths[kx]) {
+                plane_depths[kx] = pixel_z;
+
+                if (row->flat) {
+                    plane_pixels[kx] = setup->color;
+                }
+
+                written[sample] |= 1U << kx;
+            }
+        }
+
+        written_any |= written[sample];
+    }
+
+    return written_any;
+}
+
+#if SOFTRAST_X86
+
+TARGET_SSE41 static inline __m128
+raster_edge_inside_sse41(F32 e, const F32 *step_x, U32 top_left)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 value = _mm_add_ps(_mm_set1_ps(e), _mm_load_ps(step_x));
+
+    __m128 on_edge = _mm_and_ps(_mm_cmpeq_ps(value, zero), _mm_castsi128_ps(_mm_set1_epi32(static_cast<S32>(top_left))));
+    return _mm_or_ps(_mm_cmplt_ps(value, zero), on_edge);
+}
+
+TARGET_SSE41 static inline __m128i
+raster_lanes_allowed_sse41(S32 half, S32 kx_begin, S32 kx_end)
+{
+    __m128i index = _mm_add_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(half));
+    return _mm_and_si128(_mm_cmpgt_epi32(index, _mm_set1_epi32(kx_begin - 1)),
+                         _mm_cmplt_epi32(index, _mm_set1_epi32(kx_end)));
+}
+
+//
+// Depth tests and writes 4 pixels of the span, which are selected by `mask`.
+// Returns mask of written pixels, same as span kernels.
+//
+TARGET_SSE41 static inline U32
+raster_store_sse41(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 z, S32 half, __m128i mask, bool whole_span)
+{
+    if (_mm_testz_si128(mask, mask)) {
+        return 0;
+    }
+
+    __m128 pixel_z = _mm_add_ps(_mm_set1_ps(z), _mm_load_ps(setup->step_z + half));
+    pixel_z = _mm_min_ps(_mm_max_ps(pixel_z, _mm_set1_ps(setup->z_min)), _mm_set1_ps(setup->z_max));
+
+    if (!whole_span) {
+        // NOTE: Span is hanging over the end of the row, so we can't touch
+        // pixels behind it: they belong to the next row and other tile.
+        alignas(16) F32 lane_z[4];
+        _mm_store_ps(lane_z, pixel_z);
+
+        S32 bits = _mm_movemask_ps(_mm_castsi128_ps(mask));
+        U32 written = 0;
+
+        for (S32 i = 0; i < 4; ++i) {
+            if ((bits & (1 << i)) && lane_z[i] < depths[half + i]) {
+                depths[half + i] = lane_z[i];
+                pixels[half + i] = setup->color;
+                written |= 1U << (half + i);
+            }
+        }
+
+        return written;
+    }
+
+    __m128 old_z = _mm_loadu_ps(depths + half);
+    mask = _mm_and_si128(mask, _mm_castps_si128(_mm_cmplt_ps(pixel_z, old_z)));
+
+    if (_mm_testz_si128(mask, mask)) {
+        return 0;
+    }
+
+    __m128i *dest = reinterpret_cast<__m128i *>(pixels + half);
+    __m128i color = _mm_set1_epi32(static_cast<S32>(std::bit_cast<U32>(setup->color)));
+
+    _mm_storeu_ps(depths + half, _mm_blendv_ps(old_z, pixel_z, _mm_castsi128_ps(mask)));
+    _mm_storeu_si128(dest, _mm_blendv_epi8(_mm_loadu_si128(dest), color, mask));
+
+    return static_cast<U32>(_mm_movemask_ps(_mm_castsi128_ps(mask))) << half;
+}
+
+TARGET_SSE41 static U32
+raster_span_sse41(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 e0, F32 e1, F32 e2, F32 z, S32 kx_begin, S32 kx_end, bool whole_span)
+{
+    U32 written = 0;
+
+    for (S32 half = 0; half < RASTER_BLOCK_SIZE; half += 4) {
+        __m128 inside = _mm_and_ps(_mm_and_ps(
+            raster_edge_inside_sse41(e0, setup->step_x[0] + half, setup->top_left[0]),
+            raster_edge_inside_sse41(e1, setup->step_x[1] + half, setup->top_left[1])),
+            raster_edge_inside_sse41(e2, setup->step_x[2] + half, setup->top_left[2]));
+
+        __m128i mask = _mm_and_si128(_mm_castps_si128(inside), raster_lanes_allowed_sse41(half, kx_begin, kx_end));
+        written |= raster_store_sse41(pixels, depths, setup, z, half, mask, whole_span);
+    }
+
+    return written;
+}
+
+TARGET_SSE41 static U32
+raster_span_fixed_sse41(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, S32 e0, S32 e1, S32 e2, F32 z, S32 kx_begin, S32 kx_end, bool whole_span)
+{
+    U32 written = 0;
+
+    for (S32 half = 0; half < RASTER_BLOCK_SIZE; half += 4) {
+        __m128i v0 = _mm_add_epi32(_mm_set1_epi32(e0), _mm_load_si128(reinterpret_cast<const __m128i *>(setup->fixed_step_x[0] + half)));
+        __m128i v1 = _mm_add_epi32(_mm_set1_epi32(e1), _mm_load_si128(reinterpret_cast<const __m128i *>(setup->fixed_step_x[1] + half)));
+        __m128i v2 = _mm_add_epi32(_mm_set1_epi32(e2), _mm_load_si128(reinterpret_cast<const __m128i *>(setup->fixed_step_x[2] + half)));
+
+        // NOTE: Inside when sign bits of all three are set.
+        __m128i inside = _mm_srai_epi32(_mm_and_si128(_mm_and_si128(v0, v1), v2), 31);
+
+        __m128i mask = _mm_and_si128(inside, raster_lanes_allowed_sse41(half, kx_begin, kx_end));
+        written |= raster_store_sse41(pixels, depths, setup, z, half, mask, whole_span);
+    }
+
+    return written;
+}
+
+TARGET_SSE41 static U32
+raster_fill_sse41(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 z, S32 kx_begin, S32 kx_end, bool whole_span)
+{
+    U32 written = 0;
+
+    for (S32 half = 0; half < RASTER_BLOCK_SIZE; half += 4) {
+        __m128i mask = raster_lanes_allowed_sse41(half, kx_begin, kx_end);
+        written |= raster_store_sse41(pixels, depths, setup, z, half, mask, whole_span);
+    }
+
+    return written;
+}
+
+//
+// Same as `raster_store_sse41`, but only depth is written.
+//
+TARGET_SSE41 static inline U32
+raster_depth_sse41(F32 *depths, const Raster_Span_Setup *setup, F32 z, S32 half, __m128i mask, bool whole_span)
+{
+    if (_mm_testz_si128(mask, mask)) {
+        return 0;
+    }
+
+    __m128 pixel_z = _mm_add_ps(_mm_set1_ps(z), _mm_load_ps(setup->step_z + half));
+    pixel_z = _mm_min_ps(_mm_max_ps(pixel_z, _mm_set1_ps(setup->z_min)), _mm_set1_ps(setup->z_max));
+
+    if (!whole_span) {
+        alignas(16) F32 lane_z[4];
+        _mm_store_ps(lane_z, pixel_z);
+
+        S32 bits = _mm_movemask_ps(_mm_castsi128_ps(mask));
+        U32 written = 0;
+
+        for (S32 i = 0; i < 4; ++i) {
+            if ((bits & (1 << i)) && lane_z[i] < depths[half + i]) {
+                depths[half + i] = lane_z[i];
+                written |= 1U << (half + i);
+            }
+        }
+
+        return written;
+    }
+
+    __m128 old_z = _mm_loadu_ps(depths + half);
+    mask = _mm_and_si128(mask, _mm_castps_si128(_mm_cmplt_ps(pixel_z, old_z)));
+
+    _mm_storeu_ps(depths + half, _mm_blendv_ps(old_z, pixel_z, _mm_castsi128_ps(mask)));
+
+    return static_cast<U32>(_mm_movemask_ps(_mm_castsi128_ps(mask))) << half;
+}
+
+TARGET_SSE41 static U32
+raster_samples_sse41(Color4 *pixels, F32 *depths, USZ plane_stride, const Raster_Span_Setup *setup, const Raster_Samples_Row *row,
+                     S32 kx_begin, S32 kx_end, bool whole_span, U32 written[MSAA_MAX_SAMPLES])
+{
+    U32 written_any = 0;
+
+    for (U32 samples = row->samples; samples != 0; samples &= samples - 1) {
+        U32 sample = std::countr_zero(samples);
+        const F32 *e = row->e[sample];
+        const S32 *fe = row->fixed_e[sample];
+
+        Color4 *plane_pixels = pixels + sample * plane_stride;
+        F32 *plane_depths = depths + sample * plane_stride;
+
+        written[sample] = 0;
+
+        for (S32 half = 0; half < RASTER_BLOCK_SIZE; half += 4) {
+            __m128i mask = raster_lanes_allowed_sse41(half, kx_begin, kx_end);
+
+            if (row->full & (1U << sample)) {
+                // NOTE: Every lane is covered.
+            } else if (row->fixed) {
+                __m128i v0 = _mm_add_epi32(_mm_set1_epi32(fe[0]), _mm_load_si128(reinterpret_cast<const __m128i *>(setup->fixed_step_x[0] + half)));
+                __m128i v1 = _mm_add_epi32(_mm_set1_epi32(fe[1]), _mm_load_si128(reinterpret_cast<const __m128i *>(setup->fixed_step_x[1] + half)));
+                __m128i v2 = _mm_add_epi32(_mm_set1_epi32(fe[2]), _mm_load_si128(reinterpret_cast<const __m128i *>(setup->fixed_step_x[2] + half)));
+
+                mask = _mm_and_si128(mask, _mm_srai_epi32(_mm_and_si128(_mm_and_si128(v0, v1), v2), 31));
+            } else {
+                __m128 inside = _mm_and_ps(_mm_and_ps(
+                    raster_edge_inside_sse41(e[0], setup->step_x[0] + half, setup->top_left[0]),
+                    raster_edge_inside_sse41(e[1], setup->step_x[1] + half, setup->top_left[1])),
+                    raster_edge_inside_sse41(e[2], setup->step_x[2] + half, setup->top_left[2]));
+
+                mask = _mm_and_si128(mask, _mm_castps_si128(inside));
+            }
+
+            if (row->flat) {
+                written[sample] |= raster_store_sse41(plane_pixels, plane_depths, setup, row->z[sample], half, mask, whole_span);
+            } else {
+                written[sample] |= raster_depth_sse41(plane_depths, setup, row->z[sample], half, mask, whole_span);
+            }
+        }
+
+        written_any |= written[sample];
+    }
+
+    return written_any;
+}
+
+TARGET_AVX2 static inline __m256
+raster_edge_inside_avx2(F32 e, const F32 *step_x, U32 top_left)
+{
+    __m256 zero = _mm256_setzero_ps();
+    __m256 value = _mm256_add_ps(_mm256_set1_ps(e), _mm256_load_ps(step_x));
+
+    __m256 on_edge = _mm256_and_ps(_mm256_cmp_ps(value, zero, _CMP_EQ_OQ), _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<S32>(top_left))));
+    return _mm256_or_ps(_mm256_cmp_ps(value, zero, _CMP_LT_OQ), on_edge);
+}
+
+TARGET_AVX2 static inline __m256i
+raster_lanes_allowed_avx2(S32 kx_begin, S32 kx_end)
+{
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_and_si256(_mm256_cmpgt_epi32(index, _mm256_set1_epi32(kx_begin - 1)),
+                            _mm256_cmpgt_epi32(_mm256_set1_epi32(kx_end), index));
+}
+
+//
+// NOTE: Masked out lanes are not loaded, not written and not faulting, so it's
+// fine for span to hang over the end of the row.
+//
+TARGET_AVX2 static inline U32
+raster_store_avx2(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 z, __m256i mask)
+{
+    if (_mm256_testz_si256(mask, mask)) {
+        return 0;
+    }
+
+    __m256 pixel_z = _mm256_add_ps(_mm256_set1_ps(z), _mm256_load_ps(setup->step_z));
+    pixel_z = _mm256_min_ps(_mm256_max_ps(pixel_z, _mm256_set1_ps(setup->z_min)), _mm256_set1_ps(setup->z_max));
+
+    __m256 old_z = _mm256_maskload_ps(depths, mask);
+    mask = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(pixel_z, old_z, _CMP_LT_OQ)));
+
+    if (_mm256_testz_si256(mask, mask)) {
+        return 0;
+    }
+
+    __m256i color = _mm256_set1_epi32(static_cast<S32>(std::bit_cast<U32>(setup->color)));
+
+    _mm256_maskstore_ps(depths, mask, pixel_z);
+    _mm256_maskstore_epi32(reinterpret_cast<int *>(pixels), mask, color);
+
+    return static_cast<U32>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+}
+
+//
+// Same as `raster_store_avx2`, but only depth is written.
+//
+TARGET_AVX2 static inline U32
+raster_depth_avx2(F32 *depths, const Raster_Span_Setup *setup, F32 z, __m256i mask)
+{
+    if (_mm256_testz_si256(mask, mask)) {
+        return 0;
+    }
+
+    __m256 pixel_z = _mm256_add_ps(_mm256_set1_ps(z), _mm256_load_ps(setup->step_z));
+    pixel_z = _mm256_min_ps(_mm256_max_ps(pixel_z, _mm256_set1_ps(setup->z_min)), _mm256_set1_ps(setup->z_max));
+
+    __m256 old_z = _mm256_maskload_ps(depths, mask);
+    mask = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(pixel_z, old_z, _CMP_LT_OQ)));
+
+    _mm256_maskstore_ps(depths, mask, pixel_z);
+
+    return static_cast<U32>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+}
+
+TARGET_AVX2 static U32
+raster_span_avx2(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 e0, F32 e1, F32 e2, F32 z, S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span)
+{
+    __m256 inside = _mm256_and_ps(_mm256_and_ps(
+        raster_edge_inside_avx2(e0, setup->step_x[0], setup->top_left[0]),
+        raster_edge_inside_avx2(e1, setup->step_x[1], setup->top_left[1])),
+        raster_edge_inside_avx2(e2, setup->step_x[2], setup->top_left[2]));
+
+    __m256i mask = _mm256_and_si256(_mm256_castps_si256(inside), raster_lanes_allowed_avx2(kx_begin, kx_end));
+    return raster_store_avx2(pixels, depths, setup, z, mask);
+}
+
+TARGET_AVX2 static U32
+raster_span_fixed_avx2(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, S32 e0, S32 e1, S32 e2, F32 z, S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span)
+{
+    __m256i v0 = _mm256_add_epi32(_mm256_set1_epi32(e0), _mm256_load_si256(reinterpret_cast<const __m256i *>(setup->fixed_step_x[0])));
+    __m256i v1 = _mm256_add_epi32(_mm256_set1_epi32(e1), _mm256_load_si256(reinterpret_cast<const __m256i *>(setup->fixed_step_x[1])));
+    __m256i v2 = _mm256_add_epi32(_mm256_set1_epi32(e2), _mm256_load_si256(reinterpret_cast<const __m256i *>(setup->fixed_step_x[2])));
+
+    // NOTE: Inside when sign bits of all three are set.
+    __m256i inside = _mm256_srai_epi32(_mm256_and_si256(_mm256_and_si256(v0, v1), v2), 31);
+
+    __m256i mask = _mm256_and_si256(inside, raster_lanes_allowed_avx2(kx_begin, kx_end));
+    return raster_store_avx2(pixels, depths, setup, z, mask);
+}
+
+TARGET_AVX2 static U32
+raster_fill_avx2(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 z, S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span)
+{
+    return raster_store_avx2(pixels, depths, setup, z, raster_lanes_allowed_avx2(kx_begin, kx_end));
+}
+
+TARGET_AVX2 static U32
+raster_samples_avx2(Color4 *pixels, F32 *depths, USZ plane_stride, const Raster_Span_Setup *setup, const Raster_Samples_Row *row,
+                    S32 kx_begin, S32 kx_end, [[maybe_unused]] bool whole_span, U32 written[MSAA_MAX_SAMPLES])
+{
+    __m256i allowed = raster_lanes_allowed_avx2(kx_begin, kx_end);
+    U32 written_any = 0;
+
+    for (U32 samples = row->samples; samples != 0; samples &= samples - 1) {
+        U32 sample = std::countr_zero(samples);
+        const F32 *e = row->e[sample];
+        const S32 *fe = row->fixed_e[sample];
+        __m256i mask = allowed;
+
+        if (row->full & (1U << sample)) {
+            // NOTE: Every lane is covered.
+        } else if (row->fixed) {
+            __m256i v0 = _mm256_add_epi32(_mm256_set1_epi32(fe[0]), _mm256_load_si256(reinterpret_cast<const __m256i *>(setup->fixed_step_x[0])));
+            __m256i v1 = _mm256_add_epi32(_mm256_set1_epi32(fe[1]), _mm256_load_si256(reinterpret_cast<const __m256i *>(setup->fixed_step_x[1])));
+            __m256i v2 = _mm256_add_epi32(_mm256_set1_epi32(fe[2]), _mm256_load_si256(reinterpret_cast<const __m256i *>(setup->fixed_step_x[2])));
+
+            mask = _mm256_and_si256(mask, _mm256_srai_epi32(_mm256_and_si256(_mm256_and_si256(v0, v1), v2), 31));
+        } else {
+            __m256 inside = _mm256_and_ps(_mm256_and_ps(
+                raster_edge_inside_avx2(e[0], setup->step_x[0], setup->top_left[0]),
+                raster_edge_inside_avx2(e[1], setup->step_x[1], setup->top_left[1])),
+                raster_edge_inside_avx2(e[2], setup->step_x[2], setup->top_left[2]));
+
+            mask = _mm256_and_si256(mask, _mm256_castps_si256(inside));
+        }
+
+        Color4 *plane_pixels = pixels + sample * plane_stride;
+        F32 *plane_depths = depths + sample * plane_stride;
+
+        if (row->flat) {
+            written[sample] = raster_store_avx2(plane_pixels, plane_depths, setup, row->z[sample], mask);
+        } else {
+            written[sample] = raster_depth_avx2(plane_depths, setup, row->z[sample], mask);
+        }
+
+        written_any |= written[sample];
+    }
+
+    return written_any;
+}
+
+#endif // SOFTRAST_X86
+
+const Raster_Span_Proc RASTER_SPAN_PROCS[RASTER_ISA_COUNT] = {
+    raster_span_scalar,
+#if SOFTRAST_X86
+    raster_span_sse41,
+    raster_span_avx2,
+#else
+    raster_span_scalar,
+    raster_span_scalar,
+#endif
+};
+
+const Raster_Span_Fixed_Proc RASTER_SPAN_FIXED_PROCS[RASTER_ISA_COUNT] = {
+    raster_span_fixed_scalar,
+#if SOFTRAST_X86
+    raster_span_fixed_sse41,
+    raster_span_fixed_avx2,
+#else
+    raster_span_fixed_scalar,
+    raster_span_fixed_scalar,
+#endif
+};
+
+const Raster_Fill_Proc RASTER_FILL_PROCS[RASTER_ISA_COUNT] = {
+    raster_fill_scalar,
+#if SOFTRAST_X86
+    raster_fill_sse41,
+    raster_fill_avx2,
+#else
+    raster_fill_scalar,
+    raster_fill_scalar,
+#endif
+};
+
+const Raster_Samples_Proc RASTER_SAMPLES_PROCS[RASTER_ISA_COUNT] = {
+    raster_samples_scalar,
+#if SOFTRAST_X86
+    raster_samples_sse41,
+    raster_samples_avx2,
+#else
+    raster_samples_scalar,
+    raster_samples_scalar,
+#endif
+};
+
+const char *PIXELS_LAYOUT_NAMES[PIXELS_LAYOUT_COUNT] = {
+    "linear",
+    "tiled",
+};
+
+const char *RASTER_ISA_NAMES[RASTER_ISA_COUNT] = {
+    "scalar",
+    "sse4.1",
+    "avx2",
+};
+
+Raster_ISA
+detect_raster_isa(void)
+{
+#if SOFTRAST_X86
+    U32 regs[4]{};  // eax, ebx, ecx, edx
+
+    auto cpuid = [&regs](U32 leaf, U32 subleaf) {
+    #if defined(_MSC_VER)
+        __cpuidex(reinterpret_cast<int *>(regs), static_cast<int>(leaf), static_cast<int>(subleaf));
+    #else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+    #endif
+    };
+
+    cpuid(0, 0);
+    U32 max_leaf = regs[0];
+
+    cpuid(1, 0);
+    bool has_sse41 = regs[2] & (1U << 19);
+    bool has_osxsave = regs[2] & (1U << 27);
+    bool has_avx = regs[2] & (1U << 28);
+
+    bool has_avx2 = false;
+    if (max_leaf >= 7 && has_osxsave && has_avx) {
+        // NOTE: CPU might support AVX, but OS might not save YMM
+        // registers on context switch. Checking XCR0 for that.
+    #if defined(_MSC_VER)
+        U64 xcr0 = _xgetbv(0);
+    #else
+        U32 xcr0_lo = 0, xcr0_hi = 0;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        U64 xcr0 = (static_cast<U64>(xcr0_hi) << 32) | xcr0_lo;
+    #endif
+
+        cpuid(7, 0);
+        has_avx2 = (regs[1] & (1U << 5)) && (xcr0 & 0x6) == 0x6;
+    }
+
+    if (has_avx2) {
+        return RASTER_ISA_AVX2;
+    }
+
+    if (has_sse41) {
+        return RASTER_ISA_SSE41;
+    }
+#endif // SOFTRAST_X86
+
+    return RASTER_ISA_SCALAR;
+}
+
+Screen_Transform
+make_screen_transform(Transform transform, V2 screen_size)
+{
+    M3x3 m = transform.to_matrix();
+    F32 pixels_per_unit = screen_size.y / WORLD_UNITS_IN_SCREEN_HEIGHT;
+
+    Screen_Transform result{};
+
+    F32 (*rows)[4] = result.rows;
+
+    rows[0][0] = m.r0.x * pixels_per_unit;
+    rows[0][1] = m.r1.x * pixels_per_unit;
+    rows[0][2] = m.r2.x * pixels_per_unit;
+    rows[0][3] = screen_size.x / 2 + transform.position.x * pixels_per_unit;
+
+    rows[1][0] = m.r0.y * pixels_per_unit;
+    rows[1][1] = m.r1.y * pixels_per_unit;
+    rows[1][2] = m.r2.y * pixels_per_unit;
+    rows[1][3] = screen_size.y / 2 + transform.position.y * pixels_per_unit;
+
+    // NOTE: Camera looks down the -Z, same as in `world_to_screen`.
+    rows[2][0] = -m.r0.z;
+    rows[2][1] = -m.r1.z;
+    rows[2][2] = -m.r2.z;
+    rows[2][3] = -transform.position.z;
+
+    return result;
+}
+
+void
+Vertex_Stream::resize(USZ count)
+{
+    USZ padded = (count + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE * VERTEX_BATCH_SIZE;
+
+    this->count = count;
+    this->x.resize(padded);
+    this->y.resize(padded);
+    this->z.resize(padded);
+}
+
+static void
+transform_vertexes_scalar(const Screen_Transform *t, const F32 *x, const F32 *y, const F32 *z, F32 *out_x, F32 *out_y, F32 *out_z, USZ count)
+{
+    F32 *outs[3] = {out_x, out_y, out_z};
+
+    for (S32 row = 0; row < 3; ++row) {
+        const F32 *m = t->rows[row];
+        F32 *out = outs[row];
+
+        for (USZ i = 0; i < count; ++i) {
+            out[i] = ((m[0] * x[i] + m[1] * y[i]) + m[2] * z[i]) + m[3];
+        }
+    }
+}
+
+#if SOFTRAST_X86
+
+TARGET_SSE41 static void
+transform_vertexes_sse41(const Screen_Transform *t, const F32 *x, const F32 *y, const F32 *z, F32 *out_x, F32 *out_y, F32 *out_z, USZ count)
+{
+    F32 *outs[3] = {out_x, out_y, out_z};
+
+    for (S32 row = 0; row < 3; ++row) {
+        const F32 *m = t->rows[row];
+        F32 *out = outs[row];
+
+        __m128 m0 = _mm_set1_ps(m[0]);
+        __m128 m1 = _mm_set1_ps(m[1]);
+        __m128 m2 = _mm_set1_ps(m[2]);
+        __m128 m3 = _mm_set1_ps(m[3]);
+
+        for (USZ i = 0; i < count; i += 4) {
+            __m128 r = _mm_add_ps(_mm_mul_ps(m0, _mm_loadu_ps(x + i)), _mm_mul_ps(m1, _mm_loadu_ps(y + i)));
+            r = _mm_add_ps(r, _mm_mul_ps(m2, _mm_loadu_ps(z + i)));
+            r = _mm_add_ps(r, m3);
+            _mm_storeu_ps(out + i, r);
+        }
+    }
+}
+
+TARGET_AVX2 static void
+transform_vertexes_avx2(const Screen_Transform *t, const F32 *x, const F32 *y, const F32 *z, F32 *out_x, F32 *out_y, F32 *out_z, USZ count)
+{
+    F32 *outs[3] = {out_x, out_y, out_z};
+
+    // NOTE: No FMA here, it rounds once instead of twice and results would
+    // differ from other kernels.
+    for (S32 row = 0; row < 3; ++row) {
+        const F32 *m = t->rows[row];
+        F32 *out = outs[row];
+
+        __m256 m0 = _mm256_set1_ps(m[0]);
+        __m256 m1 = _mm256_set1_ps(m[1]);
+        __m256 m2 = _mm256_set1_ps(m[2]);
+        __m256 m3 = _mm256_set1_ps(m[3]);
+
+        for (USZ i = 0; i < count; i += 8) {
+            __m256 r = _mm256_add_ps(_mm256_mul_ps(m0, _mm256_loadu_ps(x + i)), _mm256_mul_ps(m1, _mm256_loadu_ps(y + i)));
+            r = _mm256_add_ps(r, _mm256_mul_ps(m2, _mm256_loadu_ps(z + i)));
+            r = _mm256_add_ps(r, m3);
+            _mm256_storeu_ps(out + i, r);
+        }
+    }
+}
+
+#endif // SOFTRAST_X86
+
+const Transform_Vertexes_Proc TRANSFORM_VERTEXES_PROCS[RASTER_ISA_COUNT] = {
+    transform_vertexes_scalar,
+#if SOFTRAST_X86
+    transform_vertexes_sse41,
+    transform_vertexes_avx2,
+#else
+    transform_vertexes_scalar,
+    transform_vertexes_scalar,
+#endif
+};
+
+#define TRANSFORM_CHUNK_SIZE 4096  // NOTE: In vertexes, multiple of `VERTEX_BATCH_SIZE`.
+
+//
+// Vertexes `[begin, end)` of one instance.
+//
+struct Vertex_Run {
+    U32 instance;
+    U32 begin;
+    U32 end;
+};
+
+//
+// Vertexes which have to be transformed, split into work items of about
+// `TRANSFORM_CHUNK_SIZE` vertexes. Item `i` is runs `[items[i], items[i + 1])`,
+// so several instances of small mesh are going into one item, and big mesh is
+// split into chunks.
+//
+struct Vertex_Work {
+    Vertex_Run *runs = nullptr;
+    U32 runs_count = 0;
+
+    U32 *items = nullptr;
+    U32 items_count = 0;
+    U32 item_size = 0;  // NOTE: Vertexes in the last item.
+
+    //
+    // `begin` and `end` are multiples of `VERTEX_BATCH_SIZE`, and are not
+    // going before the end of the previous run of the same instance.
+    //
+    inline void
+    push(U32 instance, U32 begin, U32 end) noexcept
+    {
+        while (begin < end) {
+            if (this->items_count == 0 || this->item_size >= TRANSFORM_CHUNK_SIZE) {
+                this->items[this->items_count++] = this->runs_count;
+                this->item_size = 0;
+            }
+
+            U32 size = std::min<U32>(end - begin, TRANSFORM_CHUNK_SIZE - this->item_size);
+            Vertex_Run *last = this->runs_count > this->items[this->items_count - 1] ? &this->runs[this->runs_count - 1] : nullptr;
+
+            if (last != nullptr && last->instance == instance && last->end == begin) {
+                last->end += size;
+            } else {
+                this->runs[this->runs_count++] = {instance, begin, begin + size};
+            }
+
+            this->item_size += size;
+            begin += size;
+        }
+
+        this->items[this->items_count] = this->runs_count;
+    }
+};
+
+//
+// Vertexes of clusters which are not culled (see `cull_clusters`), or every
+// vertex if `visible` is null. Pushed into frame arena.
+//
+static Vertex_Work
+plan_vertex_work(Basic_Renderer *r, USZ padded_count, U32 instances_count, const Mesh *mesh, const U8 *visible)
+{
+    USZ clusters_count = visible != nullptr ? mesh->clusters.size() : 1;
+    USZ batches_count = padded_count / VERTEX_BATCH_SIZE;
+
+    // NOTE: Every push is split into this many runs at most. Marked batches
+    // are at most every other one apart.
+    USZ runs_count = instances_count * (padded_count / TRANSFORM_CHUNK_SIZE + (visible != nullptr ? batches_count / 2 : 0) + 2);
+
+    Vertex_Work work{};
+    work.runs = r->frame_arena.push_array<Vertex_Run>(runs_count);
+    work.items = r->frame_arena.push_array<U32>(runs_count + 1);
+
+    // NOTE: Clusters are sharing vertexes, so batches which corners of any
+    // visible cluster are in are marked first.
+    U8 *batches = visible != nullptr ? r->frame_arena.push_array<U8>(batches_count) : nullptr;
+
+    if (work.runs == nullptr || work.items == nullptr || (visible != nullptr && batches == nullptr)) {
+        r->out_of_memory = true;
+        return {};
+    }
+
+    work.items[0] = 0;
+
+    for (U32 instance = 0; instance < instances_count; ++instance) {
+        if (visible == nullptr) {
+            work.push(instance, 0, static_cast<U32>(padded_count));
+            continue;
+        }
+
+        const U8 *instance_visible = visible + instance * clusters_count;
+        std::fill_n(batches, batches_count, 0);
+
+        for (USZ i = 0; i < clusters_count; ++i) {
+            if (!instance_visible[i]) {
+                continue;
+            }
+
+            const Mesh_Cluster *cluster = &mesh->clusters[i];
+
+            for (U32 k = cluster->indexes_begin; k < cluster->indexes_begin + cluster->indexes_count; ++k) {
+                batches[mesh->indexes[k] / VERTEX_BATCH_SIZE] = 1;
+            }
+        }
+
+        for (USZ begin = 0; begin < batches_count;) {
+            if (!batches[begin]) {
+                ++begin;
+                continue;
+            }
+
+            USZ end = begin + 1;
+
+            while (end < batches_count && batches[end]) {
+                ++end;
+            }
+
+            work.push(instance, static_cast<U32>(begin * VERTEX_BATCH_SIZE), static_cast<U32>(end * VERTEX_BATCH_SIZE));
+            begin = end;
+        }
+    }
+
+    return work;
+}
+
+struct Transform_Vertexes_Data {
+    Transform_Vertexes_Proc proc;
+    const Screen_Transform *transforms;
+    const Vertex_Stream *in;
+    Screen_Vertexes *out;
+    const Vertex_Work *work;
+};
+
+static void
+transform_vertexes_chunk(void *data, U32 item_index, [[maybe_unused]] U32 worker_index)
+{
+    Transform_Vertexes_Data *d = static_cast<Transform_Vertexes_Data *>(data);
+
+    for (U32 i = d->work->items[item_index]; i < d->work->items[item_index + 1]; ++i) {
+        const Vertex_Run *run = &d->work->runs[i];
+        USZ out = run->instance * d->out->stride + run->begin;
+
+        d->proc(&d->transforms[run->instance],
+                d->in->x.data() + run->begin, d->in->y.data() + run->begin, d->in->z.data() + run->begin,
+                d->out->x + out, d->out->y + out, d->out->z + out,
+                run->end - run->begin);
+    }
+}
+
+static Screen_Transform *
+make_screen_transforms(Basic_Renderer *r, std::span<const Draw_Instance> instances)
+{
+    V2 screen_size { static_cast<F32>(r->pixels_width), static_cast<F32>(r->pixels_height) };
+    Screen_Transform *transforms = r->frame_arena.push_array<Screen_Transform>(instances.size());
+
+    if (transforms == nullptr) {
+        r->out_of_memory = true;
+        return nullptr;
+    }
+
+    for (USZ i = 0; i < instances.size(); ++i) {
+        transforms[i] = make_screen_transform(instances[i].transform, screen_size);
+    }
+
+    return transforms;
+}
+
+//
+// Transforms vertexes of the `work` into `r->screen_vertexes`, every instance
+// has it's own copy of the whole mesh there. Ones which are not in the `work`
+// are left as they are.
+//
+static void
+transform_vertexes_work(Basic_Renderer *r, Thread_Pool *pool, const Vertex_Stream *positions, const Screen_Transform *transforms, U32 instances_count, const Vertex_Work *work)
+{
+    // NOTE: Padded same as input, so kernels could write whole
+    // batches.
+    USZ padded_count = positions->x.size();
+
+    r->screen_vertexes.count = positions->count;
+    r->screen_vertexes.stride = padded_count;
+    r->screen_vertexes.x = r->frame_arena.push_array<F32>(padded_count * instances_count);
+    r->screen_vertexes.y = r->frame_arena.push_array<F32>(padded_count * instances_count);
+    r->screen_vertexes.z = r->frame_arena.push_array<F32>(padded_count * instances_count);
+
+    if (r->screen_vertexes.x == nullptr || r->screen_vertexes.y == nullptr || r->screen_vertexes.z == nullptr) {
+        r->out_of_memory = true;
+        return;
+    }
+
+    Transform_Vertexes_Data data{TRANSFORM_VERTEXES_PROCS[r->isa], transforms, positions, &r->screen_vertexes, work};
+
+    // NOTE: Small meshes are not worth waking up workers.
+    if (pool != nullptr && work->items_count > 1) {
+        pool->parallel_for(work->items_count, transform_vertexes_chunk, &data);
+    } else {
+        for (U32 i = 0; i < work->items_count; ++i) {
+            transform_vertexes_chunk(&data, i, 0);
+        }
+    }
+}
+
+bool
+transform_vertexes(Basic_Renderer *r, Thread_Pool *pool, const Vertex_Stream *positions, Transform transform)
+{
+    Draw_Instance instance{transform};
+
+    r->out_of_memory = false;
+
+    Screen_Transform *transforms = make_screen_transforms(r, {&instance, 1});
+    Vertex_Work work = plan_vertex_work(r, positions->x.size(), 1, nullptr, nullptr);
+
+    if (!r->out_of_memory) {
+        transform_vertexes_work(r, pool, positions, transforms, 1, &work);
+    }
+
+    return !r->out_of_memory;
+}
+
+template<typename Shader>
+static void
+render_triangles_serial_shaded(Basic_Renderer *r, std::span<const Raster_Triangle> triangles, const Shader *shader)
+{
+    R32 screen{0, 0, static_cast<S32>(r->pixels_width), static_cast<S32>(r->pixels_height)};
+
+    for (const Raster_Triangle &t : triangles) {
+        raster_triangle_shaded(r, &t, screen, shader);
+    }
+
+    r->resolve_clear();
+    r->resolve_samples();
+}
+
+template<typename Shader>
+struct Render_Tile_Data {
+    Basic_Renderer *r;
+    const Raster_Triangle *triangles;
+    const Shader *shader;
+};
+
+template<typename Shader>
+static void
+render_tile(void *data, U32 tile_index, [[maybe_unused]] U32 worker_index)
+{
+    Render_Tile_Data<Shader> *d = static_cast<Render_Tile_Data<Shader> *>(data);
+    Tile_Bins *tb = &d->r->tile_bins;
+
+    R32 tile{};
+    tile.x = static_cast<S32>(tile_index % tb->tiles_x) * TILE_SIZE;
+    tile.y = static_cast<S32>(tile_index / tb->tiles_x) * TILE_SIZE;
+    tile.w = TILE_SIZE;
+    tile.h = TILE_SIZE;
+
+    std::span<const U32> bin = tb->bin(tile_index);
+
+    for (U32 triangle_index : bin) {
+        raster_triangle_shaded(d->r, d->triangles + triangle_index, tile, d->shader);
+    }
+
+    // NOTE: Nothing is drawn in it this frame, unless there is another render
+    // call.
+    clear_tile(d->r, tile_index);
+
+    if (!bin.empty()) {
+        resolve_samples_tile(d->r, tile_index);
+    }
+}
+
+//
+// Sorts indexes of the triangles into bins of the tiles they are overlapping.
+// Two passes: first one counts triangles of every tile, so bins could be
+// laid out one after another in frame arena, second one fills them.
+//
+static bool
+bin_triangles(Basic_Renderer *r, std::span<const Raster_Triangle> triangles)
+{
+    Tile_Bins *tb = &r->tile_bins;
+    U32 tiles_count = tb->tiles_count();
+
+    USZ scratch = r->frame_arena.save();
+
+    // NOTE: Bins are left empty if they don't fit.
+    tb->offsets = nullptr;
+    tb->indexes = nullptr;
+
+    U32 *offsets = r->frame_arena.push_array<U32>(tiles_count + 1);
+
+    if (offsets == nullptr) {
+        return false;
+    }
+
+    std::fill_n(offsets, tiles_count + 1, 0);
+
+    auto for_each_tile = [tb](const R32 &bb, auto &&proc) {
+        S32 tile_x_begin = bb.x / TILE_SIZE;
+        S32 tile_y_begin = bb.y / TILE_SIZE;
+        S32 tile_x_end = (bb.w - 1) / TILE_SIZE;
+        S32 tile_y_end = (bb.h - 1) / TILE_SIZE;
+
+        for (S32 tile_y = tile_y_begin; tile_y <= tile_y_end; ++tile_y) {
+            for (S32 tile_x = tile_x_begin; tile_x <= tile_x_end; ++tile_x) {
+                proc(get_offset(tb->tiles_x, tile_y, tile_x));
+            }
+        }
+    };
+
+    for (const Raster_Triangle &t : triangles) {
+        if (t.bb.x < t.bb.w && t.bb.y < t.bb.h) {
+            for_each_tile(t.bb, [offsets](S32 tile_index) { ++offsets[tile_index + 1]; });
+        }
+    }
+
+    for (U32 i = 0; i < tiles_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // NOTE: Bins are filled front to back using their offsets as cursors, which
+    // are moved back afterwards. Triangles are visited in order, so every bin
+    // stays in submission order.
+    U32 *indexes = r->frame_arena.push_array<U32>(offsets[tiles_count]);
+
+    if (indexes == nullptr) {
+        r->frame_arena.restore(scratch);
+        return false;
+    }
+
+    for (U32 i = 0; i < triangles.size(); ++i) {
+        const R32 &bb = triangles[i].bb;
+
+        if (bb.x < bb.w && bb.y < bb.h) {
+            for_each_tile(bb, [offsets, indexes, i](S32 tile_index) { indexes[offsets[tile_index]++] = i; });
+        }
+    }
+
+    for (U32 i = tiles_count; i > 0; --i) {
+        offsets[i] = offsets[i - 1];
+    }
+
+    offsets[0] = 0;
+
+    tb->offsets = offsets;
+    tb->indexes = indexes;
+
+    return true;
+}
+
+template<typename Shader>
+static void
+render_triangles_binned_shaded(Basic_Renderer *r, Thread_Pool *pool, std::span<const Raster_Triangle> triangles, const Shader *shader)
+{
+    if (!bin_triangles(r, triangles)) {
+        ++r->stats.draws_failed;
+        r->resolve_clear();
+        return;
+    }
+
+    Render_Tile_Data<Shader> data{r, triangles.data(), shader};
+    pool->parallel_for(r->tile_bins.tiles_count(), render_tile<Shader>, &data);
+}
+
+void
+render_triangles_serial(Basic_Renderer *r, std::span<const Raster_Triangle> triangles)
+{
+    Raster_Flat_Shader shader{};
+    render_triangles_serial_shaded(r, triangles, &shader);
+}
+
+void
+render_triangles_binned(Basic_Renderer *r, Thread_Pool *pool, std::span<const Raster_Triangle> triangles)
+{
+    Raster_Flat_Shader shader{};
+    render_triangles_binned_shaded(r, pool, triangles, &shader);
+}
+
+static void
+paint_mesh_randomly(Mesh *mesh)
+{
+    using result_type = decltype(std::default_random_engine())::result_type;
+    auto engine = std::default_random_engine();
+    std::uniform_int_distribution<result_type> dist(0, MAX_U8);
+
+    auto get_random_color = [](decltype(dist) *dist, decltype(engine) *engine) -> Color4 {
+        return {
+            static_cast<U8>((*dist)(*engine)),
+            static_cast<U8>((*dist)(*engine)),
+            static_cast<U8>((*dist)(*engine)),
+            MAX_U8
+        };
+    };
+
+    mesh->colors.resize(mesh->indexes.size());
+
+    /// XXX
+    for (USZ i = 0; i < mesh->indexes.size(); i += 3) {
+        Color4 color = get_random_color(&dist, &engine);
+        mesh->colors[i] = color;
+        mesh->colors[i + 1] = color;
+        mesh->colors[i + 2] = color;
+    }
+
+    mesh->vertex_colors.resize(mesh->vertexes.size());
+
+    for (Color4 &color : mesh->vertex_colors) {
+        color = get_random_color(&dist, &engine);
+    }
+}
+
+//
+// `.obj` loading.
+//
+// File is split into chunks on line boundaries, every chunk is parsed into
+// it's own arrays, then those are concatenated. Negative (relative) indexes
+// are resolved against chunk's own vertexes first and shifted by number of
+// vertexes in preceding chunks after all of them are parsed.
+//
+
+#define OBJ_CHUNK_MIN_SIZE (1 << 20)
+
+struct Obj_Chunk {
+    const C8 *begin = nullptr;
+    const C8 *end = nullptr;
+
+    Obj_File obj{};
+    std::vector<USZ> relative_corners{};  // NOTE: Positions in `obj.corners` which have to be shifted.
+
+    USZ positions_offset = 0;
+    USZ uvs_offset = 0;
+    USZ normals_offset = 0;
+    USZ corners_offset = 0;
+};
+
+struct Obj_Load_Data {
+    Obj_Chunk *chunks;
+    Obj_File *obj;
+};
+
+constexpr bool
+obj_is_space(C8 c) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const C8 *
+obj_skip_spaces(const C8 *p, const C8 *end)
+{
+    while (p < end && obj_is_space(*p)) {
+        ++p;
+    }
+
+    return p;
+}
+
+static const C8 *
+obj_skip_word(const C8 *p, const C8 *end)
+{
+    while (p < end && !obj_is_space(*p)) {
+        ++p;
+    }
+
+    return p;
+}
+
+//
+// Returns true if line at `p` starts with `keyword` followed by space, and
+// moves `p` past it.
+//
+static bool
+obj_keyword(const C8 **p, const C8 *end, std::string_view keyword)
+{
+    USZ length = keyword.size();
+
+    if (static_cast<USZ>(end - *p) > length && memcmp(*p, keyword.data(), length) == 0 && obj_is_space((*p)[length])) {
+        *p += length;
+        return true;
+    }
+
+    return false;
+}
+
+static const C8 *
+obj_parse_floats(const C8 *p, const C8 *end, F32 *values, S32 count)
+{
+    for (S32 k = 0; k < count; ++k) {
+        p = obj_skip_spaces(p, end);
+        p = std::from_chars(p, end, values[k]).ptr;
+    }
+
+    return p;
+}
+
+static std::string_view
+obj_rest_of_line(const C8 *p, const C8 *end)
+{
+    p = obj_skip_spaces(p, end);
+
+    while (end > p && obj_is_space(end[-1])) {
+        --end;
+    }
+
+    return {p, static_cast<USZ>(end - p)};
+}
+
+//
+// Counts vertexes and face corners of the chunk, so it's arrays are sized once
+// and don't grow while being parsed. Faces are counted by words, their
+// corners aren't validated.
+//
+static void
+obj_reserve_chunk(Obj_Chunk *c)
+{
+    USZ positions_count = 0, uvs_count = 0, normals_count = 0, corners_count = 0;
+
+    const C8 *p = c->begin;
+
+    while (p < c->end) {
+        const C8 *line_end = static_cast<const C8 *>(memchr(p, '\n', c->end - p));
+        if (line_end == nullptr) {
+            line_end = c->end;
+        }
+
+        p = obj_skip_spaces(p, line_end);
+
+        if (obj_keyword(&p, line_end, "v")) {
+            ++positions_count;
+        } else if (obj_keyword(&p, line_end, "vt")) {
+            ++uvs_count;
+        } else if (obj_keyword(&p, line_end, "vn")) {
+            ++normals_count;
+        } else if (obj_keyword(&p, line_end, "f")) {
+            USZ words_count = 0;
+
+            while ((p = obj_skip_spaces(p, line_end)) < line_end) {
+                p = obj_skip_word(p, line_end);
+                ++words_count;
+            }
+
+            // NOTE: Fan of `n` corners is `n - 2` triangles, 3 values per corner.
+            corners_count += words_count >= 3 ? (words_count - 2) * 9 : 0;
+        }
+
+        p = line_end + 1;
+    }
+
+    c->obj.positions.reserve(positions_count);
+    c->obj.uvs.reserve(uvs_count);
+    c->obj.normals.reserve(normals_count);
+    c->obj.corners.reserve(corners_count);
+}
+
+static void
+obj_parse_chunk(void *data, U32 chunk_index, [[maybe_unused]] U32 worker_index)
+{
+    Obj_Chunk *c = static_cast<Obj_Load_Data *>(data)->chunks + chunk_index;
+    Obj_File *obj = &c->obj;
+
+    obj_reserve_chunk(c);
+
+    struct Corner {
+        S32 values[3];
+        bool relative[3];
+    };
+
+    auto push_corner = [c, obj](const Corner &corner) {
+        for (S32 k = 0; k < 3; ++k) {
+            if (corner.relative[k]) {
+                c->relative_corners.push_back(obj->corners.size());
+            }
+
+            obj->corners.push_back(corner.values[k]);
+        }
+    };
+
+    const C8 *p = c->begin;
+
+    while (p < c->end) {
+        const C8 *line_end = static_cast<const C8 *>(memchr(p, '\n', c->end - p));
+        if (line_end == nullptr) {
+            line_end = c->end;
+        }
+
+        p = obj_skip_spaces(p, line_end);
+
+        if (obj_keyword(&p, line_end, "v")) {
+            F32 v[3]{};
+            obj_parse_floats(p, line_end, v, 3);
+            obj->positions.emplace_back(v[0], v[1], v[2]);
+
+        } else if (obj_keyword(&p, line_end, "vt")) {
+            F32 uv[2]{};
+            obj_parse_floats(p, line_end, uv, 2);
+            obj->uvs.emplace_back(uv[0], uv[1]);
+
+        } else if (obj_keyword(&p, line_end, "vn")) {
+            F32 n[3]{};
+            obj_parse_floats(p, line_end, n, 3);
+            obj->normals.emplace_back(n[0], n[1], n[2]);
+
+        } else if (obj_keyword(&p, line_end, "f")) {
+            S32 counts[3] = {
+                static_cast<S32>(obj->positions.size()),
+                static_cast<S32>(obj->uvs.size()),
+                static_cast<S32>(obj->normals.size()),
+            };
+
+            Corner first{}, previous{};
+            S32 count = 0;
+
+            while (true) {
+                p = obj_skip_spaces(p, line_end);
+
+                // NOTE: Corner is `p`, `p/t`, `p//n` or `p/t/n`.
+                Corner corner{{-1, -1, -1}, {false, false, false}};
+                const C8 *word_end = obj_skip_word(p, line_end);
+
+                for (S32 k = 0; k < 3 && p < word_end; ++k) {
+                    S32 value = 0;
+                    auto [ptr, error] = std::from_chars(p, word_end, value);
+
+                    // NOTE: In .obj index values starts from 1, negative ones
+                    // are counted back from the last vertex.
+                    if (error == std::errc{} && value < 0) {
+                        corner.values[k] = counts[k] + value;
+                        corner.relative[k] = true;
+                    } else if (error == std::errc{} && value > 0) {
+                        corner.values[k] = value - 1;
+                    } else if (k == 0) {
+                        break;
+                    }
+
+                    p = ptr;
+                    if (p < word_end && *p == '/') {
+                        ++p;
+                    }
+                }
+
+                if (p == word_end && corner.values[0] == -1 && !corner.relative[0]) {
+                    break;
+                }
+
+                p = word_end;
+
+                if (count >= 3) {
+                    push_corner(first);
+                    push_corner(previous);
+                }
+
+                push_corner(corner);
+
+                if (count == 0) {
+                    first = corner;
+                }
+                previous = corner;
+
+                ++count;
+            }
+
+            // NOTE: Dropping lines and points.
+            if (count > 0 && count < 3) {
+                obj->corners.resize(obj->corners.size() - count * 3);
+
+                while (!c->relative_corners.empty() && c->relative_corners.back() >= obj->corners.size()) {
+                    c->relative_corners.pop_back();
+                }
+            }
+
+        } else if (obj_keyword(&p, line_end, "usemtl")) {
+            obj->material_uses.push_back({std::string(obj_rest_of_line(p, line_end)), obj->corners.size() / 9});
+
+        } else if (obj_keyword(&p, line_end, "mtllib")) {
+            while (true) {
+                p = obj_skip_spaces(p, line_end);
+                if (p >= line_end) {
+                    break;
+                }
+
+                const C8 *word_end = obj_skip_word(p, line_end);
+                obj->material_libraries.emplace_back(p, word_end);
+                p = word_end;
+            }
+        }
+
+        p = line_end + 1;
+    }
+}
+
+static void
+obj_gather_chunk(void *data, U32 chunk_index, [[maybe_unused]] U32 worker_index)
+{
+    Obj_Load_Data *d = static_cast<Obj_Load_Data *>(data);
+    Obj_Chunk *c = d->chunks + chunk_index;
+
+    S32 offsets[3] = {
+        static_cast<S32>(c->positions_offset),
+        static_cast<S32>(c->uvs_offset),
+        static_cast<S32>(c->normals_offset),
+    };
+
+    for (USZ position : c->relative_corners) {
+        c->obj.corners[position] += offsets[position % 3];
+    }
+
+    std::copy(c->obj.positions.begin(), c->obj.positions.end(), d->obj->positions.begin() + c->positions_offset);
+    std::copy(c->obj.uvs.begin(), c->obj.uvs.end(), d->obj->uvs.begin() + c->uvs_offset);
+    std::copy(c->obj.normals.begin(), c->obj.normals.end(), d->obj->normals.begin() + c->normals_offset);
+    std::copy(c->obj.corners.begin(), c->obj.corners.end(), d->obj->corners.begin() + c->corners_offset);
+
+    c->obj = {};
+}
+
+Obj_File
+load_obj(std::string_view file_name, Thread_Pool *pool)
+{
+    Obj_File obj{};
+
+    USZ file_size = 0;
+    const C8 *file = static_cast<const C8 *>(platform_map_file(std::string(file_name).c_str(), &file_size));
+    if (file == nullptr) {
+        return obj;
+    }
+
+    USZ chunks_count = 1;
+    if (pool != nullptr) {
+        chunks_count = std::clamp<USZ>(file_size / OBJ_CHUNK_MIN_SIZE, 1, pool->workers_count * 4);
+    }
+
+    std::vector<Obj_Chunk> chunks(chunks_count);
+
+    const C8 *file_end = file + file_size;
+    const C8 *chunk_begin = file;
+
+    for (USZ i = 0; i < chunks_count; ++i) {
+        const C8 *chunk_end = file_end;
+
+        if (i + 1 < chunks_count) {
+            // NOTE: Moving end of the chunk past the end of the line.
+            chunk_end = std::max(chunk_begin, file + file_size / chunks_count * (i + 1));
+            const C8 *line_end = static_cast<const C8 *>(memchr(chunk_end, '\n', file_end - chunk_end));
+            chunk_end = line_end != nullptr ? line_end + 1 : file_end;
+        }
+
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    Obj_Load_Data data{chunks.data(), &obj};
+
+    if (pool != nullptr && chunks_count > 1) {
+        pool->parallel_for(static_cast<U32>(chunks_count), obj_parse_chunk, &data);
+    } else {
+        obj_parse_chunk(&data, 0, 0);
+    }
+
+    USZ positions_count = 0, uvs_count = 0, normals_count = 0, corners_count = 0;
+
+    for (Obj_Chunk &c : chunks) {
+        c.positions_offset = positions_count;
+        c.uvs_offset = uvs_count;
+        c.normals_offset = normals_count;
+        c.corners_offset = corners_count;
+
+        positions_count += c.obj.positions.size();
+        uvs_count += c.obj.uvs.size();
+        normals_count += c.obj.normals.size();
+        corners_count += c.obj.corners.size();
+
+        // NOTE: Those are few, so just moving them over serially.
+        for (Obj_File::Material_Use &use : c.obj.material_uses) {
+            use.triangles_begin += c.corners_offset / 9;
+            obj.material_uses.push_back(std::move(use));
+        }
+
+        for (std::string &library : c.obj.material_libraries) {
+            obj.material_libraries.push_back(std::move(library));
+        }
+    }
+
+    obj.positions.resize(positions_count);
+    obj.uvs.resize(uvs_count);
+    obj.normals.resize(normals_count);
+    obj.corners.resize(corners_count);
+
+    if (pool != nullptr && chunks_count > 1) {
+        pool->parallel_for(static_cast<U32>(chunks_count), obj_gather_chunk, &data);
+    } else {
+        obj_gather_chunk(&data, 0, 0);
+    }
+
+    platform_unmap_file(const_cast<C8 *>(file), file_size);
+
+    return obj;
+}
+
+bool
+load_mtl(std::string_view file_name, std::vector<Material> *materials)
+{
+    USZ file_size = 0;
+    const C8 *file = static_cast<const C8 *>(platform_map_file(std::string(file_name).c_str(), &file_size));
+    if (file == nullptr) {
+        return false;
+    }
+
+    const C8 *file_end = file + file_size;
+    const C8 *p = file;
+
+    Material *material = nullptr;
+
+    while (p < file_end) {
+        const C8 *line_end = static_cast<const C8 *>(memchr(p, '\n', file_end - p));
+        if (line_end == nullptr) {
+            line_end = file_end;
+        }
+
+        p = obj_skip_spaces(p, line_end);
+
+        if (obj_keyword(&p, line_end, "newmtl")) {
+            material = &materials->emplace_back();
+            material->name = obj_rest_of_line(p, line_end);
+        } else if (material == nullptr) {
+            // NOTE: Anything before first `newmtl` doesn't belong to any material.
+        } else if (obj_keyword(&p, line_end, "Ka")) {
+            obj_parse_floats(p, line_end, &material->ambient.x, 3);
+        } else if (obj_keyword(&p, line_end, "Kd")) {
+            obj_parse_floats(p, line_end, &material->diffuse.x, 3);
+        } else if (obj_keyword(&p, line_end, "Ks")) {
+            obj_parse_floats(p, line_end, &material->specular.x, 3);
+        } else if (obj_keyword(&p, line_end, "Ns")) {
+            obj_parse_floats(p, line_end, &material->shininess, 1);
+        } else if (obj_keyword(&p, line_end, "d")) {
+            obj_parse_floats(p, line_end, &material->opacity, 1);
+        } else if (obj_keyword(&p, line_end, "Tr")) {
+            F32 transparency = 0;
+            obj_parse_floats(p, line_end, &transparency, 1);
+            material->opacity = 1 - transparency;
+        } else if (obj_keyword(&p, line_end, "map_Kd")) {
+            // NOTE: Options like `-s 1 1 1` are not supported, file name is the last word.
+            std::string_view rest = obj_rest_of_line(p, line_end);
+            USZ last_space = rest.find_last_of(" \t");
+            material->diffuse_map = last_space == std::string_view::npos ? rest : rest.substr(last_space + 1);
+        }
+
+        p = line_end + 1;
+    }
+
+    platform_unmap_file(const_cast<C8 *>(file), file_size);
+
+    return true;
+}
+
+//
+// Post-transform vertex cache optimization.
+//
+
+#define VERTEX_CACHE_VALENCE_MAX 64  // NOTE: Vertexes with more triangles left than that are scored the same.
+
+struct Vertex_Cache_Scores {
+    F32 cache[VERTEX_CACHE_SIZE]{};
+    F32 valence[VERTEX_CACHE_VALENCE_MAX + 1]{};
+
+    Vertex_Cache_Scores(void)
+    {
+        for (S32 i = 0; i < VERTEX_CACHE_SIZE; ++i) {
+            if (i < 3) {
+                // NOTE: Vertexes of the last triangle are scored a bit lower,
+                // so strips are not walked back and forth.
+                this->cache[i] = 0.75f;
+            } else {
+                F32 scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+                this->cache[i] = std::pow(1.0f - static_cast<F32>(i - 3) * scale, 1.5f);
+            }
+        }
+
+        // NOTE: Vertexes with few triangles left are boosted, to get rid of
+        // them and not leave lone triangles behind.
+        for (S32 i = 1; i <= VERTEX_CACHE_VALENCE_MAX; ++i) {
+            this->valence[i] = 2.0f * std::pow(static_cast<F32>(i), -0.5f);
+        }
+    }
+};
+
+static F32
+vertex_cache_score(const Vertex_Cache_Scores *scores, S32 cache_position, U32 triangles_left)
+{
+    if (triangles_left == 0) {
+        return -1;
+    }
+
+    F32 score = cache_position >= 0 ? scores->cache[cache_position] : 0;
+    score += scores->valence[std::min<U32>(triangles_left, VERTEX_CACHE_VALENCE_MAX)];
+
+    return score;
+}
+
+void
+optimize_vertex_cache(S32 *indexes, USZ indexes_count)
+{
+    USZ triangles_count = indexes_count / 3;
+    if (triangles_count < 2) {
+        return;
+    }
+
+    persist_var const Vertex_Cache_Scores scores{};
+
+    // NOTE: Remapping vertexes to the local ones, so all per-vertex arrays
+    // are as big as this range needs.
+    auto [ min_index, max_index ] = std::minmax_element(indexes, indexes + indexes_count);
+    S32 index_base = *min_index;
+
+    std::vector<S32> local_of(*max_index - index_base + 1, -1);
+    std::vector<S32> unique{};
+    std::vector<S32> locals(indexes_count);
+
+    for (USZ i = 0; i < indexes_count; ++i) {
+        S32 *local = &local_of[indexes[i] - index_base];
+
+        if (*local < 0) {
+            *local = static_cast<S32>(unique.size());
+            unique.push_back(indexes[i]);
+        }
+
+        locals[i] = *local;
+    }
+
+    USZ vertexes_count = unique.size();
+
+    // NOTE: Triangles of every vertex, packed one after another. Emitted
+    // ones are swapped to the back of the vertex range, so first
+    // `triangles_left` of it are the ones still to go.
+    std::vector<U32> triangles_left(vertexes_count, 0);
+    std::vector<U32> adjacency_begin(vertexes_count + 1, 0);
+
+    for (S32 index : locals) {
+        ++triangles_left[index];
+    }
+
+    for (USZ v = 0; v < vertexes_count; ++v) {
+        adjacency_begin[v + 1] = adjacency_begin[v] + triangles_left[v];
+    }
+
+    std::vector<U32> adjacency(indexes_count);
+    std::vector<U32> adjacency_fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+
+    for (USZ i = 0; i < indexes_count; ++i) {
+        adjacency[adjacency_fill[locals[i]]++] = static_cast<U32>(i / 3);
+    }
+
+    std::vector<S32> cache_positions(vertexes_count, -1);
+    std::vector<F32> vertex_scores(vertexes_count);
+
+    for (USZ v = 0; v < vertexes_count; ++v) {
+        vertex_scores[v] = vertex_cache_score(&scores, -1, triangles_left[v]);
+    }
+
+    std::vector<F32> triangle_scores(triangles_count);
+    std::vector<bool> emitted(triangles_count, false);
+
+    S64 best_triangle = -1;
+    F32 best_score = -1;
+
+    for (USZ t = 0; t < triangles_count; ++t) {
+        const S32 *v = &locals[t * 3];
+        triangle_scores[t] = vertex_scores[v[0]] + vertex_scores[v[1]] + vertex_scores[v[2]];
+
+        if (triangle_scores[t] > best_score) {
+            best_score = triangle_scores[t];
+            best_triangle = static_cast<S64>(t);
+        }
+    }
+
+    // NOTE: Cache holds 3 extra entries, those are vertexes which are just
+    // pushed out, their scores have to be updated too.
+    S32 cache[VERTEX_CACHE_SIZE + 3];
+    S32 cache_count = 0;
+
+    USZ output_count = 0;
+    USZ scan_cursor = 0;
+
+    while (output_count < triangles_count) {
+        if (best_triangle < 0) {
+            // NOTE: Nothing in the cache has triangles left, picking next
+            // one in the original order.
+            while (emitted[scan_cursor]) {
+                ++scan_cursor;
+            }
+            best_triangle = static_cast<S64>(scan_cursor);
+        }
+
+        USZ t = static_cast<USZ>(best_triangle);
+        const S32 *triangle = &locals[t * 3];
+
+        emitted[t] = true;
+
+        for (S32 k = 0; k < 3; ++k) {
+            S32 v = triangle[k];
+            indexes[output_count * 3 + k] = unique[v];
+
+            // NOTE: Moving emitted triangle out of vertex's list.
+            U32 *list = &adjacency[adjacency_begin[v]];
+            U32 last = --triangles_left[v];
+
+            for (U32 i = 0; i <= last; ++i) {
+                if (list[i] == t) {
+                    std::swap(list[i], list[last]);
+                    break;
+                }
+            }
+        }
+
+        ++output_count;
+
+        S32 new_cache[VERTEX_CACHE_SIZE + 3];
+        S32 new_cache_count = 0;
+
+        for (S32 k = 0; k < 3; ++k) {
+            new_cache[new_cache_count++] = triangle[k];
+        }
+
+        for (S32 i = 0; i < cache_count; ++i) {
+            S32 v = cache[i];
+
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2] && new_cache_count < VERTEX_CACHE_SIZE + 3) {
+                new_cache[new_cache_count++] = v;
+            }
+        }
+
+        // NOTE: Vertexes which fell out of the cache completely still have to
+        // lose their cache bonus.
+        for (S32 i = 0; i < cache_count; ++i) {
+            cache_positions[cache[i]] = -1;
+        }
+
+        for (S32 i = 0; i < new_cache_count; ++i) {
+            S32 v = new_cache[i];
+            cache_positions[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+        }
+
+        for (S32 i = 0; i < cache_count; ++i) {
+            S32 v = cache[i];
+            vertex_scores[v] = vertex_cache_score(&scores, cache_positions[v], triangles_left[v]);
+        }
+
+        for (S32 i = 0; i < new_cache_count; ++i) {
+            S32 v = new_cache[i];
+            vertex_scores[v] = vertex_cache_score(&scores, cache_positions[v], triangles_left[v]);
+        }
+
+        best_triangle = -1;
+        best_score = -1;
+
+        for (S32 i = 0; i < new_cache_count; ++i) {
+            S32 v = new_cache[i];
+            const U32 *list = &adjacency[adjacency_begin[v]];
+
+            for (U32 j = 0; j < triangles_left[v]; ++j) {
+                U32 other = list[j];
+                const S32 *o = &locals[other * 3];
+
+                triangle_scores[other] = vertex_scores[o[0]] + vertex_scores[o[1]] + vertex_scores[o[2]];
+
+                if (triangle_scores[other] > best_score) {
+                    best_score = triangle_scores[other];
+                    best_triangle = other;
+                }
+            }
+        }
+
+        std::copy(new_cache, new_cache + new_cache_count, cache);
+        cache_count = std::min(new_cache_count, VERTEX_CACHE_SIZE);
+    }
+}
+
+F32
+measure_vertex_cache_misses(const S32 *indexes, USZ indexes_count, U32 cache_size)
+{
+    if (indexes_count < 3) {
+        return 0;
+    }
+
+    std::vector<S32> fifo(cache_size, -1);
+    U32 fifo_head = 0;
+    USZ misses = 0;
+
+    for (USZ i = 0; i < indexes_count; ++i) {
+        if (std::find(fifo.begin(), fifo.end(), indexes[i]) == fifo.end()) {
+            fifo[fifo_head] = indexes[i];
+            fifo_head = (fifo_head + 1) % cache_size;
+            ++misses;
+        }
+    }
+
+    return static_cast<F32>(misses) / static_cast<F32>(indexes_count / 3);
+}
+
+//
+// Bounding volume hierarchy.
+//
+
+#define BVH_BUILD_MAX_TASKS 64
+#define BVH_PARALLEL_MIN_ITEMS 4096  // NOTE: Smaller trees are built faster than workers wake up.
+
+static inline F32
+bvh_axis(V3 v, S32 axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static inline V3
+bvh_center(const Bvh_Bounds &b)
+{
+    return (b.min + b.max) * 0.5f;
+}
+
+static inline F32
+bvh_half_area(const Bvh_Bounds &b)
+{
+    V3 d = b.max - b.min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static inline void
+bvh_grow(Bvh_Bounds *b, const Bvh_Bounds &other)
+{
+    b->min = {std::min(b->min.x, other.min.x), std::min(b->min.y, other.min.y), std::min(b->min.z, other.min.z)};
+    b->max = {std::max(b->max.x, other.max.x), std::max(b->max.y, other.max.y), std::max(b->max.z, other.max.z)};
+}
+
+struct Bvh_Build_Task {
+    U32 node;
+    U32 parent;
+    U32 begin;
+    U32 end;
+    U32 depth;
+};
+
+struct Bvh_Build {
+    Bvh *bvh;
+    const Bvh_Bounds *bounds;
+    U32 leaf_size;
+
+    // NOTE: Nodes this deep are not built right away, but saved into `tasks`
+    // for the workers. `BVH_NODE_NONE` builds everything.
+    U32 tasks_depth;
+    Bvh_Build_Task *tasks;
+    U32 tasks_count;
+};
+
+static void
+bvh_build_node(Bvh_Build *b, U32 node_index, U32 parent, U32 begin, U32 end, U32 depth)
+{
+    Bvh *bvh = b->bvh;
+    U32 *items = bvh->items.data();
+    U32 count = end - begin;
+
+    if (depth == b->tasks_depth && count > b->leaf_size) {
+        b->tasks[b->tasks_count++] = {node_index, parent, begin, end, depth};
+        return;
+    }
+
+    Bvh_Node *node = &bvh->nodes[node_index];
+    bvh->parents[node_index] = parent;
+
+    Bvh_Bounds bounds = b->bounds[items[begin]];
+    V3 first_center = bvh_center(bounds);
+    Bvh_Bounds centers{first_center, first_center};
+
+    for (U32 i = begin + 1; i < end; ++i) {
+        const Bvh_Bounds &item = b->bounds[items[i]];
+        V3 center = bvh_center(item);
+
+        bvh_grow(&bounds, item);
+        bvh_grow(&centers, {center, center});
+    }
+
+    node->bounds = bounds;
+
+    if (count <= b->leaf_size) {
+        node->first = begin;
+        node->count = count;
+
+        for (U32 i = begin; i < end; ++i) {
+            bvh->item_leaves[items[i]] = node_index;
+        }
+
+        return;
+    }
+
+    V3 extent = centers.max - centers.min;
+    S32 axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    F32 axis_min = bvh_axis(centers.min, axis);
+    F32 axis_extent = bvh_axis(extent, axis);
+
+    U32 mid = begin + count / 2;
+
+    if (axis_extent > 0 && depth < BVH_MAX_DEPTH / 2) {
+        F32 scale = BVH_BINS_COUNT / axis_extent;
+
+        auto bin_of = [b, axis, axis_min, scale](U32 item) -> S32 {
+            F32 position = bvh_axis(bvh_center(b->bounds[item]), axis);
+            return std::min(static_cast<S32>((position - axis_min) * scale), BVH_BINS_COUNT - 1);
+        };
+
+        Bvh_Bounds bins[BVH_BINS_COUNT]{};
+        U32 bins_counts[BVH_BINS_COUNT]{};
+
+        for (U32 i = begin; i < end; ++i) {
+            S32 bin = bin_of(items[i]);
+
+            if (bins_counts[bin]++ == 0) {
+                bins[bin] = b->bounds[items[i]];
+            } else {
+                bvh_grow(&bins[bin], b->bounds[items[i]]);
+            }
+        }
+
+        // NOTE: Split `k` puts bins up to `k` to the left. Right sides
+        // of every split are swept first, then left ones.
+        F32 right_areas[BVH_BINS_COUNT]{};
+        U32 right_counts[BVH_BINS_COUNT]{};
+        Bvh_Bounds side{};
+        U32 side_count = 0;
+
+        for (S32 k = BVH_BINS_COUNT - 1; k > 0; --k) {
+            if (bins_counts[k] > 0) {
+                if (side_count == 0) {
+                    side = bins[k];
+                } else {
+                    bvh_grow(&side, bins[k]);
+                }
+                side_count += bins_counts[k];
+            }
+
+            right_areas[k - 1] = side_count > 0 ? bvh_half_area(side) : 0;
+            right_counts[k - 1] = side_count;
+        }
+
+        S32 best_split = -1;
+        F32 best_cost = 0;
+        side_count = 0;
+
+        for (S32 k = 0; k < BVH_BINS_COUNT - 1; ++k) {
+            if (bins_counts[k] > 0) {
+                if (side_count == 0) {
+                    side = bins[k];
+                } else {
+                    bvh_grow(&side, bins[k]);
+                }
+                side_count += bins_counts[k];
+            }
+
+            if (side_count == 0 || right_counts[k] == 0) {
+                continue;
+            }
+
+            F32 cost = bvh_half_area(side) * side_count + right_areas[k] * right_counts[k];
+
+            if (best_split < 0 || cost < best_cost) {
+                best_split = k;
+                best_cost = cost;
+            }
+        }
+
+        if (best_split >= 0) {
+            mid = static_cast<U32>(std::partition(items + begin, items + end, [&bin_of, best_split](U32 item) {
+                return bin_of(item) <= best_split;
+            }) - items);
+        }
+    } else if (axis_extent > 0) {
+        // NOTE: Too deep already, halving the items so it's not getting
+        // any deeper than `BVH_MAX_DEPTH`.
+        std::nth_element(items + begin, items + mid, items + end, [b, axis](U32 l, U32 r) {
+            return bvh_axis(bvh_center(b->bounds[l]), axis) < bvh_axis(bvh_center(b->bounds[r]), axis);
+        });
+    }
+
+    U32 left = node_index + 1;
+    U32 right = node_index + 2 * (mid - begin);
+
+    node->first = right;
+    node->count = 0;
+
+    bvh_build_node(b, left, node_index, begin, mid, depth + 1);
+    bvh_build_node(b, right, node_index, mid, end, depth + 1);
+}
+
+static void
+bvh_build_task(void *data, U32 task_index, [[maybe_unused]] U32 worker_index)
+{
+    const Bvh_Build *b = static_cast<const Bvh_Build *>(data);
+    const Bvh_Build_Task *task = &b->tasks[task_index];
+
+    Bvh_Build build{b->bvh, b->bounds, b->leaf_size, BVH_NODE_NONE, nullptr, 0};
+    bvh_build_node(&build, task->node, task->parent, task->begin, task->end, task->depth);
+}
+
+void
+Bvh::build(std::span<const Bvh_Bounds> bounds, U32 leaf_size, Thread_Pool *pool)
+{
+    assert(leaf_size > 0);
+
+    U32 count = static_cast<U32>(bounds.size());
+    USZ nodes_count = count > 0 ? 2 * static_cast<USZ>(count) - 1 : 0;
+
+    this->nodes.assign(nodes_count, Bvh_Node{});
+    this->parents.assign(nodes_count, BVH_NODE_NONE);
+    this->refit_marks.assign(nodes_count, 0);
+    this->refit_nodes.clear();
+    this->refit_nodes.reserve(nodes_count);
+    this->items.resize(count);
+    this->item_leaves.resize(count);
+
+    for (U32 i = 0; i < count; ++i) {
+        this->items[i] = i;
+    }
+
+    this->cost = 0;
+    this->built_cost = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    Bvh_Build_Task tasks[BVH_BUILD_MAX_TASKS];
+    Bvh_Build build{this, bounds.data(), leaf_size, BVH_NODE_NONE, tasks, 0};
+
+    // NOTE: Few subtrees per worker, so ones which got bigger
+    // subtrees are not holding up everyone else.
+    if (pool != nullptr && pool->workers_count > 1 && count >= BVH_PARALLEL_MIN_ITEMS) {
+        build.tasks_depth = 0;
+
+        while ((1U << build.tasks_depth) < pool->workers_count * 4 && (2U << build.tasks_depth) <= BVH_BUILD_MAX_TASKS) {
+            ++build.tasks_depth;
+        }
+    }
+
+    bvh_build_node(&build, 0, BVH_NODE_NONE, 0, count, 0);
+
+    if (build.tasks_count > 0) {
+        pool->parallel_for(build.tasks_count, bvh_build_task, &build);
+    }
+
+    for (const Bvh_Node &node : this->nodes) {
+        if (node.first != BVH_NODE_NONE) {
+            this->cost += bvh_half_area(node.bounds);
+        }
+    }
+
+    this->built_cost = this->cost;
+}
+
+static void
+bvh_fit_node(Bvh *bvh, std::span<const Bvh_Bounds> bounds, U32 node_index)
+{
+    Bvh_Node *node = &bvh->nodes[node_index];
+    F32 area = bvh_half_area(node->bounds);
+
+    if (node->count > 0) {
+        node->bounds = bounds[bvh->items[node->first]];
+
+        for (U32 i = node->first + 1; i < node->first + node->count; ++i) {
+            bvh_grow(&node->bounds, bounds[bvh->items[i]]);
+        }
+    } else {
+        node->bounds = bvh->nodes[node_index + 1].bounds;
+        bvh_grow(&node->bounds, bvh->nodes[node->first].bounds);
+    }
+
+    bvh->cost += bvh_half_area(node->bounds) - area;
+}
+
+void
+Bvh::refit(std::span<const Bvh_Bounds> bounds, std::span<const U32> moved)
+{
+    for (U32 item : moved) {
+        for (U32 node = this->item_leaves[item]; node != BVH_NODE_NONE && !this->refit_marks[node]; node = this->parents[node]) {
+            this->refit_marks[node] = 1;
+            this->refit_nodes.push_back(node);
+        }
+    }
+
+    // NOTE: Children are always after their parents, so going from the
+    // back fits children first.
+    std::sort(this->refit_nodes.begin(), this->refit_nodes.end(), std::greater<U32>());
+
+    for (U32 node : this->refit_nodes) {
+        bvh_fit_node(this, bounds, node);
+        this->refit_marks[node] = 0;
+    }
+
+    this->refit_nodes.clear();
+}
+
+void
+Bvh::refit(std::span<const Bvh_Bounds> bounds)
+{
+    for (USZ node = this->nodes.size(); node-- > 0;) {
+        if (this->nodes[node].first != BVH_NODE_NONE) {
+            bvh_fit_node(this, bounds, static_cast<U32>(node));
+        }
+    }
+}
+
+bool
+Bvh::degraded(void) const
+{
+    return this->cost > this->built_cost * BVH_REFIT_MAX_COST;
+}
+
+enum Bvh_Overlap : U8 {
+    BVH_OVERLAP_NONE,
+    BVH_OVERLAP_PARTIAL,
+    BVH_OVERLAP_INSIDE,
+};
+
+//
+// Calls `visit(item, inside)` for items of every leaf which `test` didn't
+// tell is outside, in depth first order. Nodes under the one which is inside
+// are not tested.
+//
+template<typename Test, typename Visit>
+static void
+bvh_traverse(const Bvh *bvh, Test test, Visit visit)
+{
+    if (bvh->nodes.empty()) {
+        return;
+    }
+
+    struct Pending {
+        U32 node;
+        bool inside;
+    };
+
+    Pending stack[BVH_MAX_DEPTH + 1];
+    U32 stack_count = 0;
+
+    stack[stack_count++] = {0, false};
+
+    while (stack_count > 0) {
+        Pending pending = stack[--stack_count];
+        const Bvh_Node *node = &bvh->nodes[pending.node];
+        bool inside = pending.inside;
+
+        if (!inside) {
+            Bvh_Overlap overlap = test(node->bounds);
+
+            if (overlap == BVH_OVERLAP_NONE) {
+                continue;
+            }
+
+            inside = overlap == BVH_OVERLAP_INSIDE;
+        }
+
+        if (node->count > 0) {
+            for (U32 i = node->first; i < node->first + node->count; ++i) {
+                visit(bvh->items[i], inside);
+            }
+        } else {
+            stack[stack_count++] = {node->first, inside};
+            stack[stack_count++] = {pending.node + 1, inside};
+        }
+    }
+}
+
+//
+// Clusters.
+//
+
+static inline F32
+v3_dot(V3 a, V3 b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline V3
+v3_cross(V3 a, V3 b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+//
+// Reorders vertexes of the `mesh` in order of the first use by `indexes`, and
+// rewrites `indexes` to match. Vertexes which no index uses are going to the
+// end.
+//
+static void
+remap_vertexes_by_first_use(Mesh *mesh, std::vector<S32> *indexes)
+{
+    std::vector<S32> remap(mesh->vertexes.size(), -1);
+    S32 vertexes_count = 0;
+
+    for (S32 &index : *indexes) {
+        if (remap[index] < 0) {
+            remap[index] = vertexes_count++;
+        }
+        index = remap[index];
+    }
+
+    for (S32 &index : remap) {
+        if (index < 0) {
+            index = vertexes_count++;
+        }
+    }
+
+    auto apply_remap = [&remap](auto *values) {
+        if (values->empty()) {
+            return;
+        }
+
+        std::remove_reference_t<decltype(*values)> reordered(values->size());
+        for (USZ i = 0; i < values->size(); ++i) {
+            reordered[remap[i]] = (*values)[i];
+        }
+
+        *values = std::move(reordered);
+    };
+
+    apply_remap(&mesh->vertexes);
+    apply_remap(&mesh->uvs);
+    apply_remap(&mesh->normals);
+    apply_remap(&mesh->vertex_colors);
+}
+
+void
+build_mesh_clusters(Mesh *mesh, Thread_Pool *pool)
+{
+    mesh->clusters.clear();
+
+    if (mesh->indexes.empty()) {
+        return;
+    }
+
+    Mesh_Group whole_mesh{0, 0, static_cast<U32>(mesh->indexes.size())};
+    const Mesh_Group *groups = mesh->groups.empty() ? &whole_mesh : mesh->groups.data();
+    USZ groups_count = mesh->groups.empty() ? 1 : mesh->groups.size();
+
+    std::vector<S32> indexes{};
+    std::vector<Color4> colors{};
+    indexes.reserve(mesh->indexes.size());
+    colors.reserve(mesh->colors.size());
+
+    std::vector<Bvh_Bounds> triangles_bounds{};
+    Bvh triangles_bvh{};
+
+    for (USZ group_index = 0; group_index < groups_count; ++group_index) {
+        const Mesh_Group *group = &groups[group_index];
+        U32 triangles_count = group->indexes_count / 3;
+
+        triangles_bounds.resize(triangles_count);
+
+        for (U32 t = 0; t < triangles_count; ++t) {
+            const S32 *corners = &mesh->indexes[group->indexes_begin + t * 3];
+            V3 a = mesh->vertexes[corners[0]];
+
+            triangles_bounds[t] = {a, a};
+            bvh_grow(&triangles_bounds[t], {mesh->vertexes[corners[1]], mesh->vertexes[corners[1]]});
+            bvh_grow(&triangles_bounds[t], {mesh->vertexes[corners[2]], mesh->vertexes[corners[2]]});
+        }
+
+        triangles_bvh.build(triangles_bounds, MESH_CLUSTER_TRIANGLES, pool);
+
+        // NOTE: Slots are in depth first order, so clusters which are next to
+        // each other in space mostly are next to each other in the mesh too.
+        // Triangles of the cluster keep order `build_mesh` gave them.
+        for (const Bvh_Node &node : triangles_bvh.nodes) {
+            if (node.first == BVH_NODE_NONE || node.count == 0) {
+                continue;
+            }
+
+            U32 *triangles = triangles_bvh.items.data() + node.first;
+            std::sort(triangles, triangles + node.count);
+
+            Mesh_Cluster cluster{};
+            cluster.indexes_begin = static_cast<U32>(indexes.size());
+            cluster.indexes_count = node.count * 3;
+
+            for (U32 i = 0; i < node.count; ++i) {
+                USZ source = group->indexes_begin + triangles[i] * 3;
+
+                indexes.insert(indexes.end(), mesh->indexes.begin() + source, mesh->indexes.begin() + source + 3);
+
+                if (!mesh->colors.empty()) {
+                    colors.insert(colors.end(), mesh->colors.begin() + source, mesh->colors.begin() + source + 3);
+                }
+            }
+
+            mesh->clusters.push_back(cluster);
+        }
+    }
+
+    // NOTE: New vertexes of every cluster are right after the ones of the
+    // previous cluster.
+    remap_vertexes_by_first_use(mesh, &indexes);
+
+    mesh->indexes = std::move(indexes);
+    mesh->colors = std::move(colors);
+}
+
+//
+// Box and normal cone of every cluster in `[begin, end)`.
+//
+static void
+update_mesh_clusters(Mesh *mesh, U32 begin, U32 end)
+{
+    for (U32 cluster_index = begin; cluster_index < end; ++cluster_index) {
+        Mesh_Cluster *cluster = &mesh->clusters[cluster_index];
+        Bvh_Bounds *bounds = &mesh->clusters_bounds[cluster_index];
+
+        V3 first = mesh->vertexes[mesh->indexes[cluster->indexes_begin]];
+        *bounds = {first, first};
+
+        for (U32 i = cluster->indexes_begin + 1; i < cluster->indexes_begin + cluster->indexes_count; ++i) {
+            V3 corner = mesh->vertexes[mesh->indexes[i]];
+            bvh_grow(bounds, {corner, corner});
+        }
+
+        // NOTE: Degenerate triangles are left out, they are culled no
+        // matter which way they are facing.
+        V3 normals[MESH_CLUSTER_TRIANGLES];
+        U32 normals_count = 0;
+        V3 axis{};
+
+        for (U32 i = cluster->indexes_begin; i < cluster->indexes_begin + cluster->indexes_count; i += 3) {
+            V3 a = mesh->vertexes[mesh->indexes[i]];
+            V3 b = mesh->vertexes[mesh->indexes[i + 1]];
+            V3 c = mesh->vertexes[mesh->indexes[i + 2]];
+
+            V3 normal = v3_cross(b - a, c - a);
+            F32 length = std::sqrt(v3_dot(normal, normal));
+
+            if (length > 0) {
+                normals[normals_count++] = normal * (1.0f / length);
+                axis = axis + normals[normals_count - 1];
+            }
+        }
+
+        F32 axis_length = std::sqrt(v3_dot(axis, axis));
+
+        cluster->cone_axis = {};
+        cluster->cone_cutoff = 2;
+
+        if (axis_length > 0) {
+            axis = axis * (1.0f / axis_length);
+
+            F32 min_dot = 1;
+
+            for (U32 i = 0; i < normals_count; ++i) {
+                min_dot = std::min(min_dot, v3_dot(normals[i], axis));
+            }
+
+            // NOTE: Cone wider than half of the sphere never has all
+            // triangles facing same way.
+            if (min_dot > 0) {
+                cluster->cone_axis = axis;
+                cluster->cone_cutoff = std::sqrt(std::max(1 - min_dot * min_dot, 0.0f)) + MESH_CLUSTER_CONE_MARGIN;
+            }
+        }
+    }
+}
+
+#define CLUSTERS_CHUNK_SIZE 256
+
+static void
+update_mesh_clusters_chunk(void *data, U32 chunk_index, [[maybe_unused]] U32 worker_index)
+{
+    Mesh *mesh = static_cast<Mesh *>(data);
+
+    U32 begin = chunk_index * CLUSTERS_CHUNK_SIZE;
+    U32 end = std::min<U32>(begin + CLUSTERS_CHUNK_SIZE, static_cast<U32>(mesh->clusters.size()));
+
+    update_mesh_clusters(mesh, begin, end);
+}
+
+//
+// Vertex deduplication.
+//
+// Open addressing hash table from corner triplet to the index of the vertex.
+//
+
+struct Vertex_Key {
+    S32 position = -1, uv = -1, normal = -1;
+
+    constexpr bool
+    operator== (const Vertex_Key &other) const noexcept
+    {
+        return this->position == other.position && this->uv == other.uv && this->normal == other.normal;
+    }
+};
+
+constexpr U64
+hash_vertex_key(Vertex_Key key) noexcept
+{
+    U64 hash = static_cast<U32>(key.position);
+    hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<U32>(key.uv);
+    hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<U32>(key.normal);
+    return hash ^ (hash >> 29);
+}
+
+Mesh
+build_mesh(const Obj_File *obj)
+{
+    Mesh mesh{};
+
+    USZ triangles_count = obj->corners.size() / 9;
+
+    bool has_uvs = !obj->uvs.empty();
+    bool has_normals = !obj->normals.empty();
+
+    USZ table_size = std::bit_ceil(std::max<USZ>(triangles_count * 3 * 2, 16));
+    std::vector<Vertex_Key> table_keys(table_size);
+    std::vector<S32> table_values(table_size, -1);
+
+    auto find_or_add_vertex = [&](Vertex_Key key) -> S32 {
+        USZ slot = hash_vertex_key(key) & (table_size - 1);
+
+        while (table_values[slot] >= 0) {
+            if (table_keys[slot] == key) {
+                return table_values[slot];
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        S32 index = static_cast<S32>(mesh.vertexes.size());
+        table_keys[slot] = key;
+        table_values[slot] = index;
+
+        mesh.vertexes.push_back(obj->positions[key.position]);
+
+        if (has_uvs) {
+            mesh.uvs.push_back(key.uv >= 0 ? obj->uvs[key.uv] : V2{});
+        }
+
+        if (has_normals) {
+            mesh.normals.push_back(key.normal >= 0 ? obj->normals[key.normal] : V3{});
+        }
+
+        return index;
+    };
+
+    // NOTE: Triangles before the first `usemtl` are using default material.
+    std::vector<Obj_File::Material_Use> uses{};
+    if (obj->material_uses.empty() || obj->material_uses.front().triangles_begin > 0) {
+        uses.push_back({"", 0});
+    }
+    uses.insert(uses.end(), obj->material_uses.begin(), obj->material_uses.end());
+
+    mesh.indexes.reserve(obj->corners.size() / 3);
+
+    for (USZ use_index = 0; use_index < uses.size(); ++use_index) {
+        USZ begin = uses[use_index].triangles_begin;
+        USZ end = use_index + 1 < uses.size() ? uses[use_index + 1].triangles_begin : triangles_count;
+
+        if (begin >= end) {
+            continue;
+        }
+
+        U32 material = 0;
+        while (material < mesh.materials.size() && mesh.materials[material].name != uses[use_index].name) {
+            ++material;
+        }
+
+        if (material == mesh.materials.size()) {
+            mesh.materials.push_back({});
+            mesh.materials.back().name = uses[use_index].name;
+        }
+
+        // NOTE: Merging with previous group if it's the same material.
+        if (mesh.groups.empty() || mesh.groups.back().material != material) {
+            mesh.groups.push_back({material, static_cast<U32>(mesh.indexes.size()), 0});
+        }
+
+        for (USZ t = begin; t < end; ++t) {
+            const S32 *corners = &obj->corners[t * 9];
+            Vertex_Key keys[3]{};
+            bool valid = true;
+
+            for (S32 k = 0; k < 3; ++k) {
+                const S32 *corner = corners + k * 3;
+
+                // NOTE: Broken position index drops the triangle, broken
+                // uv or normal is treated as missing.
+                valid = valid && corner[0] >= 0 && static_cast<USZ>(corner[0]) < obj->positions.size();
+
+                keys[k].position = corner[0];
+                keys[k].uv = corner[1] >= 0 && static_cast<USZ>(corner[1]) < obj->uvs.size() ? corner[1] : -1;
+                keys[k].normal = corner[2] >= 0 && static_cast<USZ>(corner[2]) < obj->normals.size() ? corner[2] : -1;
+            }
+
+            if (!valid) {
+                continue;
+            }
+
+            for (S32 k = 0; k < 3; ++k) {
+                mesh.indexes.push_back(find_or_add_vertex(keys[k]));
+            }
+        }
+
+        mesh.groups.back().indexes_count = static_cast<U32>(mesh.indexes.size()) - mesh.groups.back().indexes_begin;
+    }
+
+    for (const Mesh_Group &group : mesh.groups) {
+        optimize_vertex_cache(mesh.indexes.data() + group.indexes_begin, group.indexes_count);
+    }
+
+    // NOTE: Setup is reading vertexes front to back too.
+    remap_vertexes_by_first_use(&mesh, &mesh.indexes);
+
+    return mesh;
+}
+
+//
+// Binary mesh cache.
+//
+
+#define MESH_CACHE_MAGIC   0x434d5253  // NOTE: "SRMC" in little endian.
+#define MESH_CACHE_VERSION 4
+
+struct Mesh_Cache_Header {
+    U32 magic = MESH_CACHE_MAGIC;
+    U32 version = MESH_CACHE_VERSION;
+
+    // NOTE: Of the source file, cache is stale if any of those changed.
+    U64 source_size = 0;
+    S64 source_time = 0;
+
+    U64 vertexes_count = 0;
+    U64 uvs_count = 0;
+    U64 normals_count = 0;
+    U64 indexes_count = 0;
+    U64 groups_count = 0;
+    U64 clusters_count = 0;
+
+    // NOTE: Material names and `.mtl` library names are following the arrays,
+    // each as U32 length and the bytes.
+    U64 materials_count = 0;
+    U64 libraries_count = 0;
+};
+
+static bool
+mesh_cache_source_info(const std::string &file_name, U64 *size, S64 *time)
+{
+    std::error_code error{};
+
+    *size = std::filesystem::file_size(file_name, error);
+    if (error) {
+        return false;
+    }
+
+    *time = std::filesystem::last_write_time(file_name, error).time_since_epoch().count();
+    return !error;
+}
+
+//
+// Cache is trusted only as far as it's arrays are pointing inside of each
+// other, anything else is going to be parsed again from the source.
+//
+static bool
+mesh_cache_consistent(const Mesh *mesh)
+{
+    USZ vertexes_count = mesh->vertexes.size();
+    USZ indexes_count = mesh->indexes.size();
+
+    if ((!mesh->uvs.empty() && mesh->uvs.size() != vertexes_count)
+        || (!mesh->normals.empty() && mesh->normals.size() != vertexes_count)) {
+        return false;
+    }
+
+    for (S32 index : mesh->indexes) {
+        if (index < 0 || static_cast<USZ>(index) >= vertexes_count) {
+            return false;
+        }
+    }
+
+    for (const Mesh_Group &group : mesh->groups) {
+        if (group.indexes_begin > indexes_count
+            || group.indexes_count > indexes_count - group.indexes_begin
+            || group.material >= mesh->materials.size()) {
+            return false;
+        }
+    }
+
+    for (const Mesh_Cluster &cluster : mesh->clusters) {
+        if (cluster.indexes_begin > indexes_count
+            || cluster.indexes_count > indexes_count - cluster.indexes_begin) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+load_mesh_cache(const std::string &cache_name, U64 source_size, S64 source_time, Mesh *mesh, std::vector<std::string> *libraries)
+{
+    USZ size = 0;
+    const Byte *cache = static_cast<const Byte *>(platform_map_file(cache_name.c_str(), &size));
+    if (cache == nullptr) {
+        return false;
+    }
+
+    const Byte *p = cache;
+    const Byte *end = cache + size;
+
+    auto read = [&p, end](void *destination, USZ bytes) -> bool {
+        if (static_cast<USZ>(end - p) < bytes) {
+            return false;
+        }
+
+        memcpy(destination, p, bytes);
+        p += bytes;
+        return true;
+    };
+
+    // NOTE: Counts are checked against what is left before anything is
+    // allocated, so garbage in the header can't ask for more than the file.
+    auto read_array = [&read, &p, end](auto *values, U64 count) -> bool {
+        if (count > static_cast<USZ>(end - p) / sizeof((*values)[0])) {
+            return false;
+        }
+
+        values->resize(count);
+        return read(values->data(), count * sizeof((*values)[0]));
+    };
+
+    auto read_string = [&read](std::string *string) -> bool {
+        U32 length = 0;
+        if (!read(&length, sizeof(length))) {
+            return false;
+        }
+
+        string->resize(length);
+        return read(string->data(), length);
+    };
+
+    Mesh_Cache_Header header{};
+
+    bool valid = read(&header, sizeof(header))
+              && header.magic == MESH_CACHE_MAGIC
+              && header.version == MESH_CACHE_VERSION
+              && header.source_size == source_size
+              && header.source_time == source_time
+              && read_array(&mesh->vertexes, header.vertexes_count)
+              && read_array(&mesh->uvs, header.uvs_count)
+              && read_array(&mesh->normals, header.normals_count)
+              && read_array(&mesh->indexes, header.indexes_count)
+              && read_array(&mesh->groups, header.groups_count)
+              && read_array(&mesh->clusters, header.clusters_count);
+
+    // NOTE: Every string takes at least it's length.
+    valid = valid
+         && header.materials_count <= static_cast<USZ>(end - p) / sizeof(U32)
+         && header.libraries_count <= static_cast<USZ>(end - p) / sizeof(U32);
+
+    if (valid) {
+        mesh->materials.resize(header.materials_count);
+        for (USZ i = 0; i < header.materials_count && valid; ++i) {
+            valid = read_string(&mesh->materials[i].name);
+        }
+
+        libraries->resize(header.libraries_count);
+        for (USZ i = 0; i < header.libraries_count && valid; ++i) {
+            valid = read_string(&(*libraries)[i]);
+        }
+
+        valid = valid && p == end && mesh_cache_consistent(mesh);
+    }
+
+    platform_unmap_file(const_cast<Byte *>(cache), size);
+
+    if (!valid) {
+        *mesh = {};
+        libraries->clear();
+    }
+
+    return valid;
+}
+
+static void
+save_mesh_cache(const std::string &cache_name, U64 source_size, S64 source_time, const Mesh *mesh, const std::vector<std::string> &libraries)
+{
+    Mesh_Cache_Header header{};
+    header.source_size = source_size;
+    header.source_time = source_time;
+    header.vertexes_count = mesh->vertexes.size();
+    header.uvs_count = mesh->uvs.size();
+    header.normals_count = mesh->normals.size();
+    header.indexes_count = mesh->indexes.size();
+    header.groups_count = mesh->groups.size();
+    header.clusters_count = mesh->clusters.size();
+    header.materials_count = mesh->materials.size();
+    header.libraries_count = libraries.size();
+
+    // NOTE: Written next to the final one and renamed over it, so other
+    // process never maps half written cache. Failures are ignored, we will
+    // just parse `.obj` again next time.
+    std::string temp_name = cache_name + ".tmp";
+
+    FILE *file = fopen(temp_name.c_str(), "wb");
+    if (file == nullptr) {
+        return;
+    }
+
+    bool written = true;
+
+    auto write = [&written, file](const void *source, USZ bytes) {
+        written = written && (bytes == 0 || fwrite(source, bytes, 1, file) == 1);
+    };
+
+    auto write_string = [&write](const std::string &string) {
+        U32 length = static_cast<U32>(string.size());
+        write(&length, sizeof(length));
+        write(string.data(), length);
+    };
+
+    write(&header, sizeof(header));
+    write(mesh->vertexes.data(), mesh->vertexes.size() * sizeof(V3));
+    write(mesh->uvs.data(), mesh->uvs.size() * sizeof(V2));
+    write(mesh->normals.data(), mesh->normals.size() * sizeof(V3));
+    write(mesh->indexes.data(), mesh->indexes.size() * sizeof(S32));
+    write(mesh->groups.data(), mesh->groups.size() * sizeof(Mesh_Group));
+    write(mesh->clusters.data(), mesh->clusters.size() * sizeof(Mesh_Cluster));
+
+    for (const Material &material : mesh->materials) {
+        write_string(material.name);
+    }
+
+    for (const std::string &library : libraries) {
+        write_string(library);
+    }
+
+    written = fclose(file) == 0 && written;
+
+    std::error_code error{};
+    if (written) {
+        std::filesystem::rename(temp_name, cache_name, error);
+    }
+
+    if (!written || error) {
+        std::filesystem::remove(temp_name, error);
+    }
+}
+
+void
+mesh_update_positions(Mesh *mesh, Thread_Pool *pool)
+{
+    mesh->positions.resize(mesh->vertexes.size());
+
+    for (USZ i = 0; i < mesh->vertexes.size(); ++i) {
+        mesh->positions.x[i] = mesh->vertexes[i].x;
+        mesh->positions.y[i] = mesh->vertexes[i].y;
+        mesh->positions.z[i] = mesh->vertexes[i].z;
+    }
+
+    // NOTE: Centered on the box around vertexes, which is not the
+    // smallest sphere, but close enough for culling and sorting.
+    V3 min{}, max{};
+
+    if (!mesh->vertexes.empty()) {
+        min = max = mesh->vertexes[0];
+    }
+
+    for (V3 v : mesh->vertexes) {
+        min = {std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z)};
+        max = {std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z)};
+    }
+
+    mesh->bounds_center = (min + max) * 0.5f;
+
+    F32 radius_squared = 0;
+
+    for (V3 v : mesh->vertexes) {
+        V3 d = v - mesh->bounds_center;
+        radius_squared = std::max(radius_squared, d.x * d.x + d.y * d.y + d.z * d.z);
+    }
+
+    mesh->bounds_radius = std::sqrt(radius_squared);
+
+    U32 clusters_count = static_cast<U32>(mesh->clusters.size());
+    U32 chunks_count = (clusters_count + CLUSTERS_CHUNK_SIZE - 1) / CLUSTERS_CHUNK_SIZE;
+
+    mesh->clusters_bounds.resize(clusters_count);
+
+    if (pool != nullptr && chunks_count > 1) {
+        pool->parallel_for(chunks_count, update_mesh_clusters_chunk, mesh);
+    } else {
+        update_mesh_clusters(mesh, 0, clusters_count);
+    }
+
+    // NOTE: Tree is kept as long as the clusters are the same, and
+    // vertexes didn't move so much it's too loose.
+    if (mesh->clusters_bvh.items.size() == clusters_count && clusters_count > 0) {
+        mesh->clusters_bvh.refit(mesh->clusters_bounds);
+    }
+
+    if (mesh->clusters_bvh.items.size() != clusters_count || mesh->clusters_bvh.degraded()) {
+        mesh->clusters_bvh.build(mesh->clusters_bounds, BVH_LEAF_SIZE, pool);
+    }
+}
+
+Mesh
+load_mesh(std::string_view file_name, Thread_Pool *pool)
+{
+    Mesh mesh{};
+    std::vector<std::string> libraries{};
+
+    std::string source_name(file_name);
+    std::string cache_name = source_name + MESH_CACHE_EXTENSION;
+
+    U64 source_size = 0;
+    S64 source_time = 0;
+    bool has_source_info = mesh_cache_source_info(source_name, &source_size, &source_time);
+
+    if (!(has_source_info && load_mesh_cache(cache_name, source_size, source_time, &mesh, &libraries))) {
+        Obj_File obj = load_obj(file_name, pool);
+        mesh = build_mesh(&obj);
+        libraries = std::move(obj.material_libraries);
+
+        build_mesh_clusters(&mesh, pool);
+
+        if (has_source_info && !mesh.indexes.empty()) {
+            save_mesh_cache(cache_name, source_size, source_time, &mesh, libraries);
+        }
+    }
+
+    // NOTE: Libraries are relative to the `.obj`. Materials which are not
+    // found in any of them keep default values.
+    std::vector<Material> library_materials{};
+    std::filesystem::path directory = std::filesystem::path(source_name).parent_path();
+
+    for (const std::string &library : libraries) {
+        std::filesystem::path library_path = directory / library;
+        USZ first_material = library_materials.size();
+
+        load_mtl(library_path.string(), &library_materials);
+
+        for (USZ i = first_material; i < library_materials.size(); ++i) {
+            std::string *map = &library_materials[i].diffuse_map;
+
+            if (!map->empty()) {
+                *map = (library_path.parent_path() / *map).string();
+            }
+        }
+    }
+
+    for (Material &material : mesh.materials) {
+        for (const Material &library_material : library_materials) {
+            if (library_material.name == material.name) {
+                material = library_material;
+                break;
+            }
+        }
+    }
+
+    // NOTE: Materials could share a texture, it's loaded once.
+    for (USZ i = 0; i < mesh.materials.size(); ++i) {
+        Material *material = &mesh.materials[i];
+
+        if (material->diffuse_map.empty()) {
+            continue;
+        }
+
+        for (USZ k = 0; k < i; ++k) {
+            if (mesh.materials[k].diffuse_map == material->diffuse_map) {
+                material->diffuse_texture = mesh.materials[k].diffuse_texture;
+                break;
+            }
+        }
+
+        if (material->diffuse_texture < 0) {
+            Texture texture = load_texture(material->diffuse_map);
+
+            if (!texture.levels.empty()) {
+                material->diffuse_texture = static_cast<S32>(mesh.textures.size());
+                mesh.textures.push_back(std::move(texture));
+            }
+        }
+    }
+
+    mesh_update_positions(&mesh, pool);
+    paint_mesh_randomly(&mesh);
+
+    return mesh;
+}
+
+Mesh
+make_sphere_mesh(S32 rings, S32 segments, F32 radius)
+{
+    assert(rings >= 2 && segments >= 3);
+
+    Mesh mesh{};
+    mesh.vertexes.reserve((rings + 1) * (segments + 1));
+    mesh.uvs.reserve((rings + 1) * (segments + 1));
+    mesh.normals.reserve((rings + 1) * (segments + 1));
+
+    F32 pi = std::numbers::pi_v<F32>;
+
+    for (S32 ring = 0; ring <= rings; ++ring) {
+        F32 theta = pi * static_cast<F32>(ring) / static_cast<F32>(rings);
+
+        for (S32 segment = 0; segment <= segments; ++segment) {
+            F32 phi = 2 * pi * static_cast<F32>(segment) / static_cast<F32>(segments);
+
+            mesh.vertexes.emplace_back(
+                radius * std::sin(theta) * std::cos(phi),
+                radius * std::cos(theta),
+                radius * std::sin(theta) * std::sin(phi));
+
+            mesh.uvs.emplace_back(
+                static_cast<F32>(segment) / static_cast<F32>(segments),
+                1 - static_cast<F32>(ring) / static_cast<F32>(rings));
+
+            mesh.normals.push_back(mesh.vertexes.back() * (1 / radius));
+        }
+    }
+
+    // NOTE: Wound same way as faces in `assets/cube.obj`, so outside is
+    // front facing. Triangles at the poles are degenerate and are dropped by
+    // setup.
+    for (S32 ring = 0; ring < rings; ++ring) {
+        for (S32 segment = 0; segment < segments; ++segment) {
+            S32 a = ring * (segments + 1) + segment;
+            S32 b = a + segments + 1;
+
+            mesh.indexes.insert(mesh.indexes.end(), { a, a + 1, b });
+            mesh.indexes.insert(mesh.indexes.end(), { a + 1, b + 1, b });
+        }
+    }
+
+    build_mesh_clusters(&mesh, nullptr);
+    mesh_update_positions(&mesh, nullptr);
+    paint_mesh_randomly(&mesh);
+
+    return mesh;
+}
+
+Mesh
+make_triangle_soup(U32 count, F32 extent, F32 triangle_size, U32 seed)
+{
+    Mesh mesh{};
+    mesh.vertexes.reserve(count * 3);
+    mesh.indexes.reserve(count * 3);
+
+    std::default_random_engine engine(seed);
+    std::uniform_real_distribution<F32> position(-extent, extent);
+    std::uniform_real_distribution<F32> offset(-triangle_size / 2, triangle_size / 2);
+
+    for (U32 i = 0; i < count; ++i) {
+        V3 center{position(engine), position(engine), position(engine)};
+
+        for (S32 k = 0; k < 3; ++k) {
+            mesh.indexes.push_back(static_cast<S32>(mesh.vertexes.size()));
+            mesh.vertexes.emplace_back(center.x + offset(engine), center.y + offset(engine), center.z + offset(engine));
+        }
+    }
+
+    build_mesh_clusters(&mesh, nullptr);
+    mesh_update_positions(&mesh, nullptr);
+    paint_mesh_randomly(&mesh);
+
+    return mesh;
+}
+
+//
+// Where model space box lands on the screen under `t`. Depths in front of the
+// near plane are outside, same as in `clip_triangle`.
+//
+static Bvh_Overlap
+screen_box_overlap(const Screen_Transform *t, const Bvh_Bounds &bounds, V2 screen_size, F32 near_depth)
+{
+    V3 center = bvh_center(bounds);
+    V3 extent = (bounds.max - bounds.min) * 0.5f;
+
+    F32 centers[3]{}, radiuses[3]{};
+
+    for (S32 row = 0; row < 3; ++row) {
+        const F32 *m = t->rows[row];
+
+        centers[row] = m[0] * center.x + m[1] * center.y + m[2] * center.z + m[3];
+        radiuses[row] = std::abs(m[0]) * extent.x + std::abs(m[1]) * extent.y + std::abs(m[2]) * extent.z;
+    }
+
+    // NOTE: Transformed vertexes are rounded differently than the box is,
+    // so it has to be a bit outside to be culled.
+    constexpr F32 SLACK = 1.0f;
+    constexpr F32 DEPTH_SLACK = 1e-3f;
+
+    if (centers[0] + radiuses[0] < -SLACK || centers[0] - radiuses[0] > screen_size.x + SLACK ||
+        centers[1] + radiuses[1] < -SLACK || centers[1] - radiuses[1] > screen_size.y + SLACK ||
+        centers[2] + radiuses[2] < near_depth - DEPTH_SLACK) {
+        return BVH_OVERLAP_NONE;
+    }
+
+    if (centers[0] - radiuses[0] >= 0 && centers[0] + radiuses[0] <= screen_size.x &&
+        centers[1] - radiuses[1] >= 0 && centers[1] + radiuses[1] <= screen_size.y &&
+        centers[2] - radiuses[2] >= near_depth) {
+        return BVH_OVERLAP_INSIDE;
+    }
+
+    return BVH_OVERLAP_PARTIAL;
+}
+
+//
+// Flags clusters of every instance which could have any triangle left after
+// `clip_triangle`, see "Clusters". Returns row of flags per instance, one per
+// cluster, in frame arena, or null if every triangle has to be set up.
+//
+static const U8 *
+cull_clusters(Basic_Renderer *r, const Mesh *mesh, const Draw_Material *material, const Screen_Transform *transforms, U32 instances_count)
+{
+    if (!r->cluster_culling || mesh->clusters.empty()) {
+        return nullptr;
+    }
+
+    V2 screen_size { static_cast<F32>(r->pixels_width), static_cast<F32>(r->pixels_height) };
+    USZ clusters_count = mesh->clusters.size();
+
+    U8 *visible = r->frame_arena.push_array<U8>(instances_count * clusters_count);
+
+    if (visible == nullptr) {
+        r->out_of_memory = true;
+        return nullptr;
+    }
+
+    std::fill(visible, visible + instances_count * clusters_count, 0);
+
+    // NOTE: Fixed point mode takes winding from snapped vertexes, tiny
+    // triangles could flip there, so cones are not used with it.
+    bool cones = material->cull_mode != CULL_MODE_NONE && r->raster_mode == RASTER_MODE_FLOAT;
+
+    // NOTE: Culled triangles are the ones with this winding, see
+    // `clip_triangle`.
+    bool culled_clockwise = (material->cull_mode == CULL_MODE_BACK) != (material->front_face == FRONT_FACE_CW);
+
+    U64 culled_count = 0, culled_triangles = 0;
+
+    for (U32 instance = 0; instance < instances_count; ++instance) {
+        const Screen_Transform *t = &transforms[instance];
+        U8 *instance_visible = visible + instance * clusters_count;
+
+        // NOTE: Screen cross product of triangle edges is dot product of it's
+        // model space normal with cross product of first two rows of the
+        // transform. Projection is orthographic, so it's same for every
+        // triangle.
+        V3 view = v3_cross({t->rows[0][0], t->rows[0][1], t->rows[0][2]}, {t->rows[1][0], t->rows[1][1], t->rows[1][2]});
+        F32 view_length = std::sqrt(v3_dot(view, view));
+        bool instance_cones = cones && view_length > 0;
+
+        if (instance_cones) {
+            view = view * (1.0f / view_length);
+        }
+
+        U32 visible_count = 0;
+
+        bvh_traverse(&mesh->clusters_bvh,
+            [t, screen_size, r](const Bvh_Bounds &bounds) {
+                return screen_box_overlap(t, bounds, screen_size, r->near_depth);
+            },
+            [&](U32 cluster_index, bool inside) {
+                const Mesh_Cluster *cluster = &mesh->clusters[cluster_index];
+
+                if (!inside && screen_box_overlap(t, mesh->clusters_bounds[cluster_index], screen_size, r->near_depth) == BVH_OVERLAP_NONE) {
+                    return;
+                }
+
+                if (instance_cones) {
+                    F32 facing = v3_dot(view, cluster->cone_axis);
+
+                    if (culled_clockwise ? facing > cluster->cone_cutoff : facing < -cluster->cone_cutoff) {
+                        return;
+                    }
+                }
+
+                instance_visible[cluster_index] = 1;
+                ++visible_count;
+            });
+
+        if (visible_count < clusters_count) {
+            for (USZ i = 0; i < clusters_count; ++i) {
+                culled_triangles += instance_visible[i] ? 0 : mesh->clusters[i].indexes_count / 3;
+            }
+        }
+
+        culled_count += clusters_count - visible_count;
+    }
+
+    r->stats.clusters_submitted += instances_count * clusters_count;
+    r->stats.clusters_culled += culled_count;
+    r->stats.triangles_culled += culled_triangles;
+
+    return visible;
+}
+
+//
+// Calls `proc(begin, end)` for ranges of `indexes` of the group, which are
+// not in culled clusters. `visible` is row of flags of the instance, or null.
+//
+template<typename Proc>
+static void
+for_visible_indexes(const Mesh *mesh, const Mesh_Group *group, const U8 *visible, Proc proc)
+{
+    U32 group_end = group->indexes_begin + group->indexes_count;
+
+    if (visible == nullptr) {
+        proc(group->indexes_begin, group_end);
+        return;
+    }
+
+    // NOTE: Clusters are in order of their indexes, and never cross groups.
+    const Mesh_Cluster *clusters = mesh->clusters.data();
+    const Mesh_Cluster *clusters_end = clusters + mesh->clusters.size();
+    const Mesh_Cluster *cluster = std::lower_bound(clusters, clusters_end, group->indexes_begin, [](const Mesh_Cluster &c, U32 index) {
+        return c.indexes_begin < index;
+    });
+
+    for (; cluster != clusters_end && cluster->indexes_begin < group_end; ++cluster) {
+        if (visible[cluster - clusters]) {
+            proc(cluster->indexes_begin, cluster->indexes_begin + cluster->indexes_count);
+        }
+    }
+}
+
+//
+// Culls clusters of every instance and transforms vertexes of the rest. Returns
+// flags of `cull_clusters`.
+//
+static const U8 *
+transform_mesh_instances(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, std::span<const Draw_Instance> instances, const Draw_Material *material, Vertex_Work *work)
+{
+    Clock clock{};
+
+    U32 instances_count = static_cast<U32>(instances.size());
+    Screen_Transform *transforms = make_screen_transforms(r, instances);
+
+    if (r->out_of_memory) {
+        return nullptr;
+    }
+
+    const U8 *visible = cull_clusters(r, mesh, material, transforms, instances_count);
+
+    if (r->out_of_memory) {
+        return nullptr;
+    }
+
+    *work = plan_vertex_work(r, mesh->positions.x.size(), instances_count, mesh, visible);
+
+    r->stats.setup += clock.tick();
+
+    if (r->out_of_memory) {
+        return nullptr;
+    }
+
+    transform_vertexes_work(r, pool, &mesh->positions, transforms, instances_count, work);
+
+    r->stats.transform += clock.tick();
+
+    return visible;
+}
+
+//
+// Transforms every instance of the mesh and appends their triangles to
+// `r->triangles`, without clearing them first.
+//
+static void
+render_mesh_geometry(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, std::span<const Draw_Instance> instances, const Draw_Material *material)
+{
+    Vertex_Work work{};
+    const U8 *visible = transform_mesh_instances(r, pool, mesh, instances, material, &work);
+
+    if (r->out_of_memory) {
+        return;
+    }
+
+    Clock clock{};
+
+    USZ triangles_begin = r->triangles.size();
+
+    const Screen_Vertexes *screen = &r->screen_vertexes;
+
+    // NOTE: Meshes without groups are drawn as one untextured group.
+    Mesh_Group whole_mesh{0, 0, static_cast<U32>(mesh->indexes.size())};
+    const Mesh_Group *groups = mesh->groups.empty() ? &whole_mesh : mesh->groups.data();
+    USZ groups_count = mesh->groups.empty() ? 1 : mesh->groups.size();
+
+    for (USZ group_index = 0; group_index < groups_count; ++group_index) {
+        const Mesh_Group *group = &groups[group_index];
+        const Texture *texture = nullptr;
+
+        if (!mesh->uvs.empty() && group->material < mesh->materials.size()) {
+            S32 texture_index = mesh->materials[group->material].diffuse_texture;
+
+            if (texture_index >= 0) {
+                texture = &mesh->textures[texture_index];
+            }
+        }
+
+        for (USZ instance = 0; instance < instances.size(); ++instance) {
+            USZ base = instance * screen->stride;
+            Color4 color = instances[instance].color;
+            const U8 *instance_visible = visible != nullptr ? visible + instance * mesh->clusters.size() : nullptr;
+
+            for_visible_indexes(mesh, group, instance_visible, [&](U32 begin, U32 end) {
+                for (USZ i = begin; i < end; i += 3) {
+                    Raster_Triangle t{};
+                    t.texture = texture;
+                    t.material = material;
+                    t.varyings_count = texture != nullptr ? 2 : 0;
+
+                    for (S32 k = 0; k < 3; ++k) {
+                        S32 index = mesh->indexes[i + k];
+                        t.vertexes[k] = { screen->x[base + index], screen->y[base + index] };
+                        t.depths[k] = screen->z[base + index];
+
+                        if (texture != nullptr) {
+                            t.varyings[k][0] = mesh->uvs[index].x;
+                            t.varyings[k][1] = mesh->uvs[index].y;
+                        }
+                    }
+
+                    t.color = mesh->colors[i].modulate(color);
+
+                    clip_triangle(r, &t);
+                }
+            });
+        }
+    }
+
+    r->stats.setup += clock.tick();
+    r->stats.triangles_submitted += mesh->indexes.size() / 3 * instances.size();
+
+    if (!r->out_of_memory) {
+        r->stats.triangles_rasterized += r->triangles.size() - triangles_begin;
+    }
+}
+
+void
+render_mesh(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Draw_Material *material)
+{
+    r->frame_arena.reset();
+    r->triangles.clear();
+    r->previous_draws_valid = false;
+    r->out_of_memory = false;
+
+    Draw_Instance instance{transform};
+    render_mesh_geometry(r, pool, mesh, {&instance, 1}, material);
+
+    if (r->out_of_memory) {
+        ++r->stats.draws_failed;
+        r->triangles.clear();
+    }
+
+    Clock clock{};
+
+    if (pool != nullptr) {
+        render_triangles_binned(r, pool, r->triangles);
+    } else {
+        render_triangles_serial(r, r->triangles);
+    }
+
+    r->stats.raster += clock.tick();
+}
+
+//
+// Shaders.
+//
+
+template<typename Shader>
+struct Shade_Vertexes_Data {
+    const Mesh *mesh;
+    const Shader *shader;
+    const Draw_Instance *instances;
+    const M3x3 *rotations;
+    F32 *varyings;  // NOTE: Instances are `mesh->vertexes.size()` vertexes apart.
+    const Vertex_Work *work;
+};
+
+template<typename Shader>
+static void
+shade_vertexes_chunk(void *data, U32 item_index, [[maybe_unused]] U32 worker_index)
+{
+    Shade_Vertexes_Data<Shader> *d = static_cast<Shade_Vertexes_Data<Shader> *>(data);
+    const Mesh *mesh = d->mesh;
+
+    for (U32 run = d->work->items[item_index]; run < d->work->items[item_index + 1]; ++run) {
+        U32 instance = d->work->runs[run].instance;
+        Color4 color = d->instances[instance].color;
+        F32 *varyings = d->varyings + instance * mesh->vertexes.size() * Shader::VARYINGS_COUNT;
+
+        // NOTE: Runs are padded to whole batches.
+        USZ end = std::min<USZ>(d->work->runs[run].end, mesh->vertexes.size());
+
+        for (USZ i = d->work->runs[run].begin; i < end; ++i) {
+            Shader_Vertex in{};
+            in.position = mesh->vertexes[i];
+            in.normal = mesh->normals.empty() ? V3{} : d->rotations[instance] * mesh->normals[i];
+            in.uv = mesh->uvs.empty() ? V2{} : mesh->uvs[i];
+            in.color = (mesh->vertex_colors.empty() ? COLOR_WHITE : mesh->vertex_colors[i]).modulate(color);
+
+            d->shader->vertex(&in, varyings + i * Shader::VARYINGS_COUNT);
+        }
+    }
+}
+
+//
+// Same as `render_mesh_geometry`, with vertex stage of the `shader`.
+//
+template<typename Shader>
+static void
+render_mesh_geometry_shaded(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, std::span<const Draw_Instance> instances, const Shader *shader, const Draw_Material *material)
+{
+    constexpr U32 VARYINGS_COUNT = Shader::VARYINGS_COUNT;
+    static_assert(VARYINGS_COUNT > 0 && VARYINGS_COUNT <= RASTER_MAX_VARYINGS);
+
+    Vertex_Work work{};
+    const U8 *visible = transform_mesh_instances(r, pool, mesh, instances, material, &work);
+
+    if (r->out_of_memory) {
+        return;
+    }
+
+    Clock clock{};
+
+    // NOTE: Vertex stage is counted as transform.
+    USZ varyings_stride = mesh->vertexes.size() * VARYINGS_COUNT;
+    r->vertex_varyings = r->frame_arena.push_array<F32>(varyings_stride * instances.size());
+
+    M3x3 *rotations = r->frame_arena.push_array<M3x3>(instances.size());
+
+    if (r->vertex_varyings == nullptr || rotations == nullptr) {
+        r->out_of_memory = true;
+        return;
+    }
+
+    for (USZ i = 0; i < instances.size(); ++i) {
+        rotations[i] = instances[i].transform.to_matrix();
+    }
+
+    Shade_Vertexes_Data<Shader> data{mesh, shader, instances.data(), rotations, r->vertex_varyings, &work};
+
+    if (pool != nullptr && work.items_count > 1) {
+        pool->parallel_for(work.items_count, shade_vertexes_chunk<Shader>, &data);
+    } else {
+        for (U32 i = 0; i < work.items_count; ++i) {
+            shade_vertexes_chunk<Shader>(&data, i, 0);
+        }
+    }
+
+    r->stats.transform += clock.tick();
+
+    USZ triangles_begin = r->triangles.size();
+
+    const Screen_Vertexes *screen = &r->screen_vertexes;
+
+    Mesh_Group whole_mesh{0, 0, static_cast<U32>(mesh->indexes.size())};
+
+    for (USZ instance = 0; instance < instances.size(); ++instance) {
+        USZ base = instance * screen->stride;
+        const F32 *varyings = r->vertex_varyings + instance * varyings_stride;
+        Color4 color = instances[instance].color;
+        const U8 *instance_visible = visible != nullptr ? visible + instance * mesh->clusters.size() : nullptr;
+
+        for_visible_indexes(mesh, &whole_mesh, instance_visible, [&](U32 begin, U32 end) {
+            for (USZ i = begin; i < end; i += 3) {
+                Raster_Triangle t{};
+                t.material = material;
+                t.varyings_count = VARYINGS_COUNT;
+
+                for (S32 k = 0; k < 3; ++k) {
+                    S32 index = mesh->indexes[i + k];
+                    t.vertexes[k] = { screen->x[base + index], screen->y[base + index] };
+                    t.depths[k] = screen->z[base + index];
+
+                    std::copy(varyings + index * VARYINGS_COUNT, varyings + (index + 1) * VARYINGS_COUNT, t.varyings[k]);
+                }
+
+                t.color = mesh->colors[i].modulate(color);
+
+                clip_triangle(r, &t);
+            }
+        });
+    }
+
+    r->stats.setup += clock.tick();
+    r->stats.triangles_submitted += mesh->indexes.size() / 3 * instances.size();
+
+    if (!r->out_of_memory) {
+        r->stats.triangles_rasterized += r->triangles.size() - triangles_begin;
+    }
+}
+
+template<typename Shader>
+void
+render_mesh_shaded(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Shader *shader, const Draw_Material *material)
+{
+    r->frame_arena.reset();
+    r->triangles.clear();
+    r->previous_draws_valid = false;
+    r->out_of_memory = false;
+
+    Draw_Instance instance{transform};
+    render_mesh_geometry_shaded(r, pool, mesh, {&instance, 1}, shader, material);
+
+    if (r->out_of_memory) {
+        ++r->stats.draws_failed;
+        r->triangles.clear();
+    }
+
+    Clock clock{};
+
+    if (pool != nullptr) {
+        render_triangles_binned_shaded(r, pool, r->triangles, shader);
+    } else {
+        render_triangles_serial_shaded(r, r->triangles, shader);
+    }
+
+    r->stats.raster += clock.tick();
+}
+
+template void render_mesh_shaded<Vertex_Color_Shader>(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Vertex_Color_Shader *shader, const Draw_Material *material);
+template void render_mesh_shaded<Gouraud_Shader>(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Gouraud_Shader *shader, const Draw_Material *material);
+template void render_mesh_shaded<Lambert_Shader>(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Lambert_Shader *shader, const Draw_Material *material);
+
+//
+// Draw lists.
+//
+
+const char *DRAW_SHADER_NAMES[DRAW_SHADER_COUNT] = {
+    "none",
+    "vertex_color",
+    "gouraud",
+    "lambert",
+};
+
+void
+Draw_List::clear(void)
+{
+    this->commands.clear();
+    this->instances.clear();
+}
+
+//
+// Depth of the nearest point of the mesh bounds, as it's seen from the camera.
+//
+static F32
+draw_nearest_depth(const Mesh *mesh, const Transform &transform)
+{
+    // NOTE: Projection is orthographic, so depth of the nearest point is just
+    // depth of the center minus radius.
+    V3 center = transform.to_world(mesh->bounds_center);
+    return -center.z - mesh->bounds_radius;
+}
+
+static U64
+draw_sort_key(const Draw_Material *material, F32 depth)
+{
+    U32 state = (static_cast<U32>(material->shader) << 24) |
+                (static_cast<U32>(material->texture_filter) << 16) |
+                (static_cast<U32>(material->cull_mode) << 8) |
+                static_cast<U32>(material->front_face);
+
+    // NOTE: Flipping bits of the float, so it's ordered as unsigned
+    // integer, negative ones included.
+    U32 depth_bits = std::bit_cast<U32>(depth);
+    depth_bits = (depth_bits & 0x8000'0000) ? ~depth_bits : depth_bits | 0x8000'0000;
+
+    return (static_cast<U64>(state) << 32) | depth_bits;
+}
+
+void
+Draw_List::submit(const Mesh *mesh, Transform transform, const Draw_Material *material)
+{
+    Draw_Command command{};
+    command.mesh = mesh;
+    command.transform = transform;
+    command.material = *material;
+    command.sort_key = draw_sort_key(material, draw_nearest_depth(mesh, transform));
+
+    this->commands.push_back(command);
+}
+
+void
+Draw_List::submit_instances(const Mesh *mesh, std::span<const Draw_Instance> instances, const Draw_Material *material)
+{
+    if (instances.empty()) {
+        return;
+    }
+
+    Draw_Command command{};
+    command.mesh = mesh;
+    command.material = *material;
+    command.instances_begin = static_cast<U32>(this->instances.size());
+    command.instances_count = static_cast<U32>(instances.size());
+
+    // NOTE: Draw is as near as it's nearest instance.
+    F32 depth = draw_nearest_depth(mesh, instances[0].transform);
+
+    for (const Draw_Instance &instance : instances) {
+        depth = std::min(depth, draw_nearest_depth(mesh, instance.transform));
+    }
+
+    command.sort_key = draw_sort_key(material, depth);
+
+    this->instances.insert(this->instances.end(), instances.begin(), instances.end());
+    this->commands.push_back(command);
+}
+
+static bool
+v3_equal(V3 u, V3 v)
+{
+    return u.x == v.x && u.y == v.y && u.z == v.z;
+}
+
+static bool
+transform_equal(const Transform *a, const Transform *b)
+{
+    return a->roll == b->roll && a->pitch == b->pitch && a->yaw == b->yaw && v3_equal(a->position, b->position);
+}
+
+//
+// Tree over instances of the draw at `command_index`, see "Draw lists".
+//
+static const Bvh *
+fit_instances_bvh(Basic_Renderer *r, Thread_Pool *pool, U32 command_index, const Mesh *mesh, std::span<const Draw_Instance> instances)
+{
+    if (r->instances_bvhs.size() <= command_index) {
+        r->instances_bvhs.resize(command_index + 1);
+    }
+
+    Instances_Bvh *tree = &r->instances_bvhs[command_index];
+
+    auto instance_bounds = [mesh](const Transform &transform) -> Bvh_Bounds {
+        V3 center = transform.to_world(mesh->bounds_center);
+        V3 radius{mesh->bounds_radius, mesh->bounds_radius, mesh->bounds_radius};
+        return {center - radius, center + radius};
+    };
+
+    bool rebuild = tree->mesh != mesh || !v3_equal(tree->mesh_center, mesh->bounds_center) || tree->mesh_radius != mesh->bounds_radius
+        || tree->transforms.size() != instances.size();
+
+    if (rebuild) {
+        tree->mesh = mesh;
+        tree->mesh_center = mesh->bounds_center;
+        tree->mesh_radius = mesh->bounds_radius;
+        tree->transforms.resize(instances.size());
+        tree->bounds.resize(instances.size());
+        tree->moved.reserve(instances.size());
+
+        for (USZ i = 0; i < instances.size(); ++i) {
+            tree->transforms[i] = instances[i].transform;
+            tree->bounds[i] = instance_bounds(instances[i].transform);
+        }
+    } else {
+        tree->moved.clear();
+
+        for (USZ i = 0; i < instances.size(); ++i) {
+            if (!transform_equal(&tree->transforms[i], &instances[i].transform)) {
+                tree->transforms[i] = instances[i].transform;
+                tree->bounds[i] = instance_bounds(instances[i].transform);
+                tree->moved.push_back(static_cast<U32>(i));
+            }
+        }
+
+        if (!tree->moved.empty()) {
+            tree->bvh.refit(tree->bounds, tree->moved);
+            rebuild = tree->bvh.degraded();
+        }
+    }
+
+    if (rebuild) {
+        tree->bvh.build(tree->bounds, BVH_LEAF_SIZE, pool);
+    }
+
+    return &tree->bvh;
+}
+
+//
+// Drops instances whose bounding sphere is entirely outside of the screen or
+// in front of the near plane, same as every triangle of them would be, and
+// sorts the rest front to back if `sorted`, or keeps them in order otherwise.
+// Returned ones are in frame arena.
+//
+static std::span<Draw_Instance>
+cull_instances(Basic_Renderer *r, Thread_Pool *pool, U32 command_index, const Mesh *mesh, std::span<const Draw_Instance> instances, bool sorted)
+{
+    F32 width = static_cast<F32>(r->pixels_width);
+    F32 height = static_cast<F32>(r->pixels_height);
+    F32 pixels_per_unit = height / WORLD_UNITS_IN_SCREEN_HEIGHT;
+    F32 radius = mesh->bounds_radius * pixels_per_unit;
+
+    std::span<U32> visible = r->frame_arena.push_span<U32>(instances.size());
+    std::span<F32> depths = r->frame_arena.push_span<F32>(instances.size());
+
+    if (visible.data() == nullptr || depths.data() == nullptr) {
+        r->out_of_memory = true;
+        return {};
+    }
+
+    USZ visible_count = 0;
+
+    auto cull_instance = [&](U32 index) {
+        V3 center = world_to_screen(mesh->bounds_center, instances[index].transform, {width, height});
+
+        if (center.x + radius < 0 || center.x - radius > width ||
+            center.y + radius < 0 || center.y - radius > height ||
+            center.z + mesh->bounds_radius < r->near_depth) {
+            return;
+        }
+
+        depths[index] = center.z - mesh->bounds_radius;
+        visible[visible_count++] = index;
+    };
+
+    bool in_order = true;
+
+    if (instances.size() >= INSTANCES_BVH_MIN_COUNT) {
+        const Bvh *bvh = fit_instances_bvh(r, pool, command_index, mesh, instances);
+
+        // NOTE: Boxes are in world space, and projection is
+        // orthographic, so they are just scaled onto the screen.
+        auto test = [&](const Bvh_Bounds &bounds) -> Bvh_Overlap {
+            F32 x_min = width / 2 + bounds.min.x * pixels_per_unit;
+            F32 x_max = width / 2 + bounds.max.x * pixels_per_unit;
+            F32 y_min = height / 2 + bounds.min.y * pixels_per_unit;
+            F32 y_max = height / 2 + bounds.max.y * pixels_per_unit;
+
+            if (x_max < 0 || x_min > width || y_max < 0 || y_min > height || -bounds.min.z < r->near_depth) {
+                return BVH_OVERLAP_NONE;
+            }
+
+            return BVH_OVERLAP_PARTIAL;
+        };
+
+        // NOTE: Every instance which is left is tested same as without
+        // the tree, so exactly same ones are culled.
+        bvh_traverse(bvh, test, [&cull_instance](U32 index, [[maybe_unused]] bool inside) {
+            cull_instance(index);
+        });
+
+        in_order = false;
+    } else {
+        for (U32 i = 0; i < instances.size(); ++i) {
+            cull_instance(i);
+        }
+    }
+
+    U64 culled_count = instances.size() - visible_count;
+
+    r->stats.instances_submitted += instances.size();
+    r->stats.instances_culled += culled_count;
+    r->stats.triangles_submitted += culled_count * (mesh->indexes.size() / 3);
+    r->stats.triangles_culled += culled_count * (mesh->indexes.size() / 3);
+
+    visible = visible.first(visible_count);
+
+    if (sorted) {
+        std::sort(visible.begin(), visible.end(), [&depths](U32 a, U32 b) {
+            return depths[a] < depths[b] || (depths[a] == depths[b] && a < b);
+        });
+    } else if (!in_order) {
+        std::sort(visible.begin(), visible.end());
+    }
+
+    std::span<Draw_Instance> result = r->frame_arena.push_span<Draw_Instance>(visible_count);
+
+    if (result.data() == nullptr) {
+        r->out_of_memory = true;
+        return {};
+    }
+
+    for (USZ i = 0; i < visible_count; ++i) {
+        result[i] = instances[visible[i]];
+    }
+
+    return result;
+}
+
+//
+// Instances of the commands are in `a_instances` and `b_instances`.
+//
+static bool
+draw_command_equal(const Draw_Command *a, const Draw_Instance *a_instances, const Draw_Command *b, const Draw_Instance *b_instances)
+{
+    const Draw_Material *ma = &a->material, *mb = &b->material;
+
+    bool equal = a->mesh == b->mesh && a->instances_count == b->instances_count
+        && transform_equal(&a->transform, &b->transform)
+        && ma->shader == mb->shader && ma->cull_mode == mb->cull_mode && ma->front_face == mb->front_face && ma->texture_filter == mb->texture_filter
+        && v3_equal(ma->light_direction, mb->light_direction) && v3_equal(ma->ambient, mb->ambient) && v3_equal(ma->diffuse, mb->diffuse);
+
+    for (U32 i = 0; equal && i < a->instances_count; ++i) {
+        const Draw_Instance *ia = &a_instances[a->instances_begin + i];
+        const Draw_Instance *ib = &b_instances[b->instances_begin + i];
+
+        equal = transform_equal(&ia->transform, &ib->transform) && std::bit_cast<U32>(ia->color) == std::bit_cast<U32>(ib->color);
+    }
+
+    return equal;
+}
+
+static void
+mark_tiles_dirty(Basic_Renderer *r, R32 bounds)
+{
+    if (bounds.x >= bounds.w || bounds.y >= bounds.h) {
+        return;
+    }
+
+    Tile_Bins *tb = &r->tile_bins;
+
+    for (S32 tile_y = bounds.y / TILE_SIZE; tile_y <= (bounds.h - 1) / TILE_SIZE; ++tile_y) {
+        for (S32 tile_x = bounds.x / TILE_SIZE; tile_x <= (bounds.w - 1) / TILE_SIZE; ++tile_x) {
+            r->tiles_dirty[get_offset(tb->tiles_x, tile_y, tile_x)] = 1;
+        }
+    }
+}
+
+//
+// Marks tiles which have to be redrawn, see `draw_list_geometry`.
+//
+static void
+update_dirty_tiles(Basic_Renderer *r, const Draw_List *list)
+{
+    const std::vector<Draw_Command> &current = list->commands;
+    const std::vector<Draw_Command> &previous = r->previous_draws;
+
+    bool everything = !r->incremental || !r->previous_draws_valid;
+
+    std::fill(r->tiles_dirty.begin(), r->tiles_dirty.end(), everything ? 1 : 0);
+
+    if (!everything) {
+        for (USZ i = 0; i < std::max(current.size(), previous.size()); ++i) {
+            if (i < current.size() && i < previous.size() &&
+                draw_command_equal(&current[i], list->instances.data(), &previous[i], r->previous_instances.data())) {
+                continue;
+            }
+
+            if (i < previous.size()) {
+                mark_tiles_dirty(r, r->previous_draw_bounds[i]);
+            }
+
+            if (i < current.size()) {
+                mark_tiles_dirty(r, r->draw_bounds[i]);
+            }
+        }
+    }
+
+    // NOTE: Copies are reusing capacity, so they don't allocate once lists
+    // are settled.
+    if (r->incremental) {
+        r->previous_draws = current;
+        r->previous_instances = list->instances;
+        r->previous_draw_bounds.assign(r->draw_bounds.begin(), r->draw_bounds.end());
+        r->previous_draws_valid = true;
+    }
+}
+
+void
+draw_list_geometry(Basic_Renderer *r, Thread_Pool *pool, const Draw_List *list)
+{
+    const std::vector<Draw_Command> &commands = list->commands;
+
+    r->frame_arena.reset();
+    r->triangles.clear();
+
+    U64 draws_failed = r->stats.draws_failed;
+
+    std::span<U32> order = r->frame_arena.push_span<U32>(commands.size());
+    r->draw_bounds = r->frame_arena.push_span<R32>(commands.size());
+
+    // NOTE: Whole list fails, every tile is redrawn with nothing in it.
+    if (order.data() == nullptr || r->draw_bounds.data() == nullptr) {
+        r->stats.draws_failed += commands.size();
+        r->tile_bins.offsets = nullptr;
+        r->tile_bins.indexes = nullptr;
+        r->draw_bounds = {};
+        r->previous_draws_valid = false;
+        std::fill(r->tiles_dirty.begin(), r->tiles_dirty.end(), 1);
+        return;
+    }
+
+    for (U32 i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+
+    // NOTE: Ties are broken by submission order, so draws with same key are
+    // always executed in the same order.
+    if (list->sorted) {
+        std::sort(order.begin(), order.end(), [&commands](U32 a, U32 b) {
+            U64 key_a = commands[a].sort_key, key_b = commands[b].sort_key;
+            return key_a < key_b || (key_a == key_b && a < b);
+        });
+    }
+
+    for (U32 index : order) {
+        const Draw_Command *command = &commands[index];
+        const Draw_Material *material = &command->material;
+
+        USZ triangles_begin = r->triangles.size();
+
+        // NOTE: Transformed vertexes and varyings are dead once
+        // triangles of the draw are set up.
+        USZ scratch = r->frame_arena.save();
+        r->out_of_memory = false;
+
+        Draw_Instance single{command->transform};
+        std::span<const Draw_Instance> instances{&single, 1};
+
+        if (command->instances_count > 0) {
+            Clock cull_clock{};
+
+            instances = cull_instances(r, pool, index, command->mesh, std::span(list->instances).subspan(command->instances_begin, command->instances_count), list->sorted);
+
+            r->stats.setup += cull_clock.tick();
+        }
+
+        switch (instances.empty() ? DRAW_SHADER_COUNT : material->shader) {
+            case DRAW_SHADER_NONE: {
+                render_mesh_geometry(r, pool, command->mesh, instances, material);
+            } break;
+            case DRAW_SHADER_VERTEX_COLOR: {
+                Vertex_Color_Shader shader{};
+                render_mesh_geometry_shaded(r, pool, command->mesh, instances, &shader, material);
+            } break;
+            case DRAW_SHADER_GOURAUD: {
+                Gouraud_Shader shader{material->light_direction, material->ambient, material->diffuse};
+                render_mesh_geometry_shaded(r, pool, command->mesh, instances, &shader, material);
+            } break;
+            case DRAW_SHADER_LAMBERT: {
+                Lambert_Shader shader{material->light_direction, material->ambient, material->diffuse};
+                render_mesh_geometry_shaded(r, pool, command->mesh, instances, &shader, material);
+            } break;
+            case DRAW_SHADER_COUNT: {
+                // NOTE: Every instance was culled.
+            } break;
+            default: {
+                assert(false && "Unknown shader!");
+            } break;
+        }
+
+        r->frame_arena.restore(scratch);
+
+        if (r->out_of_memory) {
+            ++r->stats.draws_failed;
+            r->triangles.truncate(triangles_begin);
+        }
+
+        R32 bounds{};
+
+        for (USZ i = triangles_begin; i < r->triangles.size(); ++i) {
+            const R32 &bb = r->triangles[i].bb;
+
+            if (bb.x >= bb.w || bb.y >= bb.h) {
+                continue;
+            }
+
+            if (bounds.x >= bounds.w || bounds.y >= bounds.h) {
+                bounds = bb;
+            } else {
+                bounds = {std::min(bounds.x, bb.x), std::min(bounds.y, bb.y), std::max(bounds.w, bb.w), std::max(bounds.h, bb.h)};
+            }
+        }
+
+        r->draw_bounds[index] = bounds;
+    }
+
+    Clock clock{};
+
+    // NOTE: Triangles are already there, so every draw which has some fails.
+    if (!bin_triangles(r, r->triangles)) {
+        for (USZ i = 0; i < commands.size(); ++i) {
+            R32 bounds = r->draw_bounds[i];
+            r->stats.draws_failed += bounds.x < bounds.w && bounds.y < bounds.h ? 1 : 0;
+        }
+
+        r->triangles.clear();
+    }
+
+    // NOTE: Failed draws could be same as previous ones, which were drawn.
+    if (r->stats.draws_failed != draws_failed) {
+        r->previous_draws_valid = false;
+    }
+
+    update_dirty_tiles(r, list);
+
+    r->stats.setup += clock.tick();
+}
+
+//
+// Runs pixel stage of the shader of the draw which triangle came from. Shader
+// parameters are read from the material again, they are same as the ones
+// vertex stage had.
+//
+static void
+raster_draw_triangle(Basic_Renderer *r, const Raster_Triangle *t, R32 clip)
+{
+    const Draw_Material *material = t->material;
+
+    switch (material->shader) {
+        case DRAW_SHADER_NONE: {
+            Raster_Flat_Shader shader{};
+            raster_triangle_shaded(r, t, clip, &shader);
+        } break;
+        case DRAW_SHADER_VERTEX_COLOR: {
+            Vertex_Color_Shader shader{};
+            raster_triangle_shaded(r, t, clip, &shader);
+        } break;
+        case DRAW_SHADER_GOURAUD: {
+            Gouraud_Shader shader{material->light_direction, material->ambient, material->diffuse};
+            raster_triangle_shaded(r, t, clip, &shader);
+        } break;
+        case DRAW_SHADER_LAMBERT: {
+            Lambert_Shader shader{material->light_direction, material->ambient, material->diffuse};
+            raster_triangle_shaded(r, t, clip, &shader);
+        } break;
+        default: {
+            assert(false && "Unknown shader!");
+        } break;
+    }
+}
+
+static void
+raster_draw_tile(void *data, U32 tile_index, [[maybe_unused]] U32 worker_index)
+{
+    Basic_Renderer *r = static_cast<Basic_Renderer *>(data);
+    Tile_Bins *tb = &r->tile_bins;
+
+    if (r->incremental) {
+        // NOTE: Tile which is cleared has to be redrawn anyway.
+        if (!r->tiles_dirty[tile_index] && !r->tiles_clear_pending[tile_index]) {
+            return;
+        }
+
+        r->tiles_dirty[tile_index] = 1;
+        r->tiles_clear_pending[tile_index] = 1;
+    }
+
+    R32 tile{};
+    tile.x = static_cast<S32>(tile_index % tb->tiles_x) * TILE_SIZE;
+    tile.y = static_cast<S32>(tile_index / tb->tiles_x) * TILE_SIZE;
+    tile.w = TILE_SIZE;
+    tile.h = TILE_SIZE;
+
+    std::span<const U32> bin = tb->bin(tile_index);
+
+    for (U32 triangle_index : bin) {
+        raster_draw_triangle(r, &r->triangles[triangle_index], tile);
+    }
+
+    clear_tile(r, tile_index);
+
+    if (!bin.empty()) {
+        resolve_samples_tile(r, tile_index);
+    }
+}
+
+void
+draw_list_raster(Basic_Renderer *r, Thread_Pool *pool)
+{
+    Clock clock{};
+
+    U32 tiles_count = r->tile_bins.tiles_count();
+
+    // NOTE: Without pool tiles are drawn one by one, which gives same pixels
+    // as drawing triangles over whole screen.
+    if (pool != nullptr) {
+        pool->parallel_for(tiles_count, raster_draw_tile, r);
+    } else {
+        for (U32 i = 0; i < tiles_count; ++i) {
+            raster_draw_tile(r, i, 0);
+        }
+    }
+
+    // NOTE: Runs of redrawn tiles in a row are merged into one rectangle, and
+    // ones which are spanning same columns in consecutive rows are merged
+    // too.
+    Tile_Bins *tb = &r->tile_bins;
+    S32 width = static_cast<S32>(r->pixels_width);
+    S32 height = static_cast<S32>(r->pixels_height);
+
+    r->present_rects.clear();
+
+    for (S32 tile_y = 0; tile_y < tb->tiles_y; ++tile_y) {
+        USZ row_begin = r->present_rects.size();
+
+        for (S32 tile_x = 0; tile_x < tb->tiles_x; ++tile_x) {
+            if (!r->tiles_dirty[get_offset(tb->tiles_x, tile_y, tile_x)]) {
+                continue;
+            }
+
+            ++r->stats.tiles_drawn;
+
+            R32 rect{tile_x * TILE_SIZE, tile_y * TILE_SIZE, TILE_SIZE, std::min(TILE_SIZE, height - tile_y * TILE_SIZE)};
+
+            if (r->present_rects.size() > row_begin && r->present_rects.back().x + r->present_rects.back().w == rect.x) {
+                r->present_rects.back().w += TILE_SIZE;
+            } else {
+                r->present_rects.push_back(rect);
+            }
+
+            r->present_rects.back().w = std::min(r->present_rects.back().w, width - r->present_rects.back().x);
+        }
+
+        for (USZ i = row_begin; i < r->present_rects.size(); ++i) {
+            R32 *rect = &r->present_rects[i];
+
+            for (USZ j = 0; j < row_begin; ++j) {
+                R32 *above = &r->present_rects[j];
+
+                if (above->x == rect->x && above->w == rect->w && above->y + above->h == rect->y) {
+                    above->h += rect->h;
+                    rect->w = 0;
+                    break;
+                }
+            }
+        }
+
+        USZ kept = row_begin;
+
+        for (USZ i = row_begin; i < r->present_rects.size(); ++i) {
+            if (r->present_rects[i].w > 0) {
+                r->present_rects[kept++] = r->present_rects[i];
+            }
+        }
+
+        r->present_rects.resize(kept);
+    }
+
+    r->stats.raster += clock.tick();
+}
+
+void
+execute_draw_list(Basic_Renderer *r, Thread_Pool *pool, const Draw_List *list)
+{
+    draw_list_geometry(r, pool, list);
+    draw_list_raster(r, pool);
+}
+
+//
+// Frame pipeline.
+//
+
+static void
+frame_pipeline_geometry_main(Frame_Pipeline *p)
+{
+    for (;;) {
+        Pipeline_Frame *frame = nullptr;
+
+        {
+            std::unique_lock lock(p->mutex);
+            p->cv.wait(lock, [p] {
+                return p->should_stop || p->frames[p->next_geometry % p->depth].state == PIPELINE_FRAME_GEOMETRY;
+            });
+
+            if (p->should_stop) {
+                return;
+            }
+
+            frame = &p->frames[p->next_geometry % p->depth];
+        }
+
+        Basic_Renderer *r = &frame->renderer;
+
+        r->stats = {};
+
+        if (!r->incremental) {
+            r->clear();
+        }
+
+        draw_list_geometry(r, &p->geometry_pool, &frame->draw_list);
+
+        {
+            std::lock_guard lock(p->mutex);
+            frame->state = PIPELINE_FRAME_RASTER;
+            ++p->next_geometry;
+        }
+        p->cv.notify_all();
+    }
+}
+
+static void
+frame_pipeline_raster_main(Frame_Pipeline *p)
+{
+    for (;;) {
+        Pipeline_Frame *frame = nullptr;
+
+        {
+            std::unique_lock lock(p->mutex);
+            p->cv.wait(lock, [p] {
+                return p->should_stop || p->frames[p->next_raster % p->depth].state == PIPELINE_FRAME_RASTER;
+            });
+
+            if (p->should_stop) {
+                return;
+            }
+
+            frame = &p->frames[p->next_raster % p->depth];
+        }
+
+        draw_list_raster(&frame->renderer, &p->raster_pool);
+
+        {
+            std::lock_guard lock(p->mutex);
+            frame->state = PIPELINE_FRAME_DONE;
+            frame->done_time = p->now();
+            ++p->next_raster;
+        }
+        p->cv.notify_all();
+    }
+}
+
+void
+Frame_Pipeline::init(const Basic_Renderer *settings, U32 depth, U32 geometry_workers, U32 raster_workers)
+{
+    assert(depth > 0);
+
+    this->depth = depth;
+    this->frames = std::make_unique<Pipeline_Frame[]>(depth);
+
+    for (U32 i = 0; i < depth; ++i) {
+        Basic_Renderer *r = &this->frames[i].renderer;
+
+        r->clear_color = settings->clear_color;
+        r->isa = settings->isa;
+        r->raster_mode = settings->raster_mode;
+        r->near_depth = settings->near_depth;
+        r->clear_mode = settings->clear_mode;
+        r->samples_count = settings->samples_count;
+        r->pixels_layout = settings->pixels_layout;
+        r->incremental = settings->incremental;
+        r->cluster_culling = settings->cluster_culling;
+    }
+
+    this->ticks_begin = perf_get_counter();
+
+    this->geometry_pool.init(geometry_workers);
+    this->raster_pool.init(raster_workers);
+
+    this->geometry_thread = std::thread(frame_pipeline_geometry_main, this);
+    this->raster_thread = std::thread(frame_pipeline_raster_main, this);
+}
+
+void
+Frame_Pipeline::deinit(void)
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->should_stop = true;
+    }
+    this->cv.notify_all();
+
+    this->geometry_thread.join();
+    this->raster_thread.join();
+
+    this->geometry_pool.deinit();
+    this->raster_pool.deinit();
+
+    for (U32 i = 0; i < this->depth; ++i) {
+        this->frames[i].renderer.release();
+    }
+
+    this->frames.reset();
+    this->depth = 0;
+}
+
+void
+Frame_Pipeline::resize(S32 w, S32 h)
+{
+    this->width = w;
+    this->height = h;
+}
+
+Pipeline_Frame *
+Frame_Pipeline::begin_frame(void)
+{
+    Pipeline_Frame *frame = &this->frames[this->next_begin % this->depth];
+
+    // NOTE: Only caller releases frames, so waiting here would never end.
+    {
+        std::lock_guard lock(this->mutex);
+        assert(frame->state == PIPELINE_FRAME_FREE && "All frames are in flight!");
+
+        frame->state = PIPELINE_FRAME_RECORDING;
+        frame->index = this->next_begin++;
+    }
+
+    // NOTE: Frame isn't touched by stage threads until it's
+    // submitted, so it's resized without the lock.
+    Basic_Renderer *r = &frame->renderer;
+
+    if (r->pixels_width != static_cast<U32>(this->width) || r->pixels_height != static_cast<U32>(this->height)) {
+        r->resize(this->width, this->height);
+    }
+
+    frame->begin_time = this->now();
+    frame->draw_list.clear();
+
+    return frame;
+}
+
+void
+Frame_Pipeline::submit_frame(Pipeline_Frame *frame)
+{
+    {
+        std::lock_guard lock(this->mutex);
+        assert(frame->state == PIPELINE_FRAME_RECORDING);
+        frame->state = PIPELINE_FRAME_GEOMETRY;
+    }
+    this->cv.notify_all();
+}
+
+Pipeline_Frame *
+Frame_Pipeline::present_frame(bool drain)
+{
+    std::unique_lock lock(this->mutex);
+
+    U64 in_flight = this->next_begin - this->next_present;
+
+    if (in_flight == 0 || (!drain && in_flight < this->depth)) {
+        return nullptr;
+    }
+
+    Pipeline_Frame *frame = &this->frames[this->next_present % this->depth];
+    assert(frame->state != PIPELINE_FRAME_RECORDING && "Frame has to be submitted before it's presented!");
+
+    this->cv.wait(lock, [frame] { return frame->state == PIPELINE_FRAME_DONE; });
+
+    frame->state = PIPELINE_FRAME_PRESENTING;
+    ++this->next_present;
+
+    return frame;
+}
+
+void
+Frame_Pipeline::release_frame(Pipeline_Frame *frame)
+{
+    std::lock_guard lock(this->mutex);
+    assert(frame->state == PIPELINE_FRAME_PRESENTING);
+    frame->state = PIPELINE_FRAME_FREE;
+}
+
+F64
+Frame_Pipeline::now(void) const
+{
+    return static_cast<F64>(perf_get_counter() - this->ticks_begin) / static_cast<F64>(perf_get_counter_frequency());
+}
+
+
+//
+// Images.
+//
+
+const char *IMAGE_FORMAT_NAMES[IMAGE_FORMAT_COUNT] = {
+    "ppm",
+    "png",
+    "exr",
+};
+
+Image_Format
+image_format_from_file_name(std::string_view file_name)
+{
+    USZ dot = file_name.rfind('.');
+    if (dot == std::string_view::npos) {
+        return IMAGE_FORMAT_COUNT;
+    }
+
+    std::string_view extension = file_name.substr(dot + 1);
+
+    for (U8 format = 0; format < IMAGE_FORMAT_COUNT; ++format) {
+        std::string_view name = IMAGE_FORMAT_NAMES[format];
+
+        bool equal = extension.size() == name.size();
+        for (USZ i = 0; equal && i < name.size(); ++i) {
+            equal = (extension[i] | 0x20) == name[i];  // NOTE: ASCII lower case.
+        }
+
+        if (equal) {
+            return static_cast<Image_Format>(format);
+        }
+    }
+
+    return IMAGE_FORMAT_COUNT;
+}
+
+// NOTE: Anything which is buffered is written out once it grows over that.
+#define IMAGE_OUTPUT_FLUSH_SIZE (256 * 1024)
+
+static void
+image_put_bytes(std::vector<U8> *output, const void *bytes, USZ count)
+{
+    const U8 *source = static_cast<const U8 *>(bytes);
+    output->insert(output->end(), source, source + count);
+}
+
+static void
+image_put_u32_be(std::vector<U8> *output, U32 value)
+{
+    U8 bytes[4] = {static_cast<U8>(value >> 24), static_cast<U8>(value >> 16), static_cast<U8>(value >> 8), static_cast<U8>(value)};
+    image_put_bytes(output, bytes, sizeof(bytes));
+}
+
+static void
+image_put_u32_le(std::vector<U8> *output, U32 value)
+{
+    U8 bytes[4] = {static_cast<U8>(value), static_cast<U8>(value >> 8), static_cast<U8>(value >> 16), static_cast<U8>(value >> 24)};
+    image_put_bytes(output, bytes, sizeof(bytes));
+}
+
+static void
+image_put_u64_le(std::vector<U8> *output, U64 value)
+{
+    image_put_u32_le(output, static_cast<U32>(value));
+    image_put_u32_le(output, static_cast<U32>(value >> 32));
+}
+
+static void
+image_flush(Image_Writer *writer)
+{
+    if (!writer->failed && !writer->output.empty()) {
+        writer->failed = fwrite(writer->output.data(), writer->output.size(), 1, writer->file) != 1;
+    }
+
+    writer->output.clear();
+}
+
+//
+// PNG.
+//
+
+struct Crc32_Table {
+    U32 values[256]{};
+
+    constexpr
+    Crc32_Table(void)
+    {
+        for (U32 i = 0; i < 256; ++i) {
+            U32 crc = i;
+
+            for (U32 k = 0; k < 8; ++k) {
+                crc = (crc & 1) ? 0xEDB88320U ^ (crc >> 1) : crc >> 1;
+            }
+
+            this->values[i] = crc;
+        }
+    }
+};
+
+global_var constexpr Crc32_Table CRC32_TABLE{};
+
+static U32
+crc32_update(U32 crc, const U8 *bytes, USZ count)
+{
+    for (USZ i = 0; i < count; ++i) {
+        crc = CRC32_TABLE.values[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+//
+// Chunk out of `type` and everything what is in `writer->output`, which is
+// written out with it.
+//
+static void
+png_write_chunk(Image_Writer *writer, const char *type)
+{
+    U8 header[8] = {};
+    U32 size = static_cast<U32>(writer->output.size());
+
+    header[0] = static_cast<U8>(size >> 24);
+    header[1] = static_cast<U8>(size >> 16);
+    header[2] = static_cast<U8>(size >> 8);
+    header[3] = static_cast<U8>(size);
+    memcpy(header + 4, type, 4);
+
+    U32 crc = crc32_update(MAX_U32, header + 4, 4);
+    crc = crc32_update(crc, writer->output.data(), writer->output.size()) ^ MAX_U32;
+
+    if (!writer->failed) {
+        writer->failed = fwrite(header, sizeof(header), 1, writer->file) != 1;
+    }
+
+    image_put_u32_be(&writer->output, crc);
+    image_flush(writer);
+}
+
+//
+// Fixed Huffman codes of deflate (RFC 1951, 3.2.6). Codes are stored bit
+// reversed, since they are packed starting from the most significant bit,
+// and everything else from the least significant one. Lengths are indexed
+// by `length - 3`.
+//
+
+#define DEFLATE_MIN_MATCH 4  // NOTE: Deflate allows 3, but matches are found by hash of 4 bytes.
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_END_OF_BLOCK 256
+
+struct Deflate_Codes {
+    U16 literals[288]{};
+    U8 literals_bits[288]{};
+
+    U16 length_symbols[256]{};
+    U8 length_extra_bits[256]{};
+
+    U16 distances[30]{};
+
+    static constexpr U32
+    reverse(U32 code, U32 bits)
+    {
+        U32 result = 0;
+
+        for (U32 i = 0; i < bits; ++i) {
+            result |= ((code >> i) & 1) << (bits - 1 - i);
+        }
+
+        return result;
+    }
+
+    constexpr
+    Deflate_Codes(void)
+    {
+        for (U32 symbol = 0; symbol < 288; ++symbol) {
+            U32 code = 0, bits = 0;
+
+            if (symbol < 144) {
+                code = 0x30 + symbol, bits = 8;
+            } else if (symbol < 256) {
+                code = 0x190 + symbol - 144, bits = 9;
+            } else if (symbol < 280) {
+                code = symbol - 256, bits = 7;
+            } else {
+                code = 0xC0 + symbol - 280, bits = 8;
+            }
+
+            this->literals[symbol] = static_cast<U16>(reverse(code, bits));
+            this->literals_bits[symbol] = static_cast<U8>(bits);
+        }
+
+        for (U32 value = 0; value < 256; ++value) {
+            U32 symbol = 257 + value, extra_bits = 0;
+
+            if (value == DEFLATE_MAX_MATCH - 3) {
+                symbol = 285;
+            } else if (value >= 8) {
+                U32 top = static_cast<U32>(std::bit_width(value)) - 1;
+
+                extra_bits = top - 2;
+                symbol = 257 + 4 * (top - 1) + ((value >> extra_bits) & 3);
+            }
+
+            this->length_symbols[value] = static_cast<U16>(symbol);
+            this->length_extra_bits[value] = static_cast<U8>(extra_bits);
+        }
+
+        for (U32 code = 0; code < 30; ++code) {
+            this->distances[code] = static_cast<U16>(reverse(code, 5));
+        }
+    }
+};
+
+global_var constexpr Deflate_Codes DEFLATE_CODES{};
+
+static inline void
+deflate_put_bits(Deflate_Stream *s, std::vector<U8> *output, U32 value, U32 count)
+{
+    s->bits |= static_cast<U64>(value) << s->bits_count;
+    s->bits_count += count;
+
+    if (s->bits_count >= 32) {
+        image_put_u32_le(output, static_cast<U32>(s->bits));
+        s->bits >>= 32;
+        s->bits_count -= 32;
+    }
+}
+
+static inline void
+deflate_put_literal(Deflate_Stream *s, std::vector<U8> *output, U32 symbol)
+{
+    deflate_put_bits(s, output, DEFLATE_CODES.literals[symbol], DEFLATE_CODES.literals_bits[symbol]);
+}
+
+static inline void
+deflate_put_match(Deflate_Stream *s, std::vector<U8> *output, U32 length, U32 distance)
+{
+    U32 value = length - 3;
+    U32 extra_bits = DEFLATE_CODES.length_extra_bits[value];
+
+    deflate_put_literal(s, output, DEFLATE_CODES.length_symbols[value]);
+    deflate_put_bits(s, output, value & ((1U << extra_bits) - 1), extra_bits);
+
+    // NOTE: Same split into code and extra bits as of the lengths, but
+    // with two codes per power of two.
+    value = distance - 1;
+
+    U32 code = value;
+    extra_bits = 0;
+
+    if (value >= 4) {
+        U32 top = static_cast<U32>(std::bit_width(value)) - 1;
+
+        extra_bits = top - 1;
+        code = 2 * top + ((value >> extra_bits) & 1);
+    }
+
+    deflate_put_bits(s, output, DEFLATE_CODES.distances[code], 5);
+    deflate_put_bits(s, output, value & ((1U << extra_bits) - 1), extra_bits);
+}
+
+//
+// Compresses everything new in `s->input` as a single block with fixed codes.
+//
+static void
+deflate_compress(Deflate_Stream *s, std::vector<U8> *output, bool last)
+{
+    const U8 *input = s->input.data();
+    USZ end = s->input.size();
+    USZ i = s->input_compressed;
+
+    // NOTE: BFINAL, then BTYPE of 1, which is fixed codes.
+    deflate_put_bits(s, output, (last ? 1 : 0) | (1 << 1), 3);
+
+    while (i < end) {
+        if (end - i >= DEFLATE_MIN_MATCH) {
+            U32 word = 0;
+            memcpy(&word, input + i, sizeof(word));
+
+            U32 hash = (word * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+            U64 position = s->input_base + i;
+            U64 candidate = s->hash_table[hash];
+
+            s->hash_table[hash] = position + 1;
+
+            // NOTE: Candidate could be already dropped from the input, or be
+            // from a different 4 bytes with same hash.
+            if (candidate > s->input_base && position - (candidate - 1) <= DEFLATE_WINDOW_SIZE) {
+                const U8 *match = input + (candidate - 1 - s->input_base);
+
+                U32 match_word = 0;
+                memcpy(&match_word, match, sizeof(match_word));
+
+                if (match_word == word) {
+                    USZ max_length = std::min<USZ>(DEFLATE_MAX_MATCH, end - i);
+                    USZ length = DEFLATE_MIN_MATCH;
+
+                    while (length < max_length && match[length] == input[i + length]) {
+                        ++length;
+                    }
+
+                    deflate_put_match(s, output, static_cast<U32>(length), static_cast<U32>(position - (candidate - 1)));
+                    i += length;
+
+                    continue;
+                }
+            }
+        }
+
+        deflate_put_literal(s, output, input[i]);
+        ++i;
+    }
+
+    deflate_put_literal(s, output, DEFLATE_END_OF_BLOCK);
+
+    s->input_compressed = end;
+
+    // NOTE: Only the window is kept for the next block.
+    if (end > DEFLATE_WINDOW_SIZE) {
+        USZ dropped = end - DEFLATE_WINDOW_SIZE;
+
+        memmove(s->input.data(), s->input.data() + dropped, DEFLATE_WINDOW_SIZE);
+        s->input.resize(DEFLATE_WINDOW_SIZE);
+        s->input_base += dropped;
+        s->input_compressed -= dropped;
+    }
+}
+
+static void
+deflate_update_adler(Deflate_Stream *s, const U8 *bytes, USZ count)
+{
+    // NOTE: Largest number of bytes after which sums still fit into 32 bits
+    // before they are reduced.
+    constexpr USZ ADLER_BLOCK_SIZE = 5552;
+    constexpr U32 ADLER_MODULO = 65521;
+
+    while (count > 0) {
+        USZ block = std::min(count, ADLER_BLOCK_SIZE);
+
+        for (USZ i = 0; i < block; ++i) {
+            s->adler_a += bytes[i];
+            s->adler_b += s->adler_a;
+        }
+
+        s->adler_a %= ADLER_MODULO;
+        s->adler_b %= ADLER_MODULO;
+
+        bytes += block;
+        count -= block;
+    }
+}
+
+static void
+png_begin(Image_Writer *writer)
+{
+    static constexpr U8 PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    image_put_bytes(&writer->output, PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+    image_flush(writer);
+
+    image_put_u32_be(&writer->output, writer->width);
+    image_put_u32_be(&writer->output, writer->height);
+
+    // NOTE: 8 bits per channel, RGB, deflate, adaptive filters, not
+    // interlaced.
+    U8 format[5] = {8, 2, 0, 0, 0};
+    image_put_bytes(&writer->output, format, sizeof(format));
+    png_write_chunk(writer, "IHDR");
+
+    Deflate_Stream *s = &writer->deflate;
+
+    s->input.clear();
+    s->input_compressed = 0;
+    s->input_base = 0;
+    s->hash_table.assign(1ULL << DEFLATE_HASH_BITS, 0);
+    s->bits = 0;
+    s->bits_count = 0;
+    s->adler_a = 1;
+    s->adler_b = 0;
+
+    writer->previous_row.assign(static_cast<USZ>(writer->width) * 3, 0);
+
+    // NOTE: zlib header: deflate with 32K window, no dictionary, check
+    // bits making it multiple of 31.
+    writer->output.push_back(0x78);
+    writer->output.push_back(0x01);
+}
+
+static void
+png_write_row(Image_Writer *writer, const Color4 *pixels)
+{
+    Deflate_Stream *s = &writer->deflate;
+    USZ row_size = static_cast<USZ>(writer->width) * 3;
+    USZ row_begin = s->input.size();
+
+    s->input.resize(row_begin + 1 + row_size);
+
+    U8 *row = s->input.data() + row_begin;
+    U8 *previous = writer->previous_row.data();
+
+    // NOTE: "Up" filter, previous row of the first one is zeros.
+    *row++ = 2;
+
+    for (U32 x = 0; x < writer->width; ++x, row += 3, previous += 3) {
+        Color4 pixel = pixels[x];
+
+        row[0] = static_cast<U8>(pixel.R - previous[0]);
+        row[1] = static_cast<U8>(pixel.G - previous[1]);
+        row[2] = static_cast<U8>(pixel.B - previous[2]);
+
+        previous[0] = pixel.R;
+        previous[1] = pixel.G;
+        previous[2] = pixel.B;
+    }
+
+    deflate_update_adler(s, s->input.data() + row_begin, 1 + row_size);
+
+    bool last = writer->rows_written + 1 == writer->height;
+
+    if (!last && s->input.size() - s->input_compressed < DEFLATE_STRIP_SIZE) {
+        return;
+    }
+
+    deflate_compress(s, &writer->output, last);
+
+    if (last) {
+        // NOTE: Rest of the last byte is padded with zeros.
+        while (s->bits_count > 0) {
+            writer->output.push_back(static_cast<U8>(s->bits));
+            s->bits >>= 8;
+            s->bits_count = s->bits_count > 8 ? s->bits_count - 8 : 0;
+        }
+
+        image_put_u32_be(&writer->output, (s->adler_b << 16) | s->adler_a);
+    }
+
+    png_write_chunk(writer, "IDAT");
+
+    if (last) {
+        png_write_chunk(writer, "IEND");
+    }
+}
+
+//
+// EXR.
+//
+
+#define EXR_PIXEL_TYPE_HALF 1
+
+static_assert(std::endian::native == std::endian::little, "EXR scanlines are copied as they are in memory");
+
+//
+// Rounds to nearest even. Values which are too small for normal half are
+// flushed to zero, there is nothing that small in 8 bit colors.
+//
+static U16
+f32_to_f16(F32 value)
+{
+    U32 bits = std::bit_cast<U32>(value);
+    U32 sign = (bits >> 16) & 0x8000;
+    S32 exponent = static_cast<S32>((bits >> 23) & 0xFF) - 127 + 15;
+    U32 mantissa = bits & 0x7FFFFF;
+
+    if (exponent <= 0) {
+        return static_cast<U16>(sign);
+    }
+
+    if (exponent >= 31) {
+        return static_cast<U16>(sign | 0x7C00);
+    }
+
+    U32 half = sign | (static_cast<U32>(exponent) << 10) | (mantissa >> 13);
+    U32 rest = mantissa & 0x1FFF;
+
+    // NOTE: Carry out of mantissa goes into exponent, which is right.
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        ++half;
+    }
+
+    return static_cast<U16>(half);
+}
+
+struct Srgb_To_Linear_Halfs {
+    U16 values[256]{};
+
+    Srgb_To_Linear_Halfs(void)
+    {
+        for (U32 i = 0; i < 256; ++i) {
+            F32 c = static_cast<F32>(i) / MAX_U8;
+            F32 linear = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+
+            this->values[i] = f32_to_f16(linear);
+        }
+    }
+};
+
+static void
+exr_put_attribute(std::vector<U8> *output, const char *name, const char *type, const void *value, U32 size)
+{
+    image_put_bytes(output, name, strlen(name) + 1);
+    image_put_bytes(output, type, strlen(type) + 1);
+    image_put_u32_le(output, size);
+    image_put_bytes(output, value, size);
+}
+
+static U32
+exr_scanline_size(const Image_Writer *writer)
+{
+    return writer->width * 3 * sizeof(U16);
+}
+
+static void
+exr_begin(Image_Writer *writer)
+{
+    std::vector<U8> *output = &writer->output;
+
+    // NOTE: Magic, and version 2 of single part scanline file.
+    U8 magic[8] = {0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0};
+    image_put_bytes(output, magic, sizeof(magic));
+
+    // NOTE: Channels have to be sorted by name.
+    std::vector<U8> channels{};
+    for (const char *name : {"B", "G", "R"}) {
+        image_put_bytes(&channels, name, 2);
+        image_put_u32_le(&channels, EXR_PIXEL_TYPE_HALF);
+        image_put_u32_le(&channels, 0);  // NOTE: pLinear and reserved bytes.
+        image_put_u32_le(&channels, 1);  // NOTE: X and Y sampling.
+        image_put_u32_le(&channels, 1);
+    }
+    channels.push_back(0);
+
+    std::vector<U8> window{};
+    image_put_u32_le(&window, 0);
+    image_put_u32_le(&window, 0);
+    image_put_u32_le(&window, writer->width - 1);
+    image_put_u32_le(&window, writer->height - 1);
+
+    U8 no_compression = 0;
+    U8 increasing_y = 0;
+    F32 one = 1;
+    F32 center[2] = {0, 0};
+
+    exr_put_attribute(output, "channels", "chlist", channels.data(), static_cast<U32>(channels.size()));
+    exr_put_attribute(output, "compression", "compression", &no_compression, 1);
+    exr_put_attribute(output, "dataWindow", "box2i", window.data(), static_cast<U32>(window.size()));
+    exr_put_attribute(output, "displayWindow", "box2i", window.data(), static_cast<U32>(window.size()));
+    exr_put_attribute(output, "lineOrder", "lineOrder", &increasing_y, 1);
+    exr_put_attribute(output, "pixelAspectRatio", "float", &one, sizeof(one));
+    exr_put_attribute(output, "screenWindowCenter", "v2f", center, sizeof(center));
+    exr_put_attribute(output, "screenWindowWidth", "float", &one, sizeof(one));
+    output->push_back(0);
+
+    // NOTE: Uncompressed scanlines are all the same size, so table of their
+    // offsets is known up front.
+    U64 offset = output->size() + static_cast<U64>(writer->height) * sizeof(U64);
+    U64 scanline_size = 2 * sizeof(U32) + exr_scanline_size(writer);
+
+    for (U32 y = 0; y < writer->height; ++y) {
+        image_put_u64_le(output, offset + y * scanline_size);
+    }
+
+    writer->half_row.resize(static_cast<USZ>(writer->width) * 3);
+}
+
+static void
+exr_write_row(Image_Writer *writer, const Color4 *pixels)
+{
+    persist_var const Srgb_To_Linear_Halfs linear{};
+
+    U16 *b = writer->half_row.data();
+    U16 *g = b + writer->width;
+    U16 *r = g + writer->width;
+
+    for (U32 x = 0; x < writer->width; ++x) {
+        b[x] = linear.values[pixels[x].B];
+        g[x] = linear.values[pixels[x].G];
+        r[x] = linear.values[pixels[x].R];
+    }
+
+    image_put_u32_le(&writer->output, writer->rows_written);
+    image_put_u32_le(&writer->output, exr_scanline_size(writer));
+    image_put_bytes(&writer->output, writer->half_row.data(), exr_scanline_size(writer));
+}
+
+//
+// Writer.
+//
+
+bool
+Image_Writer::begin(const char *file_name, Image_Format format, U32 width, U32 height)
+{
+    assert(this->file == nullptr);
+
+    this->file_name = file_name;
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    this->rows_written = 0;
+    this->failed = false;
+    this->output.clear();
+
+    if (width == 0 || height == 0 || format >= IMAGE_FORMAT_COUNT) {
+        return false;
+    }
+
+    this->file = fopen(file_name, "wb");
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    switch (format) {
+        case IMAGE_FORMAT_PPM: {
+            C8 header[64] = {};
+            S32 size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+            image_put_bytes(&this->output, header, static_cast<USZ>(size));
+        } break;
+        case IMAGE_FORMAT_PNG: {
+            png_begin(this);
+        } break;
+        case IMAGE_FORMAT_EXR: {
+            exr_begin(this);
+        } break;
+        default: {
+        } break;
+    }
+
+    return !this->failed;
+}
+
+void
+Image_Writer::write_row(const Color4 *pixels)
+{
+    assert(this->file != nullptr);
+
+    if (this->failed || this->rows_written >= this->height) {
+        this->failed = true;
+        return;
+    }
+
+    switch (this->format) {
+        case IMAGE_FORMAT_PPM: {
+            USZ begin = this->output.size();
+            this->output.resize(begin + static_cast<USZ>(this->width) * 3);
+
+            U8 *row = this->output.data() + begin;
+            for (U32 x = 0; x < this->width; ++x, row += 3) {
+                row[0] = pixels[x].R;
+                row[1] = pixels[x].G;
+                row[2] = pixels[x].B;
+            }
+        } break;
+        case IMAGE_FORMAT_PNG: {
+            png_write_row(this, pixels);
+        } break;
+        case IMAGE_FORMAT_EXR: {
+            exr_write_row(this, pixels);
+        } break;
+        default: {
+        } break;
+    }
+
+    ++this->rows_written;
+
+    // NOTE: PNG writes whole chunks itself.
+    if (this->format != IMAGE_FORMAT_PNG && this->output.size() >= IMAGE_OUTPUT_FLUSH_SIZE) {
+        image_flush(this);
+    }
+}
+
+bool
+Image_Writer::end(void)
+{
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    image_flush(this);
+
+    bool written = !this->failed && this->rows_written == this->height;
+    written = fclose(this->file) == 0 && written;
+    this->file = nullptr;
+
+    if (!written) {
+        std::error_code error{};
+        std::filesystem::remove(this->file_name, error);
+    }
+
+    return written;
+}
+
+bool
+write_image(const Basic_Renderer *r, Image_Writer *writer, const char *file_name, Image_Format format)
+{
+    U32 width = r->pixels_width;
+    U32 height = r->pixels_height;
+
+    if (!writer->begin(file_name, format, width, height)) {
+        writer->end();
+        return false;
+    }
+
+    writer->strip.resize(static_cast<USZ>(width) * IMAGE_STRIP_ROWS);
+
+    // NOTE: Top row of the image is the last one of the framebuffer. Strips
+    // are aligned to the tiles, so the first one could be shorter.
+    for (U32 strip_end = height; strip_end > 0;) {
+        U32 strip_begin = (strip_end - 1) / IMAGE_STRIP_ROWS * IMAGE_STRIP_ROWS;
+        U32 rows_count = strip_end - strip_begin;
+
+        r->read_pixels(writer->strip.data(), width, R32{0, static_cast<S32>(strip_begin), static_cast<S32>(width), static_cast<S32>(rows_count)});
+
+        for (U32 y = rows_count; y > 0; --y) {
+            writer->write_row(writer->strip.data() + static_cast<USZ>(y - 1) * width);
+        }
+
+        strip_end = strip_begin;
+    }
+
+    return writer->end();
 }
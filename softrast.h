@@ -0,0 +1,2110 @@
+#pragma once
+
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <random>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <bit>
+#include <numbers>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+
+typedef signed char    S8;
+typedef signed short   S16;
+typedef signed int     S32;
+
+typedef unsigned char  U8;
+typedef unsigned short U16;
+typedef unsigned int   U32;
+
+#if defined(_WIN32)
+    typedef signed   long long S64;
+    typedef unsigned long long U64;
+#else
+    typedef signed   long S64;
+    typedef unsigned long U64;
+#endif
+
+
+typedef char     C8;
+
+#if !defined(__cplusplus)
+    typedef S16  C16;
+
+#else
+    typedef wchar_t C16;
+#endif
+
+typedef S32    C32;
+
+typedef float  F32;
+typedef double F64;
+
+typedef U8  Byte;
+typedef U64 USZ;
+typedef S64 SSZ;
+
+#define MAX_U8  255
+#define MAX_U16 65535
+#define MAX_U32 4294967295
+#define MAX_U64 18446744073709551615
+
+
+#define global_var static
+#define persist_var static
+
+
+//
+// Platform layer.
+//
+// Everything renderer needs from the OS. Implemented once per platform, see
+// `softrast_platform_win32.cpp` and `softrast_platform_linux.cpp`.
+//
+
+void *platform_allocate(USZ size);
+void platform_free(void *memory, USZ size);
+
+//
+// Reserves `size` bytes of address space, without any memory behind them.
+// Pages are made usable with `platform_commit`, and whole range is given back
+// with `platform_release`.
+//
+void *platform_reserve(USZ size);
+bool platform_commit(void *memory, USZ size);
+void platform_release(void *memory, USZ size);
+
+//
+// Gives memory behind committed pages back to the OS, range stays reserved and
+// could be committed again.
+//
+void platform_decommit(void *memory, USZ size);
+
+//
+// Maps whole file read only. Returns nullptr if file couldn't be opened or
+// it's empty.
+//
+void *platform_map_file(const char *file_name, USZ *size);
+void platform_unmap_file(void *memory, USZ size);
+
+S64 perf_get_counter_frequency(void);
+S64 perf_get_counter(void);
+
+struct Clock {
+    S64 ticks_begin;
+    S64 ticks_end;
+    S64 frequency;
+
+    Clock(void) : ticks_begin(perf_get_counter()), ticks_end(0), frequency(perf_get_counter_frequency()) {}
+
+    inline F64
+    tick(void) noexcept
+    {
+        this->ticks_end = perf_get_counter();
+        F64 elapsed = static_cast<double>(this->ticks_end - this->ticks_begin) / static_cast<double>(this->frequency);
+        this->ticks_begin = perf_get_counter();
+        return elapsed;
+    }
+};
+
+//
+// Arenas.
+//
+// Linear allocator over one reserved range of address space. Pages are
+// committed as it grows and kept until `deinit`, so once it reached it's
+// high water mark, pushing is just bumping `used`, and `reset` frees
+// everything at once. Nothing is constructed or destructed there, only
+// trivial types are allowed.
+//
+
+#define ARENA_COMMIT_SIZE (64 * 1024)
+
+struct Arena {
+    U8 *base = nullptr;
+    USZ reserved = 0;
+    USZ committed = 0;
+    USZ used = 0;
+
+    Arena(void) = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void init(USZ reserve_size);
+    void deinit(void);
+
+    //
+    // Returns `size` bytes aligned to `alignment`, which is power of two, or
+    // null if they don't fit into reserved range or pages couldn't be
+    // committed. Arena is left as it was then.
+    //
+    void *push(USZ size, USZ alignment);
+
+    template<typename T> T *
+    push_array(USZ count)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+        if (count > std::numeric_limits<USZ>::max() / sizeof(T)) {
+            return nullptr;
+        }
+
+        return static_cast<T *>(this->push(sizeof(T) * count, alignof(T)));
+    }
+
+    // NOTE: Empty span with null data on failure.
+    template<typename T> std::span<T>
+    push_span(USZ count)
+    {
+        T *items = this->push_array<T>(count);
+        return { items, items != nullptr ? count : 0 };
+    }
+
+    inline void
+    reset(void) noexcept
+    {
+        this->used = 0;
+    }
+
+    //
+    // Decommits pages above the `used`, if less than half of committed ones
+    // are in use.
+    //
+    void trim(void);
+
+    // NOTE: For scratch which is dead after some point, everything pushed
+    // after `save` is popped by `restore`.
+    inline USZ
+    save(void) const noexcept
+    {
+        return this->used;
+    }
+
+    inline void
+    restore(USZ position) noexcept
+    {
+        assert(position <= this->used);
+        this->used = position;
+    }
+};
+
+//
+// Growable array which has whole arena to itself, so it never moves and
+// `clear` is O(1).
+//
+template<typename T>
+struct Arena_Array {
+    Arena arena{};
+    T *items = nullptr;
+    USZ count = 0;
+
+    inline void
+    init(USZ reserve_count)
+    {
+        this->arena.init(sizeof(T) * reserve_count);
+        this->items = reinterpret_cast<T *>(this->arena.base);
+        this->count = 0;
+    }
+
+    inline void
+    deinit(void)
+    {
+        this->arena.deinit();
+        this->items = nullptr;
+        this->count = 0;
+    }
+
+    //
+    // Returns false, and doesn't push anything, if reserved range is full.
+    //
+    inline bool
+    push_back(const T &item)
+    {
+        // NOTE: Nothing else is pushed into this arena, so items are
+        // following each other.
+        T *slot = this->arena.template push_array<T>(1);
+
+        if (slot == nullptr) {
+            return false;
+        }
+
+        *slot = item;
+        ++this->count;
+
+        return true;
+    }
+
+    inline void
+    clear(void) noexcept
+    {
+        this->arena.reset();
+        this->count = 0;
+    }
+
+    // NOTE: Drops items past the first `new_count`.
+    inline void
+    truncate(USZ new_count) noexcept
+    {
+        assert(new_count <= this->count);
+        this->arena.restore(sizeof(T) * new_count);
+        this->count = new_count;
+    }
+
+    USZ size(void) const noexcept { return this->count; }
+    bool empty(void) const noexcept { return this->count == 0; }
+
+    T *data(void) noexcept { return this->items; }
+    const T *data(void) const noexcept { return this->items; }
+
+    T *begin(void) noexcept { return this->items; }
+    T *end(void) noexcept { return this->items + this->count; }
+    const T *begin(void) const noexcept { return this->items; }
+    const T *end(void) const noexcept { return this->items + this->count; }
+
+    T &operator[](USZ index) noexcept { return this->items[index]; }
+    const T &operator[](USZ index) const noexcept { return this->items[index]; }
+};
+
+
+struct V2 {
+
+    F32 x = 0;
+    F32 y = 0;
+
+    constexpr V2(F32 x_ = 0, F32 y_ = 0) noexcept : x(x_), y(y_) {}
+
+    F32 dot(V2 other) const;
+    F32 magnitude(void) const;
+
+    V2 normal(void) const;
+
+    V2 perpendicular_ccw(void) const;
+    V2 perpendicular_cw(void) const;
+
+    constexpr V2
+    operator+ (V2 other) const noexcept
+    {
+        return { this->x + other.x, this->y + other.y };
+    }
+
+    constexpr V2
+    operator- (V2 other) const noexcept
+    {
+        return { this->x - other.x, this->y - other.y };
+    }
+
+    constexpr V2
+    operator* (F32 value) const noexcept
+    {
+        return { this->x * value, this->y * value };
+    }
+
+    constexpr V2
+    operator/ (F32 value) const noexcept
+    {
+        return { this->x / value, this->y / value };
+    }
+};
+
+struct V3 {
+
+    F32 x = 0;
+    F32 y = 0;
+    F32 z = 0;
+
+    constexpr V3
+    operator+ (V3 other) const noexcept
+    {
+        return { this->x + other.x, this->y + other.y, this->z + other.z };
+    }
+
+    constexpr V3
+    operator+ (V2 other) const noexcept
+    {
+        return { this->x + other.x, this->y + other.y, this->z };
+    }
+
+    constexpr V3
+    operator- (V3 other) const noexcept
+    {
+        return { this->x - other.x, this->y - other.y, this->z - other.z };
+    }
+
+    constexpr V3
+    operator- (V2 other) const noexcept
+    {
+        return { this->x - other.x, this->y - other.y, this->z };
+    }
+
+    constexpr V3
+    operator* (F32 value) const noexcept
+    {
+        return { this->x * value, this->y * value, this->z * value };
+    }
+
+    template<typename Ty> constexpr Ty
+    to() const noexcept;
+};
+
+// NOTE: Specializations have to live outside of the class, GCC doesn't allow
+// them in class scope.
+template<> constexpr V2
+V3::to() const noexcept
+{
+    return { this->x, this->y };
+}
+
+// Matrix 3x3
+struct M3x3 {
+    V3 r0{}, r1{}, r2{};
+};
+
+
+/*
+    constexpr V3
+    transform(V3 ihat, V3 jhat, V3 khat, V3 p) const
+    {
+        // ihat - x axis, jhat - y axis, khat - z axis.
+        return ihat * p.x + jhat * p.y + khat * p.z;
+    }
+*/
+
+
+inline V3
+operator* (M3x3 m, V3 v)
+{
+    V3 ret = m.r0 * v.x + m.r1 * v.y + m.r2 * v.z;
+    return ret;
+}
+
+inline M3x3
+operator* (M3x3 a, M3x3 b)
+{
+    // NOTE: `r0`, `r1` and `r2` are where basis vectors are going, so `(a *
+    // b) * v == a * (b * v)`.
+    return { a * b.r0, a * b.r1, a * b.r2 };
+}
+
+
+//
+// source: https://danceswithcode.net/engineeringnotes/rotations_in_3d/rotations_in_3d_part1.html
+//
+
+
+inline M3x3
+get_rotation_mat3x3_roll(F32 roll)
+{
+    // roll - u
+    // as eurler angle symbol
+
+    M3x3 ret{};
+
+    ret.r0 = { 1, 0, 0 };
+    ret.r1 = { 0, std::cos(roll), -std::sin(roll) };
+    ret.r2 = { 0, std::sin(roll), std::cos(roll) };
+
+    return ret;
+}
+
+
+inline M3x3
+get_rotation_mat3x3_pitch(F32 pitch)
+{
+    // pitch - v
+    // as eurler angle symbol
+
+    M3x3 ret{};
+
+    ret.r0 = { std::cos(pitch), 0, std::sin(pitch) };
+    ret.r1 = { 0, 1, 0 };
+    ret.r2 = { -std::sin(pitch), 0, std::cos(pitch) };
+
+    return ret;
+}
+
+
+inline M3x3
+get_rotation_mat3x3_yaw(F32 yaw)
+{
+    // yaw - w
+    // as eurler angle symbol
+
+    M3x3 ret{};
+
+    ret.r0 = { std::cos(yaw), -std::sin(yaw), 0 };
+    ret.r1 = { std::sin(yaw), std::cos(yaw), 0 };
+    ret.r2 = { 0, 0, 1 };
+
+    return ret;
+}
+
+
+struct Transform {
+
+    F32 roll = 0, pitch = 0, yaw = 0;
+
+    V3 position{};  // NOTE: World space, applied after the rotation.
+
+    // void
+    // basis_vectors(V3 *ihat, V3 *jhat, V3 *khat) const
+    // {
+    //     if (ihat) {
+    //         *ihat = { std::cos(this->pitch), 0, std::sin(this->pitch) };
+    //     }
+
+    //     if (jhat) {
+    //         *jhat = { 0, 1, 0 };
+    //     }
+
+    //     if (khat) {
+    //         *khat = { -std::sin(this->pitch), 0, std::cos(this->pitch) };
+    //     }
+    // }
+
+    inline V3
+    to_world(V3 p) const noexcept
+    {
+        V3 result = p;
+
+        result = get_rotation_mat3x3_roll(this->roll) * result;
+        result = get_rotation_mat3x3_pitch(this->pitch) * result;
+        result = get_rotation_mat3x3_yaw(this->yaw) * result;
+
+        return result + this->position;
+    }
+
+    //
+    // Same rotation as `to_world`, combined into single matrix, without the
+    // `position`.
+    //
+    inline M3x3
+    to_matrix(void) const noexcept
+    {
+        return get_rotation_mat3x3_yaw(this->yaw) * get_rotation_mat3x3_pitch(this->pitch) * get_rotation_mat3x3_roll(this->roll);
+    }
+
+    // constexpr V3
+    // transform(V3 ihat, V3 jhat, V3 khat, V3 p) const
+    // {
+    //     // ihat - x axis, jhat - y axis, khat - z axis.
+    //     return ihat * p.x + jhat * p.y + khat * p.z;
+    // }
+
+};
+
+
+struct V3S32 {
+    S32 x = 0, y = 0, z = 0;
+
+    constexpr V3S32
+    operator- (S32 value) const noexcept
+    {
+        return { this->x - value, this->y - value, this->z - value };
+    }
+};
+
+
+struct R32 {
+    S32 x = 0, y = 0, w = 0, h = 0;
+};
+
+
+
+bool point_inside_triangle(V2 p, V2 a, V2 b, V2 c);
+
+
+struct Rect {
+    U16 X;
+    U16 Y;
+    U16 Width;
+    U16 Height;
+
+    constexpr Rect(U16 x = 0, U16 y = 0, U16 width = 0, U16 height = 0) noexcept
+        : X(x), Y(y), Width(width), Height(height)
+    { }
+
+    constexpr bool
+    IsInside(U16 x, U16 y) const noexcept
+    {
+        return x >= X && x <= X + Width && y >= Y && y <= Y + Height;
+    }
+
+
+    // TODO(ilya.a): Fix bug when `r` is bigger than `this`.
+    constexpr bool
+    IsOverlapping(const Rect &r) const noexcept
+    {
+        return IsInside(r.X + 0      , r.Y + 0)
+            || IsInside(r.X + r.Width, r.Y + r.Height)
+            || IsInside(r.X + r.Width, r.Y + 0)
+            || IsInside(r.X + 0      , r.Y + r.Height);
+    }
+};
+
+
+constexpr S32
+get_offset(S32 width, S32 y, S32 x) noexcept
+{
+    return width * y + x;
+}
+
+struct Color4 {
+    U8 B;
+    U8 G;
+    U8 R;
+    U8 A;
+
+    constexpr Color4(U8 r = 0, U8 g = 0, U8 b = 0, U8 a = 0) noexcept
+        : R(r), G(g), B(b), A(a)
+    { }
+
+    constexpr Color4
+    operator+(const Color4 &other) const noexcept
+    {
+        return Color4(R+other.R,
+                      G+other.G,
+                      B+other.B,
+                      A+other.A);
+    }
+
+    //
+    // Multiplies channels as if they were in [0, 1], so white keeps the color
+    // as it is.
+    //
+    constexpr Color4
+    modulate(const Color4 &other) const noexcept
+    {
+        return Color4((R * other.R + 127) / MAX_U8,
+                      (G * other.G + 127) / MAX_U8,
+                      (B * other.B + 127) / MAX_U8,
+                      (A * other.A + 127) / MAX_U8);
+    }
+};
+
+
+static_assert(sizeof(Color4) == sizeof(U32));
+
+global_var constexpr Color4 COLOR_WHITE = Color4(MAX_U8, MAX_U8, MAX_U8, MAX_U8);
+global_var constexpr Color4 COLOR_RED   = Color4(MAX_U8, 0, 0, 0);
+global_var constexpr Color4 COLOR_GREEN = Color4(0, MAX_U8, 0, 0);
+global_var constexpr Color4 COLOR_BLUE  = Color4(0, 0, MAX_U8, 0);
+global_var constexpr Color4 COLOR_BLACK = Color4(0, 0, 0, 0);
+
+global_var constexpr Color4 COLOR_YELLOW = COLOR_GREEN + COLOR_RED;
+
+global_var constexpr F32 WORLD_UNITS_IN_SCREEN_HEIGHT = 5;
+
+R32 calculate_bounding_box(V2 window_size, V2 triangle[3]);
+V3 world_to_screen(V3 v, Transform transform, V2 screen_size);
+
+
+//
+// Thread pool with work stealing.
+//
+// Every `parallel_for` splits index range evenly between workers (calling
+// thread is worker #0). Worker pops indices from the front of it's own range
+// and, when it runs dry, steals from the back of the other workers' ranges.
+//
+
+typedef void (*Parallel_For_Proc)(void *data, U32 index, U32 worker_index);
+
+struct Thread_Pool {
+
+    struct Work_Range {
+        // NOTE: Packed as `(end << 32) | begin`, so owner and thieves could both
+        // shrink the range with single CAS. Aligned to the cache line to not
+        // false share between workers.
+        alignas(64) std::atomic<U64> packed{0};
+    };
+
+    U32 workers_count = 0;  // Including calling thread.
+
+    std::vector<std::thread> threads{};
+    std::unique_ptr<Work_Range[]> ranges{};
+
+    std::mutex mutex{};
+    std::condition_variable wake_cv{};
+    std::condition_variable done_cv{};
+
+    U64 generation = 0;
+    U32 busy_workers = 0;
+    bool should_stop = false;
+
+    Parallel_For_Proc proc = nullptr;
+    void *data = nullptr;
+
+    void init(U32 workers_count);
+    void deinit(void);
+
+    void parallel_for(U32 count, Parallel_For_Proc proc, void *data);
+};
+
+
+//
+// Textures.
+//
+// Texels of every mip level are stored in Morton (Z) order, so texels which
+// are close in 2D are close in memory too, and raster block hits same few
+// cache lines no matter in which direction it walks over the texture. Index of
+// texel is `morton_x[x] | morton_y[y]`, with bits of the coordinates spread out
+// by lookup tables.
+//
+// Sizes are rounded up to powers of two when texture is made, and whole mip
+// chain down to 1x1 is box filtered once, right there. Coordinates are wrapped
+// (repeated). Texel (0, 0) is at UV (0, 0), which is bottom left corner of the
+// image, same as in `.obj`.
+//
+
+enum Texture_Filter : U8 {
+    TEXTURE_FILTER_NEAREST,    // NOTE: Nearest texel of nearest mip level.
+    TEXTURE_FILTER_BILINEAR,   // NOTE: 2x2 texels of nearest mip level.
+    TEXTURE_FILTER_TRILINEAR,  // NOTE: 2x2 texels of two nearest mip levels.
+
+    TEXTURE_FILTER_COUNT,
+};
+
+extern const char *TEXTURE_FILTER_NAMES[TEXTURE_FILTER_COUNT];
+
+struct Texture_Level {
+    S32 width = 0;
+    S32 height = 0;
+
+    std::vector<U32> morton_x{};
+    std::vector<U32> morton_y{};
+
+    std::vector<Color4> texels{};  // NOTE: In Morton order.
+};
+
+struct Texture {
+    std::vector<Texture_Level> levels{};  // NOTE: Empty if texture failed to load.
+};
+
+//
+// Makes texture out of `width` by `height` row major `pixels`, first row is
+// the bottom one.
+//
+Texture make_texture(const Color4 *pixels, S32 width, S32 height);
+
+Texture make_checker_texture(S32 size, S32 cells, Color4 a, Color4 b);
+
+//
+// Loads binary `.ppm` (P6) or uncompressed or RLE true color `.tga`.
+//
+Texture load_texture(std::string_view file_name);
+
+//
+// Samples texture at `uv`. `lod` is log2 of texels per pixel.
+//
+Color4 sample_texture(const Texture *texture, Texture_Filter filter, F32 lod, V2 uv);
+
+
+//
+// Binned tile rasterization.
+//
+// Triangles are projected and set up once, then sorted into bins of screen
+// tiles. Each tile is shaded by exactly one worker, which walks it's bin in
+// submission order, so tiles never share `pixels_buffer` region and result is
+// same as drawing triangles one by one.
+//
+
+#define TILE_SIZE 64
+
+
+//
+// Edge functions.
+//
+// For edge `v -> v'` edge function is `E(p) = a * (p.x - v.x) + b * (p.y - v.y)`,
+// negative inside of the triangle. Edges are set up once per triangle and
+// then stepped with additions.
+//
+// NOTE: Values are always stepped from origin of 8x8 block aligned to the
+// screen, not from the corner of bounding box or tile. That way rounding of
+// every pixel is same no matter from where raster walk starts, so tiled and
+// serial paths still produce same pixels.
+//
+
+#define RASTER_BLOCK_SIZE 8
+
+struct Edge_Function {
+    F32 a = 0, b = 0;
+    V2 origin{};
+
+    // NOTE: Top-left fill rule. Pixels exactly on the edge are owned only by
+    // top and left edges, so shared edges are drawn exactly once.
+    bool top_left = false;
+};
+
+constexpr bool
+edge_inside(F32 e, bool top_left) noexcept
+{
+    return e < 0 || (e == 0 && top_left);
+}
+
+
+//
+// Fixed point rasterization mode.
+//
+// Vertexes are snapped to 28.4 fixed point and edge functions are evaluated
+// in integers, so coverage is exact: every pixel on the shared edge belongs to
+// exactly one of the triangles.
+//
+// NOTE: Edge value for whole raster block is kept in 64 bits. But in blocks
+// which edge crosses, values are less than `(|a| + |b|) * 8` by magnitude, and
+// those are fitting into 32 bits as long as vertexes are inside of
+// `FIXED_GUARD_BAND`, so span kernels are running on 32 bit lanes.
+//
+
+enum Raster_Mode : U8 {
+    RASTER_MODE_FLOAT,
+    RASTER_MODE_FIXED,
+};
+
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE  (1 << SUBPIXEL_BITS)
+
+#define FIXED_GUARD_BAND (1 << 14)  // NOTE: In pixels, from each side of the screen.
+
+struct Edge_Function_Fixed {
+    S64 a = 0, b = 0;
+    S32 origin_x = 0, origin_y = 0;
+
+    // NOTE: Top-left rule baked in: pixel is inside if `E - bias < 0`.
+    S64 bias = 0;
+};
+
+inline S32
+snap_to_fixed(F32 value) noexcept
+{
+    return static_cast<S32>(std::lround(value * SUBPIXEL_ONE));
+}
+
+#define RASTER_MAX_VARYINGS 4
+
+struct Draw_Material;
+
+struct Raster_Triangle {
+    V2 vertexes[3]{};
+    F32 depths[3]{};
+    R32 bb{};  // NOTE: Same as `calculate_bounding_box`: `w` and `h` are exclusive max corner.
+    Color4 color{};
+
+    Edge_Function edges[3]{};
+
+    bool fixed = false;
+    Edge_Function_Fixed fixed_edges[3]{};
+
+    // NOTE: Depth plane `z(p) = depths[0] + dz_dx * (p.x - vertexes[0].x) +
+    // dz_dy * (p.y - vertexes[0].y)`. Depth is post projection `z / w`, which
+    // is affine in screen space, so interpolating it linearly is
+    // perspective-correct. Interpolated values are clamped to [z_min, z_max] of
+    // the vertexes.
+    F32 dz_dx = 0, dz_dy = 0;
+    F32 z_min = 0, z_max = 0;
+
+    // NOTE: Values interpolated over the triangle for the pixel stage, like UV
+    // or color. Only first `varyings_count` are used. Planes are set up same
+    // way as depth one.
+    U32 varyings_count = 0;
+    F32 varyings[3][RASTER_MAX_VARYINGS]{};
+    F32 dv_dx[RASTER_MAX_VARYINGS]{}, dv_dy[RASTER_MAX_VARYINGS]{};
+
+    // NOTE: Textured triangles only, others keep `texture` null and are
+    // drawn with `color`. UV is in the first two varyings. Projection is
+    // orthographic, so UV derivatives are same over the whole triangle, and
+    // so is `texture_lod`.
+    const Texture *texture = nullptr;
+    F32 texture_lod = 0;
+
+    // NOTE: Material of the draw which triangle came from: cull mode and
+    // winding for `clip_triangle`, texture filter, and shader which
+    // `draw_list_raster` runs. Never null once triangle is set up.
+    const Draw_Material *material = nullptr;
+};
+
+//
+// Computes bounding box, edge functions and depth plane of the triangle.
+// Returns false if triangle is not visible.
+//
+// NOTE: Triangle has to be clockwise on the screen, counter clockwise ones
+// are dropped. `clip_triangle` takes care of that.
+//
+bool raster_triangle_setup(Raster_Triangle *t, Raster_Mode mode, V2 screen_size);
+
+
+//
+// Clipping and culling.
+//
+// Projection is orthographic, so screen position and depth are both affine in
+// world space, and triangles are clipped right in the screen space, with
+// linearly interpolated vertexes.
+//
+// Triangles are clipped against the near plane, so nothing behind the camera
+// is drawn, and against the guard band around the screen. Everything inside
+// of the guard band is left to the rasterizer, which is already clipping to the
+// screen (and tile) with bounding box, so only triangles which are really far
+// off screen are paying for clipping. Triangles which are completely outside
+// of the screen are dropped before setup.
+//
+
+#define CLIP_GUARD_BAND (FIXED_GUARD_BAND / 4)  // NOTE: In pixels. Clipped vertexes of screens up to 8k are still in `FIXED_GUARD_BAND`.
+
+// NOTE: Camera sits at Z = 10 and looks down the -Z, anything with depth
+// less than that is behind it.
+global_var constexpr F32 CAMERA_NEAR_DEPTH = -10;
+
+enum Cull_Mode : U8 {
+    CULL_MODE_NONE,
+    CULL_MODE_BACK,
+    CULL_MODE_FRONT,
+};
+
+//
+// Winding of front facing triangles as they are seen on the screen.
+//
+enum Front_Face : U8 {
+    FRONT_FACE_CW,
+    FRONT_FACE_CCW,
+};
+
+
+//
+// Span kernels.
+//
+// Evaluate three edge functions and depth for one 8x1 row of raster block,
+// test depth and write color and depth into covered pixels which passed it.
+// All kernels are doing the same float operations in the same order, so they
+// are producing same framebuffers. Kernel is picked at runtime by CPUID.
+//
+
+enum Raster_ISA : U8 {
+    RASTER_ISA_SCALAR,
+    RASTER_ISA_SSE41,
+    RASTER_ISA_AVX2,
+
+    RASTER_ISA_COUNT,
+};
+
+struct Raster_Span_Setup {
+    alignas(32) F32 step_x[3][RASTER_BLOCK_SIZE]{};
+    alignas(32) S32 fixed_step_x[3][RASTER_BLOCK_SIZE]{};
+    alignas(32) F32 step_z[RASTER_BLOCK_SIZE]{};
+    U32 top_left[3]{};  // NOTE: All bits set for top-left edges, so it could be used as lane mask.
+    F32 z_min = 0, z_max = 0;
+    Color4 color{};
+};
+
+//
+// `pixels` and `depths` point at first pixel of the 8x1 span. Only lanes in
+// [kx_begin, kx_end) are allowed to be written. `whole_span` tells that all 8
+// pixels of the span are inside of the framebuffer row, so kernel may load
+// and store them back. Returns mask of written pixels, bit `kx` for lane `kx`.
+//
+typedef U32 (*Raster_Span_Proc)(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 e0, F32 e1, F32 e2, F32 z, S32 kx_begin, S32 kx_end, bool whole_span);
+
+//
+// Same as `Raster_Span_Proc`, but edge values are fixed point. Edge is inside
+// when it's value is negative.
+//
+typedef U32 (*Raster_Span_Fixed_Proc)(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, S32 e0, S32 e1, S32 e2, F32 z, S32 kx_begin, S32 kx_end, bool whole_span);
+
+//
+// Same as `Raster_Span_Proc`, but for spans which are known to be fully
+// covered, so only depth is tested.
+//
+typedef U32 (*Raster_Fill_Proc)(Color4 *pixels, F32 *depths, const Raster_Span_Setup *setup, F32 z, S32 kx_begin, S32 kx_end, bool whole_span);
+
+#define MSAA_MAX_SAMPLES 8
+
+//
+// Edge and depth values of one row of the block at every sample, see
+// "Multisampling". Edge values are either float or fixed point, same as
+// `Raster_Span_Proc` and `Raster_Span_Fixed_Proc` take.
+//
+struct Raster_Samples_Row {
+    U32 samples = 0;  // NOTE: Bit per sample which has to be tested.
+    U32 full = 0;     // NOTE: Samples which every edge covers whole block of, their edges are not tested.
+    bool fixed = false;
+    bool flat = false;  // NOTE: Triangle has no pixel stage, kernel writes it's color too.
+
+    F32 e[MSAA_MAX_SAMPLES][3]{};
+    S32 fixed_e[MSAA_MAX_SAMPLES][3]{};
+    F32 z[MSAA_MAX_SAMPLES]{};
+};
+
+//
+// Multisampled span kernel. For every sample of `row`, tests coverage of the 8
+// pixels, then depth of the covered ones, and writes depth of those which
+// passed (and color, when `row->flat`). `pixels` and `depths` are first pixel
+// of the span in plane of sample 0, planes are `plane_stride` apart. Lanes of
+// the samples which passed go into `written`, returns union of them.
+//
+typedef U32 (*Raster_Samples_Proc)(Color4 *pixels, F32 *depths, USZ plane_stride, const Raster_Span_Setup *setup, const Raster_Samples_Row *row,
+                                   S32 kx_begin, S32 kx_end, bool whole_span, U32 written[MSAA_MAX_SAMPLES]);
+
+Raster_ISA detect_raster_isa(void);
+
+extern const Raster_Span_Proc RASTER_SPAN_PROCS[RASTER_ISA_COUNT];
+extern const Raster_Span_Fixed_Proc RASTER_SPAN_FIXED_PROCS[RASTER_ISA_COUNT];
+extern const Raster_Fill_Proc RASTER_FILL_PROCS[RASTER_ISA_COUNT];
+extern const Raster_Samples_Proc RASTER_SAMPLES_PROCS[RASTER_ISA_COUNT];
+extern const char *RASTER_ISA_NAMES[RASTER_ISA_COUNT];
+
+
+//
+// Vertex processing.
+//
+// Rotation and projection of `world_to_screen` are folded into one affine
+// matrix once per frame, and whole vertex array is run through it in
+// structure of arrays layout, 8 vertexes at the time. Triangle setup then
+// reads screen positions from that post-transform cache by index, so every
+// vertex is transformed once per frame no matter how many triangles share it.
+//
+
+#define VERTEX_BATCH_SIZE 8
+
+//
+// Output is `row[0] * x + row[1] * y + row[2] * z + row[3]` for screen x, y
+// and depth.
+//
+struct Screen_Transform {
+    F32 rows[3][4]{};
+};
+
+Screen_Transform make_screen_transform(Transform transform, V2 screen_size);
+
+//
+// Vertex positions in structure of arrays layout. Arrays are padded with
+// zeroes up to multiple of `VERTEX_BATCH_SIZE`, so kernels never have tails.
+//
+struct Vertex_Stream {
+    USZ count = 0;  // NOTE: Without padding.
+
+    std::vector<F32> x{};
+    std::vector<F32> y{};
+    std::vector<F32> z{};
+
+    void resize(USZ count);
+};
+
+//
+// Transformed vertexes, same layout as `Vertex_Stream`, pushed into frame
+// arena.
+//
+struct Screen_Vertexes {
+    USZ count = 0;   // NOTE: Without padding.
+    USZ stride = 0;  // NOTE: Padded, instances are going one after another this far apart.
+
+    F32 *x = nullptr;
+    F32 *y = nullptr;
+    F32 *z = nullptr;
+};
+
+//
+// Transforms `count` vertexes, which is multiple of `VERTEX_BATCH_SIZE`. All
+// kernels are doing same float operations in same order, so they are producing
+// same positions.
+//
+typedef void (*Transform_Vertexes_Proc)(const Screen_Transform *t, const F32 *x, const F32 *y, const F32 *z, F32 *out_x, F32 *out_y, F32 *out_z, USZ count);
+
+extern const Transform_Vertexes_Proc TRANSFORM_VERTEXES_PROCS[RASTER_ISA_COUNT];
+
+
+//
+// Hierarchical Z.
+//
+// Keeps farthest depth of every 8x8 raster block and of every tile. Values
+// are only ever upper bounds of what is in `depth_buffer`, so triangle or
+// block whose nearest point is behind them could be skipped without changing
+// the picture.
+//
+
+global_var constexpr F32 DEPTH_CLEAR_VALUE = std::numeric_limits<F32>::infinity();
+
+struct Hi_Z_Buffer {
+    S32 blocks_x = 0;
+    S32 blocks_y = 0;
+
+    // NOTE: In persistent arena of the renderer.
+    std::span<F32> blocks{};
+    std::span<F32> tiles{};
+};
+
+//
+// Indexes of triangles overlapping every tile, all bins are in one array.
+// Bin of tile `i` is `indexes[offsets[i]..offsets[i + 1]]`, both arrays are in
+// frame arena.
+//
+struct Tile_Bins {
+    S32 tiles_x = 0;
+    S32 tiles_y = 0;
+
+    U32 *offsets = nullptr;
+    U32 *indexes = nullptr;
+
+    inline U32
+    tiles_count(void) const noexcept
+    {
+        return static_cast<U32>(this->tiles_x * this->tiles_y);
+    }
+
+    inline std::span<const U32>
+    bin(U32 tile_index) const noexcept
+    {
+        if (this->offsets == nullptr) {
+            return {};
+        }
+
+        return { this->indexes + this->offsets[tile_index], this->indexes + this->offsets[tile_index + 1] };
+    }
+};
+
+//
+// Multisampling.
+//
+// With `samples_count` of 4 or 8, every pixel keeps that many color and depth
+// samples at standard (D3D) sample positions. Samples are stored in planes:
+// sample `s` of all pixels goes one after another. Edge and depth values of a
+// sample are the ones of the pixel center shifted by sample offset. One call
+// of `Raster_Samples_Proc` per row of the block finds coverage of every sample
+// and depth tests the covered ones. Flat triangles are done right there,
+// otherwise shader (or texture) runs once per pixel, for the pixels which any
+// sample of passed, and it's color is written only into those samples.
+// Samples are averaged into `pixels_buffer` at the end of every tile.
+//
+
+//
+// Clearing.
+//
+// With `CLEAR_MODE_LAZY`, `clear` only marks every tile as pending. Tile is
+// filled with clear values (color, depth and Hi-Z) right before the first
+// triangle is drawn into it, and tiles which no triangle touched are filled at
+// the end of the raster pass, by the worker which owns the tile. So clear is
+// spread over raster workers, instead of being a single threaded pass over the
+// whole framebuffer before the frame. `CLEAR_MODE_EAGER` fills everything in
+// `clear`. Both are filling with non-temporal stores, which are not reading
+// the memory they are overwriting.
+//
+// Every render call leaves no tiles pending, so pixels are only stale if
+// nothing was drawn after `clear`, call `resolve_clear` before reading them
+// then.
+//
+
+enum Clear_Mode : U8 {
+    CLEAR_MODE_LAZY,
+    CLEAR_MODE_EAGER,
+};
+
+#define CLEAR_PIXEL 0x45454545  // NOTE: Gray, every channel is 69.
+
+//
+// Time spent in every stage of the frame, in seconds. Stages are accumulated
+// by `clear`, `render_mesh` and `present`, caller resets them when frame
+// begins.
+//
+// NOTE: Binning of triangles into tiles counts as raster, except for draw
+// lists, where it's part of the geometry stage and counts as setup. Lazy
+// clears of the tiles count as raster too.
+//
+struct Render_Stats {
+    F64 clear = 0;
+    F64 transform = 0;
+    F64 setup = 0;
+    F64 raster = 0;
+    F64 present = 0;
+
+    U64 triangles_submitted = 0;
+    U64 triangles_culled = 0;      // NOTE: Off screen, behind the camera or facing away.
+    U64 triangles_clipped = 0;
+    U64 triangles_rasterized = 0;  // NOTE: Ones which passed setup, including pieces of clipped ones.
+
+    U64 instances_submitted = 0;  // NOTE: Of `Draw_List::submit_instances`.
+    U64 instances_culled = 0;     // NOTE: Their triangles are counted as culled too.
+
+    U64 clusters_submitted = 0;  // NOTE: Of every drawn instance, see "Clusters".
+    U64 clusters_culled = 0;     // NOTE: Their triangles are counted as culled too.
+
+    U64 tiles_drawn = 0;  // NOTE: By `draw_list_raster`. Others kept pixels of the previous frame.
+
+    U64 draws_failed = 0;  // NOTE: Ran out of memory, see "Out of memory". Nothing of them is drawn.
+};
+
+struct Draw_Command;
+struct Draw_Instance;
+struct Instances_Bvh;
+
+//
+// Framebuffer memory.
+//
+// Every buffer lives in it's own reserved range, which is big enough for
+// `FRAMEBUFFER_RESERVE_WIDTH` x `FRAMEBUFFER_RESERVE_HEIGHT` (or the biggest
+// size seen so far). `resize` only commits pages which new size needs on top
+// of already committed ones, so resizing the window back and forth doesn't go
+// to the OS. Pages are decommitted when buffer shrinks below half of them.
+//
+// Rows are `pixels_pitch` pixels apart. Pitch is multiple of the cache line,
+// so 8 pixel spans never straddle lines and SIMD kernels could always load and
+// store whole spans, and it's never multiple of the page, so rows of the tile
+// are not fighting for the same cache sets.
+//
+
+//
+// Framebuffer layout.
+//
+// With `PIXELS_LAYOUT_LINEAR` pixel (x, y) of every buffer and sample plane is
+// at `y * pixels_pitch + x`. With `PIXELS_LAYOUT_TILED` buffers are made of
+// 8x8 raster blocks, which are stored as 64 pixels one after another, and
+// blocks are going in rows of `pixels_pitch / 8`. Raster walks the
+// framebuffer block by block, so block of color is 4 whole cache lines (and
+// same for depth) instead of 8 rows which are pitch apart. Planes are padded
+// to whole rows of blocks in both layouts.
+//
+// Nothing outside of renderer could read tiled pixels, `present` and
+// `read_pixels` are copying them into linear rows.
+//
+
+enum Pixels_Layout : U8 {
+    PIXELS_LAYOUT_LINEAR,
+    PIXELS_LAYOUT_TILED,
+    PIXELS_LAYOUT_COUNT,
+};
+
+extern const char *PIXELS_LAYOUT_NAMES[PIXELS_LAYOUT_COUNT];
+
+#define FRAMEBUFFER_RESERVE_WIDTH  3840
+#define FRAMEBUFFER_RESERVE_HEIGHT 2160
+#define FRAMEBUFFER_PITCH_ALIGNMENT 64  // NOTE: In bytes.
+
+// NOTE: Only address space, memory is committed as it's used.
+#define PERSISTENT_ARENA_RESERVE_SIZE (256ULL << 20)
+#define FRAME_ARENA_RESERVE_SIZE      (4ULL << 30)
+#define TRIANGLES_RESERVE_COUNT       (16ULL << 20)
+
+//
+// Out of memory.
+//
+// Frame arena and triangles can't grow past their reserved ranges. Draw which
+// doesn't fit into them, or whose pages couldn't be committed, fails: it's
+// triangles which are already set up are dropped, it's counted in
+// `Render_Stats::draws_failed`, and the rest of the frame goes on as usual.
+// Geometry stage helpers set `Basic_Renderer::out_of_memory` and bail out,
+// draw checks it once they are done.
+//
+
+struct Basic_Renderer {
+    Color4 clear_color;
+
+    U8 bytes_per_pixel = 4;
+    U64 x_offset = 0;
+    U64 y_offset = 0;
+
+    void *pixels_buffer = nullptr;
+    U32 pixels_width = 0;
+    U32 pixels_height = 0;
+    U32 pixels_pitch = 0;  // NOTE: In pixels, same for every buffer, see "Framebuffer memory".
+    Pixels_Layout pixels_layout = PIXELS_LAYOUT_LINEAR;  // NOTE: Set it before `resize`.
+
+    F32 *depth_buffer = nullptr;  // NOTE: `samples_count` planes of `pixels_pitch * pixels_height`.
+    Hi_Z_Buffer hi_z{};
+
+    // NOTE: 1, 4 or 8, see "Multisampling". Buffers are allocated for it by
+    // `resize`, so it has to be called after this is changed.
+    U32 samples_count = 1;
+    Color4 *samples_buffer = nullptr;  // NOTE: Color planes, only when `samples_count` is more than 1.
+
+    // NOTE: Reserved ranges behind the buffers.
+    Arena pixels_memory{};
+    Arena depth_memory{};
+    Arena samples_memory{};
+
+    // NOTE: Linear copy of tiled framebuffer, see `present`.
+    Color4 *present_buffer = nullptr;
+    Arena present_memory{};
+
+    Tile_Bins tile_bins{};
+
+    Clear_Mode clear_mode = CLEAR_MODE_LAZY;
+    std::span<U8> tiles_clear_pending{};  // NOTE: One per tile, see `Clear_Mode`.
+
+    Raster_ISA isa = RASTER_ISA_SCALAR;
+    Raster_Mode raster_mode = RASTER_MODE_FLOAT;
+
+    F32 near_depth = CAMERA_NEAR_DEPTH;
+
+    bool cluster_culling = true;  // NOTE: See "Clusters", it doesn't change any pixel.
+
+    // NOTE: Everything which is sized by the framebuffer, it's reset and
+    // pushed again by `resize`.
+    Arena persistent_arena{};
+
+    // NOTE: Per frame scratch. Reset at the beginning of every render call
+    // and of `draw_list_geometry`, so it lives until the next one.
+    Arena frame_arena{};
+
+    Screen_Vertexes screen_vertexes{};  // NOTE: Post-transform cache, `z` is depth.
+    F32 *vertex_varyings = nullptr;  // NOTE: Output of shader's vertex stage, see `render_mesh_shaded`.
+    Arena_Array<Raster_Triangle> triangles{};
+    std::span<R32> draw_bounds{};  // NOTE: Screen bounds of every command, `w` and `h` are exclusive max corner.
+    bool out_of_memory = false;  // NOTE: Of the current draw, see "Out of memory".
+
+    // NOTE: Incremental rendering of draw lists, see `draw_list_geometry`.
+    // Previous draws are kept across frames, so they are not in the frame
+    // arena. Copies are reusing capacity of the vectors.
+    bool incremental = false;
+    bool previous_draws_valid = false;
+    std::vector<Draw_Command> previous_draws{};
+    std::vector<Draw_Instance> previous_instances{};
+    std::vector<R32> previous_draw_bounds{};
+    std::span<U8> tiles_dirty{};  // NOTE: One per tile, ones which have to be redrawn.
+
+    // NOTE: Trees over instances of the draws, by position of the draw in
+    // the list, kept across frames, see "Draw lists".
+    std::vector<Instances_Bvh> instances_bvhs{};
+
+    // NOTE: Regular rectangles which last `draw_list_raster` has redrawn,
+    // only those have to be presented. There are never more of them than
+    // tiles, `resize` reserves that many.
+    std::vector<R32> present_rects{};
+
+    Render_Stats stats{};
+
+    void resize(S32 w, S32 h);
+
+    //
+    // Gives back framebuffer and arenas, renderer could be resized again
+    // afterwards.
+    //
+    void release(void);
+
+    void clear(void);
+    void clear_depth(void);
+    void resolve_clear(void);
+
+    //
+    // Averages samples of every pixel into `pixels_buffer`. Render calls are
+    // doing it themselves, only `raster_triangle` doesn't.
+    //
+    void resolve_samples(void);
+
+    //
+    // Returns linear pixels to present, which rows are `pixels_pitch` apart.
+    // That's `pixels_buffer` itself with linear layout. With tiled one `rects`
+    // of it are de-tiled into `present_buffer`, and rest of `present_buffer`
+    // keeps what was presented before.
+    //
+    const Color4 *present(std::span<const R32> rects);
+
+    //
+    // Copies `rect` of the framebuffer into `dest`, which rows are
+    // `dest_pitch` pixels apart, in either layout.
+    //
+    void read_pixels(Color4 *dest, U32 dest_pitch, R32 rect) const;
+};
+
+//
+// Culls and clips triangle with screen space `vertexes`, `depths` and `color`
+// set, and appends ones which are passing setup to `r->triangles`.
+//
+void clip_triangle(Basic_Renderer *r, const Raster_Triangle *t);
+
+void raster_triangle(Basic_Renderer *r, const Raster_Triangle *t, R32 clip);
+
+void render_triangles_serial(Basic_Renderer *r, std::span<const Raster_Triangle> triangles);
+void render_triangles_binned(Basic_Renderer *r, Thread_Pool *pool, std::span<const Raster_Triangle> triangles);
+
+
+//
+// Bounding volume hierarchy.
+//
+// Binary tree of boxes over items, which are given by their bounds. It's
+// built top down, every node is split where binned surface area heuristic
+// says. Node of `n` items gets `2n - 1` slots for itself and it's subtree:
+// left child is right after the parent and right one is after all slots of
+// the left subtree. That way subtrees are built by different workers right
+// into their own slots, without stitching them afterwards. Slots which
+// smaller subtrees didn't need are left unused, and children always come
+// after their parents.
+//
+// When items are moving, `refit` updates boxes of their leaves and of every
+// node above them, shape of the tree stays the same. Tree which is refitted
+// over and over gets looser, `degraded` tells when it's time to build it
+// again.
+//
+
+#define BVH_BINS_COUNT 16
+#define BVH_LEAF_SIZE  4   // NOTE: Of trees over clusters and instances.
+#define BVH_MAX_DEPTH  64  // NOTE: Nodes deeper than half of it are split by median, so it's never reached.
+#define BVH_REFIT_MAX_COST 2.0f  // NOTE: How much looser than built tree could refitted one get.
+
+#define BVH_NODE_NONE MAX_U32
+
+struct Bvh_Bounds {
+    V3 min{};
+    V3 max{};
+};
+
+struct Bvh_Node {
+    Bvh_Bounds bounds{};
+
+    // NOTE: Leaf owns `count` items starting from `first` in `Bvh::items`.
+    // Inner node has `count` of 0, and `first` is it's right child. Unused
+    // slots have `first` of `BVH_NODE_NONE`.
+    U32 first = BVH_NODE_NONE;
+    U32 count = 0;
+};
+
+struct Bvh {
+    std::vector<Bvh_Node> nodes{};
+    std::vector<U32> items{};  // NOTE: Indexes of the items, ordered so every leaf has them in a row.
+
+    // NOTE: For refit.
+    std::vector<U32> parents{};
+    std::vector<U32> item_leaves{};
+    std::vector<U32> refit_nodes{};
+    std::vector<U8> refit_marks{};
+
+    F32 cost = 0;        // NOTE: Sum of surface areas of the nodes.
+    F32 built_cost = 0;
+
+    //
+    // Leaves are getting up to `leaf_size` items. Subtrees are built on the
+    // `pool` if it's given. Doesn't allocate if it was built with as many
+    // items before.
+    //
+    void build(std::span<const Bvh_Bounds> bounds, U32 leaf_size, Thread_Pool *pool);
+
+    //
+    // Refits nodes above `moved` items, after their `bounds` changed, or every
+    // node if `moved` is not given.
+    //
+    void refit(std::span<const Bvh_Bounds> bounds, std::span<const U32> moved);
+    void refit(std::span<const Bvh_Bounds> bounds);
+
+    bool degraded(void) const;
+};
+
+
+//
+// Meshes.
+//
+
+//
+// Material from `.mtl`. Fields which are missing in the file keep their
+// defaults.
+//
+struct Material {
+    std::string name{};
+
+    V3 ambient{};               // NOTE: `Ka`.
+    V3 diffuse{1, 1, 1};        // NOTE: `Kd`.
+    V3 specular{};              // NOTE: `Ks`.
+    F32 shininess = 0;          // NOTE: `Ns`.
+    F32 opacity = 1;            // NOTE: `d`, or `1 - Tr`.
+    std::string diffuse_map{};  // NOTE: `map_Kd`, relative to the `.mtl` (`load_mesh` joins it with directory of the `.mtl`).
+
+    S32 diffuse_texture = -1;   // NOTE: Index into `Mesh::textures` of loaded `diffuse_map`, if any.
+};
+
+//
+// Range of `indexes` drawn with the same material.
+//
+struct Mesh_Group {
+    U32 material = 0;  // NOTE: Index into `materials`.
+    U32 indexes_begin = 0;
+    U32 indexes_count = 0;
+};
+
+//
+// Triangles of the mesh which are culled together, see `build_mesh_clusters`.
+//
+struct Mesh_Cluster {
+    U32 indexes_begin = 0;
+    U32 indexes_count = 0;
+
+    // NOTE: In model space, updated by `mesh_update_positions`. Normals of
+    // all triangles are inside of the cone around `cone_axis`,
+    // `cone_cutoff` is sine of it's half angle (with some margin), or more
+    // than 1 if cone is too wide to ever cull anything.
+    V3 cone_axis{};
+    F32 cone_cutoff = 2;
+};
+
+struct Mesh {
+    std::vector<V3> vertexes{};
+
+    // NOTE: One per vertex, or empty if mesh doesn't have them.
+    std::vector<V2> uvs{};
+    std::vector<V3> normals{};
+
+    std::vector<S32> indexes{};
+
+    // NOTE: Groups are covering all `indexes` in order. Procedural meshes
+    // don't have any, and are drawn with default `Material`.
+    std::vector<Material> materials{};
+    std::vector<Mesh_Group> groups{};
+
+    std::vector<Texture> textures{};
+
+    // NOTE: Copy of `vertexes` for vertex processing. Has to be updated with
+    // `mesh_update_positions` after `vertexes` are changed.
+    Vertex_Stream positions{};
+
+    // NOTE: One per index. All three corners of the triangle have same
+    // color.
+    std::vector<Color4> colors{};
+
+    // NOTE: One per vertex, for shaders.
+    std::vector<Color4> vertex_colors{};
+
+    // NOTE: Sphere around `vertexes` in model space, updated by
+    // `mesh_update_positions`.
+    V3 bounds_center{};
+    F32 bounds_radius = 0;
+
+    // NOTE: Empty until `build_mesh_clusters`, and then covering all
+    // `indexes` in order. Boxes around them (in model space) and tree over
+    // those are built, or refitted, by `mesh_update_positions`.
+    std::vector<Mesh_Cluster> clusters{};
+    std::vector<Bvh_Bounds> clusters_bounds{};
+    Bvh clusters_bvh{};
+};
+
+//
+// Updates everything what is derived from `vertexes`. Bounds and cones of the
+// clusters are computed on the `pool` if it's given.
+//
+void mesh_update_positions(Mesh *mesh, Thread_Pool *pool);
+
+//
+// Clusters.
+//
+// Triangles of every group are split into clusters of up to
+// `MESH_CLUSTER_TRIANGLES` which are close to each other: those are leaves of
+// the tree which is built over the triangles. Triangles are reordered so
+// every cluster is a range of `indexes`, but inside of the cluster they keep
+// their order. Vertexes are not copied, clusters are sharing them, but they
+// are reordered in order of the first use, so vertexes of neighbouring
+// clusters are mostly in the same batches.
+//
+// Draws are walking `clusters_bvh` and skip clusters which are off screen, or
+// which are facing away from the camera as a whole. Vertexes of those are not
+// transformed (or shaded) and their triangles are not set up at all. Call
+// `mesh_update_positions` after building them.
+//
+#define MESH_CLUSTER_TRIANGLES 64
+#define MESH_CLUSTER_CONE_MARGIN 0.01f  // NOTE: Added to the sine of the cone, so rounding never culls triangle which is barely facing the camera.
+
+void build_mesh_clusters(Mesh *mesh, Thread_Pool *pool);
+
+//
+// Contents of `.obj` as they are in the file, before vertexes are deduplicated.
+//
+struct Obj_File {
+    std::vector<V3> positions{};
+    std::vector<V2> uvs{};
+    std::vector<V3> normals{};
+
+    // NOTE: Triplets of position, uv and normal index of every
+    // triangle corner, zero based. Missing uv or normal is -1.
+    std::vector<S32> corners{};
+
+    struct Material_Use {
+        std::string name{};
+        USZ triangles_begin = 0;
+    };
+
+    std::vector<Material_Use> material_uses{};
+    std::vector<std::string> material_libraries{};
+};
+
+//
+// Parses `.obj`. Polygons are split into triangle fans. File is memory mapped
+// and parsed in chunks on the `pool`, if it's given.
+//
+Obj_File load_obj(std::string_view file_name, Thread_Pool *pool);
+
+//
+// Parses `.mtl` and appends it's materials.
+//
+bool load_mtl(std::string_view file_name, std::vector<Material> *materials);
+
+//
+// Makes one vertex out of every distinct position, uv and normal combination,
+// splits triangles into groups by material, and reorders them for
+// post-transform vertex cache (see `optimize_vertex_cache`). Only names of the
+// materials are filled in.
+//
+Mesh build_mesh(const Obj_File *obj);
+
+//
+// Reorders triangles so shared vertexes are reused while they are still in
+// `VERTEX_CACHE_SIZE` entry LRU cache (Tom Forsyth's "Linear-Speed Vertex
+// Cache Optimisation").
+//
+#define VERTEX_CACHE_SIZE 32
+
+void optimize_vertex_cache(S32 *indexes, USZ indexes_count);
+
+//
+// Average number of vertex transforms per triangle with FIFO post-transform
+// cache of `cache_size` entries (ACMR). 0.5 is the best possible, 3 is the worst.
+//
+F32 measure_vertex_cache_misses(const S32 *indexes, USZ indexes_count, U32 cache_size);
+
+//
+// Transforms every vertex of the mesh into `r->screen_vertexes`. Split between
+// workers of the `pool` if it's given. Returns false if they don't fit into
+// frame arena.
+//
+bool transform_vertexes(Basic_Renderer *r, Thread_Pool *pool, const Vertex_Stream *positions, Transform transform);
+
+//
+// Loads `.obj` with it's `.mtl` libraries and their diffuse textures, builds
+// the mesh out of it, splits it into clusters and paints every triangle and vertex
+// with random color. Triangles with UVs and textured material are drawn with
+// texture instead.
+//
+// NOTE: Built arrays (clusters included) are saved into binary cache next to
+// the file (`MESH_CACHE_EXTENSION`), next load just copies them out of it, as
+// long as size and modification time of the `.obj` are the same. `.mtl` files
+// are small, so those are parsed every time.
+//
+#define MESH_CACHE_EXTENSION ".srcache"
+
+Mesh load_mesh(std::string_view file_name, Thread_Pool *pool);
+
+//
+// UV sphere centered at origin, `rings` from pole to pole and `segments`
+// around. Painted same way as `load_mesh`. UVs are going once around the
+// sphere and from south pole to north one, mesh doesn't have texture. Has
+// normals. Procedural meshes are split into clusters too, without pool.
+//
+Mesh make_sphere_mesh(S32 rings, S32 segments, F32 radius);
+
+//
+// `count` independent triangles with random orientation, scattered inside of
+// cube with half size of `extent`. Edges are no longer than `triangle_size`.
+//
+Mesh make_triangle_soup(U32 count, F32 extent, F32 triangle_size, U32 seed);
+
+//
+// Transforms, sets up and rasterizes every triangle of the mesh. Binned on the
+// `pool` if it's given, serially otherwise. Culling, winding and texture
+// filter are taken from the `material`, it's shader is not used.
+//
+void render_mesh(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Draw_Material *material);
+
+
+//
+// Shaders.
+//
+// Shader is a plain struct which `render_mesh_shaded` is compiled for, as a
+// template parameter, so both of it's stages are inlined right into the vertex
+// and pixel loops: no virtual or indirect calls are made per vertex or pixel.
+// Shader has to have:
+//
+//     // NOTE: Up to `RASTER_MAX_VARYINGS`.
+//     static constexpr U32 VARYINGS_COUNT;
+//
+//     // NOTE: Vertex stage, once per vertex of the mesh per frame.
+//     void vertex(const Shader_Vertex *in, F32 *varyings) const;
+//
+//     // NOTE: Pixel stage, gets `varyings` interpolated over the
+//     // triangle.
+//     Color4 fragment(const F32 *varyings) const;
+//
+// NOTE: Rasterizer lives in `softrast.cpp`, so `render_mesh_shaded` is
+// explicitly instantiated there for every shader below. New shader has to be
+// added to that list too.
+//
+
+struct Shader_Vertex {
+    V3 position{};  // NOTE: Model space.
+    V3 normal{};    // NOTE: World space, zero if mesh doesn't have normals.
+    V2 uv{};
+    Color4 color{};  // NOTE: From `Mesh::vertex_colors`, white if mesh doesn't have them.
+};
+
+//
+// NOTE: Written with comparisons, so NaN goes to zero instead of being
+// undefined behavior in the conversion.
+//
+inline U8
+shader_unit_to_u8(F32 value) noexcept
+{
+    value = value > 0 ? value : 0;
+    value = value < 1 ? value : 1;
+    return static_cast<U8>(value * MAX_U8 + 0.5f);
+}
+
+inline F32
+shader_dot(V3 a, V3 b) noexcept
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+//
+// Interpolates vertex colors over the triangle.
+//
+struct Vertex_Color_Shader {
+    static constexpr U32 VARYINGS_COUNT = 3;
+
+    inline void
+    vertex(const Shader_Vertex *in, F32 *varyings) const noexcept
+    {
+        varyings[0] = static_cast<F32>(in->color.R) / MAX_U8;
+        varyings[1] = static_cast<F32>(in->color.G) / MAX_U8;
+        varyings[2] = static_cast<F32>(in->color.B) / MAX_U8;
+    }
+
+    inline Color4
+    fragment(const F32 *varyings) const noexcept
+    {
+        return Color4(shader_unit_to_u8(varyings[0]), shader_unit_to_u8(varyings[1]), shader_unit_to_u8(varyings[2]), MAX_U8);
+    }
+};
+
+//
+// Diffuse lighting from single directional light, evaluated per vertex and
+// interpolated.
+//
+struct Gouraud_Shader {
+    static constexpr U32 VARYINGS_COUNT = 3;
+
+    V3 light_direction{-0.408248f, -0.408248f, 0.816497f};  // NOTE: Towards the light, normalized. World Y goes down the screen, camera is at +Z.
+    V3 ambient{0.1f, 0.1f, 0.1f};
+    V3 diffuse{1, 1, 1};
+
+    inline void
+    vertex(const Shader_Vertex *in, F32 *varyings) const noexcept
+    {
+        F32 intensity = std::max(shader_dot(in->normal, this->light_direction), 0.0f);
+
+        varyings[0] = this->ambient.x + this->diffuse.x * intensity;
+        varyings[1] = this->ambient.y + this->diffuse.y * intensity;
+        varyings[2] = this->ambient.z + this->diffuse.z * intensity;
+    }
+
+    inline Color4
+    fragment(const F32 *varyings) const noexcept
+    {
+        return Color4(shader_unit_to_u8(varyings[0]), shader_unit_to_u8(varyings[1]), shader_unit_to_u8(varyings[2]), MAX_U8);
+    }
+};
+
+//
+// Same lighting as `Gouraud_Shader`, but normal is interpolated and lighting
+// is evaluated per pixel.
+//
+struct Lambert_Shader {
+    static constexpr U32 VARYINGS_COUNT = 3;
+
+    V3 light_direction{-0.408248f, -0.408248f, 0.816497f};
+    V3 ambient{0.1f, 0.1f, 0.1f};
+    V3 diffuse{1, 1, 1};
+
+    inline void
+    vertex(const Shader_Vertex *in, F32 *varyings) const noexcept
+    {
+        varyings[0] = in->normal.x;
+        varyings[1] = in->normal.y;
+        varyings[2] = in->normal.z;
+    }
+
+    inline Color4
+    fragment(const F32 *varyings) const noexcept
+    {
+        V3 normal{varyings[0], varyings[1], varyings[2]};
+
+        // NOTE: Interpolated normal is shorter than unit one, so it's
+        // normalized. Zero normal gets only ambient.
+        F32 length_squared = shader_dot(normal, normal);
+        F32 n_dot_l = shader_dot(normal, this->light_direction);
+        F32 intensity = length_squared > 0 && n_dot_l > 0 ? n_dot_l / std::sqrt(length_squared) : 0;
+
+        return Color4(
+            shader_unit_to_u8(this->ambient.x + this->diffuse.x * intensity),
+            shader_unit_to_u8(this->ambient.y + this->diffuse.y * intensity),
+            shader_unit_to_u8(this->ambient.z + this->diffuse.z * intensity),
+            MAX_U8);
+    }
+};
+
+//
+// Same as `render_mesh`, but pixels are colored by the `shader` instead of
+// flat triangle colors and textures.
+//
+template<typename Shader>
+void render_mesh_shaded(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Shader *shader, const Draw_Material *material);
+
+extern template void render_mesh_shaded<Vertex_Color_Shader>(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Vertex_Color_Shader *shader, const Draw_Material *material);
+extern template void render_mesh_shaded<Gouraud_Shader>(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Gouraud_Shader *shader, const Draw_Material *material);
+extern template void render_mesh_shaded<Lambert_Shader>(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Lambert_Shader *shader, const Draw_Material *material);
+
+
+//
+// Draw lists.
+//
+// Draws are recorded into `Draw_List` and executed later by
+// `execute_draw_list`, which groups them by state and sorts them front to back
+// inside of the group, so Hi-Z rejects as much of the farther draws as it can.
+//
+// Instanced draw is one mesh with many transforms and colors. Instances whose
+// bounding sphere is entirely off screen (or in front of the near plane) are
+// culled before anything else is done with them, the rest is sorted front to
+// back too. Vertexes of all of them are transformed as one batch, which is
+// split between workers by vertex count, so many copies of small mesh are not
+// going through the pool one by one, and their triangles are binned together.
+// Draws of `INSTANCES_BVH_MIN_COUNT` or more instances are culled by walking
+// the tree over them. Renderer keeps the tree of every draw from the previous
+// frame and only refits instances which moved, it's built again when mesh or
+// number of instances changed, or when refits made it too loose.
+//
+// After that whole clusters of every instance which are off screen or facing
+// away are culled, see "Clusters".
+//
+// Recording doesn't touch the renderer and execution only reads the list, so
+// one thread could record the next frame while another one executes this one,
+// as long as every thread has it's own list.
+//
+
+enum Draw_Shader : U8 {
+    DRAW_SHADER_NONE,  // NOTE: Flat colors and textures of `render_mesh`.
+    DRAW_SHADER_VERTEX_COLOR,
+    DRAW_SHADER_GOURAUD,
+    DRAW_SHADER_LAMBERT,
+
+    DRAW_SHADER_COUNT,
+};
+
+extern const char *DRAW_SHADER_NAMES[DRAW_SHADER_COUNT];
+
+//
+// Everything draw is rendered with besides mesh and transform. Fields up to
+// `texture_filter` are the state draws are grouped by, lighting is passed to
+// the shader as is.
+//
+struct Draw_Material {
+    Draw_Shader shader = DRAW_SHADER_NONE;
+    Cull_Mode cull_mode = CULL_MODE_BACK;
+    Front_Face front_face = FRONT_FACE_CW;
+    Texture_Filter texture_filter = TEXTURE_FILTER_TRILINEAR;
+
+    // NOTE: For `DRAW_SHADER_GOURAUD` and `DRAW_SHADER_LAMBERT`.
+    V3 light_direction{-0.408248f, -0.408248f, 0.816497f};
+    V3 ambient{0.1f, 0.1f, 0.1f};
+    V3 diffuse{1, 1, 1};
+};
+
+//
+// One copy of the mesh drawn by `Draw_List::submit_instances`.
+//
+struct Draw_Instance {
+    Transform transform{};
+    Color4 color = COLOR_WHITE;  // NOTE: Modulates flat colors of the mesh and `Shader_Vertex::color`.
+};
+
+#define INSTANCES_BVH_MIN_COUNT 64
+
+struct Instances_Bvh {
+    // NOTE: What the tree was fitted to, bounds of the mesh are kept too,
+    // because mesh could change under the same pointer.
+    const Mesh *mesh = nullptr;
+    V3 mesh_center{};
+    F32 mesh_radius = 0;
+    std::vector<Transform> transforms{};
+
+    std::vector<Bvh_Bounds> bounds{};  // NOTE: Boxes around bounding spheres of the instances.
+    std::vector<U32> moved{};
+    Bvh bvh{};
+};
+
+struct Draw_Command {
+    const Mesh *mesh = nullptr;
+    Transform transform{};
+    Draw_Material material{};
+
+    // NOTE: Range of `Draw_List::instances`, empty for draws of
+    // `submit`, which are drawn once with `transform`.
+    U32 instances_begin = 0;
+    U32 instances_count = 0;
+
+    // NOTE: State in the high half, depth of the nearest point of mesh
+    // bounds in the low one.
+    U64 sort_key = 0;
+};
+
+struct Draw_List {
+    std::vector<Draw_Command> commands{};
+    std::vector<Draw_Instance> instances{};
+
+    // NOTE: When false, draws are executed in order of submission.
+    bool sorted = true;
+
+    void clear(void);
+
+    //
+    // Mesh has to stay alive and unchanged until the list is executed.
+    //
+    void submit(const Mesh *mesh, Transform transform, const Draw_Material *material);
+
+    //
+    // Draws the mesh once for every instance, as single draw. Instances are
+    // copied into the list.
+    //
+    void submit_instances(const Mesh *mesh, std::span<const Draw_Instance> instances, const Draw_Material *material);
+};
+
+//
+// Both halves of `execute_draw_list`, for running them on different threads.
+// `draw_list_geometry` transforms, sets up and bins triangles of every draw
+// into `r->triangles` and `r->tile_bins`, and `draw_list_raster` draws them.
+// List has to stay unchanged until it's rasterized.
+//
+// With `r->incremental` set, every draw is compared with the draw at the same
+// position of the previous list. Tiles under old and new screen bounds of the
+// draws which changed (or appeared or disappeared) are redrawn, and the rest
+// keep pixels of the previous frame. `r->present_rects` tells which parts of
+// the framebuffer are new. Meshes are compared by pointer, so `clear`
+// renderer (which redraws everything) after changing one. Frames shouldn't be
+// cleared otherwise. `render_mesh` and `resize` are forgetting previous list.
+//
+void draw_list_geometry(Basic_Renderer *r, Thread_Pool *pool, const Draw_List *list);
+void draw_list_raster(Basic_Renderer *r, Thread_Pool *pool);
+
+void execute_draw_list(Basic_Renderer *r, Thread_Pool *pool, const Draw_List *list);
+
+
+//
+// Frame pipeline.
+//
+// Every frame goes through four stages: caller records it's draw list,
+// geometry thread clears the framebuffer and runs `draw_list_geometry`, raster
+// thread runs `draw_list_raster`, and caller presents it. Each of up to `depth`
+// frames in flight has it's own `Basic_Renderer`. With depth of 2 geometry of
+// frame N + 1 runs while frame N is rasterized, with 3 caller is recording
+// frame N + 2 at the same time too. Throughput is bounded by the slowest stage
+// instead of the sum of them, and frame is presented `depth - 1` frames later
+// than it would be without the pipeline. Depth of 1 runs stages one after
+// another.
+//
+// Geometry and raster stages have a thread pool each, since pool runs one
+// `parallel_for` at a time.
+//
+// Frames are handed out, submitted and presented in order:
+//
+//     Pipeline_Frame *frame = pipeline.begin_frame();
+//     frame->draw_list.submit(...);
+//     pipeline.submit_frame(frame);
+//
+//     if (Pipeline_Frame *presented = pipeline.present_frame(false)) {
+//         ... present presented->renderer ...
+//         pipeline.release_frame(presented);
+//     }
+//
+
+enum Pipeline_Frame_State : U8 {
+    PIPELINE_FRAME_FREE,
+    PIPELINE_FRAME_RECORDING,
+    PIPELINE_FRAME_GEOMETRY,
+    PIPELINE_FRAME_RASTER,
+    PIPELINE_FRAME_DONE,
+    PIPELINE_FRAME_PRESENTING,
+};
+
+struct Pipeline_Frame {
+    Basic_Renderer renderer{};
+    Draw_List draw_list{};
+
+    U64 index = 0;
+    Pipeline_Frame_State state = PIPELINE_FRAME_FREE;
+
+    // NOTE: Seconds since `Frame_Pipeline::init`, see `Frame_Pipeline::now`.
+    F64 begin_time = 0;
+    F64 done_time = 0;  // NOTE: When it was rasterized.
+};
+
+struct Frame_Pipeline {
+    U32 depth = 0;
+    S32 width = 0;
+    S32 height = 0;
+
+    std::unique_ptr<Pipeline_Frame[]> frames{};
+
+    Thread_Pool geometry_pool{};
+    Thread_Pool raster_pool{};
+
+    std::thread geometry_thread{};
+    std::thread raster_thread{};
+
+    std::mutex mutex{};
+    std::condition_variable cv{};
+
+    // NOTE: Index of the next frame every stage is going to take. Frame
+    // `index` lives in `frames[index % depth]`.
+    U64 next_begin = 0;
+    U64 next_geometry = 0;
+    U64 next_raster = 0;
+    U64 next_present = 0;
+
+    bool should_stop = false;
+
+    S64 ticks_begin = 0;
+
+    //
+    // Renderers of the frames take their settings (ISA, raster mode, ...)
+    // from `settings`.
+    //
+    void init(const Basic_Renderer *settings, U32 depth, U32 geometry_workers, U32 raster_workers);
+
+    //
+    // Stops the stage threads. Frames which are still in flight are dropped,
+    // present them with `present_frame(true)` before, if they are needed.
+    //
+    void deinit(void);
+
+    //
+    // Frames which are begun after this are rendered at the new size.
+    //
+    void resize(S32 w, S32 h);
+
+    //
+    // Hands out next frame for recording. One of the frames has to be
+    // released, if all of them are in flight.
+    //
+    Pipeline_Frame *begin_frame(void);
+    void submit_frame(Pipeline_Frame *frame);
+
+    //
+    // Waits for the oldest submitted frame to be rasterized. Unless `drain`
+    // is set, returns null until `depth` frames are in flight, so pipeline is
+    // filled first. Also returns null if there are no frames in flight.
+    //
+    Pipeline_Frame *present_frame(bool drain);
+    void release_frame(Pipeline_Frame *frame);
+
+    F64 now(void) const;
+};
+
+
+//
+// Images.
+//
+// Renderer doesn't need a window, so any `Basic_Renderer` is an offscreen
+// target: render into it and `write_image` reads it back with `read_pixels`,
+// strip of `IMAGE_STRIP_ROWS` rows at a time, and streams it into the file.
+// Nothing as big as the whole image is kept besides the framebuffer itself.
+// Rows of the framebuffer are going bottom to top (see `win32_blit_rects`),
+// so strips are read from the last one, and images look same as the window.
+//
+// Alpha of the framebuffer isn't coverage (cleared pixels have it too), so
+// only color is written:
+//
+//   * PPM is binary "P6".
+//   * PNG is 8 bit RGB. Every row is filtered with "Up" and compressed with
+//     single pass deflate: LZ77 with one candidate per 4 byte hash and fixed
+//     Huffman codes, so there are no tables to build or to write. Encoded rows
+//     are written out as IDAT chunk every `DEFLATE_STRIP_SIZE` bytes of input.
+//   * EXR is uncompressed scanline image with half float B, G and R. Colors
+//     are converted from sRGB into linear, which is what EXR is expected to
+//     hold.
+//
+
+enum Image_Format : U8 {
+    IMAGE_FORMAT_PPM,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_EXR,
+
+    IMAGE_FORMAT_COUNT,
+};
+
+extern const char *IMAGE_FORMAT_NAMES[IMAGE_FORMAT_COUNT];
+
+//
+// Picks format by extension of the `file_name` (".ppm", ".png" or ".exr").
+// Returns `IMAGE_FORMAT_COUNT` if it's none of those.
+//
+Image_Format image_format_from_file_name(std::string_view file_name);
+
+#define IMAGE_STRIP_ROWS 64  // NOTE: Same as `TILE_SIZE`, so tiled framebuffer is read by whole tiles.
+
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_HASH_BITS   15
+#define DEFLATE_STRIP_SIZE  (256 * 1024)  // NOTE: Of filtered bytes.
+
+//
+// State of the zlib stream of PNG. Input keeps up to `DEFLATE_WINDOW_SIZE`
+// already compressed bytes in front of the new ones, so matches could go back
+// into the previous strip.
+//
+struct Deflate_Stream {
+    std::vector<U8> input{};
+    USZ input_compressed = 0;  // NOTE: Bytes of `input` which are already in the stream.
+    U64 input_base = 0;        // NOTE: Position of `input[0]` from the beginning of the stream.
+
+    // NOTE: Position plus one of the last 4 bytes with the hash, zero is
+    // empty.
+    std::vector<U64> hash_table{};
+
+    U64 bits = 0;
+    U32 bits_count = 0;
+
+    U32 adler_a = 1;
+    U32 adler_b = 0;
+};
+
+//
+// Streaming encoder, rows are given from top to bottom:
+//
+//     writer.begin("image.png", IMAGE_FORMAT_PNG, width, height);
+//     for (every row) {
+//         writer.write_row(row);
+//     }
+//     bool written = writer.end();
+//
+// Writer could be used again for the next image, buffers keep their capacity.
+// Failures are sticky: `end` returns false if anything has failed since
+// `begin`, and removes the half written file.
+//
+struct Image_Writer {
+    FILE *file = nullptr;
+    std::string file_name{};
+    Image_Format format = IMAGE_FORMAT_PPM;
+    U32 width = 0;
+    U32 height = 0;
+    U32 rows_written = 0;
+    bool failed = false;
+
+    std::vector<U8> output{};  // NOTE: Encoded bytes which are not in the file yet.
+
+    std::vector<U8> previous_row{};  // NOTE: RGB, for "Up" filter of PNG.
+    Deflate_Stream deflate{};
+
+    std::vector<U16> half_row{};  // NOTE: B, G and R planes of EXR scanline.
+
+    // NOTE: Strip of framebuffer rows, for `write_image`.
+    std::vector<Color4> strip{};
+
+    bool begin(const char *file_name, Image_Format format, U32 width, U32 height);
+    void write_row(const Color4 *pixels);
+    bool end(void);
+};
+
+//
+// Writes whole framebuffer of `r`, in either layout, with `writer`.
+//
+bool write_image(const Basic_Renderer *r, Image_Writer *writer, const char *file_name, Image_Format format);
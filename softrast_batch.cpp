@@ -0,0 +1,439 @@
+#include "softrast.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+//
+// Batch front end: renders meshes from a number of camera poses into image
+// files, without any window, so it could make thumbnails on headless servers.
+//
+// Every image is rendered and written by one worker from start to end, on it's
+// own `Basic_Renderer`, without the pool. Workers are taking images off the
+// list with `parallel_for`, so all cores are busy with whole images and
+// nothing is synchronized inside of the frame. That's what throughput in
+// images per second wants, one image still takes as long as it would on
+// single core.
+//
+// Jobs are either read from `--jobs FILE`, one per line:
+//
+//     mesh.obj output.png [roll pitch yaw [x y z]]
+//
+// (lines starting with `#` are skipped, format is picked by extension of the
+// output), or made out of every mesh which is given on the command line: it's
+// rendered from `--views N` sides, going around it, into `--out DIR` as
+// `<mesh>_<view>.<format>`. Mesh is either `.obj` file or "sphere" or "soup",
+// same as in the bench.
+//
+// Meshes are loaded once, on all cores, and shared by the workers. With
+// `--fit` every mesh is moved to the origin and scaled to fill the image.
+//
+// Usage: softrast_batch [--jobs FILE] [--views N] [--out DIR] [--format ppm|png|exr]
+//                       [--size W H] [--threads N] [--fit] [--fixed]
+//                       [--isa scalar|sse4.1|avx2] [--msaa 1|4|8] [--layout linear|tiled]
+//                       [--shader none|vertex_color|gouraud|lambert] [--cull none|back|front]
+//                       [mesh.obj]...
+//
+
+struct Batch_Job {
+    U32 mesh_index = 0;
+    std::string output{};
+    Image_Format format = IMAGE_FORMAT_PNG;
+    Transform transform{};
+};
+
+struct Batch_Worker {
+    Basic_Renderer renderer{};
+    Draw_List draw_list{};
+    Image_Writer writer{};
+
+    U32 images_count = 0;
+    F64 render_time = 0;
+    F64 write_time = 0;
+};
+
+struct Batch_Data {
+    const std::vector<Mesh> *meshes = nullptr;
+    const std::vector<Batch_Job> *jobs = nullptr;
+    const Basic_Renderer *settings = nullptr;
+    const Draw_Material *material = nullptr;
+    S32 width = 0;
+    S32 height = 0;
+
+    Batch_Worker *workers = nullptr;
+    std::atomic<U32> failed_count{0};
+};
+
+static void
+batch_render_job(void *data, U32 job_index, U32 worker_index)
+{
+    Batch_Data *d = static_cast<Batch_Data *>(data);
+    Batch_Worker *worker = &d->workers[worker_index];
+    Basic_Renderer *r = &worker->renderer;
+    const Batch_Job *job = &(*d->jobs)[job_index];
+
+    // NOTE: Framebuffer is made by the worker which is drawing into it, so
+    // it's pages are first touched on the core which is using them.
+    if (r->pixels_width == 0) {
+        r->isa = d->settings->isa;
+        r->raster_mode = d->settings->raster_mode;
+        r->samples_count = d->settings->samples_count;
+        r->pixels_layout = d->settings->pixels_layout;
+        r->resize(d->width, d->height);
+    }
+
+    Clock clock{};
+
+    r->clear();
+    r->stats.draws_failed = 0;
+
+    worker->draw_list.clear();
+    worker->draw_list.submit(&(*d->meshes)[job->mesh_index], job->transform, d->material);
+    execute_draw_list(r, nullptr, &worker->draw_list);
+
+    worker->render_time += clock.tick();
+
+    if (r->stats.draws_failed > 0) {
+        fprintf(stderr, "Failed to render image, out of memory: %s\n", job->output.c_str());
+        d->failed_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!write_image(r, &worker->writer, job->output.c_str(), job->format)) {
+        fprintf(stderr, "Failed to write image: %s\n", job->output.c_str());
+        d->failed_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    worker->write_time += clock.tick();
+    ++worker->images_count;
+}
+
+static U32
+batch_add_mesh(std::vector<std::string> *mesh_names, const std::string &name)
+{
+    for (U32 i = 0; i < mesh_names->size(); ++i) {
+        if ((*mesh_names)[i] == name) {
+            return i;
+        }
+    }
+
+    mesh_names->push_back(name);
+    return static_cast<U32>(mesh_names->size() - 1);
+}
+
+static bool
+batch_read_jobs(const char *file_name, std::vector<std::string> *mesh_names, std::vector<Batch_Job> *jobs)
+{
+    std::ifstream file(file_name);
+    if (!file) {
+        fprintf(stderr, "Failed to open jobs file: %s\n", file_name);
+        return false;
+    }
+
+    std::string line{};
+    S32 line_number = 0;
+
+    while (std::getline(file, line)) {
+        ++line_number;
+
+        std::istringstream fields(line);
+        std::string mesh_name{};
+        Batch_Job job{};
+
+        if (!(fields >> mesh_name) || mesh_name[0] == '#') {
+            continue;
+        }
+
+        Transform *t = &job.transform;
+
+        // NOTE: Pose is optional, and position of it too.
+        bool valid = static_cast<bool>(fields >> job.output);
+        if (valid && fields >> t->roll) {
+            valid = static_cast<bool>(fields >> t->pitch >> t->yaw);
+
+            if (valid && fields >> t->position.x) {
+                valid = static_cast<bool>(fields >> t->position.y >> t->position.z);
+            }
+        }
+
+        job.format = image_format_from_file_name(job.output);
+
+        if (!valid || job.format == IMAGE_FORMAT_COUNT) {
+            fprintf(stderr, "%s:%d: Expected \"mesh output.(ppm|png|exr) [roll pitch yaw [x y z]]\"\n", file_name, line_number);
+            return false;
+        }
+
+        job.mesh_index = batch_add_mesh(mesh_names, mesh_name);
+        jobs->push_back(std::move(job));
+    }
+
+    return true;
+}
+
+//
+// Moves mesh to the origin and scales it, so it's bounding sphere fills 90%
+// of the smaller side of the image.
+//
+static void
+batch_fit_mesh(Mesh *mesh, Thread_Pool *pool, S32 width, S32 height)
+{
+    if (mesh->bounds_radius <= 0) {
+        return;
+    }
+
+    F32 half_extent = WORLD_UNITS_IN_SCREEN_HEIGHT / 2 * std::min(1.0f, static_cast<F32>(width) / static_cast<F32>(height));
+    F32 scale = 0.9f * half_extent / mesh->bounds_radius;
+    V3 center = mesh->bounds_center;
+
+    for (V3 &vertex : mesh->vertexes) {
+        vertex = {(vertex.x - center.x) * scale, (vertex.y - center.y) * scale, (vertex.z - center.z) * scale};
+    }
+
+    mesh_update_positions(mesh, pool);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *jobs_path = nullptr;
+    const char *out_path = ".";
+    Image_Format format = IMAGE_FORMAT_PNG;
+    S32 views_count = 1;
+    S32 width = 256, height = 256;
+    U32 threads_count = std::max(1U, std::thread::hardware_concurrency());
+    bool fit = false;
+
+    Basic_Renderer settings{};
+    Draw_Material material{};
+    settings.isa = detect_raster_isa();
+
+    std::vector<std::string> mesh_names{};
+
+    for (S32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs_path = argv[++i];
+        } else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+            views_count = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 kind = 0; kind < IMAGE_FORMAT_COUNT; ++kind) {
+                if (strcmp(name, IMAGE_FORMAT_NAMES[kind]) == 0) {
+                    format = static_cast<Image_Format>(kind);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown image format: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads_count = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--fit") == 0) {
+            fit = true;
+        } else if (strcmp(argv[i], "--fixed") == 0) {
+            settings.raster_mode = RASTER_MODE_FIXED;
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 isa = 0; isa < RASTER_ISA_COUNT; ++isa) {
+                if (strcmp(name, RASTER_ISA_NAMES[isa]) == 0) {
+                    settings.isa = static_cast<Raster_ISA>(isa);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown raster ISA: %s\n", name);
+                return 1;
+            }
+
+            if (settings.isa > detect_raster_isa()) {
+                fprintf(stderr, "Raster ISA is not supported by this CPU: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+            S32 samples = atoi(argv[++i]);
+
+            if (samples != 1 && samples != 4 && samples != 8) {
+                fprintf(stderr, "Unsupported MSAA samples count: %d\n", samples);
+                return 1;
+            }
+
+            settings.samples_count = static_cast<U32>(samples);
+        } else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 layout = 0; layout < PIXELS_LAYOUT_COUNT; ++layout) {
+                if (strcmp(name, PIXELS_LAYOUT_NAMES[layout]) == 0) {
+                    settings.pixels_layout = static_cast<Pixels_Layout>(layout);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown pixels layout: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--shader") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 kind = 0; kind < DRAW_SHADER_COUNT; ++kind) {
+                if (strcmp(name, DRAW_SHADER_NAMES[kind]) == 0) {
+                    material.shader = static_cast<Draw_Shader>(kind);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown shader: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+
+            if (strcmp(name, "none") == 0) {
+                material.cull_mode = CULL_MODE_NONE;
+            } else if (strcmp(name, "back") == 0) {
+                material.cull_mode = CULL_MODE_BACK;
+            } else if (strcmp(name, "front") == 0) {
+                material.cull_mode = CULL_MODE_FRONT;
+            } else {
+                fprintf(stderr, "Unknown cull mode: %s\n", name);
+                return 1;
+            }
+        } else if (argv[i][0] != '-') {
+            batch_add_mesh(&mesh_names, argv[i]);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid size: %dx%d\n", width, height);
+        return 1;
+    }
+
+    std::vector<Batch_Job> jobs{};
+
+    if (jobs_path != nullptr) {
+        if (!batch_read_jobs(jobs_path, &mesh_names, &jobs)) {
+            return 1;
+        }
+    } else {
+        std::error_code error{};
+        std::filesystem::create_directories(out_path, error);
+
+        for (U32 mesh_index = 0; mesh_index < mesh_names.size(); ++mesh_index) {
+            std::string stem = std::filesystem::path(mesh_names[mesh_index]).stem().string();
+
+            for (S32 view = 0; view < views_count; ++view) {
+                Batch_Job job{};
+                job.mesh_index = mesh_index;
+                job.format = format;
+                job.output = (std::filesystem::path(out_path) / (stem + "_" + std::to_string(view) + "." + IMAGE_FORMAT_NAMES[format])).string();
+
+                // NOTE: Tilted towards the camera, and turning around
+                // vertical axis.
+                F32 angle = 2 * std::numbers::pi_v<F32> * static_cast<F32>(view) / static_cast<F32>(views_count);
+                job.transform = Transform{0.5f, angle, 0};
+
+                jobs.push_back(std::move(job));
+            }
+        }
+    }
+
+    if (jobs.empty()) {
+        fprintf(stderr, "Nothing to render, give meshes or --jobs FILE\n");
+        return 1;
+    }
+
+    Thread_Pool pool{};
+    pool.init(threads_count);
+
+    Clock load_clock{};
+
+    std::vector<Mesh> meshes(mesh_names.size());
+
+    for (USZ i = 0; i < meshes.size(); ++i) {
+        const std::string &name = mesh_names[i];
+
+        if (name == "sphere") {
+            meshes[i] = make_sphere_mesh(64, 128, 2.0f);
+        } else if (name == "soup") {
+            meshes[i] = make_triangle_soup(100000, 2.0f, 0.15f, 69);
+        } else {
+            meshes[i] = load_mesh(name, &pool);
+        }
+
+        if (meshes[i].indexes.empty()) {
+            fprintf(stderr, "Failed to load mesh: %s\n", name.c_str());
+            pool.deinit();
+            return 1;
+        }
+
+        if (fit) {
+            batch_fit_mesh(&meshes[i], &pool, width, height);
+        }
+    }
+
+    printf("Loaded %zu meshes in %.3f ms\n", meshes.size(), load_clock.tick() * 1000.0);
+
+    std::unique_ptr<Batch_Worker[]> workers = std::make_unique<Batch_Worker[]>(pool.workers_count);
+
+    Batch_Data data{};
+    data.meshes = &meshes;
+    data.jobs = &jobs;
+    data.settings = &settings;
+    data.material = &material;
+    data.width = width;
+    data.height = height;
+    data.workers = workers.get();
+
+    Clock clock{};
+
+    pool.parallel_for(static_cast<U32>(jobs.size()), batch_render_job, &data);
+
+    F64 elapsed = clock.tick();
+
+    F64 render_time = 0;
+    F64 write_time = 0;
+
+    for (U32 i = 0; i < pool.workers_count; ++i) {
+        render_time += workers[i].render_time;
+        write_time += workers[i].write_time;
+        workers[i].renderer.release();
+    }
+
+    U32 failed_count = data.failed_count.load(std::memory_order_relaxed);
+
+    printf("Rendered %zu images of %dx%d (%s, %s, %u threads) in %.3f ms, %.1f images per second\n",
+           jobs.size(), width, height,
+           RASTER_ISA_NAMES[settings.isa],
+           settings.raster_mode == RASTER_MODE_FIXED ? "fixed" : "float",
+           pool.workers_count,
+           elapsed * 1000.0, elapsed > 0 ? jobs.size() / elapsed : 0.0);
+    printf("Per image: %.3f ms rendering, %.3f ms writing\n",
+           render_time * 1000.0 / jobs.size(), write_time * 1000.0 / jobs.size());
+
+    pool.deinit();
+
+    if (failed_count > 0) {
+        fprintf(stderr, "Failed to render or write %u images\n", failed_count);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,793 @@
+#include "softrast.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//
+// Headless benchmark. Renders every scene for a number of frames offscreen and
+// prints timings of the frame and of every renderer stage as JSON, so runs on
+// different commits could be diffed by scripts.
+//
+// `--shader none` is the built-in flat color and texture path of
+// `render_mesh`, others are going through `render_mesh_shaded`, so running
+// both on the same scenes compares templated pipeline against hard-coded one.
+//
+// Frames are recorded into `Draw_List`. With `--draws N` every scene is drawn
+// N times, each copy is further from the camera and they are submitted back to
+// front, so `--unsorted` shows how much front to back sorting saves. With
+// `--moving N` only first N copies are animated, and `--incremental` redraws
+// only tiles which they have been covering, see `draw_list_geometry`.
+//
+// With `--instances N` every draw is instanced one, with N copies of the scene
+// in a grid which is half as big again as the screen, so some of them are
+// culled up front. Every copy has it's own color and is rotating with it's
+// own phase, copies at different depths are overlapping.
+//
+// Meshes are split into clusters, with `--no-cluster-culling` clusters
+// which are off screen or facing away are not skipped, see `cull_clusters`.
+//
+// Every frame is presented, with `--layout tiled` that's de-tiling redrawn
+// part of the framebuffer, which is timed as "present" stage. Bandwidth of it
+// counts bytes which were read and written.
+//
+// With `--edge-bench` scenes are not rendered, instead coverage of random
+// triangles is found for every pixel center of their bounding boxes, once with
+// `point_inside_triangle` and once with `raster_triangle_setup` and span kernel
+// of `--isa`, block by block into scratch framebuffer, same as partially
+// covered blocks of `raster_triangle` are drawn. Both are timed `--frames`
+// times, per pixel timings are printed as JSON.
+//
+// Usage: softrast_bench [--frames N] [--warmup N] [--size W H] [--threads N]
+//                       [--isa scalar|sse4.1|avx2] [--fixed] [--serial]
+//                       [--cull none|back|front] [--ccw] [--clear lazy|eager] [--msaa 1|4|8]
+//                       [--layout linear|tiled]
+//                       [--filter nearest|bilinear|trilinear]
+//                       [--shader none|vertex_color|gouraud|lambert]
+//                       [--draws N] [--unsorted] [--moving N] [--incremental] [--instances N]
+//                       [--no-cluster-culling]
+//                       [--scene cube|sphere|textured|soup|FILE.obj]... [--soup-count N]
+//                       [--label STRING] [--out FILE] [--edge-bench]
+//
+
+struct Bench_Scene {
+    std::string name{};
+    Mesh mesh{};
+    F64 load_time = 0;
+};
+
+//
+// Same sphere as "sphere" scene, with checker texture on it. Texture is
+// bigger than the sphere on the screen, so lower mip levels are sampled too.
+//
+static Mesh
+bench_make_textured_sphere(void)
+{
+    Mesh mesh = make_sphere_mesh(64, 128, 2.0f);
+    mesh.textures.push_back(make_checker_texture(1024, 32, COLOR_WHITE, COLOR_BLUE));
+
+    Material material{};
+    material.name = "checker";
+    material.diffuse_texture = 0;
+
+    mesh.materials.push_back(material);
+    mesh.groups.push_back({0, 0, static_cast<U32>(mesh.indexes.size())});
+
+    return mesh;
+}
+
+struct Bench_Frame {
+    F64 frame = 0;
+    U64 presented_pixels = 0;
+    Render_Stats stats{};
+};
+
+struct Bench_Summary {
+    F64 min = 0;
+    F64 median = 0;
+    F64 p99 = 0;
+    F64 mean = 0;
+};
+
+static Bench_Summary
+bench_summarize(std::vector<F64> values)
+{
+    Bench_Summary result{};
+
+    if (values.empty()) {
+        return result;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    // NOTE: Nearest rank percentiles, so every reported value is one of the
+    // measured ones.
+    auto percentile = [&values](F64 p) -> F64 {
+        USZ rank = static_cast<USZ>(std::ceil(p * static_cast<F64>(values.size())));
+        return values[std::clamp<USZ>(rank, 1, values.size()) - 1];
+    };
+
+    F64 sum = 0;
+    for (F64 value : values) {
+        sum += value;
+    }
+
+    result.min = values.front();
+    result.median = percentile(0.5);
+    result.p99 = percentile(0.99);
+    result.mean = sum / static_cast<F64>(values.size());
+
+    return result;
+}
+
+static void
+bench_print_string(FILE *out, const char *string)
+{
+    fputc('"', out);
+
+    for (const char *c = string; *c != 0; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', out);
+            fputc(*c, out);
+        } else if (static_cast<U8>(*c) < 0x20) {
+            fprintf(out, "\\u%04x", static_cast<U8>(*c));
+        } else {
+            fputc(*c, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+static void
+bench_print_summary(FILE *out, const char *name, const std::vector<Bench_Frame> &frames, F64 Bench_Frame::*frame_field, F64 Render_Stats::*stats_field, bool last)
+{
+    std::vector<F64> values{};
+    values.reserve(frames.size());
+
+    for (const Bench_Frame &frame : frames) {
+        values.push_back(frame_field != nullptr ? frame.*frame_field : frame.stats.*stats_field);
+    }
+
+    Bench_Summary summary = bench_summarize(std::move(values));
+
+    fprintf(out, "        \"%s\": {\"min\": %.6f, \"median\": %.6f, \"p99\": %.6f, \"mean\": %.6f}%s\n",
+            name, summary.min * 1000.0, summary.median * 1000.0, summary.p99 * 1000.0, summary.mean * 1000.0,
+            last ? "" : ",");
+}
+
+struct Bench_Edges_Frame {
+    S32 width = 0, height = 0;
+    S32 pitch = 0;  // NOTE: Whole blocks, so every span is whole.
+    std::vector<Color4> pixels{};
+    std::vector<F32> depths{};
+};
+
+//
+// Triangles of up to `max_size` pixels, inside of the screen, all wound the way
+// `point_inside_triangle` and `raster_triangle_setup` accept. Every next one
+// is closer, so it passes depth test over the previous ones. Only vertexes,
+// depths and color are filled, setup is timed as part of the raster.
+//
+static std::vector<Raster_Triangle>
+bench_make_triangles(U32 count, S32 width, S32 height, F32 max_size, const Draw_Material *material)
+{
+    std::vector<Raster_Triangle> triangles{};
+    triangles.reserve(count);
+
+    U32 state = 69;
+    auto random = [&state](void) -> F32 {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<F32>(state >> 8) / static_cast<F32>(1u << 24);
+    };
+
+    for (U32 i = 0; i < count; ++i) {
+        Raster_Triangle t{};
+        V2 *v = t.vertexes;
+
+        V2 origin{random() * (static_cast<F32>(width) - max_size), random() * (static_cast<F32>(height) - max_size)};
+
+        for (S32 k = 0; k < 3; ++k) {
+            v[k] = {origin.x + random() * max_size, origin.y + random() * max_size};
+            t.depths[k] = 1.0f - static_cast<F32>(i + 1) / static_cast<F32>(count + 1);
+        }
+
+        if ((v[1] - v[0]).perpendicular_ccw().dot(v[2] - v[0]) > 0) {
+            std::swap(v[1], v[2]);
+        }
+
+        t.color = COLOR_WHITE;
+        t.material = material;
+        t.bb = calculate_bounding_box({static_cast<F32>(width), static_cast<F32>(height)}, v);
+
+        triangles.push_back(t);
+    }
+
+    return triangles;
+}
+
+//
+// Pixel centers are at whole coordinates, same as in the renderer.
+//
+static U64
+bench_cover_point_inside(const std::vector<Raster_Triangle> &triangles)
+{
+    U64 covered = 0;
+
+    for (const Raster_Triangle &t : triangles) {
+        for (S32 y = t.bb.y; y < t.bb.h; ++y) {
+            for (S32 x = t.bb.x; x < t.bb.w; ++x) {
+                V2 p{static_cast<F32>(x), static_cast<F32>(y)};
+                covered += point_inside_triangle(p, t.vertexes[0], t.vertexes[1], t.vertexes[2]);
+            }
+        }
+    }
+
+    return covered;
+}
+
+//
+// Float raster mode path of `raster_triangle` for partially covered blocks,
+// without tiles and Hi-Z: `raster_triangle_setup`, then edge and depth values
+// at the origin of every 8x8 block of the bounding box, stepped down it's
+// rows, and `span_proc` for every row.
+//
+static U64
+bench_cover_span_kernels(const std::vector<Raster_Triangle> &triangles, Raster_Span_Proc span_proc, Bench_Edges_Frame *frame)
+{
+    U64 covered = 0;
+    V2 screen_size{static_cast<F32>(frame->width), static_cast<F32>(frame->height)};
+
+    for (Raster_Triangle t : triangles) {
+        if (!raster_triangle_setup(&t, RASTER_MODE_FLOAT, screen_size)) {
+            continue;
+        }
+
+        const Edge_Function *e = t.edges;
+
+        Raster_Span_Setup span{};
+        F32 step_y[3][RASTER_BLOCK_SIZE]{};
+        F32 step_z_y[RASTER_BLOCK_SIZE]{};
+
+        for (S32 i = 0; i < 3; ++i) {
+            span.top_left[i] = e[i].top_left ? MAX_U32 : 0;
+
+            for (S32 k = 0; k < RASTER_BLOCK_SIZE; ++k) {
+                span.step_x[i][k] = e[i].a * static_cast<F32>(k);
+                step_y[i][k] = e[i].b * static_cast<F32>(k);
+            }
+        }
+
+        for (S32 k = 0; k < RASTER_BLOCK_SIZE; ++k) {
+            span.step_z[k] = t.dz_dx * static_cast<F32>(k);
+            step_z_y[k] = t.dz_dy * static_cast<F32>(k);
+        }
+
+        span.z_min = t.z_min;
+        span.z_max = t.z_max;
+        span.color = t.color;
+
+        for (S32 block_y = t.bb.y / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE; block_y < t.bb.h; block_y += RASTER_BLOCK_SIZE) {
+            S32 ky_begin = std::max(t.bb.y - block_y, 0);
+            S32 ky_end = std::min(t.bb.h - block_y, RASTER_BLOCK_SIZE);
+
+            for (S32 block_x = t.bb.x / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE; block_x < t.bb.w; block_x += RASTER_BLOCK_SIZE) {
+                S32 kx_begin = std::max(t.bb.x - block_x, 0);
+                S32 kx_end = std::min(t.bb.w - block_x, RASTER_BLOCK_SIZE);
+
+                F32 block[3];
+                for (S32 i = 0; i < 3; ++i) {
+                    block[i] = e[i].a * (static_cast<F32>(block_x) - e[i].origin.x)
+                             + e[i].b * (static_cast<F32>(block_y) - e[i].origin.y);
+                }
+
+                F32 z_block = t.depths[0] + t.dz_dx * (static_cast<F32>(block_x) - t.vertexes[0].x)
+                                          + t.dz_dy * (static_cast<F32>(block_y) - t.vertexes[0].y);
+
+                for (S32 ky = ky_begin; ky < ky_end; ++ky) {
+                    USZ offset = static_cast<USZ>(block_y + ky) * frame->pitch + block_x;
+
+                    U32 written = span_proc(frame->pixels.data() + offset, frame->depths.data() + offset, &span,
+                                            block[0] + step_y[0][ky], block[1] + step_y[1][ky], block[2] + step_y[2][ky],
+                                            z_block + step_z_y[ky], kx_begin, kx_end, true);
+
+                    covered += std::popcount(written);
+                }
+            }
+        }
+    }
+
+    return covered;
+}
+
+static void
+bench_print_edge_method(FILE *out, const char *name, std::vector<F64> times, U64 pixels, U64 covered, bool last)
+{
+    Bench_Summary summary = bench_summarize(std::move(times));
+    F64 ns_per_pixel = pixels != 0 ? summary.min * 1e9 / static_cast<F64>(pixels) : 0;
+
+    fprintf(out, "    \"%s\": {\"min\": %.6f, \"median\": %.6f, \"p99\": %.6f, \"mean\": %.6f, \"min_ns_per_pixel\": %.4f, \"covered\": %llu}%s\n",
+            name, summary.min * 1000.0, summary.median * 1000.0, summary.p99 * 1000.0, summary.mean * 1000.0, ns_per_pixel,
+            static_cast<unsigned long long>(covered), last ? "" : ",");
+}
+
+//
+// See `--edge-bench`. Methods are interleaved, so both are seeing same state
+// of the machine. Depths are reset before every frame, outside of the timing.
+//
+static void
+bench_edges(FILE *out, const char *label, Raster_ISA isa, S32 width, S32 height, S32 frames_count)
+{
+    Draw_Material material{};
+
+    F32 max_size = std::min({64.0f, static_cast<F32>(width), static_cast<F32>(height)});
+    std::vector<Raster_Triangle> triangles = bench_make_triangles(4096, width, height, max_size, &material);
+
+    U64 pixels = 0;
+    for (const Raster_Triangle &t : triangles) {
+        pixels += static_cast<U64>(t.bb.w - t.bb.x) * static_cast<U64>(t.bb.h - t.bb.y);
+    }
+
+    Bench_Edges_Frame frame{};
+    frame.width = width;
+    frame.height = height;
+    frame.pitch = (width + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE;
+    frame.pixels.resize(static_cast<USZ>(frame.pitch) * height);
+    frame.depths.resize(static_cast<USZ>(frame.pitch) * height);
+
+    std::vector<F64> point_times{}, kernel_times{};
+    U64 point_covered = 0, kernel_covered = 0;
+
+    for (S32 frame_index = 0; frame_index < frames_count; ++frame_index) {
+        std::fill(frame.depths.begin(), frame.depths.end(), std::numeric_limits<F32>::max());
+
+        Clock clock{};
+        point_covered = bench_cover_point_inside(triangles);
+        point_times.push_back(clock.tick());
+
+        kernel_covered = bench_cover_span_kernels(triangles, RASTER_SPAN_PROCS[isa], &frame);
+        kernel_times.push_back(clock.tick());
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"label\": ");
+    bench_print_string(out, label);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"isa\": \"%s\",\n", RASTER_ISA_NAMES[isa]);
+    fprintf(out, "  \"triangles\": %zu,\n", triangles.size());
+    fprintf(out, "  \"pixels\": %llu,\n", static_cast<unsigned long long>(pixels));
+    fprintf(out, "  \"frames\": %d,\n", frames_count);
+    fprintf(out, "  \"time_unit\": \"ms\",\n");
+    fprintf(out, "  \"edge_bench\": {\n");
+    bench_print_edge_method(out, "point_inside_triangle", std::move(point_times), pixels, point_covered, false);
+    bench_print_edge_method(out, "span_kernels", std::move(kernel_times), pixels, kernel_covered, true);
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    S32 frames_count = 200;
+    S32 warmup_count = 10;
+    S32 width = 1280, height = 720;
+    U32 threads_count = std::max(1U, std::thread::hardware_concurrency());
+    U32 soup_count = 100'000;
+    bool serial = false;
+    S32 draws_count = 1;
+    S32 moving_count = -1;  // NOTE: All of them.
+    S32 instances_count = 0;  // NOTE: Not instanced.
+    Draw_List draw_list{};
+    Draw_Material material{};
+    const char *label = "";
+    const char *out_path = nullptr;
+    bool edge_bench = false;
+    std::vector<std::string> scene_names{};
+
+    Basic_Renderer renderer{};
+    renderer.isa = detect_raster_isa();
+
+    for (S32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads_count = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--fixed") == 0) {
+            renderer.raster_mode = RASTER_MODE_FIXED;
+        } else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+
+            if (strcmp(name, "none") == 0) {
+                material.cull_mode = CULL_MODE_NONE;
+            } else if (strcmp(name, "back") == 0) {
+                material.cull_mode = CULL_MODE_BACK;
+            } else if (strcmp(name, "front") == 0) {
+                material.cull_mode = CULL_MODE_FRONT;
+            } else {
+                fprintf(stderr, "Unknown cull mode: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ccw") == 0) {
+            material.front_face = FRONT_FACE_CCW;
+        } else if (strcmp(argv[i], "--serial") == 0) {
+            serial = true;
+        } else if (strcmp(argv[i], "--clear") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+
+            if (strcmp(name, "lazy") == 0) {
+                renderer.clear_mode = CLEAR_MODE_LAZY;
+            } else if (strcmp(name, "eager") == 0) {
+                renderer.clear_mode = CLEAR_MODE_EAGER;
+            } else {
+                fprintf(stderr, "Unknown clear mode: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+            S32 samples = atoi(argv[++i]);
+
+            if (samples != 1 && samples != 4 && samples != 8) {
+                fprintf(stderr, "Unsupported MSAA samples count: %d\n", samples);
+                return 1;
+            }
+
+            renderer.samples_count = static_cast<U32>(samples);
+        } else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 layout = 0; layout < PIXELS_LAYOUT_COUNT; ++layout) {
+                if (strcmp(name, PIXELS_LAYOUT_NAMES[layout]) == 0) {
+                    renderer.pixels_layout = static_cast<Pixels_Layout>(layout);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown pixels layout: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 isa = 0; isa < RASTER_ISA_COUNT; ++isa) {
+                if (strcmp(name, RASTER_ISA_NAMES[isa]) == 0) {
+                    renderer.isa = static_cast<Raster_ISA>(isa);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown raster ISA: %s\n", name);
+                return 1;
+            }
+
+            if (renderer.isa > detect_raster_isa()) {
+                fprintf(stderr, "Raster ISA is not supported by this CPU: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 filter = 0; filter < TEXTURE_FILTER_COUNT; ++filter) {
+                if (strcmp(name, TEXTURE_FILTER_NAMES[filter]) == 0) {
+                    material.texture_filter = static_cast<Texture_Filter>(filter);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown texture filter: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--shader") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 kind = 0; kind < DRAW_SHADER_COUNT; ++kind) {
+                if (strcmp(name, DRAW_SHADER_NAMES[kind]) == 0) {
+                    material.shader = static_cast<Draw_Shader>(kind);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown shader: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            draws_count = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--unsorted") == 0) {
+            draw_list.sorted = false;
+        } else if (strcmp(argv[i], "--moving") == 0 && i + 1 < argc) {
+            moving_count = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instances_count = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            renderer.incremental = true;
+        } else if (strcmp(argv[i], "--no-cluster-culling") == 0) {
+            renderer.cluster_culling = false;
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            scene_names.emplace_back(argv[++i]);
+        } else if (strcmp(argv[i], "--soup-count") == 0 && i + 1 < argc) {
+            soup_count = static_cast<U32>(std::max(1, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--edge-bench") == 0) {
+            edge_bench = true;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (width <= 0 || height <= 0 || frames_count <= 0 || warmup_count < 0) {
+        fprintf(stderr, "Invalid frames count or size\n");
+        return 1;
+    }
+
+    if (edge_bench) {
+        FILE *out = out_path != nullptr ? fopen(out_path, "w") : stdout;
+
+        if (out == nullptr) {
+            fprintf(stderr, "Failed to open output file: %s\n", out_path);
+            return 1;
+        }
+
+        bench_edges(out, label, renderer.isa, width, height, frames_count);
+
+        if (out != stdout) {
+            fclose(out);
+        }
+
+        return 0;
+    }
+
+    if (scene_names.empty()) {
+        scene_names = {"cube", "sphere", "textured", "soup"};
+    }
+
+    Thread_Pool pool{};
+    pool.init(serial ? 1 : threads_count);
+
+    std::vector<Bench_Scene> scenes{};
+
+    for (const std::string &name : scene_names) {
+        Bench_Scene scene{};
+        scene.name = name;
+
+        Clock load_clock{};
+
+        if (name == "cube") {
+            scene.mesh = load_mesh("assets/cube.obj", serial ? nullptr : &pool);
+        } else if (name == "sphere") {
+            scene.mesh = make_sphere_mesh(64, 128, 2.0f);
+        } else if (name == "textured") {
+            scene.mesh = bench_make_textured_sphere();
+        } else if (name == "soup") {
+            scene.mesh = make_triangle_soup(soup_count, 2.0f, 0.15f, 69);
+        } else if (name.ends_with(".obj")) {
+            scene.mesh = load_mesh(name, serial ? nullptr : &pool);
+        } else {
+            fprintf(stderr, "Unknown scene: %s\n", name.c_str());
+            pool.deinit();
+            return 1;
+        }
+
+        scene.load_time = load_clock.tick();
+
+        if (scene.mesh.indexes.empty()) {
+            fprintf(stderr, "Failed to load scene: %s\n", name.c_str());
+            pool.deinit();
+            return 1;
+        }
+
+        scenes.push_back(std::move(scene));
+    }
+
+    FILE *out = stdout;
+    if (out_path != nullptr) {
+        out = fopen(out_path, "w");
+        if (out == nullptr) {
+            fprintf(stderr, "Failed to open output file: %s\n", out_path);
+            pool.deinit();
+            return 1;
+        }
+    }
+
+    renderer.resize(width, height);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"label\": ");
+    bench_print_string(out, label);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"isa\": \"%s\",\n", RASTER_ISA_NAMES[renderer.isa]);
+    fprintf(out, "  \"raster_mode\": \"%s\",\n", renderer.raster_mode == RASTER_MODE_FIXED ? "fixed" : "float");
+    fprintf(out, "  \"threads\": %u,\n", pool.workers_count);
+    fprintf(out, "  \"serial\": %s,\n", serial ? "true" : "false");
+    fprintf(out, "  \"clear_mode\": \"%s\",\n", renderer.clear_mode == CLEAR_MODE_LAZY ? "lazy" : "eager");
+    fprintf(out, "  \"msaa_samples\": %u,\n", renderer.samples_count);
+    fprintf(out, "  \"pixels_layout\": \"%s\",\n", PIXELS_LAYOUT_NAMES[renderer.pixels_layout]);
+    fprintf(out, "  \"cull_mode\": \"%s\",\n", material.cull_mode == CULL_MODE_NONE ? "none" : material.cull_mode == CULL_MODE_BACK ? "back" : "front");
+    fprintf(out, "  \"front_face\": \"%s\",\n", material.front_face == FRONT_FACE_CW ? "cw" : "ccw");
+    fprintf(out, "  \"texture_filter\": \"%s\",\n", TEXTURE_FILTER_NAMES[material.texture_filter]);
+    fprintf(out, "  \"shader\": \"%s\",\n", DRAW_SHADER_NAMES[material.shader]);
+    fprintf(out, "  \"draws\": %d,\n", draws_count);
+    fprintf(out, "  \"sorted\": %s,\n", draw_list.sorted ? "true" : "false");
+    fprintf(out, "  \"moving\": %d,\n", moving_count < 0 ? draws_count : std::min(moving_count, draws_count));
+    fprintf(out, "  \"incremental\": %s,\n", renderer.incremental ? "true" : "false");
+    fprintf(out, "  \"instances\": %d,\n", instances_count);
+    fprintf(out, "  \"cluster_culling\": %s,\n", renderer.cluster_culling ? "true" : "false");
+    fprintf(out, "  \"width\": %d,\n", width);
+    fprintf(out, "  \"height\": %d,\n", height);
+    fprintf(out, "  \"frames\": %d,\n", frames_count);
+    fprintf(out, "  \"warmup\": %d,\n", warmup_count);
+    fprintf(out, "  \"time_unit\": \"ms\",\n");
+    fprintf(out, "  \"scenes\": [\n");
+
+    U64 steady_draws_failed = 0;
+
+    std::vector<Draw_Instance> instances(instances_count);
+
+    for (USZ scene_index = 0; scene_index < scenes.size(); ++scene_index) {
+        const Bench_Scene *scene = &scenes[scene_index];
+
+        std::vector<Bench_Frame> frames{};
+        frames.reserve(frames_count);
+
+        // NOTE: Same fixed time step as in headless front end, so every run
+        // renders same frames.
+        F32 rotation = 1.0f;
+        F32 rotation_speed = 0.8f;
+        F32 dt = 1.0f / 60.0f;
+
+        for (S32 frame_index = 0; frame_index < warmup_count + frames_count; ++frame_index) {
+            renderer.stats = {};
+
+            Clock clock{};
+
+            // NOTE: Incremental frames are drawn over the previous ones.
+            if (!renderer.incremental) {
+                renderer.clear();
+            }
+
+            draw_list.clear();
+
+            for (S32 draw_index = draws_count - 1; draw_index >= 0; --draw_index) {
+                F32 draw_rotation = moving_count < 0 || draw_index < moving_count ? rotation : 1.0f;
+
+                Transform transform{draw_rotation, draw_rotation * 0.1f, draw_rotation * 0.3f};
+                transform.position = {0.2f * static_cast<F32>(draw_index), 0.1f * static_cast<F32>(draw_index), -2.0f * static_cast<F32>(draw_index)};
+
+                if (instances_count == 0) {
+                    draw_list.submit(&scene->mesh, transform, &material);
+                    continue;
+                }
+
+                S32 columns = static_cast<S32>(std::ceil(std::sqrt(static_cast<F32>(instances_count))));
+                F32 extent_y = WORLD_UNITS_IN_SCREEN_HEIGHT * 1.5f;
+                F32 extent_x = extent_y * static_cast<F32>(width) / static_cast<F32>(height);
+
+                for (S32 i = 0; i < instances_count; ++i) {
+                    Draw_Instance *instance = &instances[i];
+                    F32 phase = static_cast<F32>(i) * 0.37f;
+
+                    instance->transform = {draw_rotation + phase, (draw_rotation + phase) * 0.1f, (draw_rotation + phase) * 0.3f};
+                    instance->transform.position = {
+                        transform.position.x + extent_x * ((static_cast<F32>(i % columns) + 0.5f) / static_cast<F32>(columns) - 0.5f),
+                        transform.position.y + extent_y * ((static_cast<F32>(i / columns) + 0.5f) / static_cast<F32>(columns) - 0.5f),
+                        transform.position.z - static_cast<F32>(i % 7),
+                    };
+
+                    U32 hash = static_cast<U32>(i) * 2654435761U;
+                    instance->color = Color4(static_cast<U8>(hash >> 24) | 0x40, static_cast<U8>(hash >> 16) | 0x40, static_cast<U8>(hash >> 8) | 0x40, MAX_U8);
+                }
+
+                draw_list.submit_instances(&scene->mesh, instances, &material);
+            }
+
+            execute_draw_list(&renderer, serial ? nullptr : &pool, &draw_list);
+            renderer.present(renderer.present_rects);
+
+            F64 elapsed = clock.tick();
+            U64 presented_pixels = 0;
+
+            for (const R32 &rect : renderer.present_rects) {
+                presented_pixels += static_cast<U64>(rect.w) * static_cast<U64>(rect.h);
+            }
+
+            rotation += rotation_speed * dt;
+
+            if (frame_index >= warmup_count) {
+                frames.push_back({elapsed, presented_pixels, renderer.stats});
+            }
+        }
+
+        F64 total_time = 0;
+        U64 triangles_submitted = 0;
+        U64 triangles_culled = 0;
+        U64 triangles_clipped = 0;
+        U64 triangles_rasterized = 0;
+        U64 tiles_drawn = 0;
+        U64 instances_culled = 0;
+        U64 clusters_culled = 0;
+        U64 draws_failed = 0;
+        U64 presented_pixels = 0;
+        F64 present_time = 0;
+
+        for (const Bench_Frame &frame : frames) {
+            total_time += frame.frame;
+            presented_pixels += frame.presented_pixels;
+            present_time += frame.stats.present;
+            triangles_submitted += frame.stats.triangles_submitted;
+            triangles_culled += frame.stats.triangles_culled;
+            triangles_clipped += frame.stats.triangles_clipped;
+            triangles_rasterized += frame.stats.triangles_rasterized;
+            tiles_drawn += frame.stats.tiles_drawn;
+            instances_culled += frame.stats.instances_culled;
+            clusters_culled += frame.stats.clusters_culled;
+            draws_failed += frame.stats.draws_failed;
+        }
+
+        steady_draws_failed += draws_failed;
+
+        // NOTE: Pixels of the framebuffer, not the ones which were covered
+        // by triangles.
+        F64 pixels = static_cast<F64>(width) * static_cast<F64>(height) * static_cast<F64>(frames_count);
+
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": ");
+        bench_print_string(out, scene->name.c_str());
+        fprintf(out, ",\n");
+        fprintf(out, "      \"load_ms\": %.6f,\n", scene->load_time * 1000.0);
+        fprintf(out, "      \"triangles\": %zu,\n", static_cast<size_t>(scene->mesh.indexes.size() / 3));
+        fprintf(out, "      \"triangles_culled_per_frame\": %.1f,\n", static_cast<F64>(triangles_culled) / frames_count);
+        fprintf(out, "      \"triangles_clipped_per_frame\": %.1f,\n", static_cast<F64>(triangles_clipped) / frames_count);
+        fprintf(out, "      \"triangles_rasterized_per_frame\": %.1f,\n", static_cast<F64>(triangles_rasterized) / frames_count);
+        fprintf(out, "      \"tiles_drawn_per_frame\": %.1f,\n", static_cast<F64>(tiles_drawn) / frames_count);
+        fprintf(out, "      \"instances_culled_per_frame\": %.1f,\n", static_cast<F64>(instances_culled) / frames_count);
+        fprintf(out, "      \"clusters\": %zu,\n", scene->mesh.clusters.size());
+        fprintf(out, "      \"clusters_culled_per_frame\": %.1f,\n", static_cast<F64>(clusters_culled) / frames_count);
+        fprintf(out, "      \"draws_failed_per_frame\": %.1f,\n", static_cast<F64>(draws_failed) / frames_count);
+        fprintf(out, "      \"triangles_per_second\": %.1f,\n", static_cast<F64>(triangles_submitted) / total_time);
+        fprintf(out, "      \"pixels_per_second\": %.1f,\n", pixels / total_time);
+        // NOTE: Linear layout is presented in place, nothing is copied.
+        fprintf(out, "      \"present_bytes_per_second\": %.1f,\n",
+                present_time > 0 ? static_cast<F64>(presented_pixels) * sizeof(Color4) * 2 / present_time : 0.0);
+        fprintf(out, "      \"frame\": {\n");
+        bench_print_summary(out, "total", frames, &Bench_Frame::frame, nullptr, true);
+        fprintf(out, "      },\n");
+        fprintf(out, "      \"stages\": {\n");
+        bench_print_summary(out, "clear", frames, nullptr, &Render_Stats::clear, false);
+        bench_print_summary(out, "transform", frames, nullptr, &Render_Stats::transform, false);
+        bench_print_summary(out, "setup", frames, nullptr, &Render_Stats::setup, false);
+        bench_print_summary(out, "raster", frames, nullptr, &Render_Stats::raster, false);
+        bench_print_summary(out, "present", frames, nullptr, &Render_Stats::present, true);
+        fprintf(out, "      }\n");
+        fprintf(out, "    }%s\n", scene_index + 1 < scenes.size() ? "," : "");
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    pool.deinit();
+
+    if (steady_draws_failed > 0) {
+        fprintf(stderr, "Frames after warmup had %llu failed draws, out of memory\n", static_cast<unsigned long long>(steady_draws_failed));
+        return 1;
+    }
+
+    return 0;
+}
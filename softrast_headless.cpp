@@ -0,0 +1,274 @@
+#include "softrast.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//
+// Headless front end: renders frames into offscreen `Basic_Renderer` without
+// any window, so it could run in batch jobs and under the profiler.
+//
+// With `--pipeline DEPTH` (0 is off) frames go through `Frame_Pipeline` with that many
+// frames in flight, and latency of every frame, from beginning of it's
+// recording until it's presented, is printed along with throughput.
+//
+// Every frame is presented, which de-tiles it with `--layout tiled`.
+//
+// Usage: softrast_headless [--frames N] [--size W H] [--threads N] [--fixed] [--cull none|back|front] [--ccw] [--clear lazy|eager] [--msaa 1|4|8] [--layout linear|tiled] [--serial] [--isa scalar|sse4.1|avx2] [--filter nearest|bilinear|trilinear] [--pipeline DEPTH] [mesh.obj]
+//
+
+int
+main(int argc, char **argv)
+{
+    const char *mesh_path = "assets/cube.obj";
+    S32 frames_count = 100;
+    S32 width = 600, height = 600;
+    U32 threads_count = std::max(1U, std::thread::hardware_concurrency());
+    bool serial = false;
+    U32 pipeline_depth = 0;
+
+    Basic_Renderer renderer{};
+    Draw_List draw_list{};
+    Draw_Material material{};
+    renderer.isa = detect_raster_isa();
+
+    for (S32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads_count = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--fixed") == 0) {
+            renderer.raster_mode = RASTER_MODE_FIXED;
+        } else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+
+            if (strcmp(name, "none") == 0) {
+                material.cull_mode = CULL_MODE_NONE;
+            } else if (strcmp(name, "back") == 0) {
+                material.cull_mode = CULL_MODE_BACK;
+            } else if (strcmp(name, "front") == 0) {
+                material.cull_mode = CULL_MODE_FRONT;
+            } else {
+                fprintf(stderr, "Unknown cull mode: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ccw") == 0) {
+            material.front_face = FRONT_FACE_CCW;
+        } else if (strcmp(argv[i], "--serial") == 0) {
+            serial = true;
+        } else if (strcmp(argv[i], "--clear") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+
+            if (strcmp(name, "lazy") == 0) {
+                renderer.clear_mode = CLEAR_MODE_LAZY;
+            } else if (strcmp(name, "eager") == 0) {
+                renderer.clear_mode = CLEAR_MODE_EAGER;
+            } else {
+                fprintf(stderr, "Unknown clear mode: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+            S32 samples = atoi(argv[++i]);
+
+            if (samples != 1 && samples != 4 && samples != 8) {
+                fprintf(stderr, "Unsupported MSAA samples count: %d\n", samples);
+                return 1;
+            }
+
+            renderer.samples_count = static_cast<U32>(samples);
+        } else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 layout = 0; layout < PIXELS_LAYOUT_COUNT; ++layout) {
+                if (strcmp(name, PIXELS_LAYOUT_NAMES[layout]) == 0) {
+                    renderer.pixels_layout = static_cast<Pixels_Layout>(layout);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown pixels layout: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 isa = 0; isa < RASTER_ISA_COUNT; ++isa) {
+                if (strcmp(name, RASTER_ISA_NAMES[isa]) == 0) {
+                    renderer.isa = static_cast<Raster_ISA>(isa);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown raster ISA: %s\n", name);
+                return 1;
+            }
+
+            if (renderer.isa > detect_raster_isa()) {
+                fprintf(stderr, "Raster ISA is not supported by this CPU: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            bool found = false;
+
+            for (U8 filter = 0; filter < TEXTURE_FILTER_COUNT; ++filter) {
+                if (strcmp(name, TEXTURE_FILTER_NAMES[filter]) == 0) {
+                    material.texture_filter = static_cast<Texture_Filter>(filter);
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                fprintf(stderr, "Unknown texture filter: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipeline_depth = static_cast<U32>(std::max(0, atoi(argv[++i])));
+        } else if (argv[i][0] != '-') {
+            mesh_path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid size: %dx%d\n", width, height);
+        return 1;
+    }
+
+    Thread_Pool pool{};
+    pool.init(serial ? 1 : threads_count);
+
+    Clock load_clock{};
+
+    Mesh mesh = load_mesh(mesh_path, serial ? nullptr : &pool);
+    if (mesh.indexes.empty()) {
+        fprintf(stderr, "Failed to load mesh: %s\n", mesh_path);
+        pool.deinit();
+        return 1;
+    }
+
+    printf("Loaded %s: %zu vertexes, %zu triangles, %zu textures in %.3f ms\n",
+           mesh_path, mesh.vertexes.size(), mesh.indexes.size() / 3, mesh.textures.size(), load_clock.tick() * 1000.0);
+
+    // NOTE: Fixed time step, so every run renders same frames.
+    F32 rotation = 1.0f;
+    F32 rotation_speed = 0.8f;
+    F32 dt = 1.0f / 60.0f;
+
+    if (pipeline_depth > 0) {
+        // NOTE: Geometry is cheaper than raster, so it gets quarter of the
+        // threads.
+        U32 geometry_workers = serial ? 1 : std::max(1U, threads_count / 4);
+        U32 raster_workers = serial ? 1 : std::max(1U, threads_count - geometry_workers);
+
+        Frame_Pipeline pipeline{};
+        pipeline.init(&renderer, pipeline_depth, geometry_workers, raster_workers);
+        pipeline.resize(width, height);
+
+        F64 latency_total = 0;
+        F64 latency_max = 0;
+        S32 presented_count = 0;
+        U64 draws_failed = 0;
+
+        auto present = [&](Pipeline_Frame *frame) {
+            F64 latency = pipeline.now() - frame->begin_time;
+
+            frame->renderer.present(frame->renderer.present_rects);
+            draws_failed += frame->renderer.stats.draws_failed;
+
+            latency_total += latency;
+            latency_max = std::max(latency_max, latency);
+            ++presented_count;
+
+            pipeline.release_frame(frame);
+        };
+
+        Clock clock{};
+
+        for (S32 frame_index = 0; frame_index < frames_count; ++frame_index) {
+            Pipeline_Frame *frame = pipeline.begin_frame();
+
+            Transform transform{rotation, rotation * 0.1f, rotation * 0.3f};
+            frame->draw_list.submit(&mesh, transform, &material);
+
+            pipeline.submit_frame(frame);
+
+            if (Pipeline_Frame *presented = pipeline.present_frame(false)) {
+                present(presented);
+            }
+
+            rotation += rotation_speed * dt;
+        }
+
+        while (Pipeline_Frame *presented = pipeline.present_frame(true)) {
+            present(presented);
+        }
+
+        F64 elapsed = clock.tick();
+
+        printf("Rendered %d frames of %dx%d (%s, %s, pipeline depth %u, %u geometry + %u raster threads) in %.3f ms, %.3f ms per frame, %.1f frames per second\n",
+               frames_count, width, height,
+               RASTER_ISA_NAMES[renderer.isa],
+               renderer.raster_mode == RASTER_MODE_FIXED ? "fixed" : "float",
+               pipeline_depth, geometry_workers, raster_workers,
+               elapsed * 1000.0, frames_count > 0 ? elapsed * 1000.0 / frames_count : 0.0,
+               elapsed > 0 ? frames_count / elapsed : 0.0);
+        printf("Latency: %.3f ms mean, %.3f ms max\n",
+               presented_count > 0 ? latency_total * 1000.0 / presented_count : 0.0, latency_max * 1000.0);
+
+        pipeline.deinit();
+        pool.deinit();
+
+        if (draws_failed > 0) {
+            fprintf(stderr, "%llu draws failed, out of memory\n", static_cast<unsigned long long>(draws_failed));
+            return 1;
+        }
+
+        return 0;
+    }
+
+    renderer.resize(width, height);
+
+    Clock clock{};
+
+    for (S32 frame = 0; frame < frames_count; ++frame) {
+        renderer.clear();
+
+        Transform transform{rotation, rotation * 0.1f, rotation * 0.3f};
+
+        draw_list.clear();
+        draw_list.submit(&mesh, transform, &material);
+        execute_draw_list(&renderer, serial ? nullptr : &pool, &draw_list);
+        renderer.present(renderer.present_rects);
+
+        rotation += rotation_speed * dt;
+    }
+
+    F64 elapsed = clock.tick();
+
+    printf("Rendered %d frames of %dx%d (%s, %s, %s, %u threads) in %.3f ms, %.3f ms per frame\n",
+           frames_count, width, height,
+           RASTER_ISA_NAMES[renderer.isa],
+           renderer.raster_mode == RASTER_MODE_FIXED ? "fixed" : "float",
+           PIXELS_LAYOUT_NAMES[renderer.pixels_layout],
+           pool.workers_count,
+           elapsed * 1000.0, frames_count > 0 ? elapsed * 1000.0 / frames_count : 0.0);
+
+    pool.deinit();
+
+    if (renderer.stats.draws_failed > 0) {
+        fprintf(stderr, "%llu draws failed, out of memory\n", static_cast<unsigned long long>(renderer.stats.draws_failed));
+        return 1;
+    }
+
+    return 0;
+}
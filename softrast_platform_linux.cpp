@@ -0,0 +1,106 @@
+#include "softrast.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+void *
+platform_allocate(USZ size)
+{
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+void
+platform_free(void *memory, USZ size)
+{
+    if (munmap(memory, size) != 0) {
+        assert(false && "Failed to deallocate!");
+    }
+}
+
+void *
+platform_reserve(USZ size)
+{
+    // NOTE: Inaccessible and not counted against overcommit, until it's
+    // committed.
+    void *memory = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+bool
+platform_commit(void *memory, USZ size)
+{
+    return mprotect(memory, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void
+platform_release(void *memory, USZ size)
+{
+    if (munmap(memory, size) != 0) {
+        assert(false && "Failed to release!");
+    }
+}
+
+void
+platform_decommit(void *memory, USZ size)
+{
+    // NOTE: Pages are dropped right away and come back zeroed if they
+    // are touched again, protection makes it same as on Windows.
+    madvise(memory, size, MADV_DONTNEED);
+    mprotect(memory, size, PROT_NONE);
+}
+
+void *
+platform_map_file(const char *file_name, USZ *size)
+{
+    int file = open(file_name, O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+
+    void *memory = nullptr;
+
+    struct stat file_stat{};
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        memory = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+        } else {
+            // NOTE: Files are parsed front to back, let kernel read ahead.
+            madvise(memory, file_stat.st_size, MADV_SEQUENTIAL);
+            *size = static_cast<USZ>(file_stat.st_size);
+        }
+    }
+
+    // NOTE: Mapping stays valid after descriptor is closed.
+    close(file);
+
+    return memory;
+}
+
+void
+platform_unmap_file(void *memory, USZ size)
+{
+    if (munmap(memory, size) != 0) {
+        assert(false && "Failed to unmap file!");
+    }
+}
+
+S64
+perf_get_counter_frequency(void)
+{
+    // NOTE: `clock_gettime` is counting in nanoseconds.
+    return 1'000'000'000;
+}
+
+S64
+perf_get_counter(void)
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<S64>(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+}
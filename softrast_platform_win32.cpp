@@ -0,0 +1,106 @@
+#include "softrast.h"
+
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+
+#include <windows.h>
+
+void *
+platform_allocate(USZ size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void
+platform_free(void *memory, [[maybe_unused]] USZ size)
+{
+    if (VirtualFree(memory, 0, MEM_RELEASE) == 0) {
+        assert(false && "Failed to deallocate!");
+    }
+}
+
+void *
+platform_reserve(USZ size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool
+platform_commit(void *memory, USZ size)
+{
+    return VirtualAlloc(memory, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+}
+
+void
+platform_release(void *memory, [[maybe_unused]] USZ size)
+{
+    if (VirtualFree(memory, 0, MEM_RELEASE) == 0) {
+        assert(false && "Failed to release!");
+    }
+}
+
+void
+platform_decommit(void *memory, USZ size)
+{
+    if (VirtualFree(memory, size, MEM_DECOMMIT) == 0) {
+        assert(false && "Failed to decommit!");
+    }
+}
+
+void *
+platform_map_file(const char *file_name, USZ *size)
+{
+    HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    void *memory = nullptr;
+
+    LARGE_INTEGER file_size{};
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping != nullptr) {
+            memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+            // NOTE: View keeps mapping alive, so handles could be closed right away.
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+
+    if (memory != nullptr) {
+        *size = static_cast<USZ>(file_size.QuadPart);
+    }
+
+    return memory;
+}
+
+void
+platform_unmap_file(void *memory, [[maybe_unused]] USZ size)
+{
+    if (UnmapViewOfFile(memory) == 0) {
+        assert(false && "Failed to unmap file!");
+    }
+}
+
+S64
+perf_get_counter_frequency(void)
+{
+    LARGE_INTEGER perf_frequency_result;
+    QueryPerformanceFrequency(&perf_frequency_result);
+    S64 perf_frequency = perf_frequency_result.QuadPart;
+    return perf_frequency;
+}
+
+S64
+perf_get_counter(void)
+{
+    LARGE_INTEGER perf_counter_result;
+    QueryPerformanceCounter(&perf_counter_result);
+    S64 perf_counter = perf_counter_result.QuadPart;
+    return perf_counter;
+}
@@ -0,0 +1,565 @@
+#include "softrast.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+//
+// Tests of the renderer. Every test renders same frames in different ways
+// which have to give same pixels, and compares framebuffers byte for byte.
+// Failed checks are printed, and exit code is 1 if there were any.
+//
+// Serial and binned: `assets/cube.obj` at several rotations, with every shader,
+// rendered serially and binned on pools with 1 and `--threads` workers, in
+// float and fixed point raster modes, with and without multisampling, in both
+// pixel layouts.
+//
+// Kernels: same frames rendered serially with every `RASTER_ISA_NAMES` up to
+// the one `detect_raster_isa` found, compared with scalar kernels, also with
+// 8x multisampling.
+//
+// Overdraw: front faces of the cube (and of a sphere, which has many more
+// shared edges and vertexes) are set up once, then every triangle is drawn
+// alone. With the top-left rule every pixel which the whole mesh covers has to
+// be covered by exactly one of them. Same for a grid of screen space quads,
+// which edges are going exactly through pixel centers. In float and fixed
+// point raster modes.
+//
+// Allocations: frames after a few warmup ones are rendered serially and
+// binned, with instances, multisampling and incremental mode, and have to take
+// everything they need from the arenas of the renderer. Every heap allocation
+// goes through counting `operator new`, and any made by those frames fails the
+// test.
+//
+// Usage: softrast_test [--threads N]
+//
+
+#define TEST_WIDTH  203  // NOTE: Not multiple of the tile or the block, so partial ones are tested too.
+#define TEST_HEIGHT 157
+
+global_var U32 test_checks_count = 0;
+global_var U32 test_failed_count = 0;
+
+global_var std::atomic<U64> test_allocations_count{0};
+
+void *
+operator new(std::size_t size)
+{
+    test_allocations_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (void *memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *
+operator new(std::size_t size, std::align_val_t alignment)
+{
+    test_allocations_count.fetch_add(1, std::memory_order_relaxed);
+
+    // NOTE: `aligned_alloc` wants size to be multiple of alignment.
+    USZ align = static_cast<USZ>(alignment);
+
+    if (void *memory = std::aligned_alloc(align, (std::max<USZ>(size, 1) + align - 1) / align * align)) {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+// NOTE: Kept out of line, otherwise GCC sees `free` of the pointer which
+// came from `operator new` after inlining, and warns about mismatch.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void
+test_free(void *memory)
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory) noexcept { test_free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { test_free(memory); }
+void operator delete(void *memory, std::align_val_t) noexcept { test_free(memory); }
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept { test_free(memory); }
+
+static std::vector<Color4>
+test_read_pixels(const Basic_Renderer *r)
+{
+    std::vector<Color4> pixels(static_cast<USZ>(r->pixels_width) * r->pixels_height);
+    r->read_pixels(pixels.data(), r->pixels_width, R32{0, 0, static_cast<S32>(r->pixels_width), static_cast<S32>(r->pixels_height)});
+
+    return pixels;
+}
+
+static void
+test_vfail(const char *format, va_list args)
+{
+    ++test_failed_count;
+
+    fprintf(stderr, "FAIL: ");
+    vfprintf(stderr, format, args);
+}
+
+static void
+test_expect(bool condition, const char *format, ...)
+{
+    ++test_checks_count;
+
+    if (condition) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    test_vfail(format, args);
+    va_end(args);
+
+    fprintf(stderr, "\n");
+}
+
+//
+// Compares `pixels` with `expected`, prints first differing pixel if they are
+// not same.
+//
+static void
+test_expect_same(const std::vector<Color4> &expected, const std::vector<Color4> &pixels, U32 width, const char *format, ...)
+{
+    ++test_checks_count;
+
+    USZ different = 0;
+    USZ first = 0;
+
+    for (USZ i = 0; i < expected.size(); ++i) {
+        if (std::bit_cast<U32>(expected[i]) != std::bit_cast<U32>(pixels[i])) {
+            first = different == 0 ? i : first;
+            ++different;
+        }
+    }
+
+    if (different == 0) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    test_vfail(format, args);
+    va_end(args);
+
+    fprintf(stderr, ": %zu pixels are different, first at (%zu, %zu): %08x instead of %08x\n",
+            different, first % width, first / width,
+            std::bit_cast<U32>(pixels[first]), std::bit_cast<U32>(expected[first]));
+}
+
+static USZ
+test_count_drawn(const std::vector<Color4> &pixels)
+{
+    return static_cast<USZ>(std::count_if(pixels.begin(), pixels.end(), [](Color4 pixel) { return std::bit_cast<U32>(pixel) != CLEAR_PIXEL; }));
+}
+
+static void
+test_init_renderer(Basic_Renderer *r, Raster_Mode raster_mode, U32 samples_count, Pixels_Layout layout)
+{
+    r->isa = detect_raster_isa();
+    r->raster_mode = raster_mode;
+    r->samples_count = samples_count;
+    r->pixels_layout = layout;
+    r->resize(TEST_WIDTH, TEST_HEIGHT);
+}
+
+static std::vector<Color4>
+test_render(Basic_Renderer *r, Thread_Pool *pool, const Mesh *mesh, Transform transform, const Draw_Material *material)
+{
+    Draw_List draw_list{};
+    draw_list.submit(mesh, transform, material);
+
+    r->clear();
+    execute_draw_list(r, pool, &draw_list);
+
+    return test_read_pixels(r);
+}
+
+global_var constexpr S32 TEST_ROTATIONS_COUNT = 8;
+
+static Transform
+test_rotation(S32 index)
+{
+    F32 angle = 0.7f * static_cast<F32>(index) + 0.3f;
+    return {angle, angle * 0.1f, angle * 0.3f};
+}
+
+static void
+test_serial_and_binned(const Mesh *mesh, U32 threads_count)
+{
+    Thread_Pool single{};
+    Thread_Pool many{};
+    single.init(1);
+    many.init(threads_count);
+
+    for (Raster_Mode raster_mode : {RASTER_MODE_FLOAT, RASTER_MODE_FIXED}) {
+        for (U32 samples_count : {1U, 4U}) {
+            for (U32 layout = 0; layout < PIXELS_LAYOUT_COUNT; ++layout) {
+                Basic_Renderer r{};
+                test_init_renderer(&r, raster_mode, samples_count, static_cast<Pixels_Layout>(layout));
+
+                for (U32 shader = 0; shader < DRAW_SHADER_COUNT; ++shader) {
+                    Draw_Material material{};
+                    material.shader = static_cast<Draw_Shader>(shader);
+
+                    for (S32 rotation = 0; rotation < TEST_ROTATIONS_COUNT; ++rotation) {
+                        Transform transform = test_rotation(rotation);
+
+                        std::vector<Color4> serial = test_render(&r, nullptr, mesh, transform, &material);
+                        std::vector<Color4> binned_single = test_render(&r, &single, mesh, transform, &material);
+                        std::vector<Color4> binned_many = test_render(&r, &many, mesh, transform, &material);
+
+                        test_expect(test_count_drawn(serial) > 0, "Nothing is drawn, %s, %ux, %s, %s, rotation %d",
+                                    raster_mode == RASTER_MODE_FIXED ? "fixed" : "float", samples_count,
+                                    PIXELS_LAYOUT_NAMES[layout], DRAW_SHADER_NAMES[shader], rotation);
+
+                        test_expect_same(serial, binned_single, r.pixels_width, "Binned on 1 thread, %s, %ux, %s, %s, rotation %d",
+                                         raster_mode == RASTER_MODE_FIXED ? "fixed" : "float", samples_count,
+                                         PIXELS_LAYOUT_NAMES[layout], DRAW_SHADER_NAMES[shader], rotation);
+                        test_expect_same(serial, binned_many, r.pixels_width, "Binned on %u threads, %s, %ux, %s, %s, rotation %d",
+                                         many.workers_count, raster_mode == RASTER_MODE_FIXED ? "fixed" : "float", samples_count,
+                                         PIXELS_LAYOUT_NAMES[layout], DRAW_SHADER_NAMES[shader], rotation);
+                    }
+                }
+
+                r.release();
+            }
+        }
+    }
+
+    many.deinit();
+    single.deinit();
+}
+
+static void
+test_kernels(const Mesh *mesh)
+{
+    Raster_ISA detected = detect_raster_isa();
+
+    for (Raster_Mode raster_mode : {RASTER_MODE_FLOAT, RASTER_MODE_FIXED}) {
+        for (U32 samples_count : {1U, 4U, 8U}) {
+            for (U32 layout = 0; layout < PIXELS_LAYOUT_COUNT; ++layout) {
+                Basic_Renderer r{};
+                test_init_renderer(&r, raster_mode, samples_count, static_cast<Pixels_Layout>(layout));
+
+                for (U32 shader = 0; shader < DRAW_SHADER_COUNT; ++shader) {
+                    Draw_Material material{};
+                    material.shader = static_cast<Draw_Shader>(shader);
+
+                    for (S32 rotation = 0; rotation < TEST_ROTATIONS_COUNT; ++rotation) {
+                        Transform transform = test_rotation(rotation);
+
+                        r.isa = RASTER_ISA_SCALAR;
+                        std::vector<Color4> scalar = test_render(&r, nullptr, mesh, transform, &material);
+
+                        for (U32 isa = RASTER_ISA_SCALAR + 1; isa <= detected; ++isa) {
+                            r.isa = static_cast<Raster_ISA>(isa);
+                            std::vector<Color4> pixels = test_render(&r, nullptr, mesh, transform, &material);
+
+                            test_expect_same(scalar, pixels, r.pixels_width, "Kernels %s, %s, %ux, %s, %s, rotation %d",
+                                             RASTER_ISA_NAMES[isa], raster_mode == RASTER_MODE_FIXED ? "fixed" : "float", samples_count,
+                                             PIXELS_LAYOUT_NAMES[layout], DRAW_SHADER_NAMES[shader], rotation);
+                        }
+                    }
+                }
+
+                r.release();
+            }
+        }
+    }
+}
+
+//
+// Draws every one of `triangles` alone, and checks that every pixel which all
+// of them are covering is covered by exactly one. Returns pixels of all of
+// them.
+//
+static std::vector<Color4>
+test_overdraw_triangles(Basic_Renderer *r, std::vector<Raster_Triangle> triangles, const char *name, S32 rotation)
+{
+    // NOTE: Every drawn pixel is white, so it's never same as the cleared
+    // one.
+    for (Raster_Triangle &t : triangles) {
+        t.color = COLOR_WHITE;
+        t.texture = nullptr;
+    }
+
+    r->clear();
+    render_triangles_serial(r, triangles);
+    std::vector<Color4> whole = test_read_pixels(r);
+
+    std::vector<U32> counts(whole.size(), 0);
+
+    for (const Raster_Triangle &t : triangles) {
+        r->clear();
+        render_triangles_serial(r, {&t, 1});
+        std::vector<Color4> pixels = test_read_pixels(r);
+
+        for (USZ i = 0; i < pixels.size(); ++i) {
+            counts[i] += std::bit_cast<U32>(pixels[i]) != CLEAR_PIXEL;
+        }
+    }
+
+    USZ twice = 0, missed = 0, extra = 0;
+
+    for (USZ i = 0; i < counts.size(); ++i) {
+        bool drawn = std::bit_cast<U32>(whole[i]) != CLEAR_PIXEL;
+
+        twice += counts[i] > 1;
+        missed += drawn && counts[i] == 0;
+        extra += !drawn && counts[i] != 0;
+    }
+
+    const char *mode_name = r->raster_mode == RASTER_MODE_FIXED ? "fixed" : "float";
+
+    test_expect(test_count_drawn(whole) > 0, "Nothing is drawn, %s, %s, rotation %d", name, mode_name, rotation);
+    test_expect(twice == 0, "Overdraw of %s, %s, rotation %d: %zu pixels are covered more than once", name, mode_name, rotation, twice);
+    test_expect(missed == 0 && extra == 0, "Coverage of %s, %s, rotation %d: %zu pixels are missed and %zu are extra", name, mode_name, rotation, missed, extra);
+
+    return whole;
+}
+
+static void
+test_overdraw_mesh(const Mesh *mesh, const char *name)
+{
+    for (Raster_Mode raster_mode : {RASTER_MODE_FLOAT, RASTER_MODE_FIXED}) {
+        Basic_Renderer r{};
+        test_init_renderer(&r, raster_mode, 1, PIXELS_LAYOUT_LINEAR);
+
+        Draw_Material material{};
+        material.cull_mode = CULL_MODE_BACK;
+
+        for (S32 rotation = 0; rotation < TEST_ROTATIONS_COUNT; ++rotation) {
+            r.clear();
+            render_mesh(&r, nullptr, mesh, test_rotation(rotation), &material);
+
+            test_overdraw_triangles(&r, std::vector<Raster_Triangle>(r.triangles.begin(), r.triangles.end()), name, rotation);
+        }
+
+        r.release();
+    }
+}
+
+//
+// Rotated meshes almost never have edges going exactly through pixel centers,
+// so top-left rule is tested with a grid of screen space quads, which corners
+// are pixel centers (whole coordinates). Their edges are going through many of
+// them, horizontal and vertical ones through every pixel of the row or column.
+//
+static void
+test_overdraw_grid(void)
+{
+    constexpr S32 GRID_SIZE = 8;
+
+    for (Raster_Mode raster_mode : {RASTER_MODE_FLOAT, RASTER_MODE_FIXED}) {
+        Basic_Renderer r{};
+        test_init_renderer(&r, raster_mode, 1, PIXELS_LAYOUT_LINEAR);
+
+        Draw_Material material{};
+        V2 screen_size{static_cast<F32>(r.pixels_width), static_cast<F32>(r.pixels_height)};
+
+        V2 corners[GRID_SIZE + 1][GRID_SIZE + 1];
+
+        for (S32 j = 0; j <= GRID_SIZE; ++j) {
+            for (S32 i = 0; i <= GRID_SIZE; ++i) {
+                // NOTE: Inner corners are moved by whole pixels, so edges
+                // have different slopes.
+                S32 shift_x = i > 0 && i < GRID_SIZE ? (i * j) % 5 - 2 : 0;
+                S32 shift_y = j > 0 && j < GRID_SIZE ? (i + 2 * j) % 3 - 1 : 0;
+
+                corners[j][i] = {static_cast<F32>(4 + i * 24 + shift_x), static_cast<F32>(3 + j * 18 + shift_y)};
+            }
+        }
+
+        std::vector<Raster_Triangle> triangles{};
+
+        auto push_triangle = [&](V2 a, V2 b, V2 c) {
+            Raster_Triangle t{};
+            t.material = &material;
+            t.vertexes[0] = a;
+            t.vertexes[1] = b;
+            t.vertexes[2] = c;
+            t.depths[0] = t.depths[1] = t.depths[2] = 0.5f;
+
+            Raster_Triangle flipped = t;
+            std::swap(flipped.vertexes[1], flipped.vertexes[2]);
+
+            if (raster_triangle_setup(&t, raster_mode, screen_size)) {
+                triangles.push_back(t);
+            } else if (raster_triangle_setup(&flipped, raster_mode, screen_size)) {
+                triangles.push_back(flipped);
+            }
+        };
+
+        for (S32 j = 0; j < GRID_SIZE; ++j) {
+            for (S32 i = 0; i < GRID_SIZE; ++i) {
+                V2 p00 = corners[j][i], p10 = corners[j][i + 1];
+                V2 p01 = corners[j + 1][i], p11 = corners[j + 1][i + 1];
+
+                // NOTE: Diagonals are going both ways.
+                if ((i + j) % 2 == 0) {
+                    push_triangle(p00, p10, p11);
+                    push_triangle(p00, p11, p01);
+                } else {
+                    push_triangle(p00, p10, p01);
+                    push_triangle(p10, p11, p01);
+                }
+            }
+        }
+
+        std::vector<Color4> whole = test_overdraw_triangles(&r, std::move(triangles), "grid", 0);
+
+        // NOTE: Outer corners are not moved, so grid is a rectangle with
+        // pixel centers on it's edges. Left and top edges are inside, right
+        // and bottom ones are not.
+        S32 x_begin = 4, x_end = 4 + GRID_SIZE * 24;
+        S32 y_begin = 3, y_end = 3 + GRID_SIZE * 18;
+        USZ wrong = 0;
+
+        for (S32 y = 0; y < static_cast<S32>(r.pixels_height); ++y) {
+            for (S32 x = 0; x < static_cast<S32>(r.pixels_width); ++x) {
+                bool expected = x >= x_begin && x < x_end && y >= y_begin && y < y_end;
+                bool drawn = std::bit_cast<U32>(whole[y * r.pixels_width + x]) != CLEAR_PIXEL;
+
+                wrong += expected != drawn;
+            }
+        }
+
+        test_expect(wrong == 0, "Coverage of grid, %s: %zu pixels are not following top-left rule",
+                    raster_mode == RASTER_MODE_FIXED ? "fixed" : "float", wrong);
+
+        r.release();
+    }
+}
+
+//
+// Frames are animated same as in the bench: first draw is rotating, others are
+// not, so incremental frames have both redrawn and kept draws.
+//
+static void
+test_allocations(const Mesh *mesh, U32 threads_count)
+{
+    constexpr S32 WARMUP_FRAMES = 4;
+    constexpr S32 STEADY_FRAMES = 8;
+    constexpr S32 DRAWS_COUNT = 3;
+
+    Thread_Pool pool{};
+    pool.init(threads_count);
+
+    for (bool serial : {true, false}) {
+        for (U32 samples_count : {1U, 4U}) {
+            for (U32 layout = 0; layout < PIXELS_LAYOUT_COUNT; ++layout) {
+                for (bool incremental : {false, true}) {
+                    for (S32 instances_count : {0, 64}) {
+                        Basic_Renderer r{};
+                        r.incremental = incremental;
+                        test_init_renderer(&r, RASTER_MODE_FLOAT, samples_count, static_cast<Pixels_Layout>(layout));
+
+                        Draw_List draw_list{};
+                        Draw_Material material{};
+                        material.shader = DRAW_SHADER_LAMBERT;
+
+                        std::vector<Draw_Instance> instances(instances_count);
+                        U64 steady_allocations = 0;
+
+                        for (S32 frame_index = 0; frame_index < WARMUP_FRAMES + STEADY_FRAMES; ++frame_index) {
+                            U64 allocations_begin = test_allocations_count.load(std::memory_order_relaxed);
+
+                            if (!r.incremental) {
+                                r.clear();
+                            }
+
+                            draw_list.clear();
+
+                            for (S32 draw_index = 0; draw_index < DRAWS_COUNT; ++draw_index) {
+                                Transform transform = test_rotation(draw_index == 0 ? frame_index : 0);
+                                transform.position = {1.5f * static_cast<F32>(draw_index - 1), 0, -2.0f * static_cast<F32>(draw_index)};
+
+                                if (instances_count == 0) {
+                                    draw_list.submit(mesh, transform, &material);
+                                    continue;
+                                }
+
+                                for (S32 i = 0; i < instances_count; ++i) {
+                                    instances[i].transform = test_rotation(frame_index + i);
+                                    instances[i].transform.position = {
+                                        transform.position.x + 0.6f * static_cast<F32>(i % 8 - 4),
+                                        transform.position.y + 0.6f * static_cast<F32>(i / 8 - 4),
+                                        transform.position.z - static_cast<F32>(i % 5),
+                                    };
+                                    instances[i].color = COLOR_WHITE;
+                                }
+
+                                draw_list.submit_instances(mesh, instances, &material);
+                            }
+
+                            execute_draw_list(&r, serial ? nullptr : &pool, &draw_list);
+                            r.present(r.present_rects);
+
+                            if (frame_index >= WARMUP_FRAMES) {
+                                steady_allocations += test_allocations_count.load(std::memory_order_relaxed) - allocations_begin;
+                            }
+                        }
+
+                        test_expect(steady_allocations == 0, "Allocations, %s, %ux, %s, %s, %d instances: %llu heap allocations after warmup",
+                                    serial ? "serial" : "binned", samples_count, PIXELS_LAYOUT_NAMES[layout],
+                                    incremental ? "incremental" : "cleared", instances_count,
+                                    static_cast<unsigned long long>(steady_allocations));
+                        test_expect(r.stats.draws_failed == 0, "Allocations, %s, %ux, %s, %s, %d instances: draws failed, out of memory",
+                                    serial ? "serial" : "binned", samples_count, PIXELS_LAYOUT_NAMES[layout],
+                                    incremental ? "incremental" : "cleared", instances_count);
+
+                        r.release();
+                    }
+                }
+            }
+        }
+    }
+
+    pool.deinit();
+}
+
+int
+main(int argc, char **argv)
+{
+    U32 threads_count = std::max(4U, std::thread::hardware_concurrency());
+
+    for (S32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads_count = std::max(2, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Mesh cube = load_mesh("assets/cube.obj", nullptr);
+
+    if (cube.indexes.empty()) {
+        fprintf(stderr, "Failed to load assets/cube.obj\n");
+        return 1;
+    }
+
+    test_serial_and_binned(&cube, threads_count);
+    test_kernels(&cube);
+
+    Mesh sphere = make_sphere_mesh(16, 32, 2.0f);
+
+    test_overdraw_mesh(&cube, "cube");
+    test_overdraw_mesh(&sphere, "sphere");
+    test_overdraw_grid();
+
+    test_allocations(&cube, threads_count);
+
+    printf("%u checks, %u failed\n", test_checks_count, test_failed_count);
+
+    return test_failed_count == 0 ? 0 : 1;
+}
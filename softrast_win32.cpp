@@ -0,0 +1,318 @@
+#include "softrast.h"
+
+#include <cstdio>
+
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+
+#include <windows.h>
+
+
+#define KEY_A 0x41
+#define KEY_D 0x44
+#define KEY_S 0x53
+#define KEY_W 0x57
+
+
+/*
+ * Extracts width and height of Win32's `RECT` type.
+ */
+constexpr void
+GetRectSize(_In_ const RECT *r,
+            _Out_ S32        *w,
+            _Out_ S32        *h) noexcept
+{
+    *w = r->right  - r->left;
+    *h = r->bottom - r->top;
+}
+
+global_var bool shouldStop = false;
+
+static Basic_Renderer global_renderer{};
+static BITMAPINFO global_bitmap_info{};
+
+bool get_window_dim(HWND window, S32 *x, S32 *y, S32 *w, S32 *h);
+
+void win32_blit(HDC dc, S32 x_offset, S32 y_offset, S32 width, S32 height);
+void win32_blit_rects(HDC dc, const Color4 *pixels, const std::vector<R32> &rects);
+void win32_resize(S32 w, S32 h);
+
+LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wParam, LPARAM lParam);
+
+int WINAPI
+WinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prevInstance, _In_ LPSTR commandLine, _In_ int showMode)
+{
+    assert(AllocConsole());
+    freopen("CONOUT$", "w+", stdout); // redirect stdout to console
+    freopen("CONOUT$", "w+", stderr); // redirect stderr to console
+    freopen("CONIN$", "r+", stdin);   // redirect stdin to console
+
+    persist_var LPCSTR CLASS_NAME = "Software Rasterizer";
+    persist_var LPCSTR WINDOW_TITLE = "Software Rasterizer";
+
+    WNDCLASS windowClass{};
+    windowClass.style = CS_OWNDC | CS_VREDRAW | CS_HREDRAW;
+    windowClass.lpfnWndProc = win32_window_proc;
+    windowClass.hInstance = instance;
+    windowClass.lpszClassName = CLASS_NAME;
+
+    assert(RegisterClassA(&windowClass));
+
+    HWND window = CreateWindowExA(
+        0,
+        windowClass.lpszClassName,
+        WINDOW_TITLE,
+        WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+        CW_USEDEFAULT,  // int x
+        CW_USEDEFAULT,  // int y
+        600,  // int width
+        600 + 23,  // int height
+        nullptr,        // windowParent
+        nullptr,        // menu
+        instance,
+        nullptr);
+    assert(window);
+
+    ShowWindow(window, showMode);
+
+    global_renderer.clear_color = COLOR_WHITE;
+    global_renderer.isa = detect_raster_isa();
+
+    printf("Raster ISA: %s\n", RASTER_ISA_NAMES[global_renderer.isa]);
+
+    Thread_Pool pool{};
+    pool.init(std::max(1U, std::thread::hardware_concurrency()));
+
+    Mesh mesh = load_mesh(R"(P:\softrast\assets\cube.obj)", &pool);
+
+    Draw_List draw_list{};
+    Draw_Material material{};
+
+    Clock clock{};
+    F32 rotation = 1.0f;
+    F32 rotation_speed = 0.8f;
+
+    while (!shouldStop) {
+
+        F32 dt = static_cast<F32>(clock.tick());
+
+        MSG message = {};
+        while (PeekMessage(&message, nullptr, 0, 0, PM_REMOVE)) {
+            if (message.message == WM_QUIT) {
+                // NOTE(ilya.a): Make sure that we will quit the mainloop.
+                shouldStop = true;
+            }
+
+            TranslateMessage(&message);
+            DispatchMessageA(&message);
+        }
+
+        rotation += rotation_speed * dt;
+
+        S32 window_x = 0, window_y = 0, window_w = 0, window_h = 0;
+        assert(get_window_dim(window, &window_x, &window_y, &window_w, &window_h));
+
+        V2 window_size { static_cast<F32>(window_w), static_cast<F32>(window_h) };
+
+        // printf(" window.w = %f  window.h = %f\n", window_size.x, window_size.y);
+
+        Basic_Renderer *r = &global_renderer;
+
+        r->clear();
+
+        Transform transform{rotation, rotation * 0.1f, rotation * 0.3f};
+
+        draw_list.clear();
+        draw_list.submit(&mesh, transform, &material);
+        execute_draw_list(r, &pool, &draw_list);
+
+        #if 0
+        USZ pitch = global_renderer.pixels_pitch * global_renderer.bytes_per_pixel /* sizeof(Color4) */;
+        U8 *row = static_cast<U8 *>(global_renderer.pixels_buffer);
+
+        for (U32 y = 0; y < global_renderer.pixels_height; ++y) {
+            Color4 *pixel = reinterpret_cast<Color4 *>(row);
+
+            for (U32 x = 0; x < global_renderer.pixels_width; ++x) {
+                //*pixel = COLOR_BLACK;
+
+                V2 p{static_cast<F32>(x), static_cast<F32>(y)};
+
+
+                if constexpr (0) {
+                    V2 a{ window_size.x * 0.2f, window_size.y * 0.2f };
+                    V2 b{ window_size.x * 0.6f, window_size.y * 0.4f };
+                    V2 c{ window_size.x * 0.4f, window_size.y * 0.5f };
+
+                    if (point_inside_triangle(p, a, b, c)) {
+                        *pixel = COLOR_WHITE;
+                    }
+                }
+
+                if constexpr (0) {
+                    pixel->R = MAX_U8 * p.x / window_size.x;
+                    pixel->G = MAX_U8 * p.y / window_size.y;
+                }
+
+                ++pixel;
+            }
+
+            row += pitch;
+        }
+        #endif // #if 0
+
+        const Color4 *pixels = r->present(r->present_rects);
+
+        HDC dc = GetDC(window);
+        win32_blit_rects(dc, pixels, r->present_rects);
+        ReleaseDC(window, dc);
+
+    }
+
+    pool.deinit();
+
+    return 0;
+}
+
+
+LRESULT CALLBACK
+win32_window_proc(HWND window, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    LRESULT result = 0;
+
+    switch (message) {
+        case WM_ACTIVATEAPP: {
+            OutputDebugString("WM_ACTIVATEAPP\n");
+        } break;
+        case WM_SIZE: {
+            OutputDebugString("WM_SIZE\n");
+            S32 width = LOWORD(lParam);
+            S32 height = HIWORD(lParam);
+
+            win32_resize(width, height);
+        } break;
+        case WM_PAINT: {
+            OutputDebugString("WM_PAINT\n");
+
+            PAINTSTRUCT ps{};
+            HDC dc = BeginPaint(window, &ps);
+            assert(dc && dc != INVALID_HANDLE_VALUE);
+
+            S32 x = ps.rcPaint.left;
+            S32 y = ps.rcPaint.top;
+            S32 width = 0, height = 0;
+            GetRectSize(&ps.rcPaint, &width, &height);
+            win32_blit(dc, x, y, width, height);
+
+            EndPaint(window, &ps);
+
+        } break;
+        case WM_CLOSE: {
+            // TODO(ilya.a): Ask for closing?
+            OutputDebugString("WM_CLOSE\n");
+            shouldStop = true;
+        } break;
+        case WM_DESTROY: {
+            // TODO(ilya.a): Casey says that we maybe should recreate
+            // window later?
+            OutputDebugString("WM_DESTROY\n");
+            // PostQuitMessage(0);
+        } break;
+
+        default: {
+            // Leave other events to default Window's handler.
+            result = DefWindowProc(window, message, wParam, lParam);
+        } break;
+    }
+
+    return result;
+}
+
+void
+win32_blit(HDC dc, S32 x_offset, S32 y_offset, S32 width, S32 height)
+{
+    Basic_Renderer *r = &global_renderer;
+
+    // NOTE: Whatever was presented last, nothing is de-tiled here.
+    const Color4 *pixels = r->present({});
+
+    StretchDIBits(dc,
+        r->x_offset, r->y_offset, r->pixels_width, r->pixels_height,
+        x_offset, y_offset, width, height,
+        pixels, &global_bitmap_info,
+        DIB_RGB_COLORS, SRCCOPY
+    );
+}
+
+//
+// Presents only parts of the framebuffer which were redrawn by the last draw
+// list. Framebuffer is same size as the client area, so it's copied 1:1.
+//
+void
+win32_blit_rects(HDC dc, const Color4 *pixels, const std::vector<R32> &rects)
+{
+    Basic_Renderer *r = &global_renderer;
+    S32 height = static_cast<S32>(r->pixels_height);
+
+    for (const R32 &rect : rects) {
+        // NOTE: DIB is bottom-up, so source rectangle is measured from
+        // the bottom, and first row of the buffer is the last one on the
+        // screen.
+        StretchDIBits(dc,
+            rect.x, height - rect.y - rect.h, rect.w, rect.h,
+            rect.x, rect.y, rect.w, rect.h,
+            pixels, &global_bitmap_info,
+            DIB_RGB_COLORS, SRCCOPY
+        );
+    }
+}
+
+void
+win32_resize(S32 w, S32 h)
+{
+    global_renderer.resize(w, h);
+
+    BITMAPINFO *info = &global_bitmap_info;
+
+    info->bmiHeader.biSize          = sizeof(info->bmiHeader);
+    // NOTE: Rows of the framebuffer are padded, DIB width is what tells
+    // GDI the stride, visible part is picked by the blit rectangles.
+    info->bmiHeader.biWidth         = static_cast<S32>(global_renderer.pixels_pitch);
+    info->bmiHeader.biHeight        = h;
+    info->bmiHeader.biPlanes        = 1;
+    info->bmiHeader.biBitCount      = 32;      // NOTE: Align to WORD
+    info->bmiHeader.biCompression   = BI_RGB;
+    info->bmiHeader.biSizeImage     = 0;
+    info->bmiHeader.biXPelsPerMeter = 0;
+    info->bmiHeader.biYPelsPerMeter = 0;
+    info->bmiHeader.biClrUsed       = 0;
+    info->bmiHeader.biClrImportant  = 0;
+}
+
+bool
+get_window_dim(HWND window, S32 *x, S32 *y, S32 *w, S32 *h)
+{
+    RECT window_rect{};
+    if (!GetClientRect(window, &window_rect)) {
+        return false;
+    }
+
+    if (x) {
+        *x = window_rect.left;
+    }
+
+    if (y) {
+        *y = window_rect.top;
+    }
+
+    if (w) {
+        *w = window_rect.right - window_rect.left;
+    }
+
+    if (h) {
+        *h = window_rect.bottom - window_rect.top;
+    }
+
+    return true;
+}